@@ -294,7 +294,7 @@ MODULES   += vidloop
 MODULES   += vumeter
 
 ifneq ($(HAVE_PTHREAD),)
-MODULES   += aubridge aufile ausine
+MODULES   += aubridge aufile ausine mixer
 endif
 
 endif
@@ -4,7 +4,6 @@
  * Copyright (C) 2010 Creytiv.com
  * Copyright (C) 2020 Dalei Liu
  */
-#include <pthread.h>
 #include "rsua-mod/modapi.h"
 #include "aubridge.h"
 
@@ -18,8 +17,10 @@ struct device {
 	const struct ausrc_st *ausrc;
 	const struct auplay_st *auplay;
 	char name[64];
-	pthread_t thread;
-	volatile bool run;
+	struct mclock *mc;
+	void *sampv;
+	size_t sampc;
+	bool started;
 };
 
 
@@ -49,74 +50,53 @@ static struct device *find_device(const char *device)
 }
 
 
-static void *device_thread(void *arg)
+static void tick_handler(uint64_t ts, void *arg)
 {
-	uint64_t now, ts = tmr_jiffies();
 	struct device *dev = arg;
-	int16_t *sampv_in, *sampv_out;
-	size_t sampc_in;
-	size_t sampc_out;
-	size_t sampsz;
 
-	if (!dev->run)
-		return NULL;
+	if (dev->auplay->wh)
+		dev->auplay->wh(dev->sampv, dev->sampc, dev->auplay->arg);
+
+	if (dev->ausrc->rh) {
+		struct auframe af = {
+			.fmt   = dev->ausrc->prm.fmt,
+			.sampv = dev->sampv,
+			.sampc = dev->sampc,
+			.timestamp = ts
+		};
+		dev->ausrc->rh(&af, dev->ausrc->arg);
+	}
+}
+
+
+static int device_start(struct device *dev)
+{
+	int err;
 
 	if (dev->auplay->prm.srate != dev->ausrc->prm.srate ||
 	    dev->auplay->prm.ch != dev->ausrc->prm.ch ||
 	    dev->auplay->prm.fmt != dev->ausrc->prm.fmt) {
 
 		warning("aubridge: incompatible ausrc/auplay parameters\n");
-		return NULL;
+		return 0;
 	}
 
-	info("aubridge: thread start: %u Hz, %u channels, format=%s\n",
+	info("aubridge: start: %u Hz, %u channels, format=%s\n",
 	     dev->auplay->prm.srate, dev->auplay->prm.ch,
 	     aufmt_name(dev->auplay->prm.fmt));
 
-	sampc_in = dev->auplay->prm.srate * dev->auplay->prm.ch * PTIME/1000;
-	sampc_out = dev->ausrc->prm.srate * dev->ausrc->prm.ch * PTIME/1000;
-
-	sampsz = aufmt_sample_size(dev->auplay->prm.fmt);
-
-	sampv_in  = mem_alloc(sampsz * sampc_in, NULL);
-	sampv_out = mem_alloc(sampsz * sampc_out, NULL);
-	if (!sampv_in || !sampv_out)
-		goto out;
-
-	while (dev->run) {
-
-		(void)sys_msleep(4);
+	dev->sampc = dev->auplay->prm.srate * dev->auplay->prm.ch * PTIME/1000;
 
-		if (!dev->run)
-			break;
+	dev->sampv = mem_zalloc(aufmt_sample_size(dev->auplay->prm.fmt) *
+				dev->sampc, NULL);
+	if (!dev->sampv)
+		return ENOMEM;
 
-		now = tmr_jiffies();
+	err = mclock_alloc(&dev->mc, PTIME * 1000, tick_handler, dev);
+	if (err)
+		dev->sampv = mem_deref(dev->sampv);
 
-		if (ts > now)
-			continue;
-
-		if (dev->auplay->wh) {
-			dev->auplay->wh(sampv_in, sampc_in, dev->auplay->arg);
-		}
-
-		if (dev->ausrc->rh) {
-			struct auframe af = {
-				.fmt   = dev->ausrc->prm.fmt,
-				.sampv = sampv_in,
-				.sampc = sampc_in,
-				.timestamp = ts * 1000
-			};
-			dev->ausrc->rh(&af, dev->ausrc->arg);
-		}
-
-		ts += PTIME;
-	}
-
- out:
-	mem_deref(sampv_in);
-	mem_deref(sampv_out);
-
-	return NULL;
+	return err;
 }
 
 
@@ -156,13 +136,11 @@ int aubridge_device_connect(struct device **devp, const char *device,
 		dev->ausrc = ausrc;
 
 	/* wait until we have both SRC+PLAY */
-	if (dev->ausrc && dev->auplay && !dev->run) {
+	if (dev->ausrc && dev->auplay && !dev->started) {
 
-		dev->run = true;
-		err = pthread_create(&dev->thread, NULL, device_thread, dev);
-		if (err) {
-			dev->run = false;
-		}
+		err = device_start(dev);
+		if (!err)
+			dev->started = true;
 	}
 
 	return err;
@@ -174,10 +152,10 @@ void aubridge_device_stop(struct device *dev)
 	if (!dev)
 		return;
 
-	if (dev->run) {
-		dev->run = false;
-		pthread_join(dev->thread, NULL);
-	}
+	/* waits for a tick in progress */
+	dev->mc      = mem_deref(dev->mc);
+	dev->sampv   = mem_deref(dev->sampv);
+	dev->started = false;
 
 	dev->auplay = NULL;
 	dev->ausrc = NULL;
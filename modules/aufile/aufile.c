@@ -6,7 +6,6 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <pthread.h>
 #include "rsua-mod/modapi.h"
 #include "aufile.h"
 
@@ -28,14 +27,14 @@ struct ausrc_st {
 	const struct ausrc *as;  /* base class */
 
 	struct tmr tmr;
+	struct mclock *mc;
 	struct aufile *aufile;
 	struct aubuf *aubuf;
 	enum aufmt fmt;                 /**< Wav file sample format          */
 	struct ausrc_prm *prm;          /**< Audio src parameter             */
+	int16_t *sampv;
 	uint32_t ptime;
 	size_t sampc;
-	bool run;
-	pthread_t thread;
 	ausrc_read_h *rh;
 	ausrc_error_h *errh;
 	void *arg;
@@ -50,54 +49,30 @@ static void destructor(void *arg)
 {
 	struct ausrc_st *st = arg;
 
-	if (st->run) {
-		st->run = false;
-		pthread_join(st->thread, NULL);
-	}
+	/* waits for a tick in progress */
+	mem_deref(st->mc);
 
 	tmr_cancel(&st->tmr);
 
 	mem_deref(st->aufile);
 	mem_deref(st->aubuf);
+	mem_deref(st->sampv);
 }
 
 
-static void *play_thread(void *arg)
+static void tick_handler(uint64_t ts, void *arg)
 {
-	uint64_t now, ts = tmr_jiffies();
 	struct ausrc_st *st = arg;
-	int16_t *sampv;
-
-	sampv = mem_alloc(st->sampc * sizeof(int16_t), NULL);
-	if (!sampv)
-		return NULL;
-
-	while (st->run) {
-
-		struct auframe af = {
-			.fmt   = AUFMT_S16LE,
-			.sampv = sampv,
-			.sampc = st->sampc,
-			.timestamp = ts * 1000
-		};
-
-		sys_msleep(4);
-
-		now = tmr_jiffies();
-
-		if (ts > now)
-			continue;
-
-		aubuf_read_samp(st->aubuf, sampv, st->sampc);
+	struct auframe af = {
+		.fmt   = AUFMT_S16LE,
+		.sampv = st->sampv,
+		.sampc = st->sampc,
+		.timestamp = ts
+	};
 
-		st->rh(&af, st->arg);
+	aubuf_read_samp(st->aubuf, st->sampv, st->sampc);
 
-		ts += st->ptime;
-	}
-
-	mem_deref(sampv);
-
-	return NULL;
+	st->rh(&af, st->arg);
 }
 
 
@@ -251,14 +226,17 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	if (err)
 		goto out;
 
+	st->sampv = mem_alloc(st->sampc * sizeof(int16_t), NULL);
+	if (!st->sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
 	tmr_start(&st->tmr, st->ptime, timeout, st);
 
-	st->run = true;
-	err = pthread_create(&st->thread, NULL, play_thread, st);
-	if (err) {
-		st->run = false;
+	err = mclock_alloc(&st->mc, st->ptime * 1000, tick_handler, st);
+	if (err)
 		goto out;
-	}
 
  out:
 	if (err)
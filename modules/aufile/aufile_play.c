@@ -6,7 +6,6 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <pthread.h>
 #include <string.h>
 #include "rsua-mod/modapi.h"
 #include "aufile.h"
@@ -17,8 +16,8 @@ struct auplay_st {
 	struct aufile *auf;
 	struct auplay_prm prm;
 
-	pthread_t thread;
-	volatile bool run;
+	struct mclock *mc;
+	bool failed;
 	void *sampv;
 	size_t sampc;
 	size_t num_bytes;
@@ -30,45 +29,30 @@ struct auplay_st {
 static void auplay_destructor(void *arg)
 {
 	struct auplay_st *st = arg;
-	/* Wait for termination of other thread */
-	if (st->run) {
-		debug("aufile: stopping playback thread\n");
-		st->run = false;
-		(void)pthread_join(st->thread, NULL);
-	}
+	/* waits for a tick in progress */
+	mem_deref(st->mc);
 
 	mem_deref(st->auf);
 	mem_deref(st->sampv);
 }
 
 
-static void *write_thread(void *arg)
+static void tick_handler(uint64_t ts, void *arg)
 {
 	struct auplay_st *st = arg;
-	uint64_t t;
-	int dt;
 	int err;
-	uint32_t ptime = st->prm.ptime;
-
-	t = tmr_jiffies();
-	st->run = true;
-	while (st->run) {
-		st->wh(st->sampv, st->sampc, st->arg);
+	(void)ts;
 
-		err = aufile_write(st->auf, st->sampv, st->num_bytes);
-		if (err)
-			break;
+	if (st->failed)
+		return;
 
-		t += ptime;
-		dt = t - tmr_jiffies();
-		if (dt <= 2)
-			continue;
+	st->wh(st->sampv, st->sampc, st->arg);
 
-		sys_msleep(dt);
+	err = aufile_write(st->auf, st->sampv, st->num_bytes);
+	if (err) {
+		warning("aufile: write failed (%m)\n", err);
+		st->failed = true;
 	}
-
-	st->run = false;
-	return NULL;
 }
 
 
@@ -112,13 +96,16 @@ int play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	st->num_bytes = st->sampc * aufmt_sample_size(prm->fmt);
 	st->sampv = mem_alloc(st->num_bytes, NULL);
 
-	info("aufile: writing speaker audio to %s\n", file);
-	err = pthread_create(&st->thread, NULL, write_thread, st);
-	if (err) {
-		st->run = false;
+	if (!st->sampv) {
+		err = ENOMEM;
 		goto out;
 	}
 
+	info("aufile: writing speaker audio to %s\n", file);
+	err = mclock_alloc(&st->mc, st->prm.ptime * 1000, tick_handler, st);
+	if (err)
+		goto out;
+
 out:
 	if (err)
 		mem_deref(st);
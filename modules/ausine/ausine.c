@@ -6,7 +6,6 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <pthread.h>
 #include <stdlib.h>
 #include <math.h>
 #include "rsua-mod/modapi.h"
@@ -31,10 +30,10 @@ static const double PI = 3.14159265358979323846264338328;
 struct ausrc_st {
 	const struct ausrc *as;  /* base class */
 
+	struct mclock *mc;
+	int16_t *sampv;
 	uint32_t ptime;
 	size_t sampc;
-	bool run;
-	pthread_t thread;
 	ausrc_read_h *rh;
 	ausrc_error_h *errh;
 	void *arg;
@@ -50,67 +49,41 @@ static void destructor(void *arg)
 {
 	struct ausrc_st *st = arg;
 
-	if (st->run) {
-		st->run = false;
-		pthread_join(st->thread, NULL);
-	}
+	mem_deref(st->mc);
+	mem_deref(st->sampv);
 }
 
 
-static void *play_thread(void *arg)
+static void tick_handler(uint64_t ts, void *arg)
 {
-	uint64_t now, ts = tmr_jiffies();
 	struct ausrc_st *st = arg;
-	int16_t *sampv;
+	int16_t *sampv = st->sampv;
+	struct auframe af = {
+		.fmt   = AUFMT_S16LE,
+		.sampv = sampv,
+		.sampc = st->sampc,
+		.timestamp = ts
+	};
 	double sample, rad_per_sec;
 	double sec_per_frame = 1.0 / 48000;
 	int inc;
-	size_t frames;
-
-	sampv = mem_alloc(st->sampc * sizeof(int16_t), NULL);
-	if (!sampv)
-		return NULL;
-
-	while (st->run) {
-
-		struct auframe af = {
-			.fmt   = AUFMT_S16LE,
-			.sampv = sampv,
-			.sampc = st->sampc,
-			.timestamp = ts * 1000
-		};
-		size_t frame;
-
-		sys_msleep(4);
-
-		now = tmr_jiffies();
-
-		if (ts > now)
-			continue;
-
-		inc = 0;
-		rad_per_sec = st->freq * 2.0 * PI;
-		frames = st->sampc / 2;
-
-		for (frame = 0; frame < frames; frame += 1) {
-			sample = sin((st->sec_offset + frame * sec_per_frame)
-					* rad_per_sec);
-			sampv[inc] = (int16_t)(SCALE * 50 / 100.0f * sample);
-			sampv[inc+1] = (int16_t)(SCALE * 50 / 100.0f * sample);
-			inc += 2;
-		}
-
-		st->sec_offset = fmod(st->sec_offset + sec_per_frame * frames,
-				1.0);
-
-		st->rh(&af, st->arg);
-
-		ts += st->ptime;
+	size_t frames, frame;
+
+	inc = 0;
+	rad_per_sec = st->freq * 2.0 * PI;
+	frames = st->sampc / 2;
+
+	for (frame = 0; frame < frames; frame += 1) {
+		sample = sin((st->sec_offset + frame * sec_per_frame)
+				* rad_per_sec);
+		sampv[inc] = (int16_t)(SCALE * 50 / 100.0f * sample);
+		sampv[inc+1] = (int16_t)(SCALE * 50 / 100.0f * sample);
+		inc += 2;
 	}
 
-	mem_deref(sampv);
+	st->sec_offset = fmod(st->sec_offset + sec_per_frame * frames, 1.0);
 
-	return NULL;
+	st->rh(&af, st->arg);
 }
 
 
@@ -171,13 +144,16 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	info("ausine: audio ptime=%u sampc=%zu\n",
 	     st->ptime, st->sampc);
 
-	st->run = true;
-	err = pthread_create(&st->thread, NULL, play_thread, st);
-	if (err) {
-		st->run = false;
+	st->sampv = mem_alloc(st->sampc * sizeof(int16_t), NULL);
+	if (!st->sampv) {
+		err = ENOMEM;
 		goto out;
 	}
 
+	err = mclock_alloc(&st->mc, st->ptime * 1000, tick_handler, st);
+	if (err)
+		goto out;
+
  out:
 	if (err)
 		mem_deref(st);
@@ -18,3 +18,4 @@ int av1_decode_update(struct viddec_state **vdsp, const struct vidcodec *vc,
 		      const char *fmtp);
 int av1_decode(struct viddec_state *vds, struct vidframe *frame,
 	       bool *intra, bool marker, uint16_t seq, struct mbuf *mb);
+bool av1_keyframe(const struct mbuf *mb);
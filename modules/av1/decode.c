@@ -297,3 +297,16 @@ int av1_decode(struct viddec_state *vds, struct vidframe *frame,
 
 	return err;
 }
+
+
+/* check the first packet of a frame, without decoding it */
+bool av1_keyframe(const struct mbuf *mb)
+{
+	struct mbuf pkt = *mb;
+	struct hdr hdr;
+
+	if (hdr_decode(&hdr, &pkt))
+		return false;
+
+	return hdr.start && hdr.partid == 0 && is_keyframe(&pkt);
+}
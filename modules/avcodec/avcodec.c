@@ -101,6 +101,7 @@ static struct vidcodec h264 = {
 	.ench      = avcodec_encode,
 	.decupdh   = avcodec_decode_update,
 	.dech      = avcodec_decode_h264,
+	.keyh      = avcodec_h264_keyframe,
 	.fmtp_ench = avcodec_h264_fmtp_enc,
 	.fmtp_cmph = avcodec_h264_fmtp_cmp,
 };
@@ -112,6 +113,7 @@ static struct vidcodec h264_1 = {
 	.ench      = avcodec_encode,
 	.decupdh   = avcodec_decode_update,
 	.dech      = avcodec_decode_h264,
+	.keyh      = avcodec_h264_keyframe,
 	.fmtp_ench = avcodec_h264_fmtp_enc,
 	.fmtp_cmph = avcodec_h264_fmtp_cmp,
 };
@@ -70,6 +70,7 @@ int avcodec_decode_h263(struct viddec_state *st, struct vidframe *frame,
 		bool *intra, bool eof, uint16_t seq, struct mbuf *src);
 int avcodec_decode_h264(struct viddec_state *st, struct vidframe *frame,
 		bool *intra, bool eof, uint16_t seq, struct mbuf *src);
+bool avcodec_h264_keyframe(const struct mbuf *src);
 int avcodec_decode_h265(struct viddec_state *st, struct vidframe *frame,
 			bool *intra, bool eof, uint16_t seq, struct mbuf *src);
 int avcodec_decode_mpeg4(struct viddec_state *st, struct vidframe *frame,
@@ -306,6 +306,38 @@ static int ffdecode(struct viddec_state *st, struct vidframe *frame,
 }
 
 
+/* check if the packet starts an IDR picture or its parameter sets */
+bool avcodec_h264_keyframe(const struct mbuf *src)
+{
+	struct mbuf pkt = *src;
+	struct h264_nal_header hdr;
+	struct h264_fu fu;
+
+	if (h264_nal_header_decode(&hdr, &pkt))
+		return false;
+
+	if (hdr.type == H264_NALU_STAP_A) {
+
+		if (mbuf_get_left(&pkt) < 3)
+			return false;
+
+		pkt.pos += 2;
+
+		if (h264_nal_header_decode(&hdr, &pkt))
+			return false;
+	}
+	else if (hdr.type == H264_NALU_FU_A) {
+
+		if (h264_fu_hdr_decode(&fu, &pkt) || !fu.s)
+			return false;
+
+		hdr.type = fu.type;
+	}
+
+	return h264_is_keyframe(hdr.type) || hdr.type == H264_NALU_SPS;
+}
+
+
 int avcodec_decode_h264(struct viddec_state *st, struct vidframe *frame,
 			bool *intra, bool marker, uint16_t seq,
 			struct mbuf *src)
@@ -16,12 +16,37 @@
  *
  * N session objects
  * 1 session object has 2 call objects (left, right leg)
+ *
+ * When both legs of a session negotiated the same codec for a media,
+ * with compatible format parameters, the RTP packets are relayed between
+ * the legs as they are, without jitter buffer, decoding and encoding.
+ * The RTCP feedback of one leg, e.g. a picture loss or a NACK, is passed
+ * on to the other leg. Otherwise the media is transcoded through the
+ * audio/video-bridge devices. The codecs are compared again after every
+ * SDP offer or answer of a leg, on a mismatch the relay is stopped and
+ * the media is transcoded again.
  */
 
 
+/** RTP relay of one media in one direction */
+struct relay {
+	struct stream *src;          /**< Stream receiving the packets     */
+	struct stream *dst;          /**< Stream sending the packets       */
+	int pt_in;                   /**< Last payload type received       */
+	int pt_out;                  /**< Payload type sent for pt_in      */
+	uint64_t n_packets;          /**< Relayed packets                  */
+	uint64_t n_bytes;            /**< Relayed payload bytes            */
+	uint64_t n_drops;            /**< Packets of unknown payload type  */
+	uint64_t n_feedback;         /**< Feedback passed on to dst        */
+};
+
 struct session {
 	struct le le;
 	struct call *call_in, *call_out;
+	struct relay audio[2];       /**< Audio relay, in->out and out->in */
+	struct relay video[2];       /**< Video relay, in->out and out->in */
+	struct tmr tmr_update;       /**< Compares the codecs after an SDP */
+	struct media_ctx *ctx;       /**< Media context of the video source */
 };
 
 
@@ -38,10 +63,25 @@ static struct call *other_call(struct session *sess, const struct call *call)
 }
 
 
+static void relay_stop(struct relay *rel)
+{
+	stream_set_relay(rel->src, NULL, NULL, NULL);
+	rel->src = NULL;
+	rel->dst = NULL;
+}
+
+
 static void destructor(void *arg)
 {
 	struct session *sess = arg;
 
+	tmr_cancel(&sess->tmr_update);
+
+	relay_stop(&sess->audio[0]);
+	relay_stop(&sess->audio[1]);
+	relay_stop(&sess->video[0]);
+	relay_stop(&sess->video[1]);
+
 	debug("b2bua: session destroyed (in=%p, out=%p)\n",
 	      sess->call_in, sess->call_out);
 
@@ -51,6 +91,212 @@ static void destructor(void *arg)
 }
 
 
+static void relay_handler(struct stream *strm, const struct rtp_header *hdr,
+			  struct mbuf *mb, void *arg)
+{
+	struct relay *rel = arg;
+	(void)strm;
+
+	if (hdr->pt != rel->pt_in) {
+
+		const struct sdp_format *lf, *rf = NULL;
+
+		/* the same format on the other leg, e.g. telephone-event */
+		lf = sdp_media_lformat(stream_sdpmedia(rel->src), hdr->pt);
+		if (lf)
+			rf = sdp_media_rformat(stream_sdpmedia(rel->dst),
+					       lf->name);
+
+		rel->pt_in  = hdr->pt;
+		rel->pt_out = rf ? rf->pt : -1;
+	}
+
+	if (rel->pt_out < 0) {
+		++rel->n_drops;
+		return;
+	}
+
+	++rel->n_packets;
+	rel->n_bytes += mbuf_get_left(mb);
+
+	(void)stream_relay_send(rel->dst, hdr, rel->pt_out, mb);
+}
+
+
+/*
+ * The feedback of the peer of the src leg is about the packets relayed
+ * from the dst leg, it goes to the source on that leg
+ */
+static void relay_rtcp_handler(struct stream *strm, struct rtcp_msg *msg,
+			       void *arg)
+{
+	struct relay *rel = arg;
+
+	if (msg->hdr.pt != RTCP_FIR && msg->hdr.pt != RTCP_PSFB &&
+	    msg->hdr.pt != RTCP_RTPFB)
+		return;
+
+	if (0 == stream_relay_feedback(strm, rel->dst, msg))
+		++rel->n_feedback;
+}
+
+
+static bool format_match(const struct sdp_media *m,
+			 const struct sdp_format *a,
+			 const struct sdp_format *b)
+{
+	const struct sdp_format *lf;
+
+	if (!a || !b)
+		return false;
+
+	if (str_casecmp(a->name, b->name) || a->srate != b->srate ||
+	    a->ch != b->ch)
+		return false;
+
+	/* the codec compares the parameters it depends on, e.g. the
+	   packetization mode and profile of H.264 */
+	lf = sdp_media_format(m, true, NULL, -1, a->name, a->srate, a->ch);
+	if (lf && lf->cmph)
+		return lf->cmph(a->params, b->params, lf->data);
+
+	if (!str_isset(a->params) && !str_isset(b->params))
+		return true;
+
+	return 0 == str_casecmp(a->params, b->params);
+}
+
+
+/* both legs negotiated the same codec for a media */
+static bool media_match(struct stream *s_in, struct stream *s_out)
+{
+	if (!s_in || !s_out)
+		return false;
+
+	return format_match(stream_sdpmedia(s_in),
+			    sdp_media_rformat(stream_sdpmedia(s_in), NULL),
+			    sdp_media_rformat(stream_sdpmedia(s_out), NULL));
+}
+
+
+static void relay_start(struct relay *relv, struct stream *s_in,
+			struct stream *s_out)
+{
+	relv[0].src = s_in;
+	relv[0].dst = s_out;
+	relv[1].src = s_out;
+	relv[1].dst = s_in;
+
+	relv[0].pt_in = relv[1].pt_in = -1;
+
+	stream_set_relay(s_in,  relay_handler, relay_rtcp_handler, &relv[0]);
+	stream_set_relay(s_out, relay_handler, relay_rtcp_handler, &relv[1]);
+}
+
+
+/*
+ * Start or keep the relay of a media if the codecs match, stop it if they
+ * no longer do. Returns true if the media is relayed
+ */
+static bool relay_update(struct relay *relv, struct stream *s_in,
+			 struct stream *s_out, const char *media)
+{
+	if (!media_match(s_in, s_out)) {
+
+		if (!relv[0].src)
+			return false;
+
+		info("b2bua: %s codecs differ, transcoding\n", media);
+
+		relay_stop(&relv[0]);
+		relay_stop(&relv[1]);
+
+		return false;
+	}
+
+	if (!relv[0].src) {
+		info("b2bua: relaying %s (%s)\n", media,
+		     sdp_media_rformat(stream_sdpmedia(s_in), NULL)->name);
+
+		relay_start(relv, s_in, s_out);
+	}
+
+	/* the payload types may have changed */
+	relv[0].pt_in = relv[1].pt_in = -1;
+
+	return true;
+}
+
+
+static void session_relay(struct session *sess)
+{
+	struct audio *au_in, *au_out;
+	struct video *vid_in, *vid_out;
+	const bool audio_relay = sess->audio[0].src != NULL;
+	const bool video_relay = sess->video[0].src != NULL;
+
+	au_in   = call_audio(sess->call_in);
+	au_out  = call_audio(sess->call_out);
+	vid_in  = call_video(sess->call_in);
+	vid_out = call_video(sess->call_out);
+
+	if (relay_update(sess->audio, audio_strm(au_in), audio_strm(au_out),
+			 "audio")) {
+
+		/* the bridge devices are not needed, the media update of
+		   a leg may have started them again */
+		audio_stop(au_in);
+		audio_stop(au_out);
+	}
+	else if (audio_relay) {
+		(void)audio_start(au_in);
+		(void)audio_start(au_out);
+	}
+
+	if (relay_update(sess->video, video_strm(vid_in),
+			 video_strm(vid_out), "video")) {
+
+		video_stop(vid_in);
+		video_stop(vid_out);
+	}
+	else if (video_relay) {
+		(void)video_update(vid_in, &sess->ctx,
+				   call_peeruri(sess->call_in));
+		(void)video_update(vid_out, &sess->ctx,
+				   call_peeruri(sess->call_out));
+	}
+}
+
+
+/* the media of a leg are updated after the SDP event, compare then */
+static void update_handler(void *arg)
+{
+	struct session *sess = arg;
+
+	if (call_state(sess->call_in) != CALL_STATE_ESTABLISHED ||
+	    call_state(sess->call_out) != CALL_STATE_ESTABLISHED)
+		return;
+
+	session_relay(sess);
+}
+
+
+static struct session *session_find(const struct call *call)
+{
+	struct le *le;
+
+	for (le = sessionl.head; le; le = le->next) {
+
+		struct session *sess = le->data;
+
+		if (sess->call_in == call || sess->call_out == call)
+			return sess;
+	}
+
+	return NULL;
+}
+
+
 static void call_event_handler(struct call *call, enum call_event ev,
 			       const char *str, void *arg)
 {
@@ -62,8 +308,14 @@ static void call_event_handler(struct call *call, enum call_event ev,
 	case CALL_EVENT_ESTABLISHED:
 		debug("b2bua: CALL_ESTABLISHED: peer_uri=%s\n",
 		      call_peeruri(call));
-		call_answer(call2, 200,
-			    call_has_video(call) ? VIDMODE_ON : VIDMODE_OFF);
+		if (call_state(call2) != CALL_STATE_ESTABLISHED) {
+			call_answer(call2, 200, call_has_video(call) ?
+				    VIDMODE_ON : VIDMODE_OFF);
+		}
+		else {
+			/* both legs have negotiated their media */
+			session_relay(sess);
+		}
 		break;
 
 	case CALL_EVENT_CLOSED:
@@ -135,6 +387,7 @@ static int new_session(struct call *call)
 static void ua_event_handler(struct ua *ua, enum ua_event ev,
 			     struct call *call, const char *prm, void *arg)
 {
+	struct session *sess;
 	int err;
 	(void)ua;
 	(void)prm;
@@ -152,12 +405,37 @@ static void ua_event_handler(struct ua *ua, enum ua_event ev,
 		}
 		break;
 
+	case UA_EVENT_CALL_REMOTE_SDP:
+		sess = session_find(call);
+		if (sess)
+			tmr_start(&sess->tmr_update, 0, update_handler, sess);
+		break;
+
 	default:
 		break;
 	}
 }
 
 
+static int relay_status(struct re_printf *pf, const char *media,
+			const struct relay *relv)
+{
+	if (!relv[0].src)
+		return re_hprintf(pf, " %s: transcoding\n", media);
+
+	return re_hprintf(pf, " %s: relay"
+			  " in->out %llu packets %llu bytes %llu drops"
+			  " %llu feedback,"
+			  " out->in %llu packets %llu bytes %llu drops"
+			  " %llu feedback\n",
+			  media,
+			  relv[0].n_packets, relv[0].n_bytes, relv[0].n_drops,
+			  relv[1].n_feedback,
+			  relv[1].n_packets, relv[1].n_bytes, relv[1].n_drops,
+			  relv[0].n_feedback);
+}
+
+
 static int b2bua_status(struct re_printf *pf, void *arg)
 {
 	struct le *le;
@@ -180,6 +458,8 @@ static int b2bua_status(struct re_printf *pf, void *arg)
 
 		err |= re_hprintf(pf, " %H\n", call_status, sess->call_in);
 		err |= re_hprintf(pf, " %H\n", call_status, sess->call_out);
+		err |= relay_status(pf, "audio", sess->audio);
+		err |= relay_status(pf, "video", sess->video);
 	}
 
 	return err;
@@ -143,33 +143,23 @@ static int send_event(struct ctrl_st *st, const char *eclass,
 /*
  * Relay UA events
  */
-static void ua_event_handler(struct ua *ua, enum ua_event ev,
-			     struct call *call, const char *prm, void *arg)
+static void ua_event_handler(struct ua_event_rec *rec, void *arg)
 {
 	struct ctrl_st *st = arg;
 	struct mbuf *buf;
 	struct re_printf pf;
-	struct odict *od = NULL;
 	int err = 0;
-	const struct odict_entry *eclass = NULL;
-	const char *etype = uag_event_str(ev);
 
 	if (!st->interface)
 		return;
 
 	buf = mbuf_alloc(192);
-	err = odict_alloc(&od, 8);
-	if (!buf || err)
-		goto out;
+	if (!buf)
+		return;
 
 	pf.vph = print_handler;
 	pf.arg = buf;
-	err = event_encode_dict(od, ua, ev, call, prm);
-	if (err)
-		goto out;
-
-	eclass = odict_lookup(od, "class");
-	err = json_encode_odict(&pf, od);
+	err = re_hprintf(&pf, "{%H}", ua_event_rec_encode, rec);
 	if (err) {
 		warning("ctrl_dbus: failed to encode json (%m)\n", err);
 		goto out;
@@ -177,12 +167,11 @@ static void ua_event_handler(struct ua *ua, enum ua_event ev,
 
 	mbuf_write_u8(buf, 0);
 	mbuf_set_pos(buf, 0);
-	send_event(st, eclass ? eclass->u.str : "other", etype,
+	send_event(st, uag_event_class_name(rec->cls), uag_event_str(rec->ev),
 			(const char *) mbuf_buf(buf));
 
  out:
 	mem_deref(buf);
-	mem_deref(od);
 }
 
 
@@ -306,7 +295,7 @@ static int ctrl_init(void)
 	if (err)
 		goto outerr;
 
-	err = uag_event_register(ua_event_handler, m_st);
+	err = uag_event_subscribe(UA_EVCLASS_ALL, ua_event_handler, m_st);
 	if (err)
 		goto outerr;
 
@@ -338,7 +327,7 @@ outerr:
 
 static int ctrl_close(void)
 {
-	uag_event_unregister(ua_event_handler);
+	uag_event_unsubscribe(ua_event_handler);
 	m_st = mem_deref(m_st);
 	return 0;
 }
@@ -83,6 +83,7 @@
  *
  \verbatim
   ctrl_tcp_listen     0.0.0.0:4444         # IP-address and port to listen on
+  ctrl_tcp_events     register,call        # Event classes, default all
  \endverbatim
  */
 
@@ -257,46 +258,41 @@ static void tcp_conn_handler(const struct sa *peer, void *arg)
 /*
  * Relay UA events
  */
-static void ua_event_handler(struct ua *ua, enum ua_event ev,
-			     struct call *call, const char *prm, void *arg)
+static void ua_event_handler(struct ua_event_rec *rec, void *arg)
 {
 	struct ctrl_st *st = arg;
-	struct mbuf *buf = mbuf_alloc(1024);
-	struct re_printf pf = {print_handler, buf};
-	struct odict *od = NULL;
+	struct mbuf *buf;
+	struct re_printf pf;
 	int err;
 
-	buf->pos = NETSTRING_HEADER_SIZE;
+	if (!st->tc)
+		return;
 
-	err = odict_alloc(&od, 8);
-	if (err)
+	buf = mbuf_alloc(1024);
+	if (!buf)
 		return;
 
-	err = odict_entry_add(od, "event", ODICT_BOOL, true);
-	err |= event_encode_dict(od, ua, ev, call, prm);
-	if (err) {
-		warning("ctrl_tcp: failed to encode event (%m)\n", err);
-		goto out;
-	}
+	pf.vph = print_handler;
+	pf.arg = buf;
 
-	err = json_encode_odict(&pf, od);
+	buf->pos = NETSTRING_HEADER_SIZE;
+
+	err = re_hprintf(&pf, "{\"event\":true,%H}",
+			 ua_event_rec_encode, rec);
 	if (err) {
 		warning("ctrl_tcp: failed to encode json (%m)\n", err);
 		goto out;
 	}
 
-	if (st->tc) {
-		buf->pos = NETSTRING_HEADER_SIZE;
-		err = tcp_send(st->tc, buf);
-		if (err) {
-			warning("ctrl_tcp: failed to send the message (%m)\n",
-				err);
-		}
+	buf->pos = NETSTRING_HEADER_SIZE;
+	err = tcp_send(st->tc, buf);
+	if (err) {
+		warning("ctrl_tcp: failed to send the message (%m)\n",
+			err);
 	}
 
  out:
 	mem_deref(buf);
-	mem_deref(od);
 }
 
 
@@ -344,17 +340,24 @@ static int ctrl_alloc(struct ctrl_st **stp, const struct sa *laddr)
 static int ctrl_init(void)
 {
 	struct sa laddr;
+	uint32_t classes = UA_EVCLASS_ALL;
+	struct pl pl;
 	int err;
 
 	if (conf_get_sa(conf_cur(), "ctrl_tcp_listen", &laddr)) {
 		sa_set_str(&laddr, "0.0.0.0", CTRL_PORT);
 	}
 
+	if (0 == conf_get(conf_cur(), "ctrl_tcp_events", &pl) &&
+	    uag_event_class_decode(&classes, &pl)) {
+		warning("ctrl_tcp: invalid event classes '%r'\n", &pl);
+	}
+
 	err = ctrl_alloc(&ctrl, &laddr);
 	if (err)
 		return err;
 
-	err = uag_event_register(ua_event_handler, ctrl);
+	err = uag_event_subscribe(classes, ua_event_handler, ctrl);
 	if (err)
 		return err;
 
@@ -364,7 +367,7 @@ static int ctrl_init(void)
 
 static int ctrl_close(void)
 {
-	uag_event_unregister(ua_event_handler);
+	uag_event_unsubscribe(ua_event_handler);
 	ctrl = mem_deref(ctrl);
 
 	return 0;
@@ -6,8 +6,6 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <unistd.h>
-#include <pthread.h>
 #include "rsua-mod/modapi.h"
 
 
@@ -30,13 +28,7 @@
 struct vidsrc_st {
 	const struct vidsrc *vs;  /* inheritance */
 	struct vidframe *frame;
-#ifdef HAVE_PTHREAD
-	pthread_t thread;
-	bool run;
-#else
-	struct tmr tmr;
-#endif
-	uint64_t ts;
+	struct mclock *mc;
 	double fps;
 	vidsrc_frame_h *frameh;
 	void *arg;
@@ -51,64 +43,20 @@ static struct vidsrc *vidsrc;
 static struct vidisp *vidisp;
 
 
-static void process_frame(struct vidsrc_st *st)
-{
-	st->ts += (VIDEO_TIMEBASE / st->fps);
-
-	st->frameh(st->frame, st->ts, st->arg);
-}
-
-
-#ifdef HAVE_PTHREAD
-static void *read_thread(void *arg)
+static void tick_handler(uint64_t ts, void *arg)
 {
 	struct vidsrc_st *st = arg;
 
-	st->ts = tmr_jiffies_usec();
-
-	while (st->run) {
-
-		if (tmr_jiffies_usec() < st->ts) {
-			sys_msleep(4);
-			continue;
-		}
-
-		process_frame(st);
-	}
-
-	return NULL;
+	st->frameh(st->frame, ts, st->arg);
 }
-#else
-static void tmr_handler(void *arg)
-{
-	struct vidsrc_st *st = arg;
-	const uint64_t now = tmr_jiffies_usec();
-
-	tmr_start(&st->tmr, 4, tmr_handler, st);
-
-	if (!st->ts)
-		st->ts = now;
-
-	if (now >= st->ts) {
-		process_frame(st);
-	}
-}
-#endif
 
 
 static void src_destructor(void *arg)
 {
 	struct vidsrc_st *st = arg;
 
-#ifdef HAVE_PTHREAD
-	if (st->run) {
-		st->run = false;
-		pthread_join(st->thread, NULL);
-	}
-#else
-	tmr_cancel(&st->tmr);
-#endif
-
+	/* waits for a tick in progress */
+	mem_deref(st->mc);
 	mem_deref(st->frame);
 }
 
@@ -135,7 +83,7 @@ static int src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 	(void)dev;
 	(void)errorh;
 
-	if (!stp || !prm || !size || !frameh)
+	if (!stp || !prm || !size || !frameh || prm->fps <= 0)
 		return EINVAL;
 
 	st = mem_zalloc(sizeof(*st), src_destructor);
@@ -166,16 +114,8 @@ static int src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 		vidframe_draw_vline(st->frame, x, 0, size->h, r, g, b);
 	}
 
-#ifdef HAVE_PTHREAD
-	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
-	if (err) {
-		st->run = false;
-		goto out;
-	}
-#else
-	tmr_start(&st->tmr, 1, tmr_handler, st);
-#endif
+	err = mclock_alloc(&st->mc, (uint32_t)(VIDEO_TIMEBASE / st->fps),
+			   tick_handler, st);
 
  out:
 	if (err)
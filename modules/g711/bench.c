@@ -0,0 +1,107 @@
+/**
+ * @file g711/bench.c  G.711 Audio Codec -- kernel micro-benchmark
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "rsua-mod/modapi.h"
+#include "g711.h"
+
+
+enum {
+	FRAME_SAMPC = 160,       /* 20ms at 8000 Hz       */
+	BATCH       = 1000,      /* frames between checks */
+	DURATION    = 200000,    /* per kernel [us]       */
+};
+
+struct bench {
+	int16_t pcm[FRAME_SAMPC];
+	uint8_t law[FRAME_SAMPC];
+};
+
+
+static double run_enc(g711_enc_h *enc, struct bench *b)
+{
+	uint64_t start = tmr_jiffies_usec(), elapsed;
+	uint64_t n = 0;
+	int i;
+
+	do {
+		for (i=0; i<BATCH; i++)
+			enc(b->law, b->pcm, FRAME_SAMPC);
+
+		n += BATCH * FRAME_SAMPC;
+		elapsed = tmr_jiffies_usec() - start;
+
+	} while (elapsed < DURATION);
+
+	return (double)n / (double)elapsed;
+}
+
+
+static double run_dec(g711_dec_h *dec, struct bench *b)
+{
+	uint64_t start = tmr_jiffies_usec(), elapsed;
+	uint64_t n = 0;
+	int i;
+
+	do {
+		for (i=0; i<BATCH; i++)
+			dec(b->pcm, b->law, FRAME_SAMPC);
+
+		n += BATCH * FRAME_SAMPC;
+		elapsed = tmr_jiffies_usec() - start;
+
+	} while (elapsed < DURATION);
+
+	return (double)n / (double)elapsed;
+}
+
+
+/**
+ * Measure the throughput of each verified kernel, in million samples
+ * per second, on 20ms frames of random samples
+ *
+ * @param pf  Print handler
+ * @param arg Command argument (unused)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int g711_bench(struct re_printf *pf, void *arg)
+{
+	const struct g711_kernel *k;
+	struct bench *b;
+	size_t i;
+	int err;
+
+	(void)arg;
+
+	b = mem_zalloc(sizeof(*b), NULL);
+	if (!b)
+		return ENOMEM;
+
+	for (i=0; i<FRAME_SAMPC; i++)
+		b->pcm[i] = (int16_t)rand_u16();
+
+	err = re_hprintf(pf, "g711 kernels [Msamples/s]:\n"
+			 "  %-6s %10s %10s %10s %10s\n",
+			 "kernel", "ulaw enc", "ulaw dec",
+			 "alaw enc", "alaw dec");
+
+	for (i=0; (k = g711_kernel_get(i)); i++) {
+
+		double ue = run_enc(k->ulaw_enc, b);
+		double ud = run_dec(k->ulaw_dec, b);
+		double ae = run_enc(k->alaw_enc, b);
+		double ad = run_dec(k->alaw_dec, b);
+		bool active = k == g711_kernel_active();
+
+		err |= re_hprintf(pf, "  %-6s %10.1f %10.1f %10.1f %10.1f"
+				  "%s\n", k->name, ue, ud, ae, ad,
+				  active ? "  (active)" : "");
+	}
+
+	mem_deref(b);
+
+	return err;
+}
@@ -6,15 +6,23 @@
  */
 
 #include "rsua-mod/modapi.h"
+#include "g711.h"
 
 
 /**
  * @defgroup g711 g711
  *
  * The G.711 audio codec
+ *
+ * Samples are converted in batches by the fastest kernel that the CPU
+ * supports, see kernel.c. The command g711_bench reports the throughput
+ * of each kernel.
  */
 
 
+static const struct g711_kernel *kern;
+
+
 static int pcmu_encode(struct auenc_state *aes, bool *marker, uint8_t *buf,
 		       size_t *len, int fmt, const void *sampv, size_t sampc)
 {
@@ -34,8 +42,7 @@ static int pcmu_encode(struct auenc_state *aes, bool *marker, uint8_t *buf,
 
 	*len = sampc;
 
-	while (sampc--)
-		*buf++ = g711_pcm2ulaw(*p++);
+	kern->ulaw_enc(buf, p, sampc);
 
 	return 0;
 }
@@ -61,8 +68,7 @@ static int pcmu_decode(struct audec_state *ads, int fmt, void *sampv,
 
 	*sampc = len;
 
-	while (len--)
-		*p++ = g711_ulaw2pcm(*buf++);
+	kern->ulaw_dec(p, buf, len);
 
 	return 0;
 }
@@ -87,8 +93,7 @@ static int pcma_encode(struct auenc_state *aes, bool *marker, uint8_t *buf,
 
 	*len = sampc;
 
-	while (sampc--)
-		*buf++ = g711_pcm2alaw(*p++);
+	kern->alaw_enc(buf, p, sampc);
 
 	return 0;
 }
@@ -114,8 +119,7 @@ static int pcma_decode(struct audec_state *ads, int fmt, void *sampv,
 
 	*sampc = len;
 
-	while (len--)
-		*p++ = g711_alaw2pcm(*buf++);
+	kern->alaw_dec(p, buf, len);
 
 	return 0;
 }
@@ -144,17 +148,26 @@ static struct aucodec pcma = {
 };
 
 
+static const struct cmd cmdv[] = {
+	{"g711_bench", 0, 0, "Benchmark the G.711 kernels", g711_bench},
+};
+
+
 static int module_init(void)
 {
+	g711_kernel_init();
+	kern = g711_kernel_active();
+
 	aucodec_register(data_aucodecl(), &pcmu);
 	aucodec_register(data_aucodecl(), &pcma);
 
-	return 0;
+	return cmd_register(data_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(data_commands(), cmdv);
 	aucodec_unregister(&pcma);
 	aucodec_unregister(&pcmu);
 
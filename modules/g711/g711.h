@@ -0,0 +1,28 @@
+/**
+ * @file g711.h  G.711 Audio Codec -- internal API
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+
+typedef void (g711_enc_h)(uint8_t *dst, const int16_t *src, size_t n);
+typedef void (g711_dec_h)(int16_t *dst, const uint8_t *src, size_t n);
+
+/** A set of batch G.711 kernels for one instruction set */
+struct g711_kernel {
+	const char *name;         /**< Instruction set name             */
+	g711_enc_h *ulaw_enc;     /**< Linear to u-law                  */
+	g711_dec_h *ulaw_dec;     /**< u-law to linear                  */
+	g711_enc_h *alaw_enc;     /**< Linear to A-law                  */
+	g711_dec_h *alaw_dec;     /**< A-law to linear                  */
+};
+
+
+/* kernel.c */
+void g711_kernel_init(void);
+const struct g711_kernel *g711_kernel_active(void);
+const struct g711_kernel *g711_kernel_get(size_t i);
+
+
+/* bench.c */
+int g711_bench(struct re_printf *pf, void *arg);
@@ -0,0 +1,715 @@
+/**
+ * @file g711/kernel.c  G.711 Audio Codec -- batch kernels
+ *
+ * The vector kernels compute the G.711 segment and mantissa directly,
+ * instead of the table lookups done by the scalar librem functions. Each
+ * vector kernel is compared with the scalar functions for every possible
+ * input when the module is loaded, and is only used if it is bit-exact.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include "rsua-mod/modapi.h"
+#include "g711.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define USE_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+/*
+ * Scalar reference kernels
+ */
+
+static void ulaw_enc_c(uint8_t *dst, const int16_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_pcm2ulaw(*src++);
+}
+
+
+static void ulaw_dec_c(int16_t *dst, const uint8_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_ulaw2pcm(*src++);
+}
+
+
+static void alaw_enc_c(uint8_t *dst, const int16_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_pcm2alaw(*src++);
+}
+
+
+static void alaw_dec_c(int16_t *dst, const uint8_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_alaw2pcm(*src++);
+}
+
+
+#ifdef USE_X86
+
+/*
+ * SSE2, 8 samples per vector
+ *
+ * The mantissa shift is done as an unsigned high multiply with a power
+ * of two, since SSE2 has no per-lane variable shift.
+ */
+
+static inline TARGET_SSE2 __m128i ulaw_enc_v128(__m128i x)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i neg  = _mm_cmplt_epi16(x, zero);
+	__m128i v, seg = zero, m = _mm_set1_epi16((short)0x8000);
+	__m128i u, mask;
+	int i;
+
+	v = _mm_srai_epi16(x, 2);
+	v = _mm_sub_epi16(_mm_xor_si128(v, neg), neg);
+	v = _mm_min_epi16(v, _mm_set1_epi16(8159));
+	v = _mm_add_epi16(v, _mm_set1_epi16(33));
+
+	for (i=0; i<8; i++) {
+		const __m128i gt = _mm_cmpgt_epi16(v,
+					_mm_set1_epi16((0x40 << i) - 1));
+
+		seg = _mm_sub_epi16(seg, gt);
+		m   = _mm_sub_epi16(m, _mm_and_si128(_mm_srli_epi16(m, 1),
+						     gt));
+	}
+
+	u = _mm_and_si128(_mm_mulhi_epu16(v, m), _mm_set1_epi16(0x0f));
+	u = _mm_or_si128(u, _mm_slli_epi16(seg, 4));
+	u = _mm_min_epi16(u, _mm_set1_epi16(0x7f));
+
+	mask = _mm_xor_si128(_mm_set1_epi16(0xff),
+			     _mm_and_si128(neg, _mm_set1_epi16(0x80)));
+
+	return _mm_xor_si128(u, mask);
+}
+
+
+static inline TARGET_SSE2 __m128i alaw_enc_v128(__m128i x)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i neg  = _mm_cmplt_epi16(x, zero);
+	__m128i v, seg = zero, m = _mm_set1_epi16((short)0x8000);
+	__m128i a, mask;
+	int i;
+
+	/* negative values map to -v - 1 */
+	v = _mm_xor_si128(_mm_srai_epi16(x, 3), neg);
+
+	for (i=0; i<7; i++) {
+		const __m128i gt = _mm_cmpgt_epi16(v,
+					_mm_set1_epi16((0x20 << i) - 1));
+
+		seg = _mm_sub_epi16(seg, gt);
+		if (i)
+			m = _mm_sub_epi16(m, _mm_and_si128(
+						  _mm_srli_epi16(m, 1), gt));
+	}
+
+	a = _mm_and_si128(_mm_mulhi_epu16(v, m), _mm_set1_epi16(0x0f));
+	a = _mm_or_si128(a, _mm_slli_epi16(seg, 4));
+
+	mask = _mm_xor_si128(_mm_set1_epi16(0xd5),
+			     _mm_and_si128(neg, _mm_set1_epi16(0x80)));
+
+	return _mm_xor_si128(a, mask);
+}
+
+
+/* shift each lane of t left by the 3-bit count in s */
+static inline TARGET_SSE2 __m128i shl3_v128(__m128i t, __m128i s)
+{
+	int b;
+
+	for (b=1; b<8; b<<=1) {
+		const __m128i vb = _mm_set1_epi16((short)b);
+		const __m128i on = _mm_cmpeq_epi16(_mm_and_si128(s, vb), vb);
+
+		t = _mm_or_si128(_mm_andnot_si128(on, t),
+				 _mm_and_si128(on, _mm_sll_epi16(t,
+						_mm_cvtsi32_si128(b))));
+	}
+
+	return t;
+}
+
+
+static inline TARGET_SSE2 __m128i ulaw_dec_v128(__m128i u)
+{
+	const __m128i sign = _mm_set1_epi16(0x80);
+	__m128i t, e, neg;
+
+	u = _mm_xor_si128(u, _mm_set1_epi16(0xff));
+
+	t = _mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x0f)), 3);
+	t = _mm_add_epi16(t, _mm_set1_epi16(0x84));
+	e = _mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi16(7));
+	t = shl3_v128(t, e);
+
+	t = _mm_sub_epi16(t, _mm_set1_epi16(0x84));
+	neg = _mm_cmpeq_epi16(_mm_and_si128(u, sign), sign);
+
+	return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+
+static inline TARGET_SSE2 __m128i alaw_dec_v128(__m128i a)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i t, seg, pos;
+
+	a = _mm_xor_si128(a, _mm_set1_epi16(0x55));
+
+	t   = _mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x0f)), 4);
+	seg = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi16(7));
+
+	/* seg 0: t + 8, otherwise (t + 0x108) << (seg - 1) */
+	t = _mm_add_epi16(t, _mm_set1_epi16(8));
+	t = _mm_add_epi16(t, _mm_andnot_si128(_mm_cmpeq_epi16(seg, zero),
+					      _mm_set1_epi16(0x100)));
+	t = shl3_v128(t, _mm_subs_epu16(seg, _mm_set1_epi16(1)));
+
+	pos = _mm_cmpeq_epi16(_mm_and_si128(a, _mm_set1_epi16(0x80)), zero);
+
+	return _mm_sub_epi16(_mm_xor_si128(t, pos), pos);
+}
+
+
+static TARGET_SSE2 void ulaw_enc_sse2(uint8_t *dst, const int16_t *src,
+				      size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 8));
+
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_packus_epi16(ulaw_enc_v128(a),
+						  ulaw_enc_v128(b)));
+	}
+
+	ulaw_enc_c(dst, src, n);
+}
+
+
+static TARGET_SSE2 void alaw_enc_sse2(uint8_t *dst, const int16_t *src,
+				      size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 8));
+
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_packus_epi16(alaw_enc_v128(a),
+						  alaw_enc_v128(b)));
+	}
+
+	alaw_enc_c(dst, src, n);
+}
+
+
+static TARGET_SSE2 void ulaw_dec_sse2(int16_t *dst, const uint8_t *src,
+				      size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst,
+				 ulaw_dec_v128(_mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128((__m128i *)(dst + 8),
+				 ulaw_dec_v128(_mm_unpackhi_epi8(v, zero)));
+	}
+
+	ulaw_dec_c(dst, src, n);
+}
+
+
+static TARGET_SSE2 void alaw_dec_sse2(int16_t *dst, const uint8_t *src,
+				      size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst,
+				 alaw_dec_v128(_mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128((__m128i *)(dst + 8),
+				 alaw_dec_v128(_mm_unpackhi_epi8(v, zero)));
+	}
+
+	alaw_dec_c(dst, src, n);
+}
+
+
+/*
+ * AVX2, 16 samples per vector -- same algorithm as SSE2
+ */
+
+static inline TARGET_AVX2 __m256i ulaw_enc_v256(__m256i x)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i neg  = _mm256_cmpgt_epi16(zero, x);
+	__m256i v, seg = zero, m = _mm256_set1_epi16((short)0x8000);
+	__m256i u, mask;
+	int i;
+
+	v = _mm256_abs_epi16(_mm256_srai_epi16(x, 2));
+	v = _mm256_min_epi16(v, _mm256_set1_epi16(8159));
+	v = _mm256_add_epi16(v, _mm256_set1_epi16(33));
+
+	for (i=0; i<8; i++) {
+		const __m256i gt = _mm256_cmpgt_epi16(v,
+					_mm256_set1_epi16((0x40 << i) - 1));
+
+		seg = _mm256_sub_epi16(seg, gt);
+		m   = _mm256_sub_epi16(m, _mm256_and_si256(
+					       _mm256_srli_epi16(m, 1), gt));
+	}
+
+	u = _mm256_and_si256(_mm256_mulhi_epu16(v, m),
+			     _mm256_set1_epi16(0x0f));
+	u = _mm256_or_si256(u, _mm256_slli_epi16(seg, 4));
+	u = _mm256_min_epi16(u, _mm256_set1_epi16(0x7f));
+
+	mask = _mm256_xor_si256(_mm256_set1_epi16(0xff),
+				_mm256_and_si256(neg,
+						 _mm256_set1_epi16(0x80)));
+
+	return _mm256_xor_si256(u, mask);
+}
+
+
+static inline TARGET_AVX2 __m256i alaw_enc_v256(__m256i x)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i neg  = _mm256_cmpgt_epi16(zero, x);
+	__m256i v, seg = zero, m = _mm256_set1_epi16((short)0x8000);
+	__m256i a, mask;
+	int i;
+
+	v = _mm256_xor_si256(_mm256_srai_epi16(x, 3), neg);
+
+	for (i=0; i<7; i++) {
+		const __m256i gt = _mm256_cmpgt_epi16(v,
+					_mm256_set1_epi16((0x20 << i) - 1));
+
+		seg = _mm256_sub_epi16(seg, gt);
+		if (i)
+			m = _mm256_sub_epi16(m, _mm256_and_si256(
+					       _mm256_srli_epi16(m, 1), gt));
+	}
+
+	a = _mm256_and_si256(_mm256_mulhi_epu16(v, m),
+			     _mm256_set1_epi16(0x0f));
+	a = _mm256_or_si256(a, _mm256_slli_epi16(seg, 4));
+
+	mask = _mm256_xor_si256(_mm256_set1_epi16(0xd5),
+				_mm256_and_si256(neg,
+						 _mm256_set1_epi16(0x80)));
+
+	return _mm256_xor_si256(a, mask);
+}
+
+
+/* shift each lane of t left by the count in s, using a 32-bit shift */
+static inline TARGET_AVX2 __m256i shl_v256(__m256i t, __m256i s)
+{
+	const __m256i lo = _mm256_set1_epi32(0xffff);
+	__m256i even, odd;
+
+	even = _mm256_sllv_epi32(_mm256_and_si256(t, lo),
+				 _mm256_and_si256(s, lo));
+	odd  = _mm256_sllv_epi32(_mm256_srli_epi32(t, 16),
+				 _mm256_srli_epi32(s, 16));
+
+	return _mm256_or_si256(_mm256_and_si256(even, lo),
+			       _mm256_slli_epi32(odd, 16));
+}
+
+
+static inline TARGET_AVX2 __m256i ulaw_dec_v256(__m256i u)
+{
+	const __m256i sign = _mm256_set1_epi16(0x80);
+	__m256i t, e, neg;
+
+	u = _mm256_xor_si256(u, _mm256_set1_epi16(0xff));
+
+	t = _mm256_slli_epi16(_mm256_and_si256(u, _mm256_set1_epi16(0x0f)),
+			      3);
+	t = _mm256_add_epi16(t, _mm256_set1_epi16(0x84));
+	e = _mm256_and_si256(_mm256_srli_epi16(u, 4), _mm256_set1_epi16(7));
+	t = shl_v256(t, e);
+
+	t = _mm256_sub_epi16(t, _mm256_set1_epi16(0x84));
+	neg = _mm256_cmpeq_epi16(_mm256_and_si256(u, sign), sign);
+
+	return _mm256_sub_epi16(_mm256_xor_si256(t, neg), neg);
+}
+
+
+static inline TARGET_AVX2 __m256i alaw_dec_v256(__m256i a)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i t, seg, pos;
+
+	a = _mm256_xor_si256(a, _mm256_set1_epi16(0x55));
+
+	t   = _mm256_slli_epi16(_mm256_and_si256(a,
+						 _mm256_set1_epi16(0x0f)), 4);
+	seg = _mm256_and_si256(_mm256_srli_epi16(a, 4),
+			       _mm256_set1_epi16(7));
+
+	t = _mm256_add_epi16(t, _mm256_set1_epi16(8));
+	t = _mm256_add_epi16(t, _mm256_andnot_si256(
+				     _mm256_cmpeq_epi16(seg, zero),
+				     _mm256_set1_epi16(0x100)));
+	t = shl_v256(t, _mm256_subs_epu16(seg, _mm256_set1_epi16(1)));
+
+	pos = _mm256_cmpeq_epi16(_mm256_and_si256(a,
+						  _mm256_set1_epi16(0x80)),
+				 zero);
+
+	return _mm256_sub_epi16(_mm256_xor_si256(t, pos), pos);
+}
+
+
+/* pack 16 words of 0..255 to 16 bytes in order */
+static inline TARGET_AVX2 __m128i pack_v256(__m256i r)
+{
+	r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), 0xd8);
+
+	return _mm256_castsi256_si128(r);
+}
+
+
+static TARGET_AVX2 void ulaw_enc_avx2(uint8_t *dst, const int16_t *src,
+				      size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)src);
+
+		_mm_storeu_si128((__m128i *)dst, pack_v256(ulaw_enc_v256(v)));
+	}
+
+	ulaw_enc_c(dst, src, n);
+}
+
+
+static TARGET_AVX2 void alaw_enc_avx2(uint8_t *dst, const int16_t *src,
+				      size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)src);
+
+		_mm_storeu_si128((__m128i *)dst, pack_v256(alaw_enc_v256(v)));
+	}
+
+	alaw_enc_c(dst, src, n);
+}
+
+
+static TARGET_AVX2 void ulaw_dec_avx2(int16_t *dst, const uint8_t *src,
+				      size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm256_storeu_si256((__m256i *)dst,
+				    ulaw_dec_v256(_mm256_cvtepu8_epi16(v)));
+	}
+
+	ulaw_dec_c(dst, src, n);
+}
+
+
+static TARGET_AVX2 void alaw_dec_avx2(int16_t *dst, const uint8_t *src,
+				      size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm256_storeu_si256((__m256i *)dst,
+				    alaw_dec_v256(_mm256_cvtepu8_epi16(v)));
+	}
+
+	alaw_dec_c(dst, src, n);
+}
+
+#endif /* USE_X86 */
+
+
+#ifdef USE_NEON
+
+/*
+ * NEON, 8 samples per vector -- the segment is taken from the count of
+ * leading zeros, and the shifts are per-lane.
+ */
+
+static inline uint16x8_t ulaw_enc_neon8(int16x8_t x)
+{
+	const uint16x8_t neg = vcltq_s16(x, vdupq_n_s16(0));
+	int16x8_t v, seg, u;
+	uint16x8_t mask;
+
+	v = vabsq_s16(vshrq_n_s16(x, 2));
+	v = vminq_s16(v, vdupq_n_s16(8159));
+	v = vaddq_s16(v, vdupq_n_s16(33));
+
+	seg = vsubq_s16(vdupq_n_s16(10), vclzq_s16(v));
+	seg = vmaxq_s16(seg, vdupq_n_s16(0));
+
+	u = vshlq_s16(v, vnegq_s16(vaddq_s16(seg, vdupq_n_s16(1))));
+	u = vandq_s16(u, vdupq_n_s16(0x0f));
+	u = vorrq_s16(u, vshlq_n_s16(seg, 4));
+	u = vminq_s16(u, vdupq_n_s16(0x7f));
+
+	mask = veorq_u16(vdupq_n_u16(0xff), vandq_u16(neg,
+						       vdupq_n_u16(0x80)));
+
+	return veorq_u16(vreinterpretq_u16_s16(u), mask);
+}
+
+
+static inline uint16x8_t alaw_enc_neon8(int16x8_t x)
+{
+	const uint16x8_t neg = vcltq_s16(x, vdupq_n_s16(0));
+	int16x8_t v, seg, a;
+	uint16x8_t mask;
+
+	v = veorq_s16(vshrq_n_s16(x, 3), vreinterpretq_s16_u16(neg));
+
+	seg = vsubq_s16(vdupq_n_s16(11), vclzq_s16(v));
+	seg = vmaxq_s16(seg, vdupq_n_s16(0));
+
+	a = vshlq_s16(v, vnegq_s16(vmaxq_s16(seg, vdupq_n_s16(1))));
+	a = vandq_s16(a, vdupq_n_s16(0x0f));
+	a = vorrq_s16(a, vshlq_n_s16(seg, 4));
+
+	mask = veorq_u16(vdupq_n_u16(0xd5), vandq_u16(neg,
+						       vdupq_n_u16(0x80)));
+
+	return veorq_u16(vreinterpretq_u16_s16(a), mask);
+}
+
+
+static inline int16x8_t ulaw_dec_neon8(uint8x8_t b)
+{
+	int16x8_t u = vreinterpretq_s16_u16(vmovl_u8(vmvn_u8(b)));
+	int16x8_t t, e;
+	uint16x8_t neg;
+
+	t = vshlq_n_s16(vandq_s16(u, vdupq_n_s16(0x0f)), 3);
+	t = vaddq_s16(t, vdupq_n_s16(0x84));
+	e = vandq_s16(vshrq_n_s16(u, 4), vdupq_n_s16(7));
+	t = vsubq_s16(vshlq_s16(t, e), vdupq_n_s16(0x84));
+
+	neg = vtstq_s16(u, vdupq_n_s16(0x80));
+
+	return vbslq_s16(neg, vnegq_s16(t), t);
+}
+
+
+static inline int16x8_t alaw_dec_neon8(uint8x8_t b)
+{
+	int16x8_t a = vreinterpretq_s16_u16(vmovl_u8(veor_u8(b,
+							vdup_n_u8(0x55))));
+	int16x8_t t, seg;
+	uint16x8_t pos;
+
+	t   = vshlq_n_s16(vandq_s16(a, vdupq_n_s16(0x0f)), 4);
+	seg = vandq_s16(vshrq_n_s16(a, 4), vdupq_n_s16(7));
+
+	t = vaddq_s16(t, vbslq_s16(vceqq_s16(seg, vdupq_n_s16(0)),
+				   vdupq_n_s16(8), vdupq_n_s16(0x108)));
+	t = vshlq_s16(t, vmaxq_s16(vsubq_s16(seg, vdupq_n_s16(1)),
+				   vdupq_n_s16(0)));
+
+	pos = vtstq_s16(a, vdupq_n_s16(0x80));
+
+	return vbslq_s16(pos, t, vnegq_s16(t));
+}
+
+
+static void ulaw_enc_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8)
+		vst1_u8(dst, vmovn_u16(ulaw_enc_neon8(vld1q_s16(src))));
+
+	ulaw_enc_c(dst, src, n);
+}
+
+
+static void alaw_enc_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8)
+		vst1_u8(dst, vmovn_u16(alaw_enc_neon8(vld1q_s16(src))));
+
+	alaw_enc_c(dst, src, n);
+}
+
+
+static void ulaw_dec_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8)
+		vst1q_s16(dst, ulaw_dec_neon8(vld1_u8(src)));
+
+	ulaw_dec_c(dst, src, n);
+}
+
+
+static void alaw_dec_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8)
+		vst1q_s16(dst, alaw_dec_neon8(vld1_u8(src)));
+
+	alaw_dec_c(dst, src, n);
+}
+
+#endif /* USE_NEON */
+
+
+static const struct g711_kernel kernel_c = {
+	"c", ulaw_enc_c, ulaw_dec_c, alaw_enc_c, alaw_dec_c
+};
+
+#ifdef USE_X86
+static const struct g711_kernel kernel_sse2 = {
+	"sse2", ulaw_enc_sse2, ulaw_dec_sse2, alaw_enc_sse2, alaw_dec_sse2
+};
+
+static const struct g711_kernel kernel_avx2 = {
+	"avx2", ulaw_enc_avx2, ulaw_dec_avx2, alaw_enc_avx2, alaw_dec_avx2
+};
+#endif
+
+#ifdef USE_NEON
+static const struct g711_kernel kernel_neon = {
+	"neon", ulaw_enc_neon, ulaw_dec_neon, alaw_enc_neon, alaw_dec_neon
+};
+#endif
+
+
+/* usable kernels, in order of preference -- the scalar kernel is last */
+static const struct g711_kernel *kernelv[4];
+static size_t kernelc;
+
+
+static bool enc_exact(g711_enc_h *enc, g711_enc_h *ref)
+{
+	int16_t src[256];
+	uint8_t out[256], exp[256];
+	uint32_t i, j;
+
+	for (i=0; i<65536; i+=256) {
+
+		for (j=0; j<256; j++)
+			src[j] = (int16_t)(uint16_t)(i + j);
+
+		enc(out, src, 256);
+		ref(exp, src, 256);
+
+		if (memcmp(out, exp, sizeof(out)))
+			return false;
+	}
+
+	return true;
+}
+
+
+static bool dec_exact(g711_dec_h *dec, g711_dec_h *ref)
+{
+	uint8_t src[256];
+	int16_t out[256], exp[256];
+	uint32_t i;
+
+	for (i=0; i<256; i++)
+		src[i] = (uint8_t)i;
+
+	dec(out, src, 256);
+	ref(exp, src, 256);
+
+	return 0 == memcmp(out, exp, sizeof(out));
+}
+
+
+static void add_kernel(const struct g711_kernel *k)
+{
+	if (!enc_exact(k->ulaw_enc, ulaw_enc_c) ||
+	    !dec_exact(k->ulaw_dec, ulaw_dec_c) ||
+	    !enc_exact(k->alaw_enc, alaw_enc_c) ||
+	    !dec_exact(k->alaw_dec, alaw_dec_c)) {
+
+		warning("g711: %s kernel is not bit-exact, disabled\n",
+			k->name);
+		return;
+	}
+
+	kernelv[kernelc++] = k;
+}
+
+
+/**
+ * Detect the CPU features and verify the vector kernels
+ */
+void g711_kernel_init(void)
+{
+	kernelc = 0;
+
+#ifdef USE_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		add_kernel(&kernel_avx2);
+	if (__builtin_cpu_supports("sse2"))
+		add_kernel(&kernel_sse2);
+#endif
+
+#ifdef USE_NEON
+	add_kernel(&kernel_neon);
+#endif
+
+	kernelv[kernelc++] = &kernel_c;
+
+	info("g711: using %s kernel\n", kernelv[0]->name);
+}
+
+
+/**
+ * Get the kernel used by the codec
+ *
+ * @return Fastest verified kernel
+ */
+const struct g711_kernel *g711_kernel_active(void)
+{
+	return kernelc ? kernelv[0] : &kernel_c;
+}
+
+
+/**
+ * Get a verified kernel by index
+ *
+ * @param i Index, 0 is the active kernel
+ *
+ * @return Kernel, or NULL if the index is out of range
+ */
+const struct g711_kernel *g711_kernel_get(size_t i)
+{
+	return i < kernelc ? kernelv[i] : NULL;
+}
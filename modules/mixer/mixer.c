@@ -0,0 +1,398 @@
+/**
+ * @file mixer.c Audio conference mixer
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+#include <string.h>
+#include "rsua-mod/modapi.h"
+
+
+/**
+ * @defgroup mixer mixer
+ *
+ * Audio conference mixer module
+ *
+ * The calls which use the same mixer device join a conference. The audio
+ * player of a call is the input of its participant, and the audio source
+ * of the call gets the mix of the other participants. Only the loudest
+ * participants are mixed, and the incoming audio of silent participants
+ * is not decoded when the peer sends RFC 6464 audio levels.
+ *
+ * Sample config:
+ *
+ \verbatim
+  audio_player            mixer,conf1
+  audio_source            mixer,conf1
+  mixer_srate             48000      # Mixer sample rate [Hz]
+  mixer_ptime             20         # Packet time of the mix [ms]
+  mixer_speakers          3          # Active speakers mixed
+  mixer_vad               50         # Minimum speaker level [-dBov]
+ \endverbatim
+ */
+
+
+struct conference {
+	struct le le;
+	char *name;
+	struct confmix *mix;
+	struct list partl;
+};
+
+struct mixpart {
+	struct le le;
+	struct conference *conf;
+	struct confmix_part *part;
+	const void *arg;             /**< Audio object of the call         */
+	struct audio *au;            /**< Audio object, if found           */
+};
+
+struct auplay_st {
+	const struct auplay *ap;     /* inheritance */
+	struct mixpart *mp;
+};
+
+struct ausrc_st {
+	const struct ausrc *as;      /* inheritance */
+	struct mixpart *mp;
+};
+
+
+static struct ausrc *ausrc;
+static struct auplay *auplay;
+static struct list confl;
+
+static struct {
+	uint32_t srate;
+	uint32_t ptime;
+	uint32_t speakers;
+	uint32_t vad;
+} mixer = {
+	48000,
+	20,
+	3,
+	50,
+};
+
+
+static void conf_destructor(void *arg)
+{
+	struct conference *conf = arg;
+
+	list_unlink(&conf->le);
+	mem_deref(conf->mix);
+	mem_deref(conf->name);
+}
+
+
+static int conf_get(struct conference **confp, const char *name)
+{
+	struct conference *conf;
+	struct le *le;
+	int err;
+
+	for (le = confl.head; le; le = le->next) {
+
+		conf = le->data;
+
+		if (0 == str_casecmp(conf->name, name)) {
+			*confp = mem_ref(conf);
+			return 0;
+		}
+	}
+
+	conf = mem_zalloc(sizeof(*conf), conf_destructor);
+	if (!conf)
+		return ENOMEM;
+
+	err = str_dup(&conf->name, name);
+	if (err)
+		goto out;
+
+	err = confmix_alloc(&conf->mix, mixer.srate, mixer.ptime,
+			    mixer.speakers, -(int)mixer.vad);
+	if (err)
+		goto out;
+
+	err = confmix_start(conf->mix);
+	if (err)
+		goto out;
+
+	list_append(&confl, &conf->le, conf);
+
+	info("mixer: conference '%s' created\n", name);
+
+ out:
+	if (err)
+		mem_deref(conf);
+	else
+		*confp = conf;
+
+	return err;
+}
+
+
+/* the player and source handler argument is the audio object of a call */
+static struct audio *find_audio(const void *arg)
+{
+	struct le *le, *lec;
+
+	for (le = list_head(uag_list()); le; le = le->next) {
+
+		for (lec = list_head(ua_calls(le->data)); lec;
+		     lec = lec->next) {
+
+			struct audio *au = call_audio(lec->data);
+
+			if (au && au == arg)
+				return au;
+		}
+	}
+
+	return NULL;
+}
+
+
+static int level_handler(double *level, void *arg)
+{
+	struct mixpart *mp = arg;
+
+	return audio_level_get(mp->au, level);
+}
+
+
+static void part_destructor(void *arg)
+{
+	struct mixpart *mp = arg;
+
+	list_unlink(&mp->le);
+	mem_deref(mp->part);
+	mem_deref(mp->conf);
+}
+
+
+/* the player and the source of a call share one participant */
+static int part_get(struct mixpart **mpp, const char *device,
+		    const void *arg)
+{
+	struct conference *conf;
+	struct mixpart *mp;
+	struct le *le;
+	int err;
+
+	if (!str_isset(device))
+		return EINVAL;
+
+	err = conf_get(&conf, device);
+	if (err)
+		return err;
+
+	for (le = conf->partl.head; le; le = le->next) {
+
+		mp = le->data;
+
+		if (mp->arg == arg) {
+			*mpp = mem_ref(mp);
+			mem_deref(conf);
+			return 0;
+		}
+	}
+
+	mp = mem_zalloc(sizeof(*mp), part_destructor);
+	if (!mp) {
+		mem_deref(conf);
+		return ENOMEM;
+	}
+
+	mp->conf = conf;
+	mp->arg  = arg;
+
+	err = confmix_part_alloc(&mp->part, conf->mix);
+	if (err)
+		goto out;
+
+	mp->au = find_audio(arg);
+	if (mp->au) {
+		confmix_part_set_levelh(mp->part, level_handler, mp);
+		audio_set_rx_squelch(mp->au, -(int)mixer.vad);
+	}
+
+	list_append(&conf->partl, &mp->le, mp);
+
+ out:
+	if (err)
+		mem_deref(mp);
+	else
+		*mpp = mp;
+
+	return err;
+}
+
+
+static void auplay_destructor(void *arg)
+{
+	struct auplay_st *st = arg;
+
+	if (st->mp)
+		confmix_part_set_input(st->mp->part, 0, 0, NULL, NULL);
+
+	mem_deref(st->mp);
+}
+
+
+static int play_alloc(struct auplay_st **stp, const struct auplay *ap,
+		      struct auplay_prm *prm, const char *device,
+		      auplay_write_h *wh, void *arg)
+{
+	struct auplay_st *st;
+	int err;
+
+	if (!stp || !ap || !prm || !wh)
+		return EINVAL;
+
+	if (prm->fmt != AUFMT_S16LE) {
+		warning("mixer: unsupported sample format (%s)\n",
+			aufmt_name(prm->fmt));
+		return ENOTSUP;
+	}
+
+	st = mem_zalloc(sizeof(*st), auplay_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->ap = ap;
+
+	err = part_get(&st->mp, device, arg);
+	if (err)
+		goto out;
+
+	err = confmix_part_set_input(st->mp->part, prm->srate, prm->ch,
+				     wh, arg);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+static void ausrc_destructor(void *arg)
+{
+	struct ausrc_st *st = arg;
+
+	if (st->mp)
+		confmix_part_set_output(st->mp->part, 0, 0, NULL, NULL);
+
+	mem_deref(st->mp);
+}
+
+
+static int src_alloc(struct ausrc_st **stp, const struct ausrc *as,
+		     struct media_ctx **ctx,
+		     struct ausrc_prm *prm, const char *device,
+		     ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
+{
+	struct ausrc_st *st;
+	int err;
+	(void)ctx;
+	(void)errh;
+
+	if (!stp || !as || !prm || !rh)
+		return EINVAL;
+
+	if (prm->fmt != AUFMT_S16LE) {
+		warning("mixer: unsupported sample format (%s)\n",
+			aufmt_name(prm->fmt));
+		return ENOTSUP;
+	}
+
+	st = mem_zalloc(sizeof(*st), ausrc_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->as = as;
+
+	err = part_get(&st->mp, device, arg);
+	if (err)
+		goto out;
+
+	err = confmix_part_set_output(st->mp->part, prm->srate, prm->ch,
+				      rh, arg);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+static int mixer_status(struct re_printf *pf, void *arg)
+{
+	struct le *le;
+	int err = 0;
+	(void)arg;
+
+	err |= re_hprintf(pf, "Mixer conferences (%u):\n",
+			  list_count(&confl));
+
+	for (le = confl.head; le; le = le->next) {
+
+		const struct conference *conf = le->data;
+
+		err |= re_hprintf(pf, "  %s: %H", conf->name,
+				  confmix_debug, conf->mix);
+	}
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"mixer", 0,       0, "Conference mixer status", mixer_status },
+};
+
+
+static int module_init(void)
+{
+	int err;
+
+	conf_get_u32(conf_cur(), "mixer_srate", &mixer.srate);
+	conf_get_u32(conf_cur(), "mixer_ptime", &mixer.ptime);
+	conf_get_u32(conf_cur(), "mixer_speakers", &mixer.speakers);
+	conf_get_u32(conf_cur(), "mixer_vad", &mixer.vad);
+
+	err  = ausrc_register(&ausrc, data_ausrcl(), "mixer", src_alloc);
+	err |= auplay_register(&auplay, data_auplayl(), "mixer", play_alloc);
+	if (err)
+		return err;
+
+	return cmd_register(data_commands(), cmdv, ARRAY_SIZE(cmdv));
+}
+
+
+static int module_close(void)
+{
+	cmd_unregister(data_commands(), cmdv);
+
+	ausrc  = mem_deref(ausrc);
+	auplay = mem_deref(auplay);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(mixer) = {
+	"mixer",
+	"audio",
+	module_init,
+	module_close,
+};
@@ -19,38 +19,27 @@
 /*
  * Relay UA events as publish messages to the Broker
  */
-static void ua_event_handler(struct ua *ua, enum ua_event ev,
-			     struct call *call, const char *prm, void *arg)
+static void ua_event_handler(struct ua_event_rec *rec, void *arg)
 {
 	struct mqtt *mqtt = arg;
-	struct odict *od = NULL;
 	int err;
 
-	err = odict_alloc(&od, 8);
-	if (err)
-		return;
-
-	err = event_encode_dict(od, ua, ev, call, prm);
-	if (err)
-		goto out;
-
 	/* send audio jitter buffer values together with VU rx values. */
-	if (ev == UA_EVENT_VU_RX) {
-		err = event_add_au_jb_stat(od,call);
-		if (err) {
-			info("Could not add audio jb value.\n");
-		}
+	if (rec->ev == UA_EVENT_VU_RX) {
+		err = mqtt_publish_message(mqtt, mqtt->pubtopic,
+					   "{%H,\"audio_jb_ms\":%llu}",
+					   ua_event_rec_encode, rec,
+					   audio_jb_current_value(
+						   call_audio(rec->call)));
+	}
+	else {
+		err = mqtt_publish_message(mqtt, mqtt->pubtopic, "{%H}",
+					   ua_event_rec_encode, rec);
 	}
-
-	err = mqtt_publish_message(mqtt, mqtt->pubtopic, "%H",
-				   json_encode_odict, od);
 	if (err) {
 		warning("mqtt: failed to publish message (%m)\n", err);
-		goto out;
+		return;
 	}
-
- out:
-	mem_deref(od);
 }
 
 
@@ -94,9 +83,16 @@ int mqtt_publish_message(struct mqtt *mqtt, const char *topic,
 
 int mqtt_publish_init(struct mqtt *mqtt)
 {
+	uint32_t classes = UA_EVCLASS_ALL;
+	struct pl pl;
 	int err;
 
-	err = uag_event_register(ua_event_handler, mqtt);
+	if (0 == conf_get(conf_cur(), "mqtt_events", &pl) &&
+	    uag_event_class_decode(&classes, &pl)) {
+		warning("mqtt: invalid event classes '%r'\n", &pl);
+	}
+
+	err = uag_event_subscribe(classes, ua_event_handler, mqtt);
 	if (err)
 		return err;
 
@@ -106,5 +102,5 @@ int mqtt_publish_init(struct mqtt *mqtt)
 
 void mqtt_publish_close(void)
 {
-	uag_event_unregister(&ua_event_handler);
+	uag_event_unsubscribe(&ua_event_handler);
 }
@@ -12,7 +12,10 @@ struct swscale_enc {
 	struct vidfilt_enc_st vf;   /**< Inheritance           */
 
 	struct SwsContext *sws;
+	struct vidpool *pool;
 	struct vidframe *frame;
+	struct vidsz src_size;
+	enum vidfmt src_format;
 	struct vidsz dst_size;
 	enum vidfmt swscale_format;
 };
@@ -38,6 +41,7 @@ static void encode_destructor(void *arg)
 	list_unlink(&st->vf.le);
 
 	mem_deref(st->frame);
+	mem_deref(st->pool);
 	sws_freeContext(st->sws);
 }
 
@@ -48,7 +52,6 @@ static int encode_update(struct vidfilt_enc_st **stp, void **ctx,
 {
 	struct swscale_enc *st;
 	int err = 0;
-	(void)vid;
 
 	if (!stp || !ctx || !vf || !prm)
 		return EINVAL;
@@ -63,6 +66,10 @@ static int encode_update(struct vidfilt_enc_st **stp, void **ctx,
 	st->dst_size.w = prm->width;
 	st->dst_size.h = prm->height;
 	st->swscale_format = prm->fmt;
+	st->src_format = (enum vidfmt)-1;
+
+	/* the output frames are taken from the pool of the stream */
+	st->pool = mem_ref(video_frame_pool(vid, true));
 
 	if (err)
 		mem_deref(st);
@@ -108,21 +115,26 @@ static int encode_process(struct vidfilt_enc_st *st, struct vidframe *frame,
 		return EINVAL;
 	}
 
-	if (!enc->sws) {
+	/* the context is created again if the input changes */
+	if (!enc->sws || frame->fmt != enc->src_format ||
+	    !vidsz_cmp(&frame->size, &enc->src_size)) {
 
 		struct SwsContext *sws;
 		int flags = 0;
 
-		sws = sws_getContext(width, height, avpixfmt,
-				     enc->dst_size.w, enc->dst_size.h,
-				     avpixfmt_dst,
-				     flags, NULL, NULL, NULL);
+		sws = sws_getCachedContext(enc->sws, width, height, avpixfmt,
+					   enc->dst_size.w, enc->dst_size.h,
+					   avpixfmt_dst,
+					   flags, NULL, NULL, NULL);
 		if (!sws) {
 			warning("swscale: sws_getContext error\n");
+			enc->sws = NULL;
 			return ENOMEM;
 		}
 
 		enc->sws = sws;
+		enc->src_size = frame->size;
+		enc->src_format = frame->fmt;
 
 		info("swscale: created SwsContext:"
 		     " '%s' %d x %d --> '%s' %u x %u\n",
@@ -131,14 +143,14 @@ static int encode_process(struct vidfilt_enc_st *st, struct vidframe *frame,
 		     enc->dst_size.w, enc->dst_size.h);
 	}
 
-	if (!enc->frame) {
+	/* the previous frame is given back, the encoder is done with it */
+	enc->frame = mem_deref(enc->frame);
 
-		err = vidframe_alloc(&enc->frame, enc->swscale_format,
-				     &enc->dst_size);
-		if (err) {
-			warning("swscale: vidframe_alloc error (%m)\n", err);
-			return err;
-		}
+	err = vidpool_get(enc->pool, &enc->frame, enc->swscale_format,
+			  &enc->dst_size);
+	if (err) {
+		warning("swscale: vidframe_alloc error (%m)\n", err);
+		return err;
 	}
 
 	for (i=0; i<4; i++) {
@@ -31,6 +31,7 @@ static struct vp8_vidcodec vp8 = {
 		.ench      = vp8_encode,
 		.decupdh   = vp8_decode_update,
 		.dech      = vp8_decode,
+		.keyh      = vp8_keyframe,
 		.fmtp_ench = vp8_fmtp_enc,
 	},
 	.max_fs   = 3600,
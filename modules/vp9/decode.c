@@ -363,3 +363,16 @@ int vp9_decode(struct viddec_state *vds, struct vidframe *frame,
 
 	return err;
 }
+
+
+/* check the first packet of a frame, without decoding it */
+bool vp9_keyframe(const struct mbuf *mb)
+{
+	struct mbuf pkt = *mb;
+	struct hdr hdr;
+
+	if (hdr_decode(&hdr, &pkt))
+		return false;
+
+	return hdr.b && is_keyframe(&pkt);
+}
@@ -35,6 +35,7 @@ static struct vp9_vidcodec vp9 = {
 		.ench      = vp9_encode,
 		.decupdh   = vp9_decode_update,
 		.dech      = vp9_decode,
+		.keyh      = vp9_keyframe,
 		.fmtp_ench = vp9_fmtp_enc,
 	},
 	.max_fs = 3600
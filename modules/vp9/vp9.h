@@ -22,6 +22,7 @@ int vp9_decode_update(struct viddec_state **vdsp, const struct vidcodec *vc,
 		      const char *fmtp);
 int vp9_decode(struct viddec_state *vds, struct vidframe *frame,
 	       bool *intra, bool marker, uint16_t seq, struct mbuf *mb);
+bool vp9_keyframe(const struct mbuf *mb);
 
 
 /* SDP */
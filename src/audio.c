@@ -27,10 +27,12 @@
 #include "auplay.h"
 #include "cmd.h"
 #include "data.h"
+#include "dsp.h"
 #include "metric.h"
 #include "rtpext.h"
 #include "stream.h"
 #include "timestamp.h"
+#include "workpool.h"
 #include "log.h"
 
 /** Magic number */
@@ -73,6 +75,7 @@ enum {
 	AUDIO_SAMPSZ    = MAX_SRATE * MAX_CHANNELS * MAX_PTIME / 1000,
 
 	SILENCE_Q = 1024 * 1024,  /* Quadratic sample value for silence */
+	SQUELCH_HANGOVER = 10,    /* Packets decoded after the talk ends */
 };
 
 
@@ -104,11 +107,14 @@ struct autx {
 	struct auresamp resamp;       /**< Optional resampler for DSP      */
 	struct list filtl;            /**< Audio filters in encoding order */
 	struct mbuf *mb;              /**< Buffer for outgoing RTP packets */
+	struct mbuf *mb_tel;          /**< Buffer for Telephony Events     */
 	struct media_ctx **ctx;       /**< Shared A/V source media context */
 	char *module;                 /**< Audio source module name        */
 	char *device;                 /**< Audio source device name        */
 	void *sampv;                  /**< Sample buffer                   */
 	int16_t *sampv_rs;            /**< Sample buffer for resampler     */
+	void *sampv_conv;             /**< Sample buffer for conversion    */
+	size_t conv_sz;               /**< Conversion buffer size [bytes]  */
 	uint32_t ptime;               /**< Packet time for sending         */
 	uint64_t ts_ext;              /**< Ext. Timestamp for outgoing RTP */
 	uint32_t ts_base;             /**< First timestamp sent            */
@@ -124,6 +130,7 @@ struct autx {
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
+		uint64_t n_alloc;     /**< Heap allocations in hot path    */
 	} stats;
 
 #ifdef HAVE_PTHREAD
@@ -166,10 +173,14 @@ struct aurx {
 	char *device;                 /**< Audio player device name        */
 	void *sampv;                  /**< Sample buffer                   */
 	int16_t *sampv_rs;            /**< Sample buffer for resampler     */
+	void *sampv_conv;             /**< Sample buffer for conversion    */
+	size_t conv_sz;               /**< Conversion buffer size [bytes]  */
 	uint32_t ptime;               /**< Packet time for receiving       */
 	int pt;                       /**< Payload type for incoming RTP   */
 	double level_last;            /**< Last audio level value [dBov]   */
 	bool level_set;               /**< True if level_last is set       */
+	int squelch;                  /**< No decoding below level [dBov]  */
+	uint32_t quietc;              /**< Packets in a row below squelch  */
 	enum aufmt play_fmt;          /**< Sample format for audio playback*/
 	enum aufmt dec_fmt;           /**< Sample format for decoder       */
 	bool need_conv;               /**< Sample format conversion needed */
@@ -181,18 +192,15 @@ struct aurx {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
 		uint64_t n_discard;
+		uint64_t n_squelch;   /**< Packets not decoded, silent     */
+		uint64_t n_alloc;     /**< Heap allocations in hot path    */
 	} stats;
 
 	enum jbuf_type jbtype;       /**< Jitter buffer type               */
 	volatile int32_t wcnt;       /**< Write handler call count         */
 
 #ifdef HAVE_PTHREAD
-	struct {
-		pthread_t tid;
-		bool run;
-		pthread_cond_t cond;
-		pthread_mutex_t mutex;
-	} thr;                /**< Audio decode thread             */
+	struct workpool_job *job;     /**< Decode job on the worker pool   */
 #else
 	struct tmr tmr;       /**< Timer for audio decoding        */
 #endif
@@ -317,12 +325,7 @@ static void stop_rx(struct aurx *rx)
 
 	/* audio player must be stopped first */
 #ifdef HAVE_PTHREAD
-	if (rx->thr.run) {
-		rx->thr.run = false;
-		pthread_cond_signal(&rx->thr.cond);
-		pthread_join(rx->thr.tid, NULL);
-	}
-
+	workpool_job_cancel(rx->job);
 #else
 	tmr_cancel(&rx->tmr);
 #endif
@@ -346,19 +349,21 @@ static void audio_destructor(void *arg)
 	mem_deref(a->rx.dec);
 	mem_deref(a->tx.aubuf);
 	mem_deref(a->tx.mb);
+	mem_deref(a->tx.mb_tel);
 	mem_deref(a->tx.sampv);
 	mem_deref(a->rx.sampv);
 	mem_deref(a->rx.aubuf);
 	mem_deref(a->tx.sampv_rs);
 	mem_deref(a->rx.sampv_rs);
+	mem_deref(a->tx.sampv_conv);
+	mem_deref(a->rx.sampv_conv);
 	mem_deref(a->tx.module);
 	mem_deref(a->tx.device);
 	mem_deref(a->rx.module);
 	mem_deref(a->rx.device);
 
 #ifdef HAVE_PTHREAD
-	pthread_mutex_destroy(&a->rx.thr.mutex);
-	pthread_cond_destroy(&a->rx.thr.cond);
+	mem_deref(a->rx.job);
 #endif
 
 	list_flush(&a->tx.filtl);
@@ -575,7 +580,7 @@ static void poll_aubuf_tx(struct audio *a)
 
 		/* Convert from ausrc format to 16-bit format */
 
-		void *tmp_sampv;
+		void *tmp_sampv = tx->sampv_conv;
 
 		if (!tx->need_conv) {
 			info("audio: NOTE: source sample conversion"
@@ -584,15 +589,22 @@ static void poll_aubuf_tx(struct audio *a)
 			tx->need_conv = true;
 		}
 
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
-		if (!tmp_sampv)
-			return;
+		/* the conversion buffer is preallocated by start_source,
+		 * fall back to the heap only if it is too small */
+		if (num_bytes > tx->conv_sz) {
+			tmp_sampv = mem_zalloc(num_bytes, NULL);
+			if (!tmp_sampv)
+				return;
+
+			++tx->stats.n_alloc;
+		}
 
 		aubuf_read(tx->aubuf, tmp_sampv, num_bytes);
 
-		auconv_to_s16(sampv, tx->src_fmt, tmp_sampv, sampc);
+		dsp_to_s16(sampv, tx->src_fmt, tmp_sampv, sampc);
 
-		mem_deref(tmp_sampv);
+		if (tmp_sampv != tx->sampv_conv)
+			mem_deref(tmp_sampv);
 	}
 	else {
 		warning("audio: tx: invalid sample formats (%s -> %s)\n",
@@ -639,38 +651,34 @@ static void poll_aubuf_tx(struct audio *a)
 }
 
 
+/*
+ * @note This function has REAL-TIME properties
+ */
 static void check_telev(struct audio *a, struct autx *tx)
 {
 	const struct sdp_format *fmt;
-	struct mbuf *mb;
+	struct mbuf *mb = tx->mb_tel;
 	bool marker = false;
 	int err;
 
-	mb = mbuf_alloc(STREAM_PRESZ + 64);
-	if (!mb)
-		return;
-
 	mb->pos = mb->end = STREAM_PRESZ;
 
 	err = telev_poll(a->telev, &marker, mb);
 	if (err)
-		goto out;
+		return;
 
 	if (marker)
 		tx->ts_tel = (uint32_t)tx->ts_ext;
 
 	fmt = sdp_media_rformat(stream_sdpmedia(audio_strm(a)), telev_rtpfmt);
 	if (!fmt)
-		goto out;
+		return;
 
 	mb->pos = STREAM_PRESZ;
 	err = stream_send(a->strm, false, marker, fmt->pt, tx->ts_tel, mb);
 	if (err) {
 		warning("audio: telev: stream_send %m\n", err);
 	}
-
- out:
-	mem_deref(mb);
 }
 
 
@@ -707,25 +715,27 @@ static void auplay_write_handler(void *sampv, size_t sampc, void *arg)
 }
 
 
+/*
+ * Receive path: called from auplay_write_handler2() on the frame about to
+ * be played, to drop frames after EAGAIN and to set the silence state of
+ * the jitter buffer.
+ */
 static bool silence(const void *sampv, size_t sampc, int fmt)
 {
-	const int16_t *v;
-	int32_t sum = 0;
-	size_t i;
+	static const double q_float = (double)SILENCE_Q / (32768.0 * 32768.0);
 
-	if (fmt != AUFMT_S16LE)
-		return true;
+	switch (fmt) {
 
-	v = sampv;
+	case AUFMT_S16LE:
+		return dsp_sumsq_s16(sampv, sampc) <=
+			(uint64_t)sampc * SILENCE_Q;
 
-	for (i = 0; i < sampc; i++) {
-		sum += v[i]*v[i];
+	case AUFMT_FLOAT:
+		return dsp_sumsq_float(sampv, sampc) <= sampc * q_float;
 
-		if (sum > (int32_t) (i + 1) * SILENCE_Q)
-			return false;
+	default:
+		return true;
 	}
-
-	return true;
 }
 
 
@@ -748,45 +758,13 @@ static void audio_decode(void *arg)
 			break;
 
 #ifdef HAVE_PTHREAD
-		if (!rx->thr.run)
+		if (workpool_job_stopping(rx->job))
 			break;
 #endif
 	}
 }
 
 
-#ifdef HAVE_PTHREAD
-static void *rx_thread(void *arg)
-{
-	struct audio *a = arg;
-	struct timespec ts;
-	uint64_t ms;
-	int err = 0;
-
-	while (a->rx.thr.run) {
-
-		ms = tmr_jiffies() + 500;
-		ts.tv_sec = ms / 1000;
-		ts.tv_nsec = (ms % 1000) * 1000000UL;
-
-		err = pthread_mutex_lock(&a->rx.thr.mutex);
-		if (err)
-			return NULL;
-
-		pthread_cond_timedwait(&a->rx.thr.cond, &a->rx.thr.mutex, &ts);
-
-		err = pthread_mutex_unlock(&a->rx.thr.mutex);
-		if (!a->rx.thr.run || err)
-			break;
-
-		audio_decode(a);
-	}
-
-	return NULL;
-}
-#endif
-
-
 /*
  * Write samples to Audio Player. This version of the write handler is used
  * for the configuration jitter_buffer_type JBUF_ADAPTIVE.
@@ -832,19 +810,8 @@ static void auplay_write_handler2(void *sampv, size_t sampc, void *arg)
 
 	rx->wcnt++;
 #ifdef HAVE_PTHREAD
-	pthread_mutex_lock(&a->rx.thr.mutex);
-	if (!rx->thr.run) {
-		rx->thr.run = true;
-		err = pthread_create(&rx->thr.tid, NULL, rx_thread, a);
-		if (err) {
-			rx->thr.run = false;
-			return;
-		}
-	}
-
-	/* decode aubuf_minsz bytes in decoding thread */
-	pthread_cond_signal(&a->rx.thr.cond);
-	pthread_mutex_unlock(&a->rx.thr.mutex);
+	/* decode aubuf_minsz bytes on the shared worker pool */
+	workpool_job_post(rx->job);
 #else
 	/* decode aubuf_minsz bytes in polling thread */
 	tmr_start(&rx->tmr, 0, audio_decode, a);
@@ -1057,7 +1024,7 @@ static int aurx_stream_decode(struct aurx *rx, bool marker,
 	else if (rx->dec_fmt == AUFMT_S16LE) {
 
 		/* Convert from 16-bit to auplay format */
-		void *tmp_sampv;
+		void *tmp_sampv = rx->sampv_conv;
 		size_t num_bytes = sampc * aufmt_sample_size(rx->play_fmt);
 
 		if (!rx->need_conv) {
@@ -1068,15 +1035,22 @@ static int aurx_stream_decode(struct aurx *rx, bool marker,
 			rx->need_conv = true;
 		}
 
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
-		if (!tmp_sampv)
-			return ENOMEM;
+		/* the conversion buffer is preallocated by start_player,
+		 * fall back to the heap only if it is too small */
+		if (num_bytes > rx->conv_sz) {
+			tmp_sampv = mem_zalloc(num_bytes, NULL);
+			if (!tmp_sampv)
+				return ENOMEM;
+
+			++rx->stats.n_alloc;
+		}
 
-		auconv_from_s16(rx->play_fmt, tmp_sampv, sampv, sampc);
+		dsp_from_s16(rx->play_fmt, tmp_sampv, sampv, sampc);
 
 		err = aubuf_write(rx->aubuf, tmp_sampv, num_bytes);
 
-		mem_deref(tmp_sampv);
+		if (tmp_sampv != rx->sampv_conv)
+			mem_deref(tmp_sampv);
 
 		if (err)
 			goto out;
@@ -1102,6 +1076,7 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	struct audio *a = arg;
 	struct aurx *rx = &a->rx;
 	bool discard = false;
+	bool quiet = false;
 	size_t i;
 	int wrap;
 
@@ -1121,6 +1096,8 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 
 			a->rx.level_last = -(double)(extv[i].data[0] & 0x7f);
 			a->rx.level_set = true;
+
+			quiet = rx->squelch && rx->level_last < rx->squelch;
 		}
 		else {
 			debug("audio: rtp header ext ignored (id=%u)\n",
@@ -1191,6 +1168,14 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 		return;
 	}
 
+	/* the sender is silent, as of its RFC 6464 audio level */
+	if (!quiet)
+		rx->quietc = 0;
+	else if (++rx->quietc > SQUELCH_HANGOVER) {
+		++rx->stats.n_squelch;
+		return;
+	}
+
  out:
 	if (lostc)
 		aurx_stream_decode(&a->rx, hdr->m, mb, lostc);
@@ -1329,12 +1314,13 @@ int audio_alloc(struct audio **ap, struct list *streaml,
 	}
 
 	tx->mb = mbuf_alloc(STREAM_PRESZ + 4096);
+	tx->mb_tel = mbuf_alloc(STREAM_PRESZ + 64);
 	tx->sampv = mem_zalloc(AUDIO_SAMPSZ * aufmt_sample_size(tx->enc_fmt),
 			       NULL);
 
 	rx->sampv = mem_zalloc(AUDIO_SAMPSZ * aufmt_sample_size(rx->dec_fmt),
 			       NULL);
-	if (!tx->mb || !tx->sampv || !rx->sampv) {
+	if (!tx->mb || !tx->mb_tel || !tx->sampv || !rx->sampv) {
 		err = ENOMEM;
 		goto out;
 	}
@@ -1384,10 +1370,18 @@ int audio_alloc(struct audio **ap, struct list *streaml,
 	rx->pt     = -1;
 	rx->ptime  = ptime;
 #ifdef HAVE_PTHREAD
-	err  = pthread_mutex_init(&rx->thr.mutex, NULL);
-	err |= pthread_cond_init(&rx->thr.cond, NULL);
-	if (err)
-		goto out;
+	if (rx->jbtype == JBUF_ADAPTIVE) {
+		struct workpool *pool;
+
+		err = workpool_shared(&pool, WORKPOOL_AUDIO);
+		if (err)
+			goto out;
+
+		err = workpool_job_alloc(&rx->job, pool, audio_decode, a);
+		mem_deref(pool);
+		if (err)
+			goto out;
+	}
 #endif
 
 	a->eventh  = eventh;
@@ -1626,6 +1620,18 @@ static int start_player(struct aurx *rx, struct audio *a,
 		}
 	}
 
+	/* Optional sample format conversion, sized for the largest frame */
+	if (rx->play_fmt != rx->dec_fmt && !rx->sampv_conv) {
+
+		const size_t sz = aufmt_sample_size(rx->play_fmt);
+
+		rx->sampv_conv = mem_zalloc(AUDIO_SAMPSZ * sz, NULL);
+		if (!rx->sampv_conv)
+			return ENOMEM;
+
+		rx->conv_sz = AUDIO_SAMPSZ * sz;
+	}
+
 	/* Start Audio Player */
 	if (!rx->auplay && auplay_find(auplayl, NULL)) {
 
@@ -1732,6 +1738,18 @@ static int start_source(struct autx *tx, struct audio *a, struct list *ausrcl)
 		}
 	}
 
+	/* Optional sample format conversion, sized for the largest frame */
+	if (tx->src_fmt != tx->enc_fmt && !tx->sampv_conv) {
+
+		const size_t sz = aufmt_sample_size(tx->src_fmt);
+
+		tx->sampv_conv = mem_zalloc(AUDIO_SAMPSZ * sz, NULL);
+		if (!tx->sampv_conv)
+			return ENOMEM;
+
+		tx->conv_sz = AUDIO_SAMPSZ * sz;
+	}
+
 	/* Start Audio Source */
 	if (!tx->ausrc && ausrc_find(ausrcl, NULL) && !a->hold) {
 
@@ -2232,6 +2250,24 @@ void audio_level_put(const struct audio *au, bool tx, double lvl)
 }
 
 
+/**
+ * Skip decoding incoming RTP packets whose RFC 6464 audio level is below
+ * a threshold. Decoding goes on for a few packets after the level drops,
+ * so that the ends of words are not cut off.
+ *
+ * @param au    Audio object
+ * @param level Threshold in [dBov], e.g. -50, or 0 to decode all packets
+ */
+void audio_set_rx_squelch(struct audio *au, int level)
+{
+	if (!au)
+		return;
+
+	au->rx.squelch = min(level, 0);
+	au->rx.quietc  = 0;
+}
+
+
 /**
  * Get the last value of the audio level from incoming RTP packets
  *
@@ -2335,8 +2371,16 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  rx->auplay ? rx->auplay->ap->name : "none",
 			  rx->device,
 			  aufmt_name(rx->play_fmt));
-	err |= re_hprintf(pf, "       n_discard:%llu\n",
-			  rx->stats.n_discard);
+	err |= re_hprintf(pf, "       n_discard:%llu n_squelch:%llu\n",
+			  rx->stats.n_discard, rx->stats.n_squelch);
+	err |= re_hprintf(pf, " hot-path allocations: tx=%llu rx=%llu\n",
+			  tx->stats.n_alloc, rx->stats.n_alloc);
+#ifdef HAVE_PTHREAD
+	if (rx->job) {
+		err |= re_hprintf(pf, " decode pool: %H\n",
+				  workpool_debug, workpool_job_pool(rx->job));
+	}
+#endif
 	if (rx->level_set) {
 		err |= re_hprintf(pf, "       level %.3f dBov\n",
 				  rx->level_last);
@@ -2537,6 +2581,23 @@ bool audio_rxaubuf_started(const struct audio *au)
 }
 
 
+/**
+ * Get the number of heap allocations done in the real-time audio path.
+ * All buffers are preallocated, so this should stay zero.
+ *
+ * @param au      Audio object
+ *
+ * @return Number of allocations in the transmit and receive path
+ */
+uint64_t audio_rt_alloc_count(const struct audio *au)
+{
+	if (!au)
+		return 0;
+
+	return au->tx.stats.n_alloc + au->rx.stats.n_alloc;
+}
+
+
 /**
  * Set the audio stream on hold
  *
@@ -8,6 +8,7 @@
 #include "aulevel.h"
 #include <math.h>
 #include "rsua-rem/rem.h"
+#include "dsp.h"
 #include "log.h"
 
 
@@ -39,37 +40,19 @@
  */
 static double calc_rms(const int16_t *data, size_t len)
 {
-	double sum = 0;
-	size_t i;
-
 	if (!data || !len)
 		return .0;
 
-	for (i = 0; i < len; i++) {
-		const double sample = data[i];
-
-		sum += sample * sample;
-	}
-
-	return sqrt(sum / (double)len);
+	return sqrt((double)dsp_sumsq_s16(data, len) / (double)len);
 }
 
 
 static double calc_rms_float(const float *data, size_t len)
 {
-	double sum = 0;
-	size_t i;
-
 	if (!data || !len)
 		return .0;
 
-	for (i = 0; i < len; i++) {
-		const double sample = data[i];
-
-		sum += sample * sample;
-	}
-
-	return sqrt(sum / (double)len);
+	return sqrt(dsp_sumsq_float(data, len) / (double)len);
 }
 
 
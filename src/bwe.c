@@ -0,0 +1,778 @@
+/**
+ * @file bwe.c  Bandwidth estimation and congestion control
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include "bwe.h"
+
+
+/*
+ * A simplified Google Congestion Control (draft-ietf-rmcat-gcc-02).
+ *
+ * The receiver groups the packets by their abs-send-time and measures how
+ * the one-way delay changes from one group to the next. The slope of the
+ * accumulated delay is compared with an adaptive threshold, a growing
+ * delay means that the queue of the bottleneck fills up. The estimate is
+ * then lowered to 85% of the received rate, otherwise it grows by 8% per
+ * second. The estimate is sent back to the sender with RTCP REMB.
+ *
+ * The sender uses the lower of the REMB and a loss based rate. The loss
+ * based rate is lowered when RTCP reports more than 10% loss, and grows
+ * by 8% per report below 2%.
+ */
+
+enum {
+	AST_FRAC_BITS   = 18,        /* abs-send-time is 6.18 fixed point   */
+	AST_PERIOD      = 64000000,  /* Wrap-around of abs-send-time [us]   */
+	GROUP_LEN       = 5000,      /* Packets sent within form a group    */
+	GROUP_RESET     = 3000000,   /* Start over after a gap of [us]      */
+	TREND_WIN       = 20,        /* Groups in the trendline window      */
+	TREND_MAX_N     = 60,        /* Deltas counted to scale the trend   */
+	MAX_DELTAS      = 1000,
+	RATE_WIN        = 500000,    /* Window of the received rate [us]    */
+	FB_INTERVAL     = 1000000,   /* Regular REMB interval [us]          */
+	FB_MIN_INTERVAL = 200000,    /* REMB interval after a decrease      */
+	LOSS_INTERVAL   = 300000,    /* Loss based decrease at most [us]    */
+	LOSS_HIGH       = 26,        /* 10% in 1/256                        */
+	LOSS_LOW        = 5,         /* 2% in 1/256                         */
+};
+
+enum rc_state {
+	RC_HOLD = 0,
+	RC_INCREASE,
+	RC_DECREASE,
+};
+
+/** Packets sent in a short burst */
+struct group {
+	int64_t first;       /**< First send time [us]  */
+	int64_t send;        /**< Last send time [us]   */
+	uint64_t arrival;    /**< Last arrival [us]     */
+	bool valid;          /**< Group has packets     */
+};
+
+/** Receiver side estimator */
+struct bwe_rx {
+	uint32_t ast_last;           /**< Last abs-send-time             */
+	int64_t send_ext;            /**< Extended abs-send-time         */
+	bool ast_set;                /**< A send time was received       */
+	struct group cur;            /**< Group being received           */
+	struct group prev;           /**< Last complete group            */
+
+	double acc;                  /**< Accumulated delay [ms]         */
+	double smoothed;             /**< Smoothed accumulated delay     */
+	double xv[TREND_WIN];        /**< Arrival time [ms]              */
+	double yv[TREND_WIN];        /**< Smoothed delay [ms]            */
+	unsigned head;               /**< Next point in the window       */
+	unsigned n;                  /**< Points in the window           */
+	unsigned n_deltas;           /**< Group deltas, up to MAX_DELTAS */
+	uint64_t first_arrival;      /**< Time origin of the window      */
+	double trend;                /**< Slope of the delay             */
+	double prev_trend;           /**< Previous slope                 */
+
+	double threshold;            /**< Adaptive threshold [ms]        */
+	double time_over;            /**< Time above threshold [ms]      */
+	unsigned over_count;         /**< Groups above threshold         */
+	uint64_t thr_last;           /**< Last threshold update [us]     */
+	enum bwe_usage usage;        /**< Detected path usage            */
+
+	uint64_t rate_start;         /**< Start of the rate window [us]  */
+	uint64_t rate_bytes;         /**< Bytes in the rate window       */
+	uint32_t incoming;           /**< Received rate [bit/s]          */
+
+	enum rc_state rc;            /**< Rate control state             */
+	uint32_t estimate;           /**< Estimated bandwidth [bit/s]    */
+	uint32_t min;                /**< Lowest estimate [bit/s]        */
+	uint32_t max;                /**< Highest estimate [bit/s]       */
+	uint64_t rc_last;            /**< Last rate update [us]          */
+	bool started;                /**< The estimate is valid          */
+
+	uint64_t fb_last;            /**< Last REMB [us]                 */
+	uint32_t fb_bps;             /**< Last REMB bitrate              */
+	bool fb_now;                 /**< Send REMB without waiting      */
+
+	/** Statistics */
+	struct {
+		uint64_t packets;    /**< Packets with a send time       */
+		uint64_t overuse;    /**< Overuse detected               */
+		uint64_t remb;       /**< REMB sent                      */
+	} stats;
+};
+
+/** Sender side rate controller */
+struct bwe_tx {
+	uint32_t target;             /**< Target bitrate [bit/s]         */
+	uint32_t min;                /**< Lowest target [bit/s]          */
+	uint32_t max;                /**< Highest target [bit/s]         */
+	uint32_t remb;               /**< Last REMB, 0 if none           */
+	uint32_t loss_bps;           /**< Loss based rate [bit/s]        */
+	uint64_t loss_last;          /**< Last loss based decrease [us]  */
+	uint8_t fraction;            /**< Last fraction lost, in 1/256   */
+
+	/** Statistics */
+	struct {
+		uint64_t remb;       /**< REMB received                  */
+		uint64_t rr;         /**< Reception reports received     */
+		uint64_t decreases;  /**< Loss based decreases           */
+	} stats;
+};
+
+
+static uint32_t clamp_bps(uint64_t bps, uint32_t lo, uint32_t hi)
+{
+	if (bps < lo)
+		return lo;
+	if (bps > hi)
+		return hi;
+
+	return (uint32_t)bps;
+}
+
+
+/* extend the 24-bit abs-send-time and convert it to [us] */
+static int64_t send_time(struct bwe_rx *bwe, uint32_t ast)
+{
+	int32_t diff;
+
+	ast &= 0xffffff;
+
+	if (bwe->ast_set) {
+		diff = (ast - bwe->ast_last) & 0xffffff;
+		if (diff & 0x800000)
+			diff -= 0x1000000;
+
+		bwe->send_ext += diff;
+	}
+	else {
+		bwe->send_ext = ast;
+		bwe->ast_set  = true;
+	}
+
+	bwe->ast_last = ast;
+
+	return bwe->send_ext * 1000000 / (1 << AST_FRAC_BITS);
+}
+
+
+static void rate_measure(struct bwe_rx *bwe, uint64_t now, size_t size)
+{
+	if (!bwe->rate_start)
+		bwe->rate_start = now;
+
+	bwe->rate_bytes += size;
+
+	if (now - bwe->rate_start < RATE_WIN)
+		return;
+
+	bwe->incoming = (uint32_t)(bwe->rate_bytes * 8 * 1000000 /
+				   (now - bwe->rate_start));
+	bwe->rate_start = now;
+	bwe->rate_bytes = 0;
+}
+
+
+/* least squares slope of the smoothed delay over the arrival time */
+static void trendline_update(struct bwe_rx *bwe, double delta, double t)
+{
+	double xm = 0, ym = 0, num = 0, den = 0;
+	unsigned i;
+
+	bwe->acc     += delta;
+	bwe->smoothed = 0.9 * bwe->smoothed + 0.1 * bwe->acc;
+
+	bwe->xv[bwe->head] = t;
+	bwe->yv[bwe->head] = bwe->smoothed;
+	bwe->head = (bwe->head + 1) % TREND_WIN;
+
+	if (bwe->n < TREND_WIN)
+		++bwe->n;
+
+	if (bwe->n < TREND_WIN)
+		return;
+
+	for (i=0; i<TREND_WIN; i++) {
+		xm += bwe->xv[i];
+		ym += bwe->yv[i];
+	}
+
+	xm /= TREND_WIN;
+	ym /= TREND_WIN;
+
+	for (i=0; i<TREND_WIN; i++) {
+		num += (bwe->xv[i] - xm) * (bwe->yv[i] - ym);
+		den += (bwe->xv[i] - xm) * (bwe->xv[i] - xm);
+	}
+
+	if (den != 0)
+		bwe->trend = num / den;
+}
+
+
+static void threshold_update(struct bwe_rx *bwe, double m, uint64_t now)
+{
+	const double am = m < 0 ? -m : m;
+	double k, dt;
+
+	/* a spike, e.g. a route change, is not adapted to */
+	if (am > bwe->threshold + 15) {
+		bwe->thr_last = now;
+		return;
+	}
+
+	k  = am < bwe->threshold ? 0.039 : 0.0087;
+	dt = (double)min(now - bwe->thr_last, 100000ULL) / 1000.0;
+
+	bwe->threshold += k * (am - bwe->threshold) * dt;
+
+	if (bwe->threshold < 6)
+		bwe->threshold = 6;
+	else if (bwe->threshold > 600)
+		bwe->threshold = 600;
+
+	bwe->thr_last = now;
+}
+
+
+static void detect(struct bwe_rx *bwe, double send_delta, uint64_t now)
+{
+	const double m = min(bwe->n_deltas, (unsigned)TREND_MAX_N) *
+		bwe->trend * 4;
+
+	if (m > bwe->threshold) {
+
+		if (bwe->time_over < 0)
+			bwe->time_over = send_delta / 2;
+		else
+			bwe->time_over += send_delta;
+
+		++bwe->over_count;
+
+		if (bwe->time_over > 10 && bwe->over_count > 1 &&
+		    bwe->trend >= bwe->prev_trend) {
+
+			bwe->time_over  = 0;
+			bwe->over_count = 0;
+			bwe->usage      = BWE_OVERUSE;
+			++bwe->stats.overuse;
+		}
+	}
+	else if (m < -bwe->threshold) {
+		bwe->time_over  = -1;
+		bwe->over_count = 0;
+		bwe->usage      = BWE_UNDERUSE;
+	}
+	else {
+		bwe->time_over  = -1;
+		bwe->over_count = 0;
+		bwe->usage      = BWE_NORMAL;
+	}
+
+	bwe->prev_trend = bwe->trend;
+
+	threshold_update(bwe, m, now);
+}
+
+
+/* AIMD, the decrease is relative to what is actually received */
+static void rate_update(struct bwe_rx *bwe, uint64_t now)
+{
+	const uint64_t dt = bwe->started ?
+		min(now - bwe->rc_last, 1000000ULL) : 0;
+	uint64_t est = bwe->estimate;
+	uint64_t dec;
+
+	switch (bwe->usage) {
+
+	case BWE_NORMAL:
+		if (bwe->rc == RC_HOLD)
+			bwe->rc = RC_INCREASE;
+		break;
+
+	case BWE_OVERUSE:
+		bwe->rc = RC_DECREASE;
+		break;
+
+	case BWE_UNDERUSE:
+		bwe->rc = RC_HOLD;
+		break;
+	}
+
+	switch (bwe->rc) {
+
+	case RC_INCREASE:
+		/* do not run away from the received rate */
+		if (bwe->incoming &&
+		    est > (uint64_t)bwe->incoming * 3 / 2 + 10000)
+			break;
+
+		est += est * dt * 8 / 100 / 1000000;
+		break;
+
+	case RC_DECREASE:
+		dec = (bwe->incoming ? bwe->incoming : est) * 85 / 100;
+		if (dec < est)
+			est = dec;
+
+		bwe->rc     = RC_HOLD;
+		bwe->fb_now = true;
+		break;
+
+	default:
+		break;
+	}
+
+	bwe->estimate = clamp_bps(est, bwe->min, bwe->max);
+	bwe->rc_last  = now;
+	bwe->started  = true;
+}
+
+
+static void group_start(struct group *g, int64_t send, uint64_t now)
+{
+	g->first   = send;
+	g->send    = send;
+	g->arrival = now;
+	g->valid   = true;
+}
+
+
+static void group_delta(struct bwe_rx *bwe)
+{
+	const double send_delta = (bwe->cur.send - bwe->prev.send) / 1000.0;
+	const uint64_t t = bwe->cur.arrival;
+	double arrival_delta;
+
+	arrival_delta = (double)(t - bwe->prev.arrival) / 1000.0;
+
+	if (!bwe->n_deltas) {
+		bwe->first_arrival = t;
+		bwe->thr_last      = t;
+	}
+
+	if (bwe->n_deltas < MAX_DELTAS)
+		++bwe->n_deltas;
+
+	trendline_update(bwe, arrival_delta - send_delta,
+			 (double)(t - bwe->first_arrival) / 1000.0);
+	detect(bwe, send_delta, t);
+	rate_update(bwe, t);
+}
+
+
+/**
+ * Allocate a receiver side bandwidth estimator
+ *
+ * @param bwep      Pointer to allocated estimator
+ * @param start_bps Initial estimate [bit/s]
+ * @param min_bps   Lowest estimate [bit/s]
+ * @param max_bps   Highest estimate [bit/s]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_rx_alloc(struct bwe_rx **bwep, uint32_t start_bps,
+		 uint32_t min_bps, uint32_t max_bps)
+{
+	struct bwe_rx *bwe;
+
+	if (!bwep || !min_bps || min_bps > max_bps)
+		return EINVAL;
+
+	bwe = mem_zalloc(sizeof(*bwe), NULL);
+	if (!bwe)
+		return ENOMEM;
+
+	bwe->min       = min_bps;
+	bwe->max       = max_bps;
+	bwe->estimate  = clamp_bps(start_bps, min_bps, max_bps);
+	bwe->threshold = 12.5;
+	bwe->time_over = -1;
+
+	*bwep = bwe;
+
+	return 0;
+}
+
+
+/**
+ * Add a received packet to the estimator
+ *
+ * @param bwe  Receiver side estimator
+ * @param now  Arrival time [us]
+ * @param ast  abs-send-time of the packet, 6.18 fixed point seconds
+ * @param size Packet size [bytes]
+ */
+void bwe_rx_packet(struct bwe_rx *bwe, uint64_t now, uint32_t ast,
+		   size_t size)
+{
+	int64_t send;
+
+	if (!bwe)
+		return;
+
+	++bwe->stats.packets;
+
+	rate_measure(bwe, now, size);
+
+	send = send_time(bwe, ast);
+
+	/* after a pause the old groups tell nothing */
+	if (bwe->cur.valid && now - bwe->cur.arrival > GROUP_RESET) {
+		bwe->cur.valid  = false;
+		bwe->prev.valid = false;
+	}
+
+	if (!bwe->cur.valid) {
+		group_start(&bwe->cur, send, now);
+		return;
+	}
+
+	/* reordered, belongs to an older group */
+	if (send < bwe->cur.first)
+		return;
+
+	if (send - bwe->cur.first <= GROUP_LEN) {
+		bwe->cur.send    = max(bwe->cur.send, send);
+		bwe->cur.arrival = now;
+		return;
+	}
+
+	if (bwe->prev.valid)
+		group_delta(bwe);
+
+	bwe->prev = bwe->cur;
+	group_start(&bwe->cur, send, now);
+}
+
+
+/**
+ * Check if the estimate should be sent to the sender
+ *
+ * @param bwe  Receiver side estimator
+ * @param now  Current time [us]
+ * @param bpsp Returned estimate [bit/s]
+ *
+ * @return True if a REMB should be sent now, otherwise false
+ */
+bool bwe_rx_feedback(struct bwe_rx *bwe, uint64_t now, uint32_t *bpsp)
+{
+	uint64_t ival = FB_INTERVAL;
+
+	if (!bwe || !bpsp || !bwe->started)
+		return false;
+
+	/* a decrease is reported early */
+	if (bwe->fb_now ||
+	    (uint64_t)bwe->estimate * 100 < (uint64_t)bwe->fb_bps * 97)
+		ival = FB_MIN_INTERVAL;
+
+	if (bwe->stats.remb && now - bwe->fb_last < ival)
+		return false;
+
+	bwe->fb_last = now;
+	bwe->fb_bps  = bwe->estimate;
+	bwe->fb_now  = false;
+	++bwe->stats.remb;
+
+	*bpsp = bwe->estimate;
+
+	return true;
+}
+
+
+/**
+ * Get the current estimate of a receiver side estimator
+ *
+ * @param bwe Receiver side estimator
+ *
+ * @return Estimated bandwidth [bit/s], 0 if not estimated yet
+ */
+uint32_t bwe_rx_estimate(const struct bwe_rx *bwe)
+{
+	return bwe && bwe->started ? bwe->estimate : 0;
+}
+
+
+/**
+ * Get the detected usage of the network path
+ *
+ * @param bwe Receiver side estimator
+ *
+ * @return Path usage
+ */
+enum bwe_usage bwe_rx_usage(const struct bwe_rx *bwe)
+{
+	return bwe ? bwe->usage : BWE_NORMAL;
+}
+
+
+/**
+ * Print the state of a receiver side estimator
+ *
+ * @param pf  Print function
+ * @param bwe Receiver side estimator
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_rx_debug(struct re_printf *pf, const struct bwe_rx *bwe)
+{
+	if (!bwe)
+		return 0;
+
+	return re_hprintf(pf, "bwe rx: estimate=%u incoming=%u usage=%s"
+			  " trend=%.3f threshold=%.1f packets=%llu"
+			  " overuse=%llu remb=%llu\n",
+			  bwe_rx_estimate(bwe), bwe->incoming,
+			  bwe_usage_name(bwe->usage), bwe->trend,
+			  bwe->threshold, bwe->stats.packets,
+			  bwe->stats.overuse, bwe->stats.remb);
+}
+
+
+static void tx_update(struct bwe_tx *bwe)
+{
+	uint32_t bps = bwe->loss_bps;
+
+	if (bwe->remb && bwe->remb < bps)
+		bps = bwe->remb;
+
+	bwe->target = clamp_bps(bps, bwe->min, bwe->max);
+}
+
+
+/**
+ * Allocate a sender side rate controller
+ *
+ * @param bwep      Pointer to allocated rate controller
+ * @param start_bps Initial target [bit/s]
+ * @param min_bps   Lowest target [bit/s]
+ * @param max_bps   Highest target [bit/s]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_tx_alloc(struct bwe_tx **bwep, uint32_t start_bps,
+		 uint32_t min_bps, uint32_t max_bps)
+{
+	struct bwe_tx *bwe;
+
+	if (!bwep || !min_bps || min_bps > max_bps)
+		return EINVAL;
+
+	bwe = mem_zalloc(sizeof(*bwe), NULL);
+	if (!bwe)
+		return ENOMEM;
+
+	bwe->min      = min_bps;
+	bwe->max      = max_bps;
+	bwe->loss_bps = clamp_bps(start_bps, min_bps, max_bps);
+
+	tx_update(bwe);
+
+	*bwep = bwe;
+
+	return 0;
+}
+
+
+/**
+ * Handle a REMB from the receiver
+ *
+ * @param bwe Sender side rate controller
+ * @param bps Estimate of the receiver [bit/s]
+ */
+void bwe_tx_remb(struct bwe_tx *bwe, uint32_t bps)
+{
+	if (!bwe || !bps)
+		return;
+
+	bwe->remb = bps;
+	++bwe->stats.remb;
+
+	tx_update(bwe);
+}
+
+
+/**
+ * Handle the loss reported in an RTCP reception report
+ *
+ * @param bwe      Sender side rate controller
+ * @param now      Current time [us]
+ * @param fraction Fraction lost, in 1/256
+ */
+void bwe_tx_loss(struct bwe_tx *bwe, uint64_t now, uint8_t fraction)
+{
+	if (!bwe)
+		return;
+
+	bwe->fraction = fraction;
+	++bwe->stats.rr;
+
+	if (fraction > LOSS_HIGH) {
+
+		if (bwe->stats.decreases &&
+		    now - bwe->loss_last < LOSS_INTERVAL)
+			return;
+
+		/* rate * (1 - 0.5 * loss) */
+		bwe->loss_bps  = (uint32_t)((uint64_t)bwe->target *
+					    (512 - fraction) / 512);
+		bwe->loss_last = now;
+		++bwe->stats.decreases;
+	}
+	else if (fraction < LOSS_LOW) {
+		bwe->loss_bps = clamp_bps((uint64_t)bwe->loss_bps * 108 / 100
+					  + 1000, bwe->min, bwe->max);
+	}
+
+	tx_update(bwe);
+}
+
+
+/**
+ * Get the target bitrate of a sender side rate controller
+ *
+ * @param bwe Sender side rate controller
+ *
+ * @return Target bitrate [bit/s]
+ */
+uint32_t bwe_tx_target(const struct bwe_tx *bwe)
+{
+	return bwe ? bwe->target : 0;
+}
+
+
+/**
+ * Print the state of a sender side rate controller
+ *
+ * @param pf  Print function
+ * @param bwe Sender side rate controller
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_tx_debug(struct re_printf *pf, const struct bwe_tx *bwe)
+{
+	if (!bwe)
+		return 0;
+
+	return re_hprintf(pf, "bwe tx: target=%u remb=%u loss=%u/256"
+			  " (rate=%u) remb_rx=%llu rr=%llu decreases=%llu\n",
+			  bwe->target, bwe->remb, bwe->fraction,
+			  bwe->loss_bps, bwe->stats.remb, bwe->stats.rr,
+			  bwe->stats.decreases);
+}
+
+
+/**
+ * Get the abs-send-time of a packet
+ *
+ * @param now Send time [us]
+ *
+ * @return 24-bit abs-send-time, 6.18 fixed point seconds
+ */
+uint32_t bwe_abs_send_time(uint64_t now)
+{
+	now %= AST_PERIOD;
+
+	return (uint32_t)((now << AST_FRAC_BITS) / 1000000) & 0xffffff;
+}
+
+
+/**
+ * Encode the FCI of a REMB, Receiver Estimated Maximum Bitrate
+ * (draft-alvestrand-rmcat-remb-03)
+ *
+ * @param mb    Buffer to encode into
+ * @param bps   Estimated bitrate [bit/s]
+ * @param ssrcv SSRCs the estimate applies to
+ * @param ssrcc Number of SSRCs
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_remb_encode(struct mbuf *mb, uint32_t bps,
+		    const uint32_t *ssrcv, size_t ssrcc)
+{
+	uint32_t mant = bps;
+	uint8_t exp = 0;
+	size_t i;
+	int err;
+
+	if (!mb || (ssrcc && !ssrcv) || ssrcc > 255)
+		return EINVAL;
+
+	while (mant > 0x3ffff) {
+		mant >>= 1;
+		++exp;
+	}
+
+	err  = mbuf_write_mem(mb, (const uint8_t *)"REMB", 4);
+	err |= mbuf_write_u8(mb, (uint8_t)ssrcc);
+	err |= mbuf_write_u8(mb, exp << 2 | mant >> 16);
+	err |= mbuf_write_u16(mb, htons(mant & 0xffff));
+
+	for (i=0; i<ssrcc; i++)
+		err |= mbuf_write_u32(mb, htonl(ssrcv[i]));
+
+	return err;
+}
+
+
+/**
+ * Decode the FCI of a REMB, the buffer position is not changed
+ *
+ * @param bpsp Returned bitrate [bit/s]
+ * @param mb   Buffer with the FCI of an Application Layer Feedback
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_remb_decode(uint32_t *bpsp, const struct mbuf *mb)
+{
+	const uint8_t *p;
+	uint64_t bps;
+	uint8_t exp;
+
+	if (!bpsp || !mb)
+		return EINVAL;
+
+	if (mbuf_get_left(mb) < 8)
+		return EBADMSG;
+
+	p = mbuf_buf(mb);
+
+	if (memcmp(p, "REMB", 4))
+		return ENOENT;
+
+	if (mbuf_get_left(mb) < 8 + (size_t)p[4] * 4)
+		return EBADMSG;
+
+	exp = p[5] >> 2;
+	bps = (p[5] & 0x03) << 16 | p[6] << 8 | p[7];
+
+	if (exp >= 32)
+		bps = bps ? UINT32_MAX : 0;
+	else
+		bps <<= exp;
+
+	*bpsp = bps > UINT32_MAX ? UINT32_MAX : (uint32_t)bps;
+
+	return 0;
+}
+
+
+/**
+ * Get the name of a path usage
+ *
+ * @param usage Path usage
+ *
+ * @return Name of the usage
+ */
+const char *bwe_usage_name(enum bwe_usage usage)
+{
+	switch (usage) {
+
+	case BWE_NORMAL:   return "normal";
+	case BWE_UNDERUSE: return "underuse";
+	case BWE_OVERUSE:  return "overuse";
+	default:           return "???";
+	}
+}
@@ -0,0 +1,48 @@
+/**
+ * @file bwe.h
+ * @brief Bandwidth estimation and congestion control
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UABWE_H_INCLUDED
+#define UABWE_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+/** Detected state of the network path */
+enum bwe_usage {
+	BWE_NORMAL = 0,
+	BWE_UNDERUSE,
+	BWE_OVERUSE,
+};
+
+struct bwe_rx;
+struct bwe_tx;
+
+/* Receiver: delay based estimator */
+int  bwe_rx_alloc(struct bwe_rx **bwep, uint32_t start_bps,
+		  uint32_t min_bps, uint32_t max_bps);
+void bwe_rx_packet(struct bwe_rx *bwe, uint64_t now, uint32_t ast,
+		   size_t size);
+bool bwe_rx_feedback(struct bwe_rx *bwe, uint64_t now, uint32_t *bpsp);
+uint32_t bwe_rx_estimate(const struct bwe_rx *bwe);
+enum bwe_usage bwe_rx_usage(const struct bwe_rx *bwe);
+int  bwe_rx_debug(struct re_printf *pf, const struct bwe_rx *bwe);
+
+/* Sender: rate controller */
+int  bwe_tx_alloc(struct bwe_tx **bwep, uint32_t start_bps,
+		  uint32_t min_bps, uint32_t max_bps);
+void bwe_tx_remb(struct bwe_tx *bwe, uint32_t bps);
+void bwe_tx_loss(struct bwe_tx *bwe, uint64_t now, uint8_t fraction);
+uint32_t bwe_tx_target(const struct bwe_tx *bwe);
+int  bwe_tx_debug(struct re_printf *pf, const struct bwe_tx *bwe);
+
+/* Wire formats */
+uint32_t bwe_abs_send_time(uint64_t now);
+int  bwe_remb_encode(struct mbuf *mb, uint32_t bps,
+		     const uint32_t *ssrcv, size_t ssrcc);
+int  bwe_remb_decode(uint32_t *bpsp, const struct mbuf *mb);
+const char *bwe_usage_name(enum bwe_usage usage);
+
+#endif /* UABWE_H_INCLUDED */
@@ -15,6 +15,7 @@
 #include "audio.h"
 #include "cmd.h"
 #include "custom_hdrs.h"
+#include "lathist.h"
 #include "menc.h"
 #include "mnat.h"
 #include "mctrl.h"
@@ -63,6 +64,8 @@ struct call {
 	time_t time_start;        /**< Time when call started               */
 	time_t time_conn;         /**< Time when call initiated             */
 	time_t time_stop;         /**< Time when call stopped               */
+	uint64_t setup_start;     /**< Time when call_alloc() started [us]  */
+	uint64_t setupv[CALL_PHASE_MAX]; /**< End of the setup phases [us]  */
 	bool outgoing;            /**< True if outgoing, false if incoming  */
 	bool got_offer;           /**< Got SDP Offer from Peer              */
 	bool on_hold;             /**< True if call is on hold (local)      */
@@ -80,13 +83,60 @@ struct call {
 
 	uint32_t rtp_timeout_ms;  /**< RTP Timeout in [ms]                  */
 	uint32_t linenum;         /**< Line number from 1 to N              */
+	struct call_lines *lines; /**< Line table of the call list (ref.)   */
+	struct le he_id;          /**< Hash element by call-id              */
 	struct list custom_hdrs;  /**< List of custom headers if any        */
 };
 
 
+/** Line number table, shared by all calls in one call list */
+struct call_lines {
+	struct le he;             /**< Hash element by call list            */
+	const struct list *lst;   /**< Owning call list                     */
+	uint32_t freev[CALL_LINENUM_MAX / 32]; /**< Bitmap of free numbers  */
+	struct call *callv[CALL_LINENUM_MAX];  /**< Calls by line number    */
+};
+
+enum {
+	CALL_HASH_SIZE = 256,     /**< Buckets in the call lookup tables    */
+};
+
+static struct {
+	struct hash *ht_id;       /**< Calls by call-id                     */
+	struct hash *ht_lines;    /**< Line number tables by call list      */
+	uint32_t count;           /**< Number of active calls               */
+} calltbl;
+
+/** Call setup latency of all calls, per phase [us] */
+static struct lathist setup_histv[CALL_PHASE_MAX];
+
+
 static int send_invite(struct call *call);
 
 
+/* record the end of a setup phase, only the first one counts */
+static void setup_mark(struct call *call, enum call_phase ph)
+{
+	const uint64_t now = tmr_jiffies_usec();
+	uint64_t from;
+
+	if (call->setupv[ph])
+		return;
+
+	call->setupv[ph] = now;
+
+	if (ph == CALL_PHASE_ALLOC)
+		from = call->setup_start;
+	else
+		from = call->setupv[CALL_PHASE_ALLOC];
+
+	if (!from)
+		return;
+
+	lathist_add(&setup_histv[ph], now >= from ? now - from : 0);
+}
+
+
 static const char *state_name(enum call_state st)
 {
 	switch (st) {
@@ -277,6 +327,8 @@ static void mnat_handler(int err, uint16_t scode, const char *reason,
 		return;
 	}
 
+	setup_mark(call, CALL_PHASE_MNAT);
+
 	info("call: media-nat '%s' established/gathered\n",
 	     call->acc->mnatid);
 
@@ -389,6 +441,8 @@ static void call_destructor(void *arg)
 
 	call_stream_stop(call);
 	list_unlink(&call->le);
+	hash_unlink(&call->he_id);
+	release_linenum(call);
 	tmr_cancel(&call->tmr_dtmf);
 
 	mem_deref(call->sess);
@@ -472,6 +526,8 @@ static void menc_event_handler(enum menc_event event,
 	switch (event) {
 
 	case MENC_EVENT_SECURE:
+		setup_mark(call, CALL_PHASE_MENC);
+
 		if (strstr(prm, "audio")) {
 			stream_set_secure(audio_strm(call->audio), true);
 			stream_start(audio_strm(call->audio));
@@ -564,6 +620,8 @@ static void stream_rtpestab_handler(struct stream *strm, void *arg)
 	struct call *call = arg;
 	MAGIC_CHECK(call);
 
+	setup_mark(call, CALL_PHASE_RTP);
+
 	ua_event(call->ua, UA_EVENT_CALL_RTPESTAB, call,
 		 "%s", sdp_media_name(stream_sdpmedia(strm)));
 }
@@ -610,22 +668,138 @@ static void stream_error_handler(struct stream *strm, int err, void *arg)
 }
 
 
-static int assign_linenum(uint32_t *linenum, const struct list *lst)
+static uint32_t lines_key(const struct list *lst)
+{
+	return hash_joaat((const uint8_t *)&lst, sizeof(lst));
+}
+
+
+static bool lines_handler(struct le *le, void *arg)
+{
+	const struct call_lines *lines = le->data;
+
+	return lines->lst == arg;
+}
+
+
+static struct call_lines *lines_find(const struct list *lst)
+{
+	struct le *le;
+
+	le = hash_lookup(calltbl.ht_lines, lines_key(lst), lines_handler,
+			 (void *)lst);
+
+	return list_ledata(le);
+}
+
+
+static void lines_destructor(void *arg)
 {
+	struct call_lines *lines = arg;
+
+	hash_unlink(&lines->he);
+}
+
+
+static int lines_get(struct call_lines **linesp, const struct list *lst)
+{
+	struct call_lines *lines;
+	size_t i;
+	int err = 0;
+
+	if (!calltbl.ht_id)
+		err |= hash_alloc(&calltbl.ht_id, CALL_HASH_SIZE);
+	if (!calltbl.ht_lines)
+		err |= hash_alloc(&calltbl.ht_lines, CALL_HASH_SIZE);
+	if (err)
+		return err;
+
+	lines = lines_find(lst);
+	if (lines) {
+		*linesp = mem_ref(lines);
+		return 0;
+	}
+
+	lines = mem_zalloc(sizeof(*lines), lines_destructor);
+	if (!lines)
+		return ENOMEM;
+
+	lines->lst = lst;
+	for (i=0; i<ARRAY_SIZE(lines->freev); i++)
+		lines->freev[i] = ~0u;
+
+	for (i=0; i<CALL_LINENUM_MIN; i++)
+		lines->freev[0] &= ~(1u << i);
+
+	hash_append(calltbl.ht_lines, lines_key(lst), &lines->he, lines);
+
+	*linesp = lines;
+
+	return 0;
+}
+
+
+/* Take the lowest free line number of the call list and count the call */
+static int assign_linenum(struct call *call, const struct list *lst)
+{
+	struct call_lines *lines;
 	uint32_t num;
+	size_t i;
+	int err;
 
-	for (num=CALL_LINENUM_MIN; num<CALL_LINENUM_MAX; num++) {
+	err = lines_get(&lines, lst);
+	if (err)
+		return err;
 
-		if (!call_find_linenum(lst, num)) {
-			*linenum = num;
-			return 0;
-		}
+	for (i=0; i<ARRAY_SIZE(lines->freev); i++) {
+
+		if (!lines->freev[i])
+			continue;
+
+		num = (uint32_t)(i * 32) + __builtin_ctz(lines->freev[i]);
+
+		lines->freev[i] &= ~(1u << (num % 32));
+		lines->callv[num] = call;
+
+		call->linenum = num;
+		call->lines = lines;
+		++calltbl.count;
+
+		return 0;
 	}
 
+	mem_deref(lines);
+
 	return ENOENT;
 }
 
 
+static void release_linenum(struct call *call)
+{
+	struct call_lines *lines = call->lines;
+
+	if (!lines)
+		return;
+
+	lines->callv[call->linenum] = NULL;
+	lines->freev[call->linenum / 32] |= 1u << (call->linenum % 32);
+	call->lines = mem_deref(lines);
+
+	if (--calltbl.count == 0) {
+		calltbl.ht_id = mem_deref(calltbl.ht_id);
+		calltbl.ht_lines = mem_deref(calltbl.ht_lines);
+	}
+}
+
+
+static void index_id(struct call *call)
+{
+	hash_unlink(&call->he_id);
+	hash_append(calltbl.ht_id, hash_joaat_str(call->id),
+		    &call->he_id, call);
+}
+
+
 /**
  * Allocate a new Call state object
  *
@@ -656,6 +830,7 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	struct le *le;
 	struct stream_param stream_prm;
 	enum vidmode vidmode = prm ? prm->vidmode : VIDMODE_OFF;
+	const uint64_t setup_start = tmr_jiffies_usec();
 	bool use_video = true, got_offer = false;
 	int label = 0;
 	int err = 0;
@@ -791,7 +966,7 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 		call_enable_rtp_timeout(call, cfg->avt.rtp_timeout*1000);
 	}
 
-	err = assign_linenum(&call->linenum, lst);
+	err = assign_linenum(call, lst);
 	if (err) {
 		warning("call: could not assign linenumber\n");
 		goto out;
@@ -802,6 +977,9 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	 */
 	list_append(lst, &call->le, call);
 
+	call->setup_start = setup_start;
+	setup_mark(call, CALL_PHASE_ALLOC);
+
  out:
 	if (err)
 		mem_deref(call);
@@ -1435,6 +1613,8 @@ static int sipsess_answer_handler(const struct sip_msg *msg, void *arg)
 	if (err)
 		return err;
 
+	setup_mark(call, CALL_PHASE_SDP);
+
 	return 0;
 }
 
@@ -1449,6 +1629,8 @@ static void sipsess_estab_handler(const struct sip_msg *msg, void *arg)
 	if (call->state == CALL_STATE_ESTABLISHED)
 		return;
 
+	setup_mark(call, CALL_PHASE_ESTAB);
+
 	set_state(call, CALL_STATE_ESTABLISHED);
 
 	call_stream_start(call, true);
@@ -1727,6 +1909,8 @@ int call_accept(struct call *call, struct sipsess_sock *sess_sock,
 
 			return 0;
 		}
+
+		setup_mark(call, CALL_PHASE_SDP);
 	}
 
 	err = sipsess_accept(&call->sess, sess_sock, msg, 180, "Ringing",
@@ -1749,6 +1933,8 @@ int call_accept(struct call *call, struct sipsess_sock *sess_sock,
 	if (err)
 		return err;
 
+	index_id(call);
+
 	set_state(call, CALL_STATE_INCOMING);
 
 	/* New call */
@@ -1819,8 +2005,10 @@ static void sipsess_progr_handler(const struct sip_msg *msg, void *arg)
 	else
 		call_event_handler(call, CALL_EVENT_RINGING, call->peer_uri);
 
-	if (media)
+	if (media) {
+		setup_mark(call, CALL_PHASE_SDP);
 		update_media(call);
+	}
 }
 
 
@@ -1870,6 +2058,10 @@ static int send_invite(struct call *call)
 
 	err = str_dup(&call->id,
 		      sip_dialog_callid(sipsess_dialog(call->sess)));
+	if (err)
+		goto out;
+
+	index_id(call);
 
 	/* save call setup timer */
 	call->time_conn = time(NULL);
@@ -1913,6 +2105,141 @@ uint32_t call_setup_duration(const struct call *call)
 }
 
 
+/**
+ * Set the time when the request of an incoming call arrived, before it
+ * was admitted
+ *
+ * @param call Call object
+ * @param ts   Arrival time on the monotonic clock [us]
+ */
+void call_set_admit_time(struct call *call, uint64_t ts)
+{
+	uint64_t alloc;
+
+	if (!call || call->setupv[CALL_PHASE_ADMIT])
+		return;
+
+	alloc = call->setupv[CALL_PHASE_ALLOC];
+	if (!alloc)
+		return;
+
+	call->setupv[CALL_PHASE_ADMIT] = alloc;
+	lathist_add(&setup_histv[CALL_PHASE_ADMIT],
+		    alloc >= ts ? alloc - ts : 0);
+}
+
+
+/**
+ * Get the name of a call setup phase
+ *
+ * @param ph Call setup phase
+ *
+ * @return Name of the phase
+ */
+const char *call_phase_name(enum call_phase ph)
+{
+	switch (ph) {
+
+	case CALL_PHASE_ADMIT: return "admit";
+	case CALL_PHASE_ALLOC: return "alloc";
+	case CALL_PHASE_SDP:   return "sdp";
+	case CALL_PHASE_MNAT:  return "mnat";
+	case CALL_PHASE_MENC:  return "menc";
+	case CALL_PHASE_ESTAB: return "estab";
+	case CALL_PHASE_RTP:   return "rtp";
+	default:               return "?";
+	}
+}
+
+
+/**
+ * Get the latency histogram of a call setup phase, of all calls
+ *
+ * @param ph Call setup phase
+ *
+ * @return Latency histogram [us], NULL if no such phase
+ */
+const struct lathist *call_setup_hist(enum call_phase ph)
+{
+	if ((unsigned)ph >= CALL_PHASE_MAX)
+		return NULL;
+
+	return &setup_histv[ph];
+}
+
+
+/**
+ * Reset the call setup latency histograms
+ */
+void call_setup_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<CALL_PHASE_MAX; i++)
+		lathist_reset(&setup_histv[i]);
+}
+
+
+/**
+ * Print the call setup latency of all calls, per phase
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int call_setup_debug(struct re_printf *pf, void *unused)
+{
+	unsigned i;
+	int err;
+	(void)unused;
+
+	err = re_hprintf(pf, "Call setup latency [us]:\n");
+
+	for (i=0; i<CALL_PHASE_MAX; i++) {
+
+		err |= re_hprintf(pf, "  %-6s %H\n", call_phase_name(i),
+				  lathist_debug, &setup_histv[i]);
+	}
+
+	return err;
+}
+
+
+/**
+ * Encode the call setup latency of all calls to a dictionary, one object
+ * per phase
+ *
+ * @param od Dictionary to encode into
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int call_setup_json_api(struct odict *od)
+{
+	unsigned i;
+	int err = 0;
+
+	if (!od)
+		return EINVAL;
+
+	for (i=0; i<CALL_PHASE_MAX && !err; i++) {
+
+		struct odict *odph;
+
+		err = odict_alloc(&odph, 8);
+		if (err)
+			break;
+
+		err  = lathist_encode_dict(odph, &setup_histv[i]);
+		err |= odict_entry_add(od, call_phase_name(i),
+				       ODICT_OBJECT, odph);
+		mem_deref(odph);
+	}
+
+	return err;
+}
+
+
 /**
  * Get the audio object for the current call
  *
@@ -2263,16 +2590,29 @@ uint32_t call_linenum(const struct call *call)
  */
 struct call *call_find_linenum(const struct list *calls, uint32_t linenum)
 {
-	struct le *le;
+	struct call_lines *lines;
 
-	for (le = list_head(calls); le; le = le->next) {
-		struct call *call = le->data;
+	if (!calls || linenum >= CALL_LINENUM_MAX)
+		return NULL;
 
-		if (linenum == call->linenum)
-			return call;
-	}
+	lines = lines_find(calls);
 
-	return NULL;
+	return lines ? lines->callv[linenum] : NULL;
+}
+
+
+struct id_match {
+	const struct list *calls;
+	const char *id;
+};
+
+
+static bool id_handler(struct le *le, void *arg)
+{
+	const struct call *call = le->data;
+	const struct id_match *m = arg;
+
+	return call->le.list == m->calls && 0 == str_cmp(m->id, call->id);
 }
 
 
@@ -2286,16 +2626,24 @@ struct call *call_find_linenum(const struct list *calls, uint32_t linenum)
  */
 struct call *call_find_id(const struct list *calls, const char *id)
 {
-	struct le *le;
+	struct id_match m = {calls, id};
 
-	for (le = list_head(calls); le; le = le->next) {
-		struct call *call = le->data;
+	if (!calls || !id)
+		return NULL;
 
-		if (0 == str_cmp(id, call->id))
-			return call;
-	}
+	return list_ledata(hash_lookup(calltbl.ht_id, hash_joaat_str(id),
+				       id_handler, &m));
+}
 
-	return NULL;
+
+/**
+ * Get the number of active calls of all call lists
+ *
+ * @return Number of calls
+ */
+uint32_t call_count(void)
+{
+	return calltbl.count;
 }
 
 
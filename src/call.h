@@ -35,8 +35,22 @@ enum call_state {
 	CALL_STATE_UNKNOWN
 };
 
+/** Call setup phases, measured from the allocation of the call */
+enum call_phase {
+	CALL_PHASE_ADMIT = 0,  /**< Incoming request admitted, from arrival */
+	CALL_PHASE_ALLOC,      /**< Call allocated, from call_alloc()      */
+	CALL_PHASE_SDP,        /**< SDP offer/answer completed             */
+	CALL_PHASE_MNAT,       /**< Media NAT established                  */
+	CALL_PHASE_MENC,       /**< First stream secured                   */
+	CALL_PHASE_ESTAB,      /**< SIP session established                */
+	CALL_PHASE_RTP,        /**< First RTP received                     */
+
+	CALL_PHASE_MAX
+};
+
 struct account;
 struct call;
+struct lathist;
 
 typedef void (call_event_h)(struct call *call, enum call_event ev,
 			    const char *str, void *arg);
@@ -77,10 +91,16 @@ void          call_enable_rtp_timeout(struct call *call, uint32_t timeout_ms);
 uint32_t      call_linenum(const struct call *call);
 struct call  *call_find_linenum(const struct list *calls, uint32_t linenum);
 struct call  *call_find_id(const struct list *calls, const char *id);
+uint32_t      call_count(void);
 void call_set_current(struct list *calls, struct call *call);
 const struct list *call_get_custom_hdrs(const struct call *call);
 int call_set_media_direction(struct call *call, enum sdp_dir a,
 			     enum sdp_dir v);
+const char   *call_phase_name(enum call_phase ph);
+const struct lathist *call_setup_hist(enum call_phase ph);
+void          call_setup_reset(void);
+int           call_setup_debug(struct re_printf *pf, void *unused);
+int           call_setup_json_api(struct odict *od);
 
 
 #ifndef UAMODAPI_USE		/* Internal API */
@@ -118,6 +138,7 @@ int  call_af(const struct call *call);
 void call_set_xrtpstat(struct call *call);
 struct account *call_account(const struct call *call);
 void call_set_custom_hdrs(struct call *call, const struct list *hdrs);
+void call_set_admit_time(struct call *call, uint64_t ts);
 
 #endif /* ifndef UAMODAPI_USE */
 
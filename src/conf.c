@@ -648,6 +648,8 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 			   sizeof(cfg->sip.cert));
 	(void)conf_get_str(conf, "sip_cafile", cfg->sip.cafile,
 			   sizeof(cfg->sip.cafile));
+	(void)conf_get_u32(conf, "sip_reg_rate", &cfg->sip.reg_rate);
+	(void)conf_get_u32(conf, "sip_reg_jitter", &cfg->sip.reg_jitter);
 
 	/* Call */
 	(void)conf_get_u32(conf, "call_local_timeout",
@@ -703,6 +705,11 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 		return EINVAL;
 	}
 
+	(void)conf_get_u32(conf, "file_cache_size",
+			   &cfg->audio.file_cache_size);
+	(void)conf_get_bool(conf, "file_cache_mmap",
+			    &cfg->audio.file_cache_mmap);
+
 	/* Video */
 	(void)conf_get_csv(conf, "video_source",
 			   cfg->video.src_mod, sizeof(cfg->video.src_mod),
@@ -719,6 +726,12 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	(void)conf_get_bool(conf, "video_fullscreen", &cfg->video.fullscreen);
 
 	conf_get_vidfmt(conf, "videnc_format", &cfg->video.enc_fmt);
+	(void)conf_get_bool(conf, "video_cc", &cfg->video.cc);
+	(void)conf_get_u32(conf, "video_decode_queue",
+			   &cfg->video.dec_queue);
+	(void)conf_get_u32(conf, "video_convert_threads",
+			   &cfg->video.conv_threads);
+	(void)conf_get_u32(conf, "video_simulcast", &cfg->video.simulcast);
 
 	/* AVT - Audio/Video Transport */
 	if (0 == conf_get_u32(conf, "rtp_tos", &v))
@@ -740,6 +753,11 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 			     &cfg->avt.jbuf_wish);
 	(void)conf_get_bool(conf, "rtp_stats", &cfg->avt.rtp_stats);
 	(void)conf_get_u32(conf, "rtp_timeout", &cfg->avt.rtp_timeout);
+	(void)conf_get_u32(conf, "rtp_rx_batch", &cfg->avt.rtp_rx_batch);
+	(void)conf_get_u32(conf, "rtp_tx_batch", &cfg->avt.rtp_tx_batch);
+	(void)conf_get_u32(conf, "worker_threads", &cfg->avt.worker_threads);
+	(void)conf_get_u32(conf, "video_worker_threads",
+			   &cfg->avt.video_worker_threads);
 
 	if (err) {
 		warning("config: configure parse error (%m)\n", err);
@@ -777,6 +795,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "sip_listen\t\t%s\n"
 			 "sip_certificate\t%s\n"
 			 "sip_cafile\t\t%s\n"
+			 "sip_reg_rate\t\t%u\n"
+			 "sip_reg_jitter\t\t%u\n"
 			 "\n"
 			 "# Call\n"
 			 "call_local_timeout\t%u\n"
@@ -792,6 +812,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "auplay_channels\t\t%u\n"
 			 "ausrc_channels\t\t%u\n"
 			 "audio_level\t\t%s\n"
+			 "file_cache_size\t\t%u # in kB\n"
+			 "file_cache_mmap\t\t%s\n"
 			 "\n"
 			 "# Video\n"
 			 "video_source\t\t%s,%s\n"
@@ -801,6 +823,10 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "video_fps\t\t%.2f\n"
 			 "video_fullscreen\t%s\n"
 			 "videnc_format\t\t%s\n"
+			 "video_cc\t\t%s\n"
+			 "video_decode_queue\t%u\n"
+			 "video_convert_threads\t%u\n"
+			 "video_simulcast\t\t%u\n"
 			 "\n"
 			 "# AVT\n"
 			 "rtp_tos\t\t\t%u\n"
@@ -812,6 +838,10 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "jitter_buffer_wish\t%u\n"
 			 "rtp_stats\t\t%s\n"
 			 "rtp_timeout\t\t%u # in seconds\n"
+			 "rtp_rx_batch\t\t%u\n"
+			 "rtp_tx_batch\t\t%u\n"
+			 "worker_threads\t\t%u\n"
+			 "video_worker_threads\t%u\n"
 			 "\n"
 			 "# Network\n"
 			 "net_interface\t\t%s\n"
@@ -819,6 +849,7 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 ,
 
 			 cfg->sip.local, cfg->sip.cert, cfg->sip.cafile,
+			 cfg->sip.reg_rate, cfg->sip.reg_jitter,
 
 			 cfg->call.local_timeout,
 			 cfg->call.max_calls,
@@ -830,6 +861,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->audio.srate_play, cfg->audio.srate_src,
 			 cfg->audio.channels_play, cfg->audio.channels_src,
 			 cfg->audio.level ? "yes" : "no",
+			 cfg->audio.file_cache_size,
+			 cfg->audio.file_cache_mmap ? "yes" : "no",
 
 			 cfg->video.src_mod, cfg->video.src_dev,
 			 cfg->video.disp_mod, cfg->video.disp_dev,
@@ -837,6 +870,10 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->video.bitrate, cfg->video.fps,
 			 cfg->video.fullscreen ? "yes" : "no",
 			 vidfmt_name(cfg->video.enc_fmt),
+			 cfg->video.cc ? "yes" : "no",
+			 cfg->video.dec_queue,
+			 cfg->video.conv_threads,
+			 cfg->video.simulcast,
 
 			 cfg->avt.rtp_tos,
 			 range_print, &cfg->avt.rtp_ports,
@@ -847,6 +884,10 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->avt.jbuf_wish,
 			 cfg->avt.rtp_stats ? "yes" : "no",
 			 cfg->avt.rtp_timeout,
+			 cfg->avt.rtp_rx_batch,
+			 cfg->avt.rtp_tx_batch,
+			 cfg->avt.worker_threads,
+			 cfg->avt.video_worker_threads,
 
 			 cfg->net.ifname
 		   );
@@ -957,6 +998,8 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "#sip_listen\t\t0.0.0.0:5060\n"
 			  "#sip_certificate\tcert.pem\n"
 			  "#sip_cafile\t\t%s\n"
+			  "#sip_reg_rate\t\t50\t\t# REGISTERs/s, 0=unlimited\n"
+			  "#sip_reg_jitter\t\t10\t\t# interval spread in %%\n"
 			  "\n"
 			  "# Call\n"
 			  "call_local_timeout\t%u\n"
@@ -1003,6 +1046,10 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "video_fps\t\t%.2f\n"
 			  "video_fullscreen\tno\n"
 			  "videnc_format\t\t%s\n"
+			  "video_cc\t\tyes\t\t# REMB and loss based\n"
+			  "#video_decode_queue\t8\t\t# frames, 0 = off\n"
+			  "#video_convert_threads\t2\t\t# per frame\n"
+			  "#video_simulcast\t3\t\t# layers, 1 = off\n"
 			  ,
 			  default_video_device(),
 			  default_video_display(),
@@ -1022,6 +1069,10 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "#jitter_buffer_wish\t%u\t\t# frames for start\n"
 			  "rtp_stats\t\tno\n"
 			  "#rtp_timeout\t\t60\n"
+			  "#rtp_rx_batch\t\t16\t\t# packets per read, 0=off\n"
+			  "#rtp_tx_batch\t\t16\t\t# packets per send, 0=off\n"
+			  "#worker_threads\t\t0\t\t# audio, 0 = one per CPU\n"
+			  "#video_worker_threads\t0\t\t# 0 = one per CPU\n"
 			  "\n# Network\n"
 			  "#dns_server\t\t1.1.1.1:53\n"
 			  "#dns_server\t\t1.0.0.1:53\n"
@@ -1031,7 +1082,9 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "# Play tones\n"
 			  "#file_ausrc\t\taufile\n"
 			  "#file_srate\t\t16000\n"
-			  "#file_channels\t\t1\n",
+			  "#file_channels\t\t1\n"
+			  "#file_cache_size\t8192\t\t# kB, 0=off\n"
+			  "#file_cache_mmap\tno\t\t# no in-place edits\n",
 			  cfg->avt.jbuf_del.min, cfg->avt.jbuf_del.max,
 			  cfg->avt.jbuf_del.min + 1,
 			  default_interface_print, NULL);
@@ -1204,6 +1257,7 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "#module\t\t\t" "aubridge" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "aufile" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "ausine" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module\t\t\t" "mixer" MOD_EXT "\n");
 
 
 	(void)re_fprintf(f, "\n# Video codec Modules (in order)\n");
@@ -1306,6 +1360,7 @@ int config_write_template(const char *file, const struct config *cfg)
 
 	(void)re_fprintf(f, "\n");
 	(void)re_fprintf(f, "ctrl_tcp_listen\t\t0.0.0.0:4444 # ctrl_tcp\n");
+	(void)re_fprintf(f, "#ctrl_tcp_events\tall # ctrl_tcp\n");
 
 	(void)re_fprintf(f, "\n");
 	(void)re_fprintf(f, "evdev_device\t\t/dev/input/event0\n");
@@ -1380,12 +1435,20 @@ int config_write_template(const char *file, const struct config *cfg)
 			 "#mqtt_broker_clientid\tbaresip01\n"
 			 "#mqtt_broker_user\tuser\n"
 			 "#mqtt_broker_password\tpass\n"
-			 "#mqtt_basetopic\t\tbaresip/01\n");
+			 "#mqtt_basetopic\t\tbaresip/01\n"
+			 "#mqtt_events\t\tall\n");
 
 	(void)re_fprintf(f,
 			 "\n# sndfile\n"
 			 "#snd_path\t\t/tmp\n");
 
+	(void)re_fprintf(f,
+			 "\n# Conference mixer\n"
+			 "#mixer_srate\t\t48000\n"
+			 "#mixer_ptime\t\t20\n"
+			 "#mixer_speakers\t\t3\n"
+			 "#mixer_vad\t\t50\t# Speaker level [-dBov]\n");
+
 	(void)re_fprintf(f,
 			 "\n# EBU ACIP\n"
 			 "#ebuacip_jb_type\tfixed\t# auto,fixed\n");
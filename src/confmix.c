@@ -0,0 +1,574 @@
+/**
+ * @file confmix.c  Audio conference mixer
+ *
+ * Mixes the audio of the participants of a conference, once per packet
+ * time on the shared media clock. The mixer runs at one sample rate with
+ * one channel, the inputs and outputs of the participants are resampled
+ * as needed.
+ *
+ * Only the loudest participants, the active speakers, are mixed. The
+ * speakers are summed into a 32-bit accumulator, every speaker gets the
+ * sum without its own input and all other participants share the sum of
+ * all speakers. The cost of a packet time is therefore bounded by the
+ * number of speakers, plus reading and writing every participant once.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "confmix.h"
+#include <string.h>
+#include <pthread.h>
+#include "rsua-rem/rem.h"
+#include "auframe.h"
+#include "aulevel.h"
+#include "dsp.h"
+#include "mclock.h"
+
+
+enum {
+	MAX_SPEAKERS = 16,
+	MAX_SRATE = 48000,     /* [Hz] */
+	MAX_PTIME = 60,        /* [ms] */
+};
+
+struct confmix {
+	pthread_mutex_t mutex;        /**< Protects the participants       */
+	struct list partl;            /**< Participants                    */
+	struct mclock *mc;            /**< Media clock, when started       */
+	uint32_t srate;               /**< Mixer sample rate, mono [Hz]    */
+	uint32_t ptime;               /**< Packet time [ms]                */
+	size_t sampc;                 /**< Samples per packet time         */
+	uint32_t speakers;            /**< Maximum active speakers         */
+	double vad;                   /**< Minimum level of a speaker      */
+	int32_t *acc;                 /**< Sum of the active speakers      */
+	int16_t *mix;                 /**< Mix of all active speakers      */
+	int16_t *zero;                /**< Silence                         */
+	struct confmix_part *spkv[MAX_SPEAKERS]; /**< Active speakers      */
+	struct confmix_stats stats;   /**< Statistics                      */
+};
+
+struct confmix_part {
+	struct le le;                 /**< Element in the participants     */
+	struct confmix *mix;          /**< Conference mixer (ref.)         */
+
+	confmix_read_h *rh;           /**< Input handler                   */
+	void *rarg;                   /**< Input handler argument          */
+	confmix_level_h *levelh;      /**< Optional input level handler    */
+	void *larg;                   /**< Level handler argument          */
+	struct auresamp in_rs;        /**< Input resampler                 */
+	size_t in_sampc;              /**< Input samples per packet time   */
+	int16_t *in_buf;              /**< Input samples                   */
+	int16_t *pcm;                 /**< Input in the mixer format       */
+	double level;                 /**< Input level [dBov]              */
+	bool speaking;                /**< Active speaker in the last tick */
+
+	confmix_write_h *wh;          /**< Output handler                  */
+	void *warg;                   /**< Output handler argument         */
+	struct auresamp out_rs;       /**< Output resampler                */
+	size_t out_sampc;             /**< Output samples per packet time  */
+	int16_t *out_buf;             /**< Mix for this participant        */
+	int16_t *out_rs_buf;          /**< Mix in the output format        */
+};
+
+
+static void destructor(void *arg)
+{
+	struct confmix *mix = arg;
+
+	/* waits for a tick in progress */
+	mem_deref(mix->mc);
+
+	pthread_mutex_destroy(&mix->mutex);
+
+	mem_deref(mix->acc);
+	mem_deref(mix->mix);
+	mem_deref(mix->zero);
+}
+
+
+static void swap_buf(int16_t **a, int16_t **b)
+{
+	int16_t *t = *a;
+
+	*a = *b;
+	*b = t;
+}
+
+
+static void read_input(struct confmix *mix, struct confmix_part *p)
+{
+	p->rh(p->in_buf, p->in_sampc, p->rarg);
+
+	if (p->in_rs.resample) {
+		size_t sampc = mix->sampc;
+
+		if (auresamp(&p->in_rs, p->pcm, &sampc,
+			     p->in_buf, p->in_sampc) || sampc != mix->sampc)
+			memset(p->pcm, 0, mix->sampc * sizeof(int16_t));
+	}
+
+	if (!p->levelh || p->levelh(&p->level, p->larg))
+		p->level = aulevel_calc_dbov(AUFMT_S16LE, p->pcm, mix->sampc);
+}
+
+
+/* keep the loudest inputs, sorted by level */
+static uint32_t add_speaker(struct confmix *mix, uint32_t n,
+			    struct confmix_part *p)
+{
+	uint32_t i = n;
+
+	if (n == mix->speakers) {
+		if (p->level <= mix->spkv[n - 1]->level)
+			return n;
+		--i;
+	}
+	else {
+		++n;
+	}
+
+	while (i > 0 && mix->spkv[i - 1]->level < p->level) {
+		mix->spkv[i] = mix->spkv[i - 1];
+		--i;
+	}
+
+	mix->spkv[i] = p;
+
+	return n;
+}
+
+
+static void write_output(struct confmix *mix, struct confmix_part *p,
+			 uint64_t ts)
+{
+	struct auframe af;
+
+	if (p->speaking)
+		dsp_mix_out_s16(p->out_buf, mix->acc, p->pcm, mix->sampc);
+	else
+		memcpy(p->out_buf, mix->mix, mix->sampc * sizeof(int16_t));
+
+	if (p->out_rs.resample) {
+		size_t sampc = p->out_sampc;
+
+		if (auresamp(&p->out_rs, p->out_rs_buf, &sampc,
+			     p->out_buf, mix->sampc))
+			return;
+
+		auframe_init(&af, AUFMT_S16LE, p->out_rs_buf, sampc);
+	}
+	else {
+		auframe_init(&af, AUFMT_S16LE, p->out_buf, mix->sampc);
+	}
+
+	af.timestamp = ts;
+
+	p->wh(&af, p->warg);
+}
+
+
+/**
+ * Mix one packet time. This is called by the media clock once the mixer
+ * is started, otherwise by the owner of the mixer.
+ *
+ * @param mix Conference mixer
+ * @param ts  Timestamp of the packet time [us]
+ */
+void confmix_process(struct confmix *mix, uint64_t ts)
+{
+	uint64_t t0, t;
+	uint32_t n = 0, i;
+	struct le *le;
+
+	if (!mix)
+		return;
+
+	t0 = tmr_jiffies_usec();
+
+	pthread_mutex_lock(&mix->mutex);
+
+	/* every input is read, so that its buffer does not fill up */
+	for (le = mix->partl.head; le; le = le->next) {
+		struct confmix_part *p = le->data;
+
+		p->speaking = false;
+
+		if (!p->rh)
+			continue;
+
+		read_input(mix, p);
+
+		if (p->level >= mix->vad)
+			n = add_speaker(mix, n, p);
+	}
+
+	memset(mix->acc, 0, mix->sampc * sizeof(int32_t));
+
+	for (i=0; i<n; i++) {
+		mix->spkv[i]->speaking = true;
+		dsp_mix_add_s16(mix->acc, mix->spkv[i]->pcm, mix->sampc);
+	}
+
+	dsp_mix_out_s16(mix->mix, mix->acc, mix->zero, mix->sampc);
+
+	for (le = mix->partl.head; le; le = le->next) {
+		struct confmix_part *p = le->data;
+
+		if (p->wh)
+			write_output(mix, p, ts);
+	}
+
+	t = tmr_jiffies_usec() - t0;
+
+	++mix->stats.ticks;
+	mix->stats.speakers  += n;
+	mix->stats.tick_usec += t;
+	mix->stats.tick_max   = max(mix->stats.tick_max, t);
+
+	pthread_mutex_unlock(&mix->mutex);
+}
+
+
+static void tick_handler(uint64_t ts, void *arg)
+{
+	confmix_process(arg, ts);
+}
+
+
+/**
+ * Allocate a conference mixer
+ *
+ * @param mixp     Pointer to allocated mixer
+ * @param srate    Sample rate of the mixer [Hz]
+ * @param ptime    Packet time [ms]
+ * @param speakers Maximum number of active speakers mixed
+ * @param vad      Minimum audio level of an active speaker [dBov]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_alloc(struct confmix **mixp, uint32_t srate, uint32_t ptime,
+		  uint32_t speakers, int vad)
+{
+	struct confmix *mix;
+	int err;
+
+	if (!mixp || !srate || srate > MAX_SRATE ||
+	    !ptime || ptime > MAX_PTIME || !speakers)
+		return EINVAL;
+
+	mix = mem_zalloc(sizeof(*mix), destructor);
+	if (!mix)
+		return ENOMEM;
+
+	err = pthread_mutex_init(&mix->mutex, NULL);
+	if (err)
+		goto out;
+
+	mix->srate    = srate;
+	mix->ptime    = ptime;
+	mix->sampc    = srate * ptime / 1000;
+	mix->speakers = min(speakers, (uint32_t)MAX_SPEAKERS);
+	mix->vad      = vad;
+
+	mix->acc  = mem_zalloc(mix->sampc * sizeof(int32_t), NULL);
+	mix->mix  = mem_zalloc(mix->sampc * sizeof(int16_t), NULL);
+	mix->zero = mem_zalloc(mix->sampc * sizeof(int16_t), NULL);
+	if (!mix->acc || !mix->mix || !mix->zero)
+		err = ENOMEM;
+
+ out:
+	if (err)
+		mem_deref(mix);
+	else
+		*mixp = mix;
+
+	return err;
+}
+
+
+/**
+ * Start mixing on the shared media clock
+ *
+ * @param mix Conference mixer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_start(struct confmix *mix)
+{
+	if (!mix)
+		return EINVAL;
+
+	if (mix->mc)
+		return 0;
+
+	return mclock_alloc(&mix->mc, mix->ptime * 1000, tick_handler, mix);
+}
+
+
+/**
+ * Get the statistics of a conference mixer
+ *
+ * @param mix   Conference mixer
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_stats(const struct confmix *mix, struct confmix_stats *stats)
+{
+	struct confmix *m = (struct confmix *)mix;
+
+	if (!mix || !stats)
+		return EINVAL;
+
+	pthread_mutex_lock(&m->mutex);
+	*stats = mix->stats;
+	stats->parts = list_count(&mix->partl);
+	pthread_mutex_unlock(&m->mutex);
+
+	return 0;
+}
+
+
+/**
+ * Print the statistics of a conference mixer
+ *
+ * @param pf  Print function
+ * @param mix Conference mixer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_debug(struct re_printf *pf, const struct confmix *mix)
+{
+	struct confmix_stats st;
+
+	if (confmix_stats(mix, &st))
+		return 0;
+
+	return re_hprintf(pf, "%u Hz, %u ms, %u participants,"
+			  " speakers %.1f (max %u), mixing %llu/%llu us\n",
+			  mix->srate, mix->ptime, st.parts,
+			  st.ticks ? (double)st.speakers / st.ticks : 0.0,
+			  mix->speakers,
+			  st.ticks ? st.tick_usec / st.ticks : 0,
+			  st.tick_max);
+}
+
+
+static void part_destructor(void *arg)
+{
+	struct confmix_part *p = arg;
+
+	pthread_mutex_lock(&p->mix->mutex);
+	list_unlink(&p->le);
+	pthread_mutex_unlock(&p->mix->mutex);
+
+	mem_deref(p->in_buf);
+	mem_deref(p->pcm);
+	mem_deref(p->out_buf);
+	mem_deref(p->out_rs_buf);
+	mem_deref(p->mix);
+}
+
+
+/**
+ * Add a participant to a conference. The participant takes part in the
+ * mix once it has an input, and gets the mix once it has an output.
+ *
+ * @param partp Pointer to allocated participant
+ * @param mix   Conference mixer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_part_alloc(struct confmix_part **partp, struct confmix *mix)
+{
+	struct confmix_part *p;
+
+	if (!partp || !mix)
+		return EINVAL;
+
+	p = mem_zalloc(sizeof(*p), part_destructor);
+	if (!p)
+		return ENOMEM;
+
+	p->mix = mem_ref(mix);
+	auresamp_init(&p->in_rs);
+	auresamp_init(&p->out_rs);
+
+	pthread_mutex_lock(&mix->mutex);
+	list_append(&mix->partl, &p->le, p);
+	pthread_mutex_unlock(&mix->mutex);
+
+	*partp = p;
+
+	return 0;
+}
+
+
+/**
+ * Set the input of a participant, signed 16-bit samples
+ *
+ * @param part  Participant
+ * @param srate Input sample rate [Hz]
+ * @param ch    Input channels
+ * @param rh    Input handler, NULL to remove the input
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_part_set_input(struct confmix_part *part, uint32_t srate,
+			   uint8_t ch, confmix_read_h *rh, void *arg)
+{
+	struct confmix *mix;
+	struct auresamp rs;
+	int16_t *in_buf = NULL, *pcm = NULL;
+	size_t sampc = 0;
+	int err = 0;
+
+	if (!part)
+		return EINVAL;
+
+	mix = part->mix;
+	auresamp_init(&rs);
+
+	if (rh) {
+		if (!srate || srate > MAX_SRATE || !ch)
+			return EINVAL;
+
+		err = auresamp_setup(&rs, srate, ch, mix->srate, 1);
+		if (err)
+			return err;
+
+		sampc  = srate * ch * mix->ptime / 1000;
+		in_buf = mem_zalloc(sampc * sizeof(int16_t), NULL);
+		pcm    = rs.resample ?
+			mem_zalloc(mix->sampc * sizeof(int16_t), NULL) :
+			mem_ref(in_buf);
+		if (!in_buf || !pcm) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	pthread_mutex_lock(&mix->mutex);
+
+	part->rh       = rh;
+	part->rarg     = arg;
+	part->in_rs    = rs;
+	part->in_sampc = sampc;
+	part->speaking = false;
+
+	swap_buf(&part->in_buf, &in_buf);
+	swap_buf(&part->pcm, &pcm);
+
+	pthread_mutex_unlock(&mix->mutex);
+
+ out:
+	mem_deref(in_buf);
+	mem_deref(pcm);
+
+	return err;
+}
+
+
+/**
+ * Set the output of a participant, signed 16-bit samples
+ *
+ * @param part  Participant
+ * @param srate Output sample rate [Hz]
+ * @param ch    Output channels
+ * @param wh    Output handler, NULL to remove the output
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int confmix_part_set_output(struct confmix_part *part, uint32_t srate,
+			    uint8_t ch, confmix_write_h *wh, void *arg)
+{
+	struct confmix *mix;
+	struct auresamp rs;
+	int16_t *out_buf = NULL, *out_rs_buf = NULL;
+	size_t sampc = 0;
+	int err = 0;
+
+	if (!part)
+		return EINVAL;
+
+	mix = part->mix;
+	auresamp_init(&rs);
+
+	if (wh) {
+		if (!srate || srate > MAX_SRATE || !ch)
+			return EINVAL;
+
+		err = auresamp_setup(&rs, mix->srate, 1, srate, ch);
+		if (err)
+			return err;
+
+		sampc   = srate * ch * mix->ptime / 1000;
+		out_buf = mem_zalloc(mix->sampc * sizeof(int16_t), NULL);
+		if (!out_buf) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		if (rs.resample) {
+			out_rs_buf = mem_zalloc(sampc * sizeof(int16_t), NULL);
+			if (!out_rs_buf) {
+				err = ENOMEM;
+				goto out;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&mix->mutex);
+
+	part->wh        = wh;
+	part->warg      = arg;
+	part->out_rs    = rs;
+	part->out_sampc = sampc;
+
+	swap_buf(&part->out_buf, &out_buf);
+	swap_buf(&part->out_rs_buf, &out_rs_buf);
+
+	pthread_mutex_unlock(&mix->mutex);
+
+ out:
+	mem_deref(out_buf);
+	mem_deref(out_rs_buf);
+
+	return err;
+}
+
+
+/**
+ * Set a handler for the audio level of a participant's input. Without a
+ * level handler, the level is calculated from the input samples.
+ *
+ * @param part   Participant
+ * @param levelh Level handler, called from the mixing thread
+ * @param arg    Handler argument
+ */
+void confmix_part_set_levelh(struct confmix_part *part,
+			     confmix_level_h *levelh, void *arg)
+{
+	if (!part)
+		return;
+
+	pthread_mutex_lock(&part->mix->mutex);
+	part->levelh = levelh;
+	part->larg   = arg;
+	pthread_mutex_unlock(&part->mix->mutex);
+}
+
+
+/**
+ * Check if a participant was an active speaker in the last packet time
+ *
+ * @param part Participant
+ *
+ * @return True if speaking, otherwise false
+ */
+bool confmix_part_speaking(const struct confmix_part *part)
+{
+	return part ? part->speaking : false;
+}
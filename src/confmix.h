@@ -0,0 +1,69 @@
+/**
+ * @file confmix.h
+ * @brief Audio conference mixer
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UACONFMIX_H_INCLUDED
+#define UACONFMIX_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+struct auframe;
+struct confmix;
+struct confmix_part;
+
+/**
+ * Read the input samples of a participant, same as auplay_write_h
+ *
+ * @param sampv Buffer for the samples, in the input format
+ * @param sampc Number of samples
+ * @param arg   Handler argument
+ */
+typedef void (confmix_read_h)(void *sampv, size_t sampc, void *arg);
+
+/**
+ * Write the mix for a participant, same as ausrc_read_h
+ *
+ * @param af  Audio frame in the output format
+ * @param arg Handler argument
+ */
+typedef void (confmix_write_h)(struct auframe *af, void *arg);
+
+/**
+ * Get the audio level of a participant's input, e.g. from RFC 6464
+ *
+ * @param level Returned audio level [dBov]
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise the level is calculated from the samples
+ */
+typedef int (confmix_level_h)(double *level, void *arg);
+
+/** Statistics of a conference mixer */
+struct confmix_stats {
+	uint32_t parts;       /**< Participants                       */
+	uint64_t ticks;       /**< Packet times mixed                 */
+	uint64_t speakers;    /**< Active speakers, summed over ticks */
+	uint64_t tick_usec;   /**< Total mixing time [us]             */
+	uint64_t tick_max;    /**< Longest mixing time [us]           */
+};
+
+int  confmix_alloc(struct confmix **mixp, uint32_t srate, uint32_t ptime,
+		   uint32_t speakers, int vad);
+int  confmix_start(struct confmix *mix);
+void confmix_process(struct confmix *mix, uint64_t ts);
+int  confmix_stats(const struct confmix *mix, struct confmix_stats *stats);
+int  confmix_debug(struct re_printf *pf, const struct confmix *mix);
+
+int  confmix_part_alloc(struct confmix_part **partp, struct confmix *mix);
+int  confmix_part_set_input(struct confmix_part *part, uint32_t srate,
+			    uint8_t ch, confmix_read_h *rh, void *arg);
+int  confmix_part_set_output(struct confmix_part *part, uint32_t srate,
+			     uint8_t ch, confmix_write_h *wh, void *arg);
+void confmix_part_set_levelh(struct confmix_part *part,
+			     confmix_level_h *levelh, void *arg);
+bool confmix_part_speaking(const struct confmix_part *part);
+
+#endif /* UACONFMIX_H_INCLUDED */
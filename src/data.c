@@ -21,7 +21,9 @@ static struct config core_config = {
 		"",
 		"",
 		"",
-		""
+		"",
+		0,
+		0
 	},
 
 	/** Call config */
@@ -47,6 +49,8 @@ static struct config core_config = {
 		AUFMT_S16LE,
 		AUFMT_S16LE,
 		{20, 160},
+		8192,
+		false,
 	},
 
 	/** Video */
@@ -58,6 +62,10 @@ static struct config core_config = {
 		25,
 		true,
 		VID_FMT_YUV420P,
+		true,
+		8,
+		2,
+		1,
 	},
 
 	/** Audio/Video Transport */
@@ -70,6 +78,10 @@ static struct config core_config = {
 		{5, 10},
 		0,
 		false,
+		0,
+		0,
+		0,
+		0,
 		0
 	},
 
@@ -49,6 +49,8 @@ struct config_sip {
 	char local[64];         /**< Local SIP Address              */
 	char cert[256];         /**< SIP Certificate                */
 	char cafile[256];       /**< SIP CA-file                    */
+	uint32_t reg_rate;      /**< REGISTERs per second, 0=off    */
+	uint32_t reg_jitter;    /**< Register interval spread [%]   */
 };
 
 /** Call config */
@@ -77,6 +79,8 @@ struct config_audio {
 	int enc_fmt;            /**< Audio encoder sample format    */
 	int dec_fmt;            /**< Audio decoder sample format    */
 	struct range buffer;    /**< Audio receive buffer in [ms]   */
+	uint32_t file_cache_size;/**< File cache in [kB], 0=off     */
+	bool file_cache_mmap;   /**< Map WAV files into the cache   */
 };
 
 /** Video */
@@ -90,6 +94,10 @@ struct config_video {
 	double fps;             /**< Video framerate                */
 	bool fullscreen;        /**< Enable fullscreen display      */
 	int enc_fmt;            /**< Encoder pixelfmt (enum vidfmt) */
+	bool cc;                /**< Congestion control, REMB/loss  */
+	uint32_t dec_queue;     /**< Decode queue in frames, 0=off  */
+	uint32_t conv_threads;  /**< Threads per frame conversion   */
+	uint32_t simulcast;     /**< Simulcast layers, 1=off        */
 };
 
 /** Audio/Video Transport */
@@ -103,6 +111,10 @@ struct config_avt {
 	uint32_t jbuf_wish;     /**< Startup wish delay of frames   */
 	bool rtp_stats;         /**< Enable RTP statistics          */
 	uint32_t rtp_timeout;   /**< RTP Timeout in seconds (0=off) */
+	uint32_t rtp_rx_batch;  /**< RTP packets per read (0=off)   */
+	uint32_t rtp_tx_batch;  /**< RTP packets per send (0=off)   */
+	uint32_t worker_threads;/**< Audio worker threads, 0=auto   */
+	uint32_t video_worker_threads; /**< Video worker threads, 0=auto */
 };
 
 /** Network Configuration */
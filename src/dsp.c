@@ -0,0 +1,1020 @@
+/**
+ * @file dsp.c  Audio DSP kernels
+ *
+ * Sum of squares, peak and sample format conversion on blocks of audio
+ * samples. There is one kernel set per instruction set, the best one
+ * supported by the CPU is selected at the first use. All kernels give the
+ * same result as the scalar kernel, except for the summation order of
+ * dsp_sumsq_float().
+ *
+ * Float to S16 conversion scales by 32768, clips to the S16 range and
+ * rounds to nearest. NaN is converted to 32767.
+ *
+ * The mixing kernels add S16 samples into a 32-bit accumulator without
+ * clipping, and take one input out of the sum again with saturation to
+ * S16, so that a conference mixer gets the N-1 mix of every participant
+ * from one sum.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "dsp.h"
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "rsua-rem/rem.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define USE_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined (__aarch64__) && defined (__ARM_NEON)
+#define USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+#define S16_SCALE (32768.0f)
+
+
+/*
+ * Scalar kernels
+ */
+
+static uint64_t sumsq_s16_c(const int16_t *v, size_t n)
+{
+	uint64_t sum = 0;
+
+	while (n--) {
+		const int32_t s = *v++;
+
+		sum += (uint32_t)(s * s);
+	}
+
+	return sum;
+}
+
+
+static double sumsq_float_c(const float *v, size_t n)
+{
+	double sum = 0;
+
+	while (n--) {
+		const double s = *v++;
+
+		sum += s * s;
+	}
+
+	return sum;
+}
+
+
+static uint32_t peak_s16_c(const int16_t *v, size_t n)
+{
+	int32_t mx = 0, mn = 0;
+
+	while (n--) {
+		const int32_t s = *v++;
+
+		if (s > mx)
+			mx = s;
+		if (s < mn)
+			mn = s;
+	}
+
+	return (uint32_t)max(mx, -mn);
+}
+
+
+static float peak_float_c(const float *v, size_t n)
+{
+	float peak = 0;
+
+	while (n--) {
+		const float s = fabsf(*v++);
+
+		if (s > peak)
+			peak = s;
+	}
+
+	return peak;
+}
+
+
+static void s16_to_float_c(float *dst, const int16_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = (float)*src++ * (1.0f / S16_SCALE);
+}
+
+
+static inline int16_t float_to_s16_one(float v)
+{
+	float s = v * S16_SCALE;
+
+	if (!(s < 32767.0f))
+		s = 32767.0f;
+	else if (s < -32768.0f)
+		s = -32768.0f;
+
+	return (int16_t)lrintf(s);
+}
+
+
+static void float_to_s16_c(int16_t *dst, const float *src, size_t n)
+{
+	while (n--)
+		*dst++ = float_to_s16_one(*src++);
+}
+
+
+static void s16_to_s24_c(uint8_t *dst, const int16_t *src, size_t n)
+{
+	while (n--) {
+		const uint16_t s = (uint16_t)*src++;
+
+		*dst++ = 0;
+		*dst++ = s & 0xff;
+		*dst++ = s >> 8;
+	}
+}
+
+
+static void s24_to_s16_c(int16_t *dst, const uint8_t *src, size_t n)
+{
+	while (n--) {
+		*dst++ = (int16_t)(src[1] | src[2] << 8);
+		src += 3;
+	}
+}
+
+
+static void mix_add_s16_c(int32_t *acc, const int16_t *src, size_t n)
+{
+	while (n--)
+		*acc++ += *src++;
+}
+
+
+static void mix_out_s16_c(int16_t *dst, const int32_t *acc,
+			  const int16_t *src, size_t n)
+{
+	while (n--) {
+		int32_t s = *acc++ - *src++;
+
+		if (s > 32767)
+			s = 32767;
+		else if (s < -32768)
+			s = -32768;
+
+		*dst++ = (int16_t)s;
+	}
+}
+
+
+#ifdef USE_X86
+
+/*
+ * SSE2
+ */
+
+static TARGET_SSE2 uint64_t sumsq_s16_sse2(const int16_t *v, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	uint64_t sum[2];
+
+	for (; n >= 8; n -= 8, v += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)v);
+
+		/* pairs of squares are at most 2^31, add them unsigned */
+		const __m128i p = _mm_madd_epi16(x, x);
+
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, zero));
+	}
+
+	_mm_storeu_si128((__m128i *)sum, acc);
+
+	return sum[0] + sum[1] + sumsq_s16_c(v, n);
+}
+
+
+static TARGET_SSE2 double sumsq_float_sse2(const float *v, size_t n)
+{
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	double sum[2];
+
+	for (; n >= 4; n -= 4, v += 4) {
+		const __m128 x = _mm_loadu_ps(v);
+		const __m128d lo = _mm_cvtps_pd(x);
+		const __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(lo, lo));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(hi, hi));
+	}
+
+	_mm_storeu_pd(sum, _mm_add_pd(acc0, acc1));
+
+	return sum[0] + sum[1] + sumsq_float_c(v, n);
+}
+
+
+static TARGET_SSE2 uint32_t peak_s16_sse2(const int16_t *v, size_t n)
+{
+	__m128i mx = _mm_setzero_si128(), mn = _mm_setzero_si128();
+	int16_t mxv[8], mnv[8];
+	uint32_t peak;
+	int i;
+
+	for (; n >= 8; n -= 8, v += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)v);
+
+		mx = _mm_max_epi16(mx, x);
+		mn = _mm_min_epi16(mn, x);
+	}
+
+	_mm_storeu_si128((__m128i *)mxv, mx);
+	_mm_storeu_si128((__m128i *)mnv, mn);
+
+	peak = peak_s16_c(v, n);
+
+	for (i=0; i<8; i++) {
+		peak = max(peak, (uint32_t)mxv[i]);
+		peak = max(peak, (uint32_t)-mnv[i]);
+	}
+
+	return peak;
+}
+
+
+static TARGET_SSE2 float peak_float_sse2(const float *v, size_t n)
+{
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 acc = _mm_setzero_ps();
+	float accv[4], peak;
+	int i;
+
+	/* MAXPS returns the second operand if one is NaN */
+	for (; n >= 4; n -= 4, v += 4)
+		acc = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(v), mask), acc);
+
+	_mm_storeu_ps(accv, acc);
+
+	peak = peak_float_c(v, n);
+
+	for (i=0; i<4; i++) {
+		if (accv[i] > peak)
+			peak = accv[i];
+	}
+
+	return peak;
+}
+
+
+static TARGET_SSE2 void s16_to_float_sse2(float *dst, const int16_t *src,
+					  size_t n)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)src);
+		__m128i lo, hi;
+
+		/* sign extend to 32-bit */
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+		_mm_storeu_ps(dst,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+
+	s16_to_float_c(dst, src, n);
+}
+
+
+static inline TARGET_SSE2 __m128i float_to_s32_sse2(__m128 x)
+{
+	x = _mm_mul_ps(x, _mm_set1_ps(S16_SCALE));
+	x = _mm_min_ps(x, _mm_set1_ps(32767.0f));
+	x = _mm_max_ps(x, _mm_set1_ps(-32768.0f));
+
+	return _mm_cvtps_epi32(x);
+}
+
+
+static TARGET_SSE2 void float_to_s16_sse2(int16_t *dst, const float *src,
+					  size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		const __m128i lo = float_to_s32_sse2(_mm_loadu_ps(src));
+		const __m128i hi = float_to_s32_sse2(_mm_loadu_ps(src + 4));
+
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(lo, hi));
+	}
+
+	float_to_s16_c(dst, src, n);
+}
+
+
+static TARGET_SSE2 void mix_add_s16_sse2(int32_t *acc, const int16_t *src,
+					 size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, acc += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)src);
+		__m128i lo, hi;
+		__m128i *a = (__m128i *)acc;
+
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+		_mm_storeu_si128(a,     _mm_add_epi32(_mm_loadu_si128(a), lo));
+		_mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1),
+						      hi));
+	}
+
+	mix_add_s16_c(acc, src, n);
+}
+
+
+static TARGET_SSE2 void mix_out_s16_sse2(int16_t *dst, const int32_t *acc,
+					 const int16_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, acc += 8, dst += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)src);
+		__m128i lo, hi;
+		const __m128i *a = (const __m128i *)acc;
+
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+		/* PACKSSDW saturates to the S16 range */
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(
+				 _mm_sub_epi32(_mm_loadu_si128(a), lo),
+				 _mm_sub_epi32(_mm_loadu_si128(a + 1), hi)));
+	}
+
+	mix_out_s16_c(dst, acc, src, n);
+}
+
+
+/*
+ * AVX2 -- the S24 conversions use 128-bit byte shuffles
+ */
+
+static TARGET_AVX2 uint64_t sumsq_s16_avx2(const int16_t *v, size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	uint64_t sum[4];
+
+	for (; n >= 16; n -= 16, v += 16) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)v);
+		const __m256i p = _mm256_madd_epi16(x, x);
+
+		acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(p, zero));
+		acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(p, zero));
+	}
+
+	_mm256_storeu_si256((__m256i *)sum, acc);
+
+	return sum[0] + sum[1] + sum[2] + sum[3] + sumsq_s16_c(v, n);
+}
+
+
+static TARGET_AVX2 double sumsq_float_avx2(const float *v, size_t n)
+{
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	double sum[4];
+
+	for (; n >= 8; n -= 8, v += 8) {
+		const __m256d lo = _mm256_cvtps_pd(_mm_loadu_ps(v));
+		const __m256d hi = _mm256_cvtps_pd(_mm_loadu_ps(v + 4));
+
+		acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(lo, lo));
+		acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(hi, hi));
+	}
+
+	_mm256_storeu_pd(sum, _mm256_add_pd(acc0, acc1));
+
+	return sum[0] + sum[1] + sum[2] + sum[3] + sumsq_float_c(v, n);
+}
+
+
+static TARGET_AVX2 uint32_t peak_s16_avx2(const int16_t *v, size_t n)
+{
+	__m256i mx = _mm256_setzero_si256(), mn = _mm256_setzero_si256();
+	int16_t mxv[16], mnv[16];
+	uint32_t peak;
+	int i;
+
+	for (; n >= 16; n -= 16, v += 16) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)v);
+
+		mx = _mm256_max_epi16(mx, x);
+		mn = _mm256_min_epi16(mn, x);
+	}
+
+	_mm256_storeu_si256((__m256i *)mxv, mx);
+	_mm256_storeu_si256((__m256i *)mnv, mn);
+
+	peak = peak_s16_c(v, n);
+
+	for (i=0; i<16; i++) {
+		peak = max(peak, (uint32_t)mxv[i]);
+		peak = max(peak, (uint32_t)-mnv[i]);
+	}
+
+	return peak;
+}
+
+
+static TARGET_AVX2 float peak_float_avx2(const float *v, size_t n)
+{
+	const __m256 mask = _mm256_castsi256_ps(
+		_mm256_set1_epi32(0x7fffffff));
+	__m256 acc = _mm256_setzero_ps();
+	float accv[8], peak;
+	int i;
+
+	for (; n >= 8; n -= 8, v += 8)
+		acc = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(v), mask),
+				    acc);
+
+	_mm256_storeu_ps(accv, acc);
+
+	peak = peak_float_c(v, n);
+
+	for (i=0; i<8; i++) {
+		if (accv[i] > peak)
+			peak = accv[i];
+	}
+
+	return peak;
+}
+
+
+static TARGET_AVX2 void s16_to_float_avx2(float *dst, const int16_t *src,
+					  size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / S16_SCALE);
+
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		const __m256i x = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)src));
+
+		_mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+						    scale));
+	}
+
+	s16_to_float_c(dst, src, n);
+}
+
+
+static inline TARGET_AVX2 __m256i float_to_s32_avx2(__m256 x)
+{
+	x = _mm256_mul_ps(x, _mm256_set1_ps(S16_SCALE));
+	x = _mm256_min_ps(x, _mm256_set1_ps(32767.0f));
+	x = _mm256_max_ps(x, _mm256_set1_ps(-32768.0f));
+
+	return _mm256_cvtps_epi32(x);
+}
+
+
+static TARGET_AVX2 void float_to_s16_avx2(int16_t *dst, const float *src,
+					  size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		const __m256i lo = float_to_s32_avx2(_mm256_loadu_ps(src));
+		const __m256i hi = float_to_s32_avx2(_mm256_loadu_ps(src + 8));
+		const __m256i s = _mm256_packs_epi32(lo, hi);
+
+		_mm256_storeu_si256((__m256i *)dst,
+				    _mm256_permute4x64_epi64(s, 0xd8));
+	}
+
+	float_to_s16_c(dst, src, n);
+}
+
+
+static TARGET_AVX2 void s16_to_s24_avx2(uint8_t *dst, const int16_t *src,
+					size_t n)
+{
+	/* 8 samples to 24 bytes: 0, lo, hi, 0, lo, hi .. */
+	const __m128i sh0 = _mm_setr_epi8(-1, 0, 1, -1, 2, 3, -1, 4,
+					  5, -1, 6, 7, -1, 8, 9, -1);
+	const __m128i sh1 = _mm_setr_epi8(10, 11, -1, 12, 13, -1, 14, 15,
+					  -1, -1, -1, -1, -1, -1, -1, -1);
+
+	for (; n >= 8; n -= 8, src += 8, dst += 24) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(x, sh0));
+		_mm_storel_epi64((__m128i *)(dst + 16),
+				 _mm_shuffle_epi8(x, sh1));
+	}
+
+	s16_to_s24_c(dst, src, n);
+}
+
+
+static TARGET_AVX2 void s24_to_s16_avx2(int16_t *dst, const uint8_t *src,
+					size_t n)
+{
+	/* samples 0-4 from bytes 0-15, samples 5-7 from bytes 8-23 */
+	const __m128i sh0 = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11,
+					  13, 14, -1, -1, -1, -1, -1, -1);
+	const __m128i sh1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+					  -1, -1, 8, 9, 11, 12, 14, 15);
+
+	for (; n >= 8; n -= 8, src += 24, dst += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)src);
+		const __m128i b = _mm_loadu_si128((const __m128i *)(src + 8));
+
+		_mm_storeu_si128((__m128i *)dst,
+				 _mm_or_si128(_mm_shuffle_epi8(a, sh0),
+					      _mm_shuffle_epi8(b, sh1)));
+	}
+
+	s24_to_s16_c(dst, src, n);
+}
+
+
+static TARGET_AVX2 void mix_add_s16_avx2(int32_t *acc, const int16_t *src,
+					 size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, acc += 16) {
+		const __m256i lo = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)src));
+		const __m256i hi = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)(src + 8)));
+		__m256i *a = (__m256i *)acc;
+
+		_mm256_storeu_si256(a, _mm256_add_epi32(
+				    _mm256_loadu_si256(a), lo));
+		_mm256_storeu_si256(a + 1, _mm256_add_epi32(
+				    _mm256_loadu_si256(a + 1), hi));
+	}
+
+	mix_add_s16_c(acc, src, n);
+}
+
+
+static TARGET_AVX2 void mix_out_s16_avx2(int16_t *dst, const int32_t *acc,
+					 const int16_t *src, size_t n)
+{
+	for (; n >= 16; n -= 16, src += 16, acc += 16, dst += 16) {
+		const __m256i lo = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)src));
+		const __m256i hi = _mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)(src + 8)));
+		const __m256i *a = (const __m256i *)acc;
+		const __m256i s = _mm256_packs_epi32(
+			_mm256_sub_epi32(_mm256_loadu_si256(a), lo),
+			_mm256_sub_epi32(_mm256_loadu_si256(a + 1), hi));
+
+		_mm256_storeu_si256((__m256i *)dst,
+				    _mm256_permute4x64_epi64(s, 0xd8));
+	}
+
+	mix_out_s16_c(dst, acc, src, n);
+}
+
+#endif /* USE_X86 */
+
+
+#ifdef USE_NEON
+
+/*
+ * NEON (AArch64)
+ */
+
+static uint64_t sumsq_s16_neon(const int16_t *v, size_t n)
+{
+	int64x2_t acc = vdupq_n_s64(0);
+
+	for (; n >= 8; n -= 8, v += 8) {
+		const int16x8_t x = vld1q_s16(v);
+
+		acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(x),
+						 vget_low_s16(x)));
+		acc = vpadalq_s32(acc, vmull_high_s16(x, x));
+	}
+
+	return (uint64_t)vaddvq_s64(acc) + sumsq_s16_c(v, n);
+}
+
+
+static double sumsq_float_neon(const float *v, size_t n)
+{
+	float64x2_t acc0 = vdupq_n_f64(0), acc1 = vdupq_n_f64(0);
+
+	for (; n >= 4; n -= 4, v += 4) {
+		const float32x4_t x = vld1q_f32(v);
+		const float64x2_t lo = vcvt_f64_f32(vget_low_f32(x));
+		const float64x2_t hi = vcvt_high_f64_f32(x);
+
+		acc0 = vaddq_f64(acc0, vmulq_f64(lo, lo));
+		acc1 = vaddq_f64(acc1, vmulq_f64(hi, hi));
+	}
+
+	return vaddvq_f64(vaddq_f64(acc0, acc1)) + sumsq_float_c(v, n);
+}
+
+
+static uint32_t peak_s16_neon(const int16_t *v, size_t n)
+{
+	int16x8_t mx = vdupq_n_s16(0), mn = vdupq_n_s16(0);
+	int32_t peak;
+
+	for (; n >= 8; n -= 8, v += 8) {
+		const int16x8_t x = vld1q_s16(v);
+
+		mx = vmaxq_s16(mx, x);
+		mn = vminq_s16(mn, x);
+	}
+
+	peak = max((int32_t)vmaxvq_s16(mx), -(int32_t)vminvq_s16(mn));
+
+	return max((uint32_t)peak, peak_s16_c(v, n));
+}
+
+
+static float peak_float_neon(const float *v, size_t n)
+{
+	float32x4_t acc = vdupq_n_f32(0);
+	float peak, tail;
+
+	/* FMAXNM returns the number if one operand is NaN */
+	for (; n >= 4; n -= 4, v += 4)
+		acc = vmaxnmq_f32(acc, vabsq_f32(vld1q_f32(v)));
+
+	peak = vmaxnmvq_f32(acc);
+	tail = peak_float_c(v, n);
+
+	return tail > peak ? tail : peak;
+}
+
+
+static void s16_to_float_neon(float *dst, const int16_t *src, size_t n)
+{
+	const float scale = 1.0f / S16_SCALE;
+
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		const int16x8_t x = vld1q_s16(src);
+		const int32x4_t lo = vmovl_s16(vget_low_s16(x));
+		const int32x4_t hi = vmovl_high_s16(x);
+
+		vst1q_f32(dst,     vmulq_n_f32(vcvtq_f32_s32(lo), scale));
+		vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_s32(hi), scale));
+	}
+
+	s16_to_float_c(dst, src, n);
+}
+
+
+static inline int32x4_t float_to_s32_neon(float32x4_t x)
+{
+	x = vmulq_n_f32(x, S16_SCALE);
+	x = vminnmq_f32(x, vdupq_n_f32(32767.0f));
+	x = vmaxq_f32(x, vdupq_n_f32(-32768.0f));
+
+	return vcvtnq_s32_f32(x);
+}
+
+
+static void float_to_s16_neon(int16_t *dst, const float *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		const int32x4_t lo = float_to_s32_neon(vld1q_f32(src));
+		const int32x4_t hi = float_to_s32_neon(vld1q_f32(src + 4));
+
+		vst1q_s16(dst, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+
+	float_to_s16_c(dst, src, n);
+}
+
+
+static void s16_to_s24_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 24) {
+		const uint8x16_t x = vreinterpretq_u8_s16(vld1q_s16(src));
+		uint8x8x3_t o;
+
+		o.val[0] = vdup_n_u8(0);
+		o.val[1] = vuzp1_u8(vget_low_u8(x), vget_high_u8(x));
+		o.val[2] = vuzp2_u8(vget_low_u8(x), vget_high_u8(x));
+
+		vst3_u8(dst, o);
+	}
+
+	s16_to_s24_c(dst, src, n);
+}
+
+
+static void s24_to_s16_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 24, dst += 8) {
+		const uint8x8x3_t x = vld3_u8(src);
+		const uint8x8x2_t o = vzip_u8(x.val[1], x.val[2]);
+
+		vst1q_s16(dst, vreinterpretq_s16_u8(vcombine_u8(o.val[0],
+								o.val[1])));
+	}
+
+	s24_to_s16_c(dst, src, n);
+}
+
+
+static void mix_add_s16_neon(int32_t *acc, const int16_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, acc += 8) {
+		const int16x8_t x = vld1q_s16(src);
+
+		vst1q_s32(acc,     vaddw_s16(vld1q_s32(acc), vget_low_s16(x)));
+		vst1q_s32(acc + 4, vaddw_high_s16(vld1q_s32(acc + 4), x));
+	}
+
+	mix_add_s16_c(acc, src, n);
+}
+
+
+static void mix_out_s16_neon(int16_t *dst, const int32_t *acc,
+			     const int16_t *src, size_t n)
+{
+	for (; n >= 8; n -= 8, src += 8, acc += 8, dst += 8) {
+		const int16x8_t x = vld1q_s16(src);
+		const int32x4_t lo = vsubw_s16(vld1q_s32(acc),
+					       vget_low_s16(x));
+		const int32x4_t hi = vsubw_high_s16(vld1q_s32(acc + 4), x);
+
+		vst1q_s16(dst, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+
+	mix_out_s16_c(dst, acc, src, n);
+}
+
+#endif /* USE_NEON */
+
+
+static const struct dsp_kernel kernel_c = {
+	"c",
+	sumsq_s16_c, sumsq_float_c, peak_s16_c, peak_float_c,
+	s16_to_float_c, float_to_s16_c, s16_to_s24_c, s24_to_s16_c,
+	mix_add_s16_c, mix_out_s16_c
+};
+
+#ifdef USE_X86
+static const struct dsp_kernel kernel_sse2 = {
+	"sse2",
+	sumsq_s16_sse2, sumsq_float_sse2, peak_s16_sse2, peak_float_sse2,
+	s16_to_float_sse2, float_to_s16_sse2, s16_to_s24_c, s24_to_s16_c,
+	mix_add_s16_sse2, mix_out_s16_sse2
+};
+
+static const struct dsp_kernel kernel_avx2 = {
+	"avx2",
+	sumsq_s16_avx2, sumsq_float_avx2, peak_s16_avx2, peak_float_avx2,
+	s16_to_float_avx2, float_to_s16_avx2, s16_to_s24_avx2,
+	s24_to_s16_avx2, mix_add_s16_avx2, mix_out_s16_avx2
+};
+#endif
+
+#ifdef USE_NEON
+static const struct dsp_kernel kernel_neon = {
+	"neon",
+	sumsq_s16_neon, sumsq_float_neon, peak_s16_neon, peak_float_neon,
+	s16_to_float_neon, float_to_s16_neon, s16_to_s24_neon,
+	s24_to_s16_neon, mix_add_s16_neon, mix_out_s16_neon
+};
+#endif
+
+
+/* supported kernels, in order of preference -- the scalar kernel is last */
+static const struct dsp_kernel *kernelv[4];
+static size_t kernelc;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+
+static void kernel_init(void)
+{
+#ifdef USE_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		kernelv[kernelc++] = &kernel_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		kernelv[kernelc++] = &kernel_sse2;
+#endif
+
+#ifdef USE_NEON
+	kernelv[kernelc++] = &kernel_neon;
+#endif
+
+	kernelv[kernelc++] = &kernel_c;
+}
+
+
+/**
+ * Get the DSP kernel set in use
+ *
+ * @return Fastest kernel set supported by the CPU
+ */
+const struct dsp_kernel *dsp_kernel(void)
+{
+	pthread_once(&kernel_once, kernel_init);
+
+	return kernelv[0];
+}
+
+
+/**
+ * Get a supported DSP kernel set by index, for testing and benchmarks
+ *
+ * @param i Index, 0 is the kernel set in use and the last is scalar
+ *
+ * @return Kernel set, or NULL if the index is out of range
+ */
+const struct dsp_kernel *dsp_kernel_get(size_t i)
+{
+	pthread_once(&kernel_once, kernel_init);
+
+	return i < kernelc ? kernelv[i] : NULL;
+}
+
+
+/**
+ * Calculate the sum of squares of signed 16-bit samples
+ *
+ * @param v Samples
+ * @param n Number of samples
+ *
+ * @return Sum of squares, without overflow
+ */
+uint64_t dsp_sumsq_s16(const int16_t *v, size_t n)
+{
+	if (!v || !n)
+		return 0;
+
+	return dsp_kernel()->sumsq_s16(v, n);
+}
+
+
+/**
+ * Calculate the sum of squares of float samples
+ *
+ * @param v Samples
+ * @param n Number of samples
+ *
+ * @return Sum of squares
+ */
+double dsp_sumsq_float(const float *v, size_t n)
+{
+	if (!v || !n)
+		return 0;
+
+	return dsp_kernel()->sumsq_float(v, n);
+}
+
+
+/**
+ * Get the peak magnitude of signed 16-bit samples
+ *
+ * @param v Samples
+ * @param n Number of samples
+ *
+ * @return Peak magnitude, from 0 to 32768
+ */
+uint32_t dsp_peak_s16(const int16_t *v, size_t n)
+{
+	if (!v || !n)
+		return 0;
+
+	return dsp_kernel()->peak_s16(v, n);
+}
+
+
+/**
+ * Get the peak magnitude of float samples, NaN is ignored
+ *
+ * @param v Samples
+ * @param n Number of samples
+ *
+ * @return Peak magnitude
+ */
+float dsp_peak_float(const float *v, size_t n)
+{
+	if (!v || !n)
+		return 0;
+
+	return dsp_kernel()->peak_float(v, n);
+}
+
+
+/**
+ * Convert samples to signed 16-bit
+ *
+ * @param dst Destination buffer, for n S16 samples
+ * @param fmt Source sample format (enum aufmt)
+ * @param src Source samples
+ * @param n   Number of samples
+ */
+void dsp_to_s16(int16_t *dst, int fmt, const void *src, size_t n)
+{
+	if (!dst || !src)
+		return;
+
+	switch (fmt) {
+
+	case AUFMT_S16LE:
+		if (dst != src)
+			memmove(dst, src, n * sizeof(int16_t));
+		break;
+
+	case AUFMT_FLOAT:
+		dsp_kernel()->float_to_s16(dst, src, n);
+		break;
+
+	case AUFMT_S24_3LE:
+		dsp_kernel()->s24_to_s16(dst, src, n);
+		break;
+
+	default:
+		auconv_to_s16(dst, fmt, (void *)src, n);
+		break;
+	}
+}
+
+
+/**
+ * Convert signed 16-bit samples to another sample format
+ *
+ * @param fmt Destination sample format (enum aufmt)
+ * @param dst Destination buffer, for n samples of fmt
+ * @param src Source samples
+ * @param n   Number of samples
+ */
+void dsp_from_s16(int fmt, void *dst, const int16_t *src, size_t n)
+{
+	if (!dst || !src)
+		return;
+
+	switch (fmt) {
+
+	case AUFMT_S16LE:
+		if (dst != src)
+			memmove(dst, src, n * sizeof(int16_t));
+		break;
+
+	case AUFMT_FLOAT:
+		dsp_kernel()->s16_to_float(dst, src, n);
+		break;
+
+	case AUFMT_S24_3LE:
+		dsp_kernel()->s16_to_s24(dst, src, n);
+		break;
+
+	default:
+		auconv_from_s16(fmt, dst, src, n);
+		break;
+	}
+}
+
+
+/**
+ * Add signed 16-bit samples to a mixing accumulator
+ *
+ * @param acc Accumulator of n samples
+ * @param src Samples to add
+ * @param n   Number of samples
+ */
+void dsp_mix_add_s16(int32_t *acc, const int16_t *src, size_t n)
+{
+	if (!acc || !src)
+		return;
+
+	dsp_kernel()->mix_add_s16(acc, src, n);
+}
+
+
+/**
+ * Get a mix from an accumulator, without one of the inputs, saturated to
+ * signed 16-bit
+ *
+ * @param dst Destination buffer for n samples, may be the same as src
+ * @param acc Accumulator of n samples
+ * @param src Samples to take out of the mix
+ * @param n   Number of samples
+ */
+void dsp_mix_out_s16(int16_t *dst, const int32_t *acc, const int16_t *src,
+		     size_t n)
+{
+	if (!dst || !acc || !src)
+		return;
+
+	dsp_kernel()->mix_out_s16(dst, acc, src, n);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file dsp.h
+ * @brief Audio DSP kernels
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UADSP_H_INCLUDED
+#define UADSP_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+
+/** A set of audio DSP kernels for one instruction set */
+struct dsp_kernel {
+	const char *name;
+
+	uint64_t (*sumsq_s16)(const int16_t *v, size_t n);
+	double   (*sumsq_float)(const float *v, size_t n);
+	uint32_t (*peak_s16)(const int16_t *v, size_t n);
+	float    (*peak_float)(const float *v, size_t n);
+
+	void (*s16_to_float)(float *dst, const int16_t *src, size_t n);
+	void (*float_to_s16)(int16_t *dst, const float *src, size_t n);
+	void (*s16_to_s24)(uint8_t *dst, const int16_t *src, size_t n);
+	void (*s24_to_s16)(int16_t *dst, const uint8_t *src, size_t n);
+
+	void (*mix_add_s16)(int32_t *acc, const int16_t *src, size_t n);
+	void (*mix_out_s16)(int16_t *dst, const int32_t *acc,
+			    const int16_t *src, size_t n);
+};
+
+const struct dsp_kernel *dsp_kernel(void);
+const struct dsp_kernel *dsp_kernel_get(size_t i);
+
+uint64_t dsp_sumsq_s16(const int16_t *v, size_t n);
+uint32_t dsp_peak_s16(const int16_t *v, size_t n);
+float    dsp_peak_float(const float *v, size_t n);
+void     dsp_to_s16(int16_t *dst, int fmt, const void *src, size_t n);
+void     dsp_mix_add_s16(int32_t *acc, const int16_t *src, size_t n);
+void     dsp_mix_out_s16(int16_t *dst, const int32_t *acc,
+			 const int16_t *src, size_t n);
+
+
+#ifndef UAMODAPI_USE		/* Internal API */
+
+double   dsp_sumsq_float(const float *v, size_t n);
+void     dsp_from_s16(int fmt, void *dst, const int16_t *src, size_t n);
+
+#endif /* ifndef UAMODAPI_USE */
+
+#endif /* UADSP_H_INCLUDED */
@@ -20,6 +20,7 @@
 #include "mnat.h"
 #include "net.h"
 #include "reg.h"
+#include "regsched.h"
 #include "sipreq.h"
 
 /** Magic number */
@@ -43,6 +44,10 @@ struct ua {
 	bool catchall;               /**< Catch all inbound requests         */
 	struct list hdr_filter;      /**< Filter for incoming headers        */
 	struct list custom_hdrs;     /**< List of outgoing headers           */
+	struct le he_cuser;          /**< Hash element by contact user       */
+	struct le he_user;           /**< Hash element by local URI user     */
+	struct le he_aor;            /**< Hash element by AOR                */
+	struct list paraml;          /**< Indexed address parameters         */
 };
 
 struct ua_xhdr_filter {
@@ -50,6 +55,19 @@ struct ua_xhdr_filter {
 	char *hdr_name;
 };
 
+/** Address parameter of a User-Agent, indexed by name */
+struct ua_param {
+	struct le le;                /**< Element in ua->paraml              */
+	struct le he;                /**< Hash element by parameter name     */
+	struct ua *ua;               /**< Parent User-Agent                  */
+	struct pl name;              /**< Parameter name                     */
+	struct pl val;               /**< Parameter value (optional)         */
+};
+
+enum {
+	UAG_HASH_SIZE = 1024,        /**< Buckets in the UA lookup tables    */
+};
+
 static struct {
 	struct config_sip *cfg;        /**< SIP configuration               */
 	struct list ual;               /**< List of User-Agents (struct ua) */
@@ -66,6 +84,12 @@ static struct {
 	ua_exit_h *exith;              /**< UA Exit handler                 */
 	void *arg;                     /**< UA Exit handler argument        */
 	char *eprm;                    /**< Extra UA parameters             */
+	struct hash *ht_cuser;         /**< UAs by contact user             */
+	struct hash *ht_user;          /**< UAs by local URI user           */
+	struct hash *ht_aor;           /**< UAs by Address-of-Record        */
+	struct hash *ht_param;         /**< UA address params by name       */
+	uint32_t catchallc;            /**< Number of catchall UAs          */
+	struct regsched *regsched;     /**< Register scheduler              */
 #ifdef USE_TLS
 	struct tls *tls;               /**< re: TLS Context                 */
 #endif
@@ -85,6 +109,12 @@ static struct {
 	NULL,
 	NULL,
 	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	0,
+	NULL,
 #ifdef USE_TLS
 	NULL,
 #endif
@@ -96,6 +126,13 @@ static void ua_destructor(void *arg)
 	struct ua *ua = arg;
 
 	list_unlink(&ua->le);
+	list_unlink(&ua->he_cuser);
+	list_unlink(&ua->he_user);
+	list_unlink(&ua->he_aor);
+	list_flush(&ua->paraml);
+
+	if (ua->catchall)
+		--uag.catchallc;
 
 	if (!list_isempty(&ua->regl))
 		ua_event(ua, UA_EVENT_UNREGISTERING, NULL, NULL);
@@ -707,6 +744,85 @@ static void add_extension(struct ua *ua, const char *extension)
 }
 
 
+static void ua_param_destructor(void *arg)
+{
+	struct ua_param *prm = arg;
+
+	list_unlink(&prm->he);
+}
+
+
+static int param_index_handler(const struct pl *name, const struct pl *val,
+			       void *arg)
+{
+	struct ua *ua = arg;
+	struct ua_param *prm;
+
+	prm = mem_zalloc(sizeof(*prm), ua_param_destructor);
+	if (!prm)
+		return ENOMEM;
+
+	prm->ua   = ua;
+	prm->name = *name;
+	prm->val  = *val;
+
+	list_append(&ua->paraml, &prm->le, prm);
+	hash_append(uag.ht_param, hash_joaat_pl_ci(name), &prm->he, prm);
+
+	return 0;
+}
+
+
+static int uag_index_alloc(void)
+{
+	int err;
+
+	if (uag.ht_cuser)
+		return 0;
+
+	err  = hash_alloc(&uag.ht_cuser, UAG_HASH_SIZE);
+	err |= hash_alloc(&uag.ht_user, UAG_HASH_SIZE);
+	err |= hash_alloc(&uag.ht_aor, UAG_HASH_SIZE);
+	err |= hash_alloc(&uag.ht_param, UAG_HASH_SIZE);
+	if (err) {
+		uag.ht_cuser = mem_deref(uag.ht_cuser);
+		uag.ht_user  = mem_deref(uag.ht_user);
+		uag.ht_aor   = mem_deref(uag.ht_aor);
+		uag.ht_param = mem_deref(uag.ht_param);
+	}
+
+	return err;
+}
+
+
+/*
+ * Add the User-Agent to the lookup tables used by uag_find(),
+ * uag_find_aor() and uag_find_param(). The UA is appended, so the
+ * first-match order of the lookups is the UA allocation order.
+ */
+static int ua_index(struct ua *ua)
+{
+	struct sip_addr *laddr = account_laddr(ua->acc);
+	int err;
+
+	err = uag_index_alloc();
+	if (err)
+		return err;
+
+	hash_append(uag.ht_cuser, hash_joaat_str_ci(ua->cuser),
+		    &ua->he_cuser, ua);
+	hash_append(uag.ht_user, hash_joaat_pl_ci(&ua->acc->luri.user),
+		    &ua->he_user, ua);
+	hash_append(uag.ht_aor, hash_joaat_str_ci(ua->acc->aor),
+		    &ua->he_aor, ua);
+
+	if (!laddr)
+		return 0;
+
+	return uri_params_apply(&laddr->params, param_index_handler, ua);
+}
+
+
 static int create_register_clients(struct ua *ua)
 {
 	int err = 0;
@@ -813,6 +929,10 @@ int ua_alloc(struct ua **uap, const char *aor)
 	if (err)
 		goto out;
 
+	err = ua_index(ua);
+	if (err)
+		goto out;
+
 	list_append(&uag.ual, &ua->le, ua);
 
 	if (!uag_current())
@@ -1318,6 +1438,7 @@ int ua_state_json_api(struct odict *od, const struct ua *ua)
 {
 	struct odict *reg = NULL;
 	struct odict *cfg = NULL;
+	struct odict *setup = NULL;
 	struct le *le;
 	size_t i = 0;
 	int err = 0;
@@ -1327,6 +1448,7 @@ int ua_state_json_api(struct odict *od, const struct ua *ua)
 
 	err |= odict_alloc(&reg, 8);
 	err |= odict_alloc(&cfg, 8);
+	err |= odict_alloc(&setup, 8);
 
 	/* user-agent info */
 	err |= odict_entry_add(od, "cuser", ODICT_STRING, ua->cuser);
@@ -1354,12 +1476,17 @@ int ua_state_json_api(struct odict *od, const struct ua *ua)
 	if (err)
 		warning("ua: failed to encode json registration (%m)\n", err);
 
+	/* call setup latency, of all user-agents */
+	err |= call_setup_json_api(setup);
+
 	/* package */
 	err |= odict_entry_add(od, "settings", ODICT_OBJECT, cfg);
 	err |= odict_entry_add(od, "registration", ODICT_OBJECT, reg);
+	err |= odict_entry_add(od, "call_setup", ODICT_OBJECT, setup);
 	if (err)
 		warning("ua: failed to encode json package (%m)\n", err);
 
+	mem_deref(setup);
 	mem_deref(cfg);
 	mem_deref(reg);
 	return err;
@@ -1516,6 +1643,7 @@ static void sipsess_conn_handler(const struct sip_msg *msg, void *arg)
 	const struct network *net = data_network();
 	const struct sip_hdr *hdr;
 	int af_sdp;
+	const uint64_t ts = tmr_jiffies_usec();
 	struct ua *ua;
 	struct call *call = NULL;
 	char to_uri[256];
@@ -1589,6 +1717,8 @@ static void sipsess_conn_handler(const struct sip_msg *msg, void *arg)
 		goto error;
 	}
 
+	call_set_admit_time(call, ts);
+
 	if (!list_isempty(&ua->hdr_filter)) {
 		struct list hdrs;
 		struct le *le;
@@ -1736,6 +1866,11 @@ int ua_init(const char *software, bool udp, bool tcp, bool tls)
 
 	list_init(&uag.ual);
 
+	err = regsched_alloc(&uag.regsched, cfg->sip.reg_rate,
+			     cfg->sip.reg_jitter);
+	if (err)
+		goto out;
+
 	err = sip_alloc(&uag.sip, net_dnsc(net), bsize, bsize, bsize,
 			software, exit_handler, NULL);
 	if (err) {
@@ -1786,6 +1921,19 @@ void ua_close(void)
 #endif
 
 	list_flush(&uag.ual);
+
+	uag.regsched = mem_deref(uag.regsched);
+
+	/* UAs with external references may outlive the lookup tables */
+	hash_clear(uag.ht_cuser);
+	hash_clear(uag.ht_user);
+	hash_clear(uag.ht_aor);
+	hash_clear(uag.ht_param);
+
+	uag.ht_cuser = mem_deref(uag.ht_cuser);
+	uag.ht_user  = mem_deref(uag.ht_user);
+	uag.ht_aor   = mem_deref(uag.ht_aor);
+	uag.ht_param = mem_deref(uag.ht_param);
 }
 
 
@@ -1966,6 +2114,18 @@ struct sip *uag_sip(void)
 }
 
 
+/**
+ * Get the register scheduler, which paces the REGISTER requests of all
+ * User-Agents
+ *
+ * @return Register scheduler
+ */
+struct regsched *uag_regsched(void)
+{
+	return uag.regsched;
+}
+
+
 /**
  * Get the global SIP Session socket
  *
@@ -1988,6 +2148,22 @@ struct sipevent_sock *uag_sipevent_sock(void)
 }
 
 
+static bool cuser_handler(struct le *le, void *arg)
+{
+	const struct ua *ua = le->data;
+
+	return 0 == pl_strcasecmp(arg, ua->cuser);
+}
+
+
+static bool user_handler(struct le *le, void *arg)
+{
+	const struct ua *ua = le->data;
+
+	return 0 == pl_casecmp(arg, &ua->acc->luri.user);
+}
+
+
 /**
  * Find the correct UA from the contact user
  *
@@ -1999,22 +2175,24 @@ struct ua *uag_find(const struct pl *cuser)
 {
 	struct le *le;
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
+	if (!cuser)
+		return NULL;
 
-		if (0 == pl_strcasecmp(cuser, ua->cuser))
-			return ua;
-	}
+	le = hash_lookup(uag.ht_cuser, hash_joaat_pl_ci(cuser),
+			 cuser_handler, (void *)cuser);
+	if (le)
+		return le->data;
 
 	/* Try also matching by AOR, for better interop */
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-
-		if (0 == pl_casecmp(cuser, &ua->acc->luri.user))
-			return ua;
-	}
+	le = hash_lookup(uag.ht_user, hash_joaat_pl_ci(cuser),
+			 user_handler, (void *)cuser);
+	if (le)
+		return le->data;
 
 	/* Last resort, try any catchall UAs */
+	if (!uag.catchallc)
+		return NULL;
+
 	for (le = uag.ual.head; le; le = le->next) {
 		struct ua *ua = le->data;
 
@@ -2026,6 +2204,14 @@ struct ua *uag_find(const struct pl *cuser)
 }
 
 
+static bool aor_handler(struct le *le, void *arg)
+{
+	const struct ua *ua = le->data;
+
+	return 0 == str_cmp(ua->acc->aor, arg);
+}
+
+
 /**
  * Find a User-Agent (UA) from an Address-of-Record (AOR)
  *
@@ -2035,18 +2221,29 @@ struct ua *uag_find(const struct pl *cuser)
  */
 struct ua *uag_find_aor(const char *aor)
 {
-	struct le *le;
+	if (!str_isset(aor))
+		return list_ledata(list_head(&uag.ual));
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
+	return list_ledata(hash_lookup(uag.ht_aor, hash_joaat_str_ci(aor),
+				       aor_handler, (void *)aor));
+}
 
-		if (str_isset(aor) && str_cmp(ua->acc->aor, aor))
-			continue;
 
-		return ua;
-	}
+struct param_match {
+	const char *name;
+	const char *value;
+};
 
-	return NULL;
+
+static bool param_handler(struct le *le, void *arg)
+{
+	const struct ua_param *prm = le->data;
+	const struct param_match *pm = arg;
+
+	if (pl_strcasecmp(&prm->name, pm->name))
+		return false;
+
+	return !pm->value || 0 == pl_strcasecmp(&prm->val, pm->value);
 }
 
 
@@ -2060,28 +2257,19 @@ struct ua *uag_find_aor(const char *aor)
  */
 struct ua *uag_find_param(const char *name, const char *value)
 {
-	struct le *le;
+	struct param_match pm;
+	struct ua_param *prm;
 
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-		struct sip_addr *laddr = account_laddr(ua->acc);
-		struct pl val;
+	if (!name)
+		return NULL;
 
-		if (value) {
+	pm.name  = name;
+	pm.value = value;
 
-			if (0 == msg_param_decode(&laddr->params, name, &val)
-			    &&
-			    0 == pl_strcasecmp(&val, value)) {
-				return ua;
-			}
-		}
-		else {
-			if (0 == msg_param_exists(&laddr->params, name, &val))
-				return ua;
-		}
-	}
+	prm = list_ledata(hash_lookup(uag.ht_param, hash_joaat_str_ci(name),
+				      param_handler, &pm));
 
-	return NULL;
+	return prm ? prm->ua : NULL;
 }
 
 
@@ -2167,16 +2355,7 @@ struct list *uag_list(void)
  */
 uint32_t uag_call_count(void)
 {
-	struct le *le;
-	uint32_t c = 0;
-
-	for (le = uag.ual.head; le; le = le->next) {
-		struct ua *ua = le->data;
-
-		c += list_count(&ua->calls);
-	}
-
-	return c;
+	return call_count();
 }
 
 
@@ -2323,10 +2502,15 @@ void ua_set_media_af(struct ua *ua, int af_media)
  */
 void ua_set_catchall(struct ua *ua, bool enabled)
 {
-	if (!ua)
+	if (!ua || ua->catchall == enabled)
 		return;
 
 	ua->catchall = enabled;
+
+	if (enabled)
+		++uag.catchallc;
+	else
+		--uag.catchallc;
 }
 
 
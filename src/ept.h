@@ -87,6 +87,7 @@ struct ua   *uag_find(const struct pl *cuser);
 struct ua   *uag_find_aor(const char *aor);
 struct ua   *uag_find_param(const char *name, const char *val);
 struct sip  *uag_sip(void);
+struct regsched *uag_regsched(void);
 struct list *uag_list(void);
 uint32_t     uag_call_count(void);
 void         uag_current_set(struct ua *ua);
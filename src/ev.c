@@ -14,12 +14,34 @@
 
 struct ua_eh {
 	struct le le;
-	ua_event_h *h;
+	ua_event_h *h;                /**< Handler, or NULL if typed       */
+	ua_event_rec_h *rech;         /**< Typed handler                   */
+	uint32_t classes;             /**< Subscribed event classes        */
 	void *arg;
 };
 
+enum {
+	JSON_STACK_SIZE = 1024,
+};
+
 
 static struct list ehl;               /**< Event handlers (struct ua_eh)   */
+static uint32_t ehl_classes;          /**< Classes of all event handlers   */
+
+
+static void update_classes(void)
+{
+	struct le *le;
+
+	ehl_classes = 0;
+
+	for (le = ehl.head; le; le = le->next) {
+
+		const struct ua_eh *eh = le->data;
+
+		ehl_classes |= eh->classes;
+	}
+}
 
 
 static void eh_destructor(void *arg)
@@ -27,10 +49,18 @@ static void eh_destructor(void *arg)
 	struct ua_eh *eh = arg;
 
 	list_unlink(&eh->le);
+	update_classes();
 }
 
 
-static const char *event_class_name(enum ua_event ev)
+/**
+ * Get the class of a User-Agent event
+ *
+ * @param ev User-Agent event
+ *
+ * @return Event class
+ */
+enum ua_event_class uag_event_class(enum ua_event ev)
 {
 	switch (ev) {
 
@@ -40,14 +70,14 @@ static const char *event_class_name(enum ua_event ev)
 	case UA_EVENT_UNREGISTERING:
 	case UA_EVENT_FALLBACK_OK:
 	case UA_EVENT_FALLBACK_FAIL:
-		return "register";
+		return UA_EVCLASS_REGISTER;
 
 	case UA_EVENT_MWI_NOTIFY:
-		return "mwi";
+		return UA_EVCLASS_MWI;
 
 	case UA_EVENT_SHUTDOWN:
 	case UA_EVENT_EXIT:
-		return "application";
+		return UA_EVCLASS_APPLICATION;
 
 	case UA_EVENT_CALL_INCOMING:
 	case UA_EVENT_CALL_RINGING:
@@ -60,14 +90,101 @@ static const char *event_class_name(enum ua_event ev)
 	case UA_EVENT_CALL_DTMF_END:
 	case UA_EVENT_CALL_RTCP:
 	case UA_EVENT_CALL_MENC:
-		return "call";
+		return UA_EVCLASS_CALL;
 	case UA_EVENT_VU_RX:
 	case UA_EVENT_VU_TX:
-		return "VU_REPORT";
+		return UA_EVCLASS_VU;
 
 	default:
-		return "other";
+		return UA_EVCLASS_OTHER;
+	}
+}
+
+
+/**
+ * Get the name of a User-Agent event class
+ *
+ * @param cls Event class
+ *
+ * @return Name of the event class
+ */
+const char *uag_event_class_name(enum ua_event_class cls)
+{
+	switch (cls) {
+
+	case UA_EVCLASS_REGISTER:    return "register";
+	case UA_EVCLASS_MWI:         return "mwi";
+	case UA_EVCLASS_APPLICATION: return "application";
+	case UA_EVCLASS_CALL:        return "call";
+	case UA_EVCLASS_VU:          return "VU_REPORT";
+	default:                     return "other";
+	}
+}
+
+
+/**
+ * Decode a list of event class names, e.g. "register,call" or "all"
+ *
+ * @param classes Returned mask of event classes
+ * @param pl      Class names, separated by comma or whitespace
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uag_event_class_decode(uint32_t *classes, const struct pl *pl)
+{
+	struct pl rem, name;
+	uint32_t mask = 0;
+
+	if (!classes || !pl)
+		return EINVAL;
+
+	rem = *pl;
+
+	while (!re_regex(rem.p, rem.l, "[^, \t]+", &name)) {
+
+		uint32_t cls;
+
+		if (0 == pl_strcasecmp(&name, "all")) {
+			mask |= UA_EVCLASS_ALL;
+		}
+		else {
+			for (cls = 1; cls < UA_EVCLASS_ALL; cls <<= 1) {
+
+				if (0 == pl_strcasecmp(&name,
+						uag_event_class_name(cls)))
+					break;
+			}
+
+			if (cls >= UA_EVCLASS_ALL)
+				return EINVAL;
+
+			mask |= cls;
+		}
+
+		rem.l -= name.p + name.l - rem.p;
+		rem.p  = name.p + name.l;
 	}
+
+	if (!mask)
+		return EINVAL;
+
+	*classes = mask;
+
+	return 0;
+}
+
+
+static const struct rtcp_stats *event_rtcp_stats(struct call *call,
+						 const char *prm)
+{
+	struct stream *strm = NULL;
+
+	if (0 == str_casecmp(prm, "audio"))
+		strm = audio_strm(call_audio(call));
+	else if (0 == str_casecmp(prm, "video"))
+		strm = video_strm(call_video(call));
+
+	return stream_rtcp_stats(strm);
 }
 
 
@@ -138,8 +255,8 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 		return EINVAL;
 
 	err |= odict_entry_add(od, "type", ODICT_STRING, event_str);
-	err |= odict_entry_add(od, "class",
-			       ODICT_STRING, event_class_name(ev));
+	err |= odict_entry_add(od, "class", ODICT_STRING,
+			       uag_event_class_name(uag_event_class(ev)));
 
 	if (ua) {
 		err |= odict_entry_add(od, "accountaor",
@@ -182,14 +299,7 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 	}
 
 	if (ev == UA_EVENT_CALL_RTCP) {
-		struct stream *strm = NULL;
-
-		if (0 == str_casecmp(prm, "audio"))
-			strm = audio_strm(call_audio(call));
-		else if (0 == str_casecmp(prm, "video"))
-			strm = video_strm(call_video(call));
-
-		err = add_rtcp_stats(od, stream_rtcp_stats(strm));
+		err = add_rtcp_stats(od, event_rtcp_stats(call, prm));
 		if (err)
 			goto out;
 	}
@@ -217,36 +327,185 @@ int event_add_au_jb_stat(struct odict *od_parent, const struct call *call)
 }
 
 
+static int rtcp_encode(struct re_printf *pf, const struct rtcp_stats *rs)
+{
+	return re_hprintf(pf, ",\"rtcp_stats\":{"
+			  "\"tx\":{\"sent\":%u,\"lost\":%d,\"jit\":%u},"
+			  "\"rx\":{\"sent\":%u,\"lost\":%d,\"jit\":%u},"
+			  "\"rtt\":%u}",
+			  rs->tx.sent, rs->tx.lost, rs->tx.jit,
+			  rs->rx.sent, rs->rx.lost, rs->rx.jit,
+			  rs->rtt);
+}
+
+
+/* same members as event_encode_dict, without the dictionary */
+static int json_encode(struct re_printf *pf, const struct ua_event_rec *rec)
+{
+	int err;
+
+	err  = re_hprintf(pf, "\"type\":\"%s\",\"class\":\"%s\"",
+			  uag_event_str(rec->ev),
+			  uag_event_class_name(rec->cls));
+
+	if (rec->ua) {
+		err |= re_hprintf(pf, ",\"accountaor\":\"%H\"",
+				  utf8_encode, ua_aor(rec->ua));
+	}
+
+	if (rec->call) {
+
+		const char *name = call_peername(rec->call);
+		const char *id = call_id(rec->call);
+
+		err |= re_hprintf(pf, ",\"direction\":\"%s\""
+				  ",\"peeruri\":\"%H\"",
+				  call_is_outgoing(rec->call) ?
+				  "outgoing" : "incoming",
+				  utf8_encode, call_peeruri(rec->call));
+		if (name) {
+			err |= re_hprintf(pf, ",\"peerdisplayname\":\"%H\"",
+					  utf8_encode, name);
+		}
+		if (id) {
+			err |= re_hprintf(pf, ",\"id\":\"%H\"",
+					  utf8_encode, id);
+		}
+	}
+
+	if (pl_isset(&rec->prm)) {
+		err |= re_hprintf(pf, ",\"param\":\"%H\"",
+				  utf8_encode, rec->prm.p);
+	}
+
+	if (rec->rtcp)
+		err |= rtcp_encode(pf, rec->rtcp);
+
+	return err;
+}
+
+
 /**
- * Register a User-Agent event handler
+ * Print the JSON object members of an event, without the braces. The
+ * members are the same as from event_encode_dict() and are only encoded
+ * once per event.
  *
- * @param h   Event handler
- * @param arg Handler argument
+ * @param pf  Print function
+ * @param rec Event record
  *
  * @return 0 if success, otherwise errorcode
  */
-int uag_event_register(ua_event_h *h, void *arg)
+int ua_event_rec_encode(struct re_printf *pf, struct ua_event_rec *rec)
 {
-	struct ua_eh *eh;
+	int n, err;
 
-	if (!h)
+	if (!pf || !rec)
 		return EINVAL;
 
-	uag_event_unregister(h);
+	if (rec->json.p)
+		goto out;
+
+	n = re_snprintf(rec->jbuf, rec->jsize, "%H", json_encode, rec);
+	if (n >= 0 && (size_t)n < rec->jsize) {
+		rec->json.p = rec->jbuf;
+		rec->json.l = n;
+		goto out;
+	}
+
+	/* too large for the stack buffer */
+	rec->jmb = mbuf_alloc(2 * rec->jsize);
+	if (!rec->jmb)
+		return ENOMEM;
+
+	err = mbuf_printf(rec->jmb, "%H", json_encode, rec);
+	if (err) {
+		rec->jmb = mem_deref(rec->jmb);
+		return err;
+	}
+
+	rec->json.p = (const char *)rec->jmb->buf;
+	rec->json.l = rec->jmb->end;
+
+ out:
+	return re_hprintf(pf, "%r", &rec->json);
+}
+
+
+/**
+ * Get the dictionary of an event, encoded once per event
+ *
+ * @param rec Event record
+ * @param odp Pointer to returned dictionary, valid during the handler call
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int ua_event_rec_dict(struct ua_event_rec *rec, const struct odict **odp)
+{
+	int err;
+
+	if (!rec || !odp)
+		return EINVAL;
+
+	if (!rec->od) {
+
+		err = odict_alloc(&rec->od, 8);
+		if (err)
+			return err;
+
+		err = event_encode_dict(rec->od, rec->ua, rec->ev, rec->call,
+					rec->prm.p);
+		if (err) {
+			rec->od = mem_deref(rec->od);
+			return err;
+		}
+	}
+
+	*odp = rec->od;
+
+	return 0;
+}
+
+
+static int eh_add(ua_event_h *h, ua_event_rec_h *rech, uint32_t classes,
+		  void *arg)
+{
+	struct ua_eh *eh;
 
 	eh = mem_zalloc(sizeof(*eh), eh_destructor);
 	if (!eh)
 		return ENOMEM;
 
-	eh->h = h;
-	eh->arg = arg;
+	eh->h       = h;
+	eh->rech    = rech;
+	eh->classes = classes;
+	eh->arg     = arg;
 
 	list_append(&ehl, &eh->le, eh);
+	update_classes();
 
 	return 0;
 }
 
 
+/**
+ * Register a User-Agent event handler
+ *
+ * @param h   Event handler
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uag_event_register(ua_event_h *h, void *arg)
+{
+	if (!h)
+		return EINVAL;
+
+	uag_event_unregister(h);
+
+	return eh_add(h, NULL, UA_EVCLASS_ALL, arg);
+}
+
+
 /**
  * Unregister a User-Agent event handler
  *
@@ -268,6 +527,48 @@ void uag_event_unregister(ua_event_h *h)
 }
 
 
+/**
+ * Subscribe to typed User-Agent events. Events of other classes are not
+ * formatted at all when no handler wants them.
+ *
+ * @param classes Mask of event classes (enum ua_event_class)
+ * @param h       Typed event handler
+ * @param arg     Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uag_event_subscribe(uint32_t classes, ua_event_rec_h *h, void *arg)
+{
+	if (!h || !classes)
+		return EINVAL;
+
+	uag_event_unsubscribe(h);
+
+	return eh_add(NULL, h, classes, arg);
+}
+
+
+/**
+ * Unsubscribe from typed User-Agent events
+ *
+ * @param h Typed event handler
+ */
+void uag_event_unsubscribe(ua_event_rec_h *h)
+{
+	struct le *le;
+
+	for (le = ehl.head; le; le = le->next) {
+
+		struct ua_eh *eh = le->data;
+
+		if (eh->rech == h) {
+			mem_deref(eh);
+			break;
+		}
+	}
+}
+
+
 /**
  * Send a User-Agent event to all UA event handlers
  *
@@ -280,22 +581,53 @@ void uag_event_unregister(ua_event_h *h)
 void ua_event(struct ua *ua, enum ua_event ev, struct call *call,
 	      const char *fmt, ...)
 {
+	struct ua_event_rec rec;
+	char jbuf[JSON_STACK_SIZE];
 	struct le *le;
 	char buf[256];
 	va_list ap;
 
+	rec.cls = uag_event_class(ev);
+
+	/* nobody is interested in this class */
+	if (!(ehl_classes & rec.cls))
+		return;
+
 	va_start(ap, fmt);
 	(void)re_vsnprintf(buf, sizeof(buf), fmt, ap);
 	va_end(ap);
 
+	rec.ev    = ev;
+	rec.ua    = ua;
+	rec.call  = call;
+	rec.rtcp  = NULL;
+	rec.jbuf  = jbuf;
+	rec.jsize = sizeof(jbuf);
+	rec.jmb   = NULL;
+	rec.od    = NULL;
+	pl_set_str(&rec.prm, buf);
+	rec.json  = pl_null;
+
+	if (ev == UA_EVENT_CALL_RTCP)
+		rec.rtcp = event_rtcp_stats(call, buf);
+
 	/* send event to all clients */
 	le = ehl.head;
 	while (le) {
 		struct ua_eh *eh = le->data;
 		le = le->next;
 
-		eh->h(ua, ev, call, buf, eh->arg);
+		if (!(eh->classes & rec.cls))
+			continue;
+
+		if (eh->h)
+			eh->h(ua, ev, call, buf, eh->arg);
+		else
+			eh->rech(&rec, eh->arg);
 	}
+
+	mem_deref(rec.jmb);
+	mem_deref(rec.od);
 }
 
 
@@ -12,6 +12,7 @@
 #include "rsua-re/re.h"
 
 struct call;
+struct rtcp_stats;
 struct ua;
 
 /** Events from User-Agent */
@@ -47,10 +48,51 @@ enum ua_event {
 	UA_EVENT_MAX,
 };
 
+/** Classes of User-Agent events, used as subscription mask */
+enum ua_event_class {
+	UA_EVCLASS_REGISTER    = 1 << 0,
+	UA_EVCLASS_MWI         = 1 << 1,
+	UA_EVCLASS_APPLICATION = 1 << 2,
+	UA_EVCLASS_CALL        = 1 << 3,
+	UA_EVCLASS_VU          = 1 << 4,
+	UA_EVCLASS_OTHER       = 1 << 5,
+
+	UA_EVCLASS_ALL         = (1 << 6) - 1,
+};
+
+/**
+ * Typed User-Agent event record. The record and its views are only valid
+ * during the handler call, the JSON and dictionary encodings are made on
+ * first use and shared by all subscribers of the event.
+ */
+struct ua_event_rec {
+	enum ua_event ev;              /**< Event type                       */
+	enum ua_event_class cls;       /**< Event class                      */
+	struct ua *ua;                 /**< User-Agent (optional)            */
+	struct call *call;             /**< Call object (optional)           */
+	struct pl prm;                 /**< Event parameters, NUL-terminated */
+	const struct rtcp_stats *rtcp; /**< RTCP statistics (CALL_RTCP)      */
+
+	/* lazy encodings, private */
+	char *jbuf;                    /**< Stack buffer for the JSON        */
+	size_t jsize;                  /**< Size of the stack buffer         */
+	struct mbuf *jmb;              /**< JSON, if too large for the stack */
+	struct pl json;                /**< Encoded JSON members             */
+	struct odict *od;              /**< Encoded dictionary               */
+};
+
 /** Defines the User-Agent event handler */
 typedef void (ua_event_h)(struct ua *ua, enum ua_event ev,
 			  struct call *call, const char *prm, void *arg);
 
+/**
+ * Defines the typed User-Agent event handler
+ *
+ * @param rec Event record
+ * @param arg Handler argument
+ */
+typedef void (ua_event_rec_h)(struct ua_event_rec *rec, void *arg);
+
 
 int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 		      struct call *call, const char *prm);
@@ -60,5 +102,12 @@ void uag_event_unregister(ua_event_h *eh);
 void ua_event(struct ua *ua, enum ua_event ev, struct call *call,
 	      const char *fmt, ...);
 const char  *uag_event_str(enum ua_event ev);
+enum ua_event_class uag_event_class(enum ua_event ev);
+const char  *uag_event_class_name(enum ua_event_class cls);
+int  uag_event_class_decode(uint32_t *classes, const struct pl *pl);
+int  uag_event_subscribe(uint32_t classes, ua_event_rec_h *h, void *arg);
+void uag_event_unsubscribe(ua_event_rec_h *h);
+int  ua_event_rec_encode(struct re_printf *pf, struct ua_event_rec *rec);
+int  ua_event_rec_dict(struct ua_event_rec *rec, const struct odict **odp);
 
 #endif /* UAEV_H_INCLUDED */
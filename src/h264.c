@@ -1,14 +1,28 @@
 /**
  * @file h264.c  H.264 video codec packetization (RFC 3984)
  *
+ * The start code scanner has one variant per instruction set, the best one
+ * supported by the CPU is selected at the first use. The packetizer splits
+ * an access unit into RTP packets which refer to the encoder's buffer, the
+ * payload is copied once, into the packet buffer that is sent.
+ *
  * Copyright (C) 2010 - 2015 Creytiv.com
  * Copyright (C) 2020 Dalei Liu
  */
 
 #include "h264.h"
 #include <string.h>
+#include <pthread.h>
 #include "vidcodec.h"
 
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define USE_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
 int h264_fu_hdr_encode(const struct h264_fu *fu, struct mbuf *mb)
 {
 	uint8_t v = fu->s<<7 | fu->s<<6 | fu->r<<5 | fu->type;
@@ -39,7 +53,7 @@ int h264_fu_hdr_decode(struct h264_fu *fu, struct mbuf *mb)
  *
  * @note: copied from ffmpeg source
  */
-const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
+static const uint8_t *find_startcode_c(const uint8_t *p, const uint8_t *end)
 {
 	const uint8_t *a = p + 4 - ((long)p & 3);
 
@@ -75,6 +89,130 @@ const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
 }
 
 
+#ifdef USE_X86
+/*
+ * The SIMD scanners compare 16 or 32 positions at once for the bytes
+ * 00 00 01, the rest of the buffer is left to the scalar scanner. Like the
+ * scalar scanner, they ignore a start code in the last three bytes.
+ */
+TARGET_SSE2
+static const uint8_t *find_startcode_sse2(const uint8_t *p,
+					  const uint8_t *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one  = _mm_set1_epi8(1);
+
+	for (; end - p > 18; p += 16) {
+		const __m128i b0 = _mm_loadu_si128((const __m128i *)(void *)p);
+		const __m128i b1 = _mm_loadu_si128((const __m128i *)
+						   (const void *)(p + 1));
+		const __m128i b2 = _mm_loadu_si128((const __m128i *)
+						   (const void *)(p + 2));
+		const __m128i m  = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+				      _mm_cmpeq_epi8(b1, zero)),
+			_mm_cmpeq_epi8(b2, one));
+		const int mask = _mm_movemask_epi8(m);
+
+		if (mask)
+			return p + __builtin_ctz((unsigned)mask);
+	}
+
+	return find_startcode_c(p, end);
+}
+
+
+TARGET_AVX2
+static const uint8_t *find_startcode_avx2(const uint8_t *p,
+					  const uint8_t *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one  = _mm256_set1_epi8(1);
+
+	for (; end - p > 34; p += 32) {
+		const __m256i b0 = _mm256_loadu_si256((const __m256i *)
+						      (const void *)p);
+		const __m256i b1 = _mm256_loadu_si256((const __m256i *)
+						      (const void *)(p + 1));
+		const __m256i b2 = _mm256_loadu_si256((const __m256i *)
+						      (const void *)(p + 2));
+		const __m256i m  = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+					 _mm256_cmpeq_epi8(b1, zero)),
+			_mm256_cmpeq_epi8(b2, one));
+		const uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+
+	return find_startcode_sse2(p, end);
+}
+#endif
+
+
+static const struct h264_scanner scanner_c = {"c", find_startcode_c};
+
+#ifdef USE_X86
+static const struct h264_scanner scanner_sse2 = {"sse2",
+						  find_startcode_sse2};
+static const struct h264_scanner scanner_avx2 = {"avx2",
+						  find_startcode_avx2};
+#endif
+
+
+/* supported scanners, in order of preference -- the scalar one is last */
+static const struct h264_scanner *scannerv[3];
+static size_t scannerc;
+static pthread_once_t scanner_once = PTHREAD_ONCE_INIT;
+
+
+static void scanner_init(void)
+{
+#ifdef USE_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		scannerv[scannerc++] = &scanner_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		scannerv[scannerc++] = &scanner_sse2;
+#endif
+
+	scannerv[scannerc++] = &scanner_c;
+}
+
+
+/**
+ * Get a supported start code scanner by index, for testing and benchmarks
+ *
+ * @param i Index, 0 is the scanner in use and the last is scalar
+ *
+ * @return Start code scanner, or NULL if the index is out of range
+ */
+const struct h264_scanner *h264_scanner_get(size_t i)
+{
+	pthread_once(&scanner_once, scanner_init);
+
+	return i < scannerc ? scannerv[i] : NULL;
+}
+
+
+/**
+ * Find the next NAL start sequence 00 00 01 in a H.264 byte stream
+ *
+ * @param p   Start of the byte stream
+ * @param end End of the byte stream
+ *
+ * @return Start of the start sequence, or end if not found
+ */
+const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
+{
+	pthread_once(&scanner_once, scanner_init);
+
+	return scannerv[0]->find(p, end);
+}
+
+
 static int rtp_send_data(const uint8_t *hdr, size_t hdr_sz,
 			 const uint8_t *buf, size_t sz,
 			 bool eof, uint64_t rtp_ts,
@@ -126,29 +264,137 @@ int h264_nal_send(bool first, bool last,
 }
 
 
+/**
+ * Start splitting an access unit in H.264 byte stream format into RTP
+ * packets, as single NAL unit packets or FU-A fragments
+ *
+ * @param pz      Packetizer
+ * @param buf     Access unit, must be kept until all packets are taken
+ * @param len     Length of the access unit
+ * @param pktsize Maximum payload size of a packet, without the NAL header
+ */
+void h264_packetizer_init(struct h264_packetizer *pz,
+			  const uint8_t *buf, size_t len, size_t pktsize)
+{
+	if (!pz)
+		return;
+
+	memset(pz, 0, sizeof(*pz));
+
+	pz->end     = buf + len;
+	pz->p       = h264_find_startcode(buf, pz->end);
+	pz->pktsize = pktsize;
+}
+
+
+/* take the next NAL unit, false if there is none */
+static bool next_nal(struct h264_packetizer *pz)
+{
+	const uint8_t *r = pz->p;
+
+	/* skip the start code */
+	while (r < pz->end && !*r)
+		++r;
+
+	if (r + 1 >= pz->end) {
+		pz->p = pz->end;
+		return false;
+	}
+
+	++r;
+
+	pz->p       = h264_find_startcode(r, pz->end);
+	pz->nal_hdr = r[0];
+	pz->nal     = r + 1;
+	pz->nal_end = pz->p;
+	pz->fu      = (size_t)(pz->nal_end - pz->nal) > pz->pktsize;
+	pz->first   = true;
+
+	return true;
+}
+
+
+/**
+ * Get the next RTP packets of an access unit. The payloads point into the
+ * access unit, the packet with the marker bit is the last one.
+ *
+ * @param pz   Packetizer
+ * @param pktv Array for the packets
+ * @param pktc Number of entries in the array
+ *
+ * @return Number of packets, 0 when the access unit is done
+ */
+size_t h264_packetizer_next(struct h264_packetizer *pz,
+			    struct h264_pkt *pktv, size_t pktc)
+{
+	size_t n = 0;
+
+	if (!pz || !pktv || pz->pktsize <= 2)
+		return 0;
+
+	while (n < pktc) {
+
+		struct h264_pkt *pkt = &pktv[n];
+		size_t size;
+
+		/* the current NAL unit is done, an empty one is sent once */
+		if (!pz->first && pz->nal >= pz->nal_end && !next_nal(pz))
+			break;
+
+		size = pz->nal_end - pz->nal;
+
+		if (!pz->fu) {
+			pkt->hdr[0]  = pz->nal_hdr;
+			pkt->hdr_len = 1;
+			pkt->pld     = pz->nal;
+			pkt->pld_len = size;
+		}
+		else {
+			const size_t sz = pz->pktsize - 2;
+
+			pkt->hdr[0]  = (pz->nal_hdr & 0x60) | H264_NALU_FU_A;
+			pkt->hdr[1]  = pz->nal_hdr & 0x1f;
+			pkt->hdr_len = 2;
+			pkt->pld     = pz->nal;
+			pkt->pld_len = min(size, sz);
+
+			if (pz->first)
+				pkt->hdr[1] |= 1<<7;
+			if (size <= sz)
+				pkt->hdr[1] |= 1<<6;  /* end bit */
+		}
+
+		pz->nal  += pkt->pld_len;
+		pz->first = false;
+
+		pkt->marker = pz->nal >= pz->nal_end && pz->p >= pz->end;
+
+		++n;
+	}
+
+	return n;
+}
+
+
 int h264_packetize(uint64_t rtp_ts, const uint8_t *buf, size_t len,
 		   size_t pktsize, videnc_packet_h *pkth, void *arg)
 {
-	const uint8_t *start = buf;
-	const uint8_t *end   = buf + len;
-	const uint8_t *r;
+	struct h264_packetizer pz;
+	struct h264_pkt pktv[16];
+	size_t n, i;
 	int err = 0;
 
-	r = h264_find_startcode(start, end);
-
-	while (r < end) {
-		const uint8_t *r1;
+	h264_packetizer_init(&pz, buf, len, pktsize);
 
-		/* skip zeros */
-		while (!*(r++))
-			;
+	while ((n = h264_packetizer_next(&pz, pktv, ARRAY_SIZE(pktv)))) {
 
-		r1 = h264_find_startcode(r, end);
+		for (i=0; i<n; i++) {
+			const struct h264_pkt *pkt = &pktv[i];
 
-		err |= h264_nal_send(true, true, (r1 >= end), r[0],
-				     rtp_ts, r+1, r1-r-1, pktsize,
-				     pkth, arg);
-		r = r1;
+			err |= pkth(pkt->marker, rtp_ts,
+				    pkt->hdr, pkt->hdr_len,
+				    pkt->pld, pkt->pld_len, arg);
+		}
 	}
 
 	return err;
@@ -21,10 +21,43 @@ struct h264_fu {
 	unsigned type:5;   /**< The NAL unit payload type               */
 };
 
+/** Start code scanner for one instruction set */
+struct h264_scanner {
+	const char *name;
+	const uint8_t *(*find)(const uint8_t *p, const uint8_t *end);
+};
+
+/** RTP packet of an access unit, the payload points into the access unit */
+struct h264_pkt {
+	uint8_t hdr[2];         /**< NAL unit or FU-A header           */
+	uint8_t hdr_len;        /**< Header length, 1 or 2             */
+	bool marker;            /**< Last packet of the access unit    */
+	const uint8_t *pld;     /**< Payload                           */
+	size_t pld_len;         /**< Payload length                    */
+};
+
+/** Packetizer state of an access unit */
+struct h264_packetizer {
+	const uint8_t *p;       /**< Next start code                   */
+	const uint8_t *end;     /**< End of the access unit            */
+	const uint8_t *nal;     /**< Rest of the current NAL unit      */
+	const uint8_t *nal_end; /**< End of the current NAL unit       */
+	size_t pktsize;         /**< Maximum payload size              */
+	uint8_t nal_hdr;        /**< Header of the current NAL unit    */
+	bool fu;                /**< Current NAL unit is fragmented    */
+	bool first;             /**< Next packet starts the NAL unit   */
+};
+
 int h264_fu_hdr_encode(const struct h264_fu *fu, struct mbuf *mb);
 int h264_fu_hdr_decode(struct h264_fu *fu, struct mbuf *mb);
 
 const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end);
+const struct h264_scanner *h264_scanner_get(size_t i);
+
+void   h264_packetizer_init(struct h264_packetizer *pz,
+			    const uint8_t *buf, size_t len, size_t pktsize);
+size_t h264_packetizer_next(struct h264_packetizer *pz,
+			    struct h264_pkt *pktv, size_t pktc);
 
 int h264_packetize(uint64_t rtp_ts, const uint8_t *buf, size_t len,
 		   size_t pktsize, videnc_packet_h *pkth, void *arg);
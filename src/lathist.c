@@ -0,0 +1,189 @@
+/**
+ * @file lathist.c  Latency histogram
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include "lathist.h"
+
+
+enum {
+	SUB_COUNT = 1 << LATHIST_SUB_BITS,
+};
+
+
+static unsigned bucket_index(uint64_t val)
+{
+	unsigned e;
+
+	if (val < SUB_COUNT)
+		return (unsigned)val;
+
+	/* position of the most significant bit */
+	e = 63 - __builtin_clzll(val);
+
+	return ((e - LATHIST_SUB_BITS + 1) << LATHIST_SUB_BITS) +
+		(unsigned)(val >> (e - LATHIST_SUB_BITS)) - SUB_COUNT;
+}
+
+
+/* highest value which falls into the bucket */
+static uint64_t bucket_value(unsigned idx)
+{
+	unsigned shift;
+	uint64_t sub;
+
+	if (idx < SUB_COUNT)
+		return idx;
+
+	shift = (idx >> LATHIST_SUB_BITS) - 1;
+	sub   = (idx & (SUB_COUNT - 1)) + SUB_COUNT;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+
+/**
+ * Reset a latency histogram
+ *
+ * @param h Latency histogram
+ */
+void lathist_reset(struct lathist *h)
+{
+	if (!h)
+		return;
+
+	memset(h, 0, sizeof(*h));
+}
+
+
+/**
+ * Record a value in a latency histogram
+ *
+ * @param h   Latency histogram
+ * @param val Value, e.g. in [us]
+ */
+void lathist_add(struct lathist *h, uint64_t val)
+{
+	if (!h)
+		return;
+
+	if (val >= (1ULL << LATHIST_MAX_BITS))
+		val = (1ULL << LATHIST_MAX_BITS) - 1;
+
+	if (!h->count || val < h->min)
+		h->min = val;
+	if (val > h->max)
+		h->max = val;
+
+	++h->count;
+	h->sum += val;
+	++h->bucketv[bucket_index(val)];
+}
+
+
+/**
+ * Get a percentile of the recorded values
+ *
+ * @param h   Latency histogram
+ * @param pct Percentile, from 0 to 100
+ *
+ * @return Highest value equivalent to the percentile, 0 if empty
+ */
+uint64_t lathist_percentile(const struct lathist *h, double pct)
+{
+	uint64_t target, n = 0;
+	double pos;
+	unsigned i;
+
+	if (!h || !h->count)
+		return 0;
+
+	if (pct <= 0)
+		return h->min;
+
+	/* rank of the value, rounded up */
+	pos = h->count * pct / 100.0;
+	target = (uint64_t)pos;
+	if (target < pos || target < 1)
+		++target;
+
+	for (i=0; i<LATHIST_BUCKETS; i++) {
+
+		n += h->bucketv[i];
+		if (n >= target)
+			return min(bucket_value(i), h->max);
+	}
+
+	return h->max;
+}
+
+
+/**
+ * Get the mean of the recorded values
+ *
+ * @param h Latency histogram
+ *
+ * @return Mean value, 0 if empty
+ */
+uint64_t lathist_mean(const struct lathist *h)
+{
+	if (!h || !h->count)
+		return 0;
+
+	return h->sum / h->count;
+}
+
+
+/**
+ * Print a one line summary of a latency histogram
+ *
+ * @param pf Print function
+ * @param h  Latency histogram
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int lathist_debug(struct re_printf *pf, const struct lathist *h)
+{
+	if (!h)
+		return 0;
+
+	return re_hprintf(pf, "n=%-6llu min=%-8llu mean=%-8llu p50=%-8llu"
+			  " p90=%-8llu p99=%-8llu max=%llu",
+			  h->count, h->min, lathist_mean(h),
+			  lathist_percentile(h, 50),
+			  lathist_percentile(h, 90),
+			  lathist_percentile(h, 99), h->max);
+}
+
+
+/**
+ * Encode the summary of a latency histogram to a dictionary
+ *
+ * @param od Dictionary to encode into
+ * @param h  Latency histogram
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int lathist_encode_dict(struct odict *od, const struct lathist *h)
+{
+	int err = 0;
+
+	if (!od || !h)
+		return EINVAL;
+
+	err |= odict_entry_add(od, "count", ODICT_INT, (int64_t)h->count);
+	err |= odict_entry_add(od, "min", ODICT_INT, (int64_t)h->min);
+	err |= odict_entry_add(od, "mean", ODICT_INT,
+			       (int64_t)lathist_mean(h));
+	err |= odict_entry_add(od, "p50", ODICT_INT,
+			       (int64_t)lathist_percentile(h, 50));
+	err |= odict_entry_add(od, "p90", ODICT_INT,
+			       (int64_t)lathist_percentile(h, 90));
+	err |= odict_entry_add(od, "p99", ODICT_INT,
+			       (int64_t)lathist_percentile(h, 99));
+	err |= odict_entry_add(od, "max", ODICT_INT, (int64_t)h->max);
+
+	return err;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file lathist.h
+ * @brief Latency histogram
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UALATHIST_H_INCLUDED
+#define UALATHIST_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+enum {
+	LATHIST_SUB_BITS = 4,     /**< Sub-buckets per power of two (log2) */
+	LATHIST_MAX_BITS = 40,    /**< Largest value recorded (log2)       */
+	LATHIST_BUCKETS  = (LATHIST_MAX_BITS - LATHIST_SUB_BITS + 1)
+			   << LATHIST_SUB_BITS,
+};
+
+/**
+ * Log-linear latency histogram, like HDR histogram. Every power of two is
+ * split into 16 buckets, the relative error is below 6.25%. Not thread
+ * safe, the owner must serialize the access.
+ */
+struct lathist {
+	uint64_t count;                    /**< Recorded values            */
+	uint64_t sum;                      /**< Sum of the values          */
+	uint64_t min;                      /**< Smallest value             */
+	uint64_t max;                      /**< Largest value              */
+	uint32_t bucketv[LATHIST_BUCKETS]; /**< Counts per bucket          */
+};
+
+void     lathist_reset(struct lathist *h);
+void     lathist_add(struct lathist *h, uint64_t val);
+uint64_t lathist_percentile(const struct lathist *h, double pct);
+uint64_t lathist_mean(const struct lathist *h);
+int      lathist_debug(struct re_printf *pf, const struct lathist *h);
+int      lathist_encode_dict(struct odict *od, const struct lathist *h);
+
+#endif /* UALATHIST_H_INCLUDED */
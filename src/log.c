@@ -1,26 +1,178 @@
 /**
  * @file log.c Logging
  *
+ * A message is formatted on the calling thread and put into a ring, a
+ * writer thread prints it. The log handlers may use the sockets of the
+ * main loop, so they are called on the thread that registered the first
+ * handler, the writer passes the messages to it by a message queue. The
+ * queue is drained by the main loop and by log_flush(). The ring has many
+ * producers and one consumer, a producer claims the slots of a message
+ * with one atomic operation and never waits. When the ring is full, the
+ * message is dropped and counted.
+ *
+ * Every call site, identified by its format string, may log a burst of
+ * messages per second, the rest is suppressed and counted. The writer
+ * thread prints a message repeated by the same call site only once.
+ *
  * Copyright (C) 2010 Creytiv.com
  * Copyright (C) 2020 Dalei Liu
  */
 
 #include "log.h"
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+
+enum {
+	RING_SIZE = 512,          /* slots, a power of two              */
+	SLOT_SIZE = 248,          /* text bytes per slot                */
+	MSG_SIZE  = 4096,         /* longest message                    */
+	NUM_SITES = 256,          /* call sites tracked for rate limits */
+	NUM_PROBE = 8,            /* slots searched for a call site     */
+	BURST     = 20,           /* default messages per site and sec. */
+	HQ_MAX    = 2048,         /* messages waiting for the handlers  */
+};
+
+struct slot {
+	uint32_t seq;             /**< Ring position, when ready       */
+	uint8_t level;            /**< Log level                        */
+	uint8_t n;                /**< Slots of the message, in the 1st */
+	uint16_t len;             /**< Text bytes in this slot          */
+	const char *fmt;          /**< Call site                        */
+	char text[SLOT_SIZE];     /**< Message text                     */
+};
+
+struct site {
+	const char *fmt;          /**< Format string of the call site   */
+	uint64_t sec;             /**< Current second                   */
+	uint32_t n;               /**< Messages in the current second   */
+	uint32_t suppressed;      /**< Messages suppressed              */
+};
+
+/* a message for the log handlers */
+struct hmsg {
+	struct le le;
+	uint32_t level;
+	char *msg;
+};
+
+enum writer_state {
+	WRITER_NONE = 0,
+	WRITER_RUNNING,
+	WRITER_FAILED,
+};
 
 
 static struct {
 	struct list logl;
 	enum log_level level;
 	bool enable_stdout;
+	uint32_t burst;
+
+	pthread_mutex_t hmutex;   /**< Protects the handlers           */
+	pthread_mutex_t mutex;    /**< Protects the writer state       */
+	pthread_cond_t cond;      /**< Signalled for a sleeping writer  */
+	pthread_cond_t drained;   /**< Signalled when the ring is empty */
+	int state;                /**< enum writer_state                */
+	bool sleeping;            /**< The writer waits for messages    */
+	pthread_t htid;           /**< Thread calling the handlers      */
+	bool hcall;               /**< Handlers are being called        */
+	struct mqueue *mq;        /**< Messages to the handler thread   */
+	pthread_t mtid;           /**< Thread calling the handlers      */
+	struct list hq;           /**< Messages waiting for handlers    */
+	uint32_t hq_n;            /**< Number of waiting messages       */
+	uint32_t head;            /**< Next ring position to claim      */
+	uint32_t tail;            /**< Next ring position to take       */
+	uint32_t done;            /**< Ring position printed up to      */
+	struct slot ring[RING_SIZE];
+	struct site sitev[NUM_SITES];
+	struct log_stats stats;
 } lg = {
 	LIST_INIT,
 	LEVEL_INFO,
-	true
+	true,
+	BURST,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	WRITER_NONE,
 };
 
 
+static void call_handlers(uint32_t level, const char *msg)
+{
+	struct le *le = lg.logl.head;
+
+	while (le) {
+
+		struct log *log = le->data;
+		le = le->next;
+
+		if (log->h)
+			log->h(level, msg);
+	}
+}
+
+
+/* call the handlers with the waiting messages, on the handler thread */
+static void hq_deliver(void)
+{
+	struct le *le;
+
+	pthread_mutex_lock(&lg.hmutex);
+
+	if (!lg.mq || !pthread_equal(lg.mtid, pthread_self()))
+		goto out;
+
+	lg.htid = pthread_self();
+	__atomic_store_n(&lg.hcall, true, __ATOMIC_RELEASE);
+
+	while ((le = list_head(&lg.hq))) {
+
+		struct hmsg *m = le->data;
+
+		list_unlink(le);
+		--lg.hq_n;
+
+		call_handlers(m->level, m->msg);
+
+		mem_deref(m);
+	}
+
+	__atomic_store_n(&lg.hcall, false, __ATOMIC_RELAXED);
+
+ out:
+	pthread_mutex_unlock(&lg.hmutex);
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	(void)id;
+	(void)data;
+	(void)arg;
+
+	hq_deliver();
+}
+
+
+/* no handler is left, drop the queue. Must be called with hmutex held */
+static void hq_close(void)
+{
+	if (!list_isempty(&lg.logl))
+		return;
+
+	lg.mq = mem_deref(lg.mq);
+	list_flush(&lg.hq);
+	lg.hq_n = 0;
+}
+
+
 /**
- * Register a log handler
+ * Register a log handler. The handlers are called on the thread that
+ * registers the first one, from its main loop or from log_flush().
  *
  * @param log Log handler
  */
@@ -29,12 +181,28 @@ void log_register_handler(struct log *log)
 	if (!log)
 		return;
 
+	pthread_mutex_lock(&lg.hmutex);
+
+	if (!lg.mq && !mqueue_alloc(&lg.mq, mqueue_handler, NULL))
+		lg.mtid = pthread_self();
+
 	list_append(&lg.logl, &log->le, log);
+
+	pthread_mutex_unlock(&lg.hmutex);
+}
+
+
+/* the handler mutex is held by the calling thread */
+static bool in_handler(void)
+{
+	return __atomic_load_n(&lg.hcall, __ATOMIC_ACQUIRE) &&
+		pthread_equal(lg.htid, pthread_self());
 }
 
 
 /**
- * Unregister a log handler
+ * Unregister a log handler. The handler is not called after this returns.
+ * A handler may unregister itself.
  *
  * @param log Log handler
  */
@@ -43,7 +211,16 @@ void log_unregister_handler(struct log *log)
 	if (!log)
 		return;
 
+	if (in_handler()) {
+		list_unlink(&log->le);
+		hq_close();
+		return;
+	}
+
+	pthread_mutex_lock(&lg.hmutex);
 	list_unlink(&log->le);
+	hq_close();
+	pthread_mutex_unlock(&lg.hmutex);
 }
 
 
@@ -121,6 +298,410 @@ void log_enable_stdout(bool enable)
 }
 
 
+/**
+ * Set the rate limit of the messages of one call site
+ *
+ * @param burst Messages per second, 0 for no limit
+ */
+void log_set_ratelimit(uint32_t burst)
+{
+	lg.burst = burst;
+}
+
+
+static void stat_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+
+static void write_msg(uint32_t level, const char *msg)
+{
+	struct hmsg *m;
+	size_t len;
+
+	if (lg.enable_stdout) {
+
+		bool color = level == LEVEL_WARN || level == LEVEL_ERROR;
+
+		if (color)
+			(void)re_fprintf(stdout, "\x1b[31m"); /* Red */
+
+		(void)re_fprintf(stdout, "%s", msg);
+
+		if (color)
+			(void)re_fprintf(stdout, "\x1b[;m");
+	}
+
+	pthread_mutex_lock(&lg.hmutex);
+
+	if (list_isempty(&lg.logl))
+		goto out;
+
+	/* without a queue, the handlers are called on this thread */
+	if (!lg.mq) {
+		lg.htid = pthread_self();
+		__atomic_store_n(&lg.hcall, true, __ATOMIC_RELEASE);
+
+		call_handlers(level, msg);
+
+		__atomic_store_n(&lg.hcall, false, __ATOMIC_RELAXED);
+		goto out;
+	}
+
+	if (lg.hq_n >= HQ_MAX) {
+		stat_add(&lg.stats.hdrops, 1);
+		goto out;
+	}
+
+	len = str_len(msg);
+
+	m = mem_zalloc(sizeof(*m) + len + 1, NULL);
+	if (!m)
+		goto out;
+
+	m->level = level;
+	m->msg   = (char *)(m + 1);
+	memcpy(m->msg, msg, len + 1);
+
+	list_append(&lg.hq, &m->le, m);
+
+	/* one wakeup for the messages queued since the last delivery */
+	if (!lg.hq_n++)
+		(void)mqueue_push(lg.mq, 0, NULL);
+
+ out:
+	pthread_mutex_unlock(&lg.hmutex);
+}
+
+
+/* Repeats of a message of the same call site, printed once */
+struct repeat {
+	const char *fmt;
+	uint32_t level;
+	uint32_t n;
+	char msg[MSG_SIZE];
+};
+
+
+static void repeat_flush(struct repeat *rep)
+{
+	char buf[64];
+
+	if (rep->n) {
+		(void)re_snprintf(buf, sizeof(buf),
+				  "last message repeated %u times\n", rep->n);
+		write_msg(rep->level, buf);
+		rep->n = 0;
+	}
+}
+
+
+static void writer_msg(struct repeat *rep, uint32_t level, const char *fmt,
+		       const char *msg)
+{
+	if (fmt == rep->fmt && level == rep->level &&
+	    0 == strcmp(msg, rep->msg)) {
+		++rep->n;
+		stat_add(&lg.stats.repeats, 1);
+		return;
+	}
+
+	repeat_flush(rep);
+
+	write_msg(level, msg);
+
+	rep->fmt   = fmt;
+	rep->level = level;
+	str_ncpy(rep->msg, msg, sizeof(rep->msg));
+}
+
+
+/* take the next message from the ring, false if there is none */
+static bool ring_get(uint32_t *level, const char **fmt, char *msg)
+{
+	struct slot *s = &lg.ring[lg.tail % RING_SIZE];
+	size_t len = 0;
+	unsigned i, n;
+
+	if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != lg.tail + 1)
+		return false;
+
+	*level = s->level;
+	*fmt   = s->fmt;
+	n      = s->n;
+
+	for (i=0; i<n; i++) {
+
+		s = &lg.ring[(lg.tail + i) % RING_SIZE];
+
+		memcpy(&msg[len], s->text, s->len);
+		len += s->len;
+
+		__atomic_store_n(&s->seq, lg.tail + i + RING_SIZE,
+				 __ATOMIC_RELEASE);
+	}
+
+	msg[len] = '\0';
+
+	lg.tail += n;
+
+	return true;
+}
+
+
+static void *writer_thread(void *arg)
+{
+	static struct repeat rep;
+	static char msg[MSG_SIZE];
+	uint32_t level;
+	const char *fmt;
+	(void)arg;
+
+	for (;;) {
+		struct timespec ts;
+
+		while (ring_get(&level, &fmt, msg)) {
+			writer_msg(&rep, level, fmt, msg);
+			__atomic_store_n(&lg.done, lg.tail, __ATOMIC_RELEASE);
+		}
+
+		pthread_mutex_lock(&lg.mutex);
+
+		pthread_cond_broadcast(&lg.drained);
+
+		__atomic_store_n(&lg.sleeping, true, __ATOMIC_SEQ_CST);
+
+		/* a message may have come before the writer was sleeping */
+		if (__atomic_load_n(&lg.head, __ATOMIC_SEQ_CST) == lg.tail) {
+
+			(void)clock_gettime(CLOCK_REALTIME, &ts);
+			++ts.tv_sec;
+
+			if (pthread_cond_timedwait(&lg.cond, &lg.mutex, &ts))
+				repeat_flush(&rep);
+		}
+
+		__atomic_store_n(&lg.sleeping, false, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_unlock(&lg.mutex);
+	}
+
+	return NULL;
+}
+
+
+static void fork_child_handler(void)
+{
+	uint32_t i;
+
+	/* the writer thread is gone, pending messages are dropped */
+	pthread_mutex_init(&lg.hmutex, NULL);
+	pthread_mutex_init(&lg.mutex, NULL);
+	pthread_cond_init(&lg.cond, NULL);
+	pthread_cond_init(&lg.drained, NULL);
+
+	for (i=0; i<RING_SIZE; i++)
+		lg.ring[i].seq = i;
+
+	lg.head     = 0;
+	lg.tail     = 0;
+	lg.done     = 0;
+	lg.sleeping = false;
+	lg.hcall    = false;
+	lg.state    = WRITER_NONE;
+}
+
+
+static void writer_start(void)
+{
+	static bool once;
+	pthread_attr_t attr;
+	pthread_t tid;
+	uint32_t i;
+
+	pthread_mutex_lock(&lg.mutex);
+
+	if (lg.state != WRITER_NONE)
+		goto out;
+
+	if (!once) {
+		for (i=0; i<RING_SIZE; i++)
+			lg.ring[i].seq = i;
+
+		(void)pthread_atfork(NULL, NULL, fork_child_handler);
+		(void)atexit(log_flush);
+		once = true;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	__atomic_store_n(&lg.state,
+			 pthread_create(&tid, &attr, writer_thread, NULL) ?
+			 WRITER_FAILED : WRITER_RUNNING, __ATOMIC_RELEASE);
+
+	pthread_attr_destroy(&attr);
+
+ out:
+	pthread_mutex_unlock(&lg.mutex);
+}
+
+
+/* put a message into the ring, false if the ring is full */
+static bool ring_put(uint32_t level, const char *fmt, const char *msg,
+		     size_t len)
+{
+	uint32_t pos, n, i;
+	struct slot *s;
+
+	n = len ? (uint32_t)((len + SLOT_SIZE - 1) / SLOT_SIZE) : 1;
+
+	pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+
+	for (;;) {
+		int32_t diff;
+
+		/* the slots are freed in order, so the last one tells */
+		s = &lg.ring[(pos + n - 1) % RING_SIZE];
+		diff = (int32_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) -
+				 (pos + n - 1));
+
+		if (diff < 0)
+			return false;
+
+		if (diff == 0 &&
+		    __atomic_compare_exchange_n(&lg.head, &pos, pos + n,
+						true, __ATOMIC_SEQ_CST,
+						__ATOMIC_RELAXED))
+			break;
+
+		if (diff > 0)
+			pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+	}
+
+	/* the first slot is ready last, then the whole message is */
+	for (i=n; i-- > 0;) {
+
+		const size_t sz = min(len - i * SLOT_SIZE, (size_t)SLOT_SIZE);
+
+		s = &lg.ring[(pos + i) % RING_SIZE];
+
+		s->level = (uint8_t)level;
+		s->n     = (uint8_t)n;
+		s->fmt   = fmt;
+		s->len   = len ? (uint16_t)sz : 0;
+		memcpy(s->text, &msg[i * SLOT_SIZE], s->len);
+
+		__atomic_store_n(&s->seq, pos + i + 1, __ATOMIC_RELEASE);
+	}
+
+	if (__atomic_load_n(&lg.sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&lg.mutex);
+		pthread_cond_signal(&lg.cond);
+		pthread_mutex_unlock(&lg.mutex);
+	}
+
+	return true;
+}
+
+
+/*
+ * Find the slot of a call site. On a collision the next slots are probed,
+ * a new call site takes a free slot or the least recently used one.
+ */
+static struct site *site_find(const char *fmt, bool *fresh)
+{
+	const uintptr_t h = (uintptr_t)fmt >> 3;
+	struct site *lru = NULL;
+	uint32_t i;
+
+	*fresh = false;
+
+	for (i=0; i<NUM_PROBE; i++) {
+
+		struct site *st = &lg.sitev[(h + i) % NUM_SITES];
+		const char *key = __atomic_load_n(&st->fmt, __ATOMIC_RELAXED);
+
+		if (!key &&
+		    __atomic_compare_exchange_n(&st->fmt, &key, fmt, false,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED)) {
+			*fresh = true;
+			return st;
+		}
+
+		if (key == fmt)
+			return st;
+
+		if (!lru || __atomic_load_n(&st->sec, __ATOMIC_RELAXED) <
+		    __atomic_load_n(&lru->sec, __ATOMIC_RELAXED))
+			lru = st;
+	}
+
+	__atomic_store_n(&lru->fmt, fmt, __ATOMIC_RELAXED);
+	*fresh = true;
+
+	return lru;
+}
+
+
+/* check the rate limit of a call site, and take its suppressed count */
+static bool site_allow(const char *fmt, uint32_t *suppressed)
+{
+	const uint32_t burst = lg.burst;
+	struct site *st;
+	uint64_t sec;
+	bool fresh;
+
+	if (!burst)
+		return true;
+
+	st  = site_find(fmt, &fresh);
+	sec = tmr_jiffies() / 1000;
+
+	if (fresh) {
+		__atomic_store_n(&st->sec, sec, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->n, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->suppressed, 0, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	if (__atomic_exchange_n(&st->sec, sec, __ATOMIC_RELAXED) != sec) {
+		__atomic_store_n(&st->n, 1, __ATOMIC_RELAXED);
+		*suppressed = __atomic_exchange_n(&st->suppressed, 0,
+						  __ATOMIC_RELAXED);
+		return true;
+	}
+
+	if (__atomic_add_fetch(&st->n, 1, __ATOMIC_RELAXED) <= burst)
+		return true;
+
+	__atomic_add_fetch(&st->suppressed, 1, __ATOMIC_RELAXED);
+	stat_add(&lg.stats.suppressed, 1);
+
+	return false;
+}
+
+
+static void put_msg(uint32_t level, const char *fmt, const char *msg,
+		    size_t len)
+{
+	if (__atomic_load_n(&lg.state, __ATOMIC_ACQUIRE) == WRITER_NONE)
+		writer_start();
+
+	if (__atomic_load_n(&lg.state, __ATOMIC_ACQUIRE) != WRITER_RUNNING) {
+		write_msg(level, msg);
+		return;
+	}
+
+	if (ring_put(level, fmt, msg, len))
+		stat_add(&lg.stats.msgs, 1);
+	else
+		stat_add(&lg.stats.drops, 1);
+}
+
+
 /**
  * Print a message to the logging system
  *
@@ -130,38 +711,102 @@ void log_enable_stdout(bool enable)
  */
 void vlog(enum log_level level, const char *fmt, va_list ap)
 {
-	char buf[4096];
-	struct le *le;
+	char buf[MSG_SIZE];
+	uint32_t suppressed = 0;
+	int len;
 
 	if (level < lg.level)
 		return;
 
-	if (re_vsnprintf(buf, sizeof(buf), fmt, ap) < 0)
+	if (!site_allow(fmt, &suppressed))
 		return;
 
-	if (lg.enable_stdout) {
+	if (suppressed) {
+		len = re_snprintf(buf, sizeof(buf),
+				  "log: %u messages suppressed\n", suppressed);
+		if (len > 0)
+			put_msg(level, NULL, buf, len);
+	}
 
-		bool color = level == LEVEL_WARN || level == LEVEL_ERROR;
+	len = re_vsnprintf(buf, sizeof(buf), fmt, ap);
+	if (len < 0)
+		return;
 
-		if (color)
-			(void)re_fprintf(stdout, "\x1b[31m"); /* Red */
+	put_msg(level, fmt, buf, min((size_t)len, sizeof(buf) - 1));
+}
 
-		(void)re_fprintf(stdout, "%s", buf);
 
-		if (color)
-			(void)re_fprintf(stdout, "\x1b[;m");
-	}
+/**
+ * Wait until all messages in the ring are printed. On the handler thread
+ * the waiting messages are passed to the log handlers too.
+ */
+void log_flush(void)
+{
+	struct timespec ts;
 
-	le = lg.logl.head;
+	pthread_mutex_lock(&lg.mutex);
 
-	while (le) {
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 2;
 
-		struct log *log = le->data;
-		le = le->next;
+	while (lg.state == WRITER_RUNNING &&
+	       __atomic_load_n(&lg.head, __ATOMIC_SEQ_CST) !=
+	       __atomic_load_n(&lg.done, __ATOMIC_ACQUIRE)) {
 
-		if (log->h)
-			log->h(level, buf);
+		pthread_cond_signal(&lg.cond);
+
+		if (pthread_cond_timedwait(&lg.drained, &lg.mutex, &ts))
+			break;
 	}
+
+	pthread_mutex_unlock(&lg.mutex);
+
+	hq_deliver();
+}
+
+
+/**
+ * Get the statistics of the logging system
+ *
+ * @param stats Returned statistics
+ */
+void log_stats(struct log_stats *stats)
+{
+	if (!stats)
+		return;
+
+	stats->msgs       = __atomic_load_n(&lg.stats.msgs, __ATOMIC_RELAXED);
+	stats->drops      = __atomic_load_n(&lg.stats.drops,
+					    __ATOMIC_RELAXED);
+	stats->suppressed = __atomic_load_n(&lg.stats.suppressed,
+					    __ATOMIC_RELAXED);
+	stats->repeats    = __atomic_load_n(&lg.stats.repeats,
+					    __ATOMIC_RELAXED);
+	stats->hdrops     = __atomic_load_n(&lg.stats.hdrops,
+					    __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Print the statistics of the logging system
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int log_debug(struct re_printf *pf, void *unused)
+{
+	struct log_stats st;
+	(void)unused;
+
+	log_stats(&st);
+
+	return re_hprintf(pf, "log: %llu messages, %llu dropped,"
+			  " %llu suppressed, %llu repeated,"
+			  " %llu not passed to handlers\n",
+			  st.msgs, st.drops, st.suppressed, st.repeats,
+			  st.hdrops);
 }
 
 
@@ -25,6 +25,15 @@ struct log {
 	log_h *h;
 };
 
+/** Statistics of the logging system */
+struct log_stats {
+	uint64_t msgs;        /**< Messages put into the ring          */
+	uint64_t drops;       /**< Messages dropped, the ring was full */
+	uint64_t suppressed;  /**< Messages over the rate limit        */
+	uint64_t repeats;     /**< Repeated messages not printed       */
+	uint64_t hdrops;      /**< Messages dropped for the handlers   */
+};
+
 void log_register_handler(struct log *logh);
 void log_unregister_handler(struct log *logh);
 void log_level_set(enum log_level level);
@@ -33,6 +42,10 @@ const char *log_level_name(enum log_level level);
 void log_enable_debug(bool enable);
 void log_enable_info(bool enable);
 void log_enable_stdout(bool enable);
+void log_set_ratelimit(uint32_t burst);
+void log_flush(void);
+void log_stats(struct log_stats *stats);
+int  log_debug(struct re_printf *pf, void *unused);
 void vlog(enum log_level level, const char *fmt, va_list ap);
 void loglv(enum log_level level, const char *fmt, ...);
 void debug(const char *fmt, ...);
@@ -0,0 +1,513 @@
+/**
+ * @file mclock.c  Shared media clock
+ *
+ * A few clock threads drive the virtual audio and video devices, which
+ * would otherwise each run a thread of their own that polls the time.
+ * Every client has a period and is ticked on deadlines of a grid of that
+ * period, so that all clients with the same period share one wake-up.
+ * The threads sleep until the earliest deadline on the monotonic clock
+ * and tick the clients which are due in a batch.
+ *
+ * A client which falls behind is ticked again at once until it has
+ * caught up, so the media timestamps stay continuous. A client which is
+ * too far behind, e.g. after the system was suspended, is moved to the
+ * next deadline instead.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "mclock.h"
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+
+
+enum {
+	NUM_THREADS = 2,      /* clock threads                      */
+	MAX_LAG = 200000,     /* resync a client behind by more [us] */
+};
+
+/* upper edges of the histogram buckets [us], the last one is open */
+static const uint32_t hist_edge[MCLOCK_HIST - 1] = {
+	100, 250, 500, 1000, 2000, 5000, 10000
+};
+
+struct mthread {
+	pthread_t tid;            /**< Clock thread                        */
+	bool started;             /**< Clock thread was created            */
+	bool run;                 /**< Clock thread is running             */
+	pthread_mutex_t mutex;    /**< Protects the clients and statistics */
+	pthread_cond_t cond;      /**< Signalled when the clients change   */
+	pthread_cond_t done;      /**< Signalled when a tick has finished  */
+	struct list clientl;      /**< Clients, sorted by deadline         */
+	const struct mclock *running; /**< Client in its tick handler      */
+	uint32_t n;               /**< Number of clients                   */
+	struct mclock_stats stats;/**< Statistics of this thread           */
+};
+
+struct mclock_base {
+	struct mthread thrv[NUM_THREADS];  /**< Clock threads             */
+	uint32_t thrc;                     /**< Number of clock threads   */
+};
+
+struct mclock {
+	struct le le;             /**< Element in the thread's clients     */
+	struct mclock_base *base; /**< Shared clock (ref.)                 */
+	struct mthread *thr;      /**< Clock thread of the client          */
+	uint64_t next;            /**< Next deadline [us]                  */
+	uint32_t period;          /**< Tick period [us]                    */
+	mclock_h *h;              /**< Tick handler                        */
+	void *arg;                /**< Handler argument                    */
+};
+
+
+static struct mclock_base *shared_clock;
+
+
+static uint64_t clock_usec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void hist_add(uint64_t *hv, uint64_t v)
+{
+	unsigned i = 0;
+
+	while (i < MCLOCK_HIST - 1 && v >= hist_edge[i])
+		++i;
+
+	++hv[i];
+}
+
+
+/* must be called with the mutex held */
+static void wait_until(struct mthread *t, uint64_t deadline)
+{
+	struct timespec ts;
+
+#ifdef LINUX
+	/* the condition uses the monotonic clock */
+#else
+	uint64_t now = clock_usec();
+	struct timespec rt;
+
+	(void)clock_gettime(CLOCK_REALTIME, &rt);
+	deadline = (uint64_t)rt.tv_sec * 1000000 + rt.tv_nsec / 1000 +
+		(deadline > now ? deadline - now : 0);
+#endif
+
+	ts.tv_sec  = deadline / 1000000;
+	ts.tv_nsec = (deadline % 1000000) * 1000;
+
+	(void)pthread_cond_timedwait(&t->cond, &t->mutex, &ts);
+}
+
+
+static bool sort_handler(struct le *le1, struct le *le2, void *arg)
+{
+	const struct mclock *mc1 = le1->data;
+	const struct mclock *mc2 = le2->data;
+	(void)arg;
+
+	return mc1->next <= mc2->next;
+}
+
+
+static uint64_t align(uint64_t now, uint32_t period)
+{
+	return (now / period + 1) * period;
+}
+
+
+static void *clock_thread(void *arg)
+{
+	struct mthread *t = arg;
+	uint64_t batch = 0;
+
+	pthread_mutex_lock(&t->mutex);
+
+	while (t->run) {
+
+		struct mclock *mc = list_ledata(list_head(&t->clientl));
+		uint64_t now, ts;
+
+		if (!mc) {
+			batch = 0;
+			pthread_cond_wait(&t->cond, &t->mutex);
+			continue;
+		}
+
+		now = clock_usec();
+
+		if (mc->next > now) {
+			batch = 0;
+			wait_until(t, mc->next);
+			continue;
+		}
+
+		if (!batch) {
+			const uint64_t late = now - mc->next;
+
+			++t->stats.ticks;
+			hist_add(t->stats.jitter, late);
+			t->stats.late_max = max(t->stats.late_max, late);
+			batch = mc->next;
+		}
+		else if (mc->next > batch) {
+
+			/* the next deadline passed during the batch */
+			++t->stats.overruns;
+			hist_add(t->stats.overrun, now - mc->next);
+			batch = mc->next;
+		}
+
+		if (now - mc->next > MAX_LAG) {
+			++t->stats.resyncs;
+			mc->next = align(now, mc->period);
+			list_unlink(&mc->le);
+			list_insert_sorted(&t->clientl, sort_handler, NULL,
+					   &mc->le, mc);
+			continue;
+		}
+
+		ts = mc->next;
+		mc->next += mc->period;
+
+		list_unlink(&mc->le);
+		list_insert_sorted(&t->clientl, sort_handler, NULL,
+				   &mc->le, mc);
+
+		t->running = mc;
+		pthread_mutex_unlock(&t->mutex);
+
+		mc->h(ts, mc->arg);
+
+		pthread_mutex_lock(&t->mutex);
+		t->running = NULL;
+		++t->stats.calls;
+		pthread_cond_broadcast(&t->done);
+	}
+
+	pthread_mutex_unlock(&t->mutex);
+
+	return NULL;
+}
+
+
+static void base_destructor(void *arg)
+{
+	struct mclock_base *base = arg;
+	uint32_t i;
+
+	if (shared_clock == base)
+		shared_clock = NULL;
+
+	for (i=0; i<base->thrc; i++) {
+		struct mthread *t = &base->thrv[i];
+
+		pthread_mutex_lock(&t->mutex);
+		t->run = false;
+		pthread_cond_signal(&t->cond);
+		pthread_mutex_unlock(&t->mutex);
+
+		if (t->started)
+			pthread_join(t->tid, NULL);
+
+		pthread_mutex_destroy(&t->mutex);
+		pthread_cond_destroy(&t->cond);
+		pthread_cond_destroy(&t->done);
+	}
+}
+
+
+static int thread_init(struct mthread *t)
+{
+	pthread_condattr_t attr;
+	int err;
+
+	err = pthread_condattr_init(&attr);
+	if (err)
+		return err;
+
+#ifdef LINUX
+	err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+	if (!err)
+		err = pthread_cond_init(&t->cond, &attr);
+
+	pthread_condattr_destroy(&attr);
+
+	if (err)
+		return err;
+
+	err = pthread_cond_init(&t->done, NULL);
+	if (err) {
+		pthread_cond_destroy(&t->cond);
+		return err;
+	}
+
+	err = pthread_mutex_init(&t->mutex, NULL);
+	if (err) {
+		pthread_cond_destroy(&t->cond);
+		pthread_cond_destroy(&t->done);
+		return err;
+	}
+
+	list_init(&t->clientl);
+
+	return 0;
+}
+
+
+static int base_alloc(struct mclock_base **basep)
+{
+	struct mclock_base *base;
+	uint32_t i;
+	int err = 0;
+
+	base = mem_zalloc(sizeof(*base), base_destructor);
+	if (!base)
+		return ENOMEM;
+
+	for (i=0; i<NUM_THREADS; i++) {
+		struct mthread *t = &base->thrv[i];
+
+		err = thread_init(t);
+		if (err)
+			goto out;
+
+		t->run = true;
+		++base->thrc;
+
+		err = pthread_create(&t->tid, NULL, clock_thread, t);
+		if (err) {
+			warning("mclock: could not create thread (%m)\n",
+				err);
+			goto out;
+		}
+
+		t->started = true;
+	}
+
+	debug("mclock: started %u clock threads\n", base->thrc);
+
+ out:
+	if (err)
+		mem_deref(base);
+	else
+		*basep = base;
+
+	return err;
+}
+
+
+static void destructor(void *arg)
+{
+	struct mclock *mc = arg;
+	struct mthread *t = mc->thr;
+
+	if (t) {
+		pthread_mutex_lock(&t->mutex);
+
+		list_unlink(&mc->le);
+		--t->n;
+
+		/* wait for a tick in progress, unless it is this one */
+		if (!pthread_equal(pthread_self(), t->tid)) {
+			while (t->running == mc)
+				pthread_cond_wait(&t->done, &t->mutex);
+		}
+
+		pthread_mutex_unlock(&t->mutex);
+	}
+
+	mem_deref(mc->base);
+}
+
+
+/**
+ * Register a client of the shared media clock. The clock threads are
+ * started with the first client and stopped with the last one.
+ *
+ * @param mcp    Pointer to allocated clock client
+ * @param period Tick period [us]
+ * @param h      Tick handler
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note The tick handler is called from a clock thread, and is not called
+ *       any more when the client has been freed. Clients are allocated
+ *       and freed from the main thread.
+ */
+int mclock_alloc(struct mclock **mcp, uint32_t period, mclock_h *h,
+		 void *arg)
+{
+	struct mclock *mc;
+	struct mthread *t;
+	uint32_t i;
+	int err = 0;
+
+	if (!mcp || !period || !h)
+		return EINVAL;
+
+	mc = mem_zalloc(sizeof(*mc), destructor);
+	if (!mc)
+		return ENOMEM;
+
+	if (shared_clock) {
+		mc->base = mem_ref(shared_clock);
+	}
+	else {
+		err = base_alloc(&shared_clock);
+		if (err)
+			goto out;
+
+		mc->base = shared_clock;
+	}
+
+	/* the thread with the fewest clients */
+	t = &mc->base->thrv[0];
+	for (i=1; i<mc->base->thrc; i++) {
+		if (mc->base->thrv[i].n < t->n)
+			t = &mc->base->thrv[i];
+	}
+
+	mc->period = period;
+	mc->h      = h;
+	mc->arg    = arg;
+
+	pthread_mutex_lock(&t->mutex);
+
+	mc->thr  = t;
+	mc->next = align(clock_usec(), period);
+	++t->n;
+
+	list_insert_sorted(&t->clientl, sort_handler, NULL, &mc->le, mc);
+
+	if (list_head(&t->clientl) == &mc->le)
+		pthread_cond_signal(&t->cond);
+
+	pthread_mutex_unlock(&t->mutex);
+
+ out:
+	if (err)
+		mem_deref(mc);
+	else
+		*mcp = mc;
+
+	return err;
+}
+
+
+/**
+ * Get the upper edge of a histogram bucket
+ *
+ * @param i Index of the bucket
+ *
+ * @return Upper edge [us], 0 for the last bucket which is open
+ */
+uint32_t mclock_hist_edge(unsigned i)
+{
+	return i < MCLOCK_HIST - 1 ? hist_edge[i] : 0;
+}
+
+
+/**
+ * Get the statistics of the shared media clock
+ *
+ * @param stats Returned statistics, summed over all clock threads
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mclock_stats(struct mclock_stats *stats)
+{
+	uint32_t i, j;
+
+	if (!stats)
+		return EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!shared_clock)
+		return 0;
+
+	for (i=0; i<shared_clock->thrc; i++) {
+		struct mthread *t = &shared_clock->thrv[i];
+
+		pthread_mutex_lock(&t->mutex);
+
+		++stats->threads;
+		stats->clients  += t->n;
+		stats->ticks    += t->stats.ticks;
+		stats->calls    += t->stats.calls;
+		stats->overruns += t->stats.overruns;
+		stats->resyncs  += t->stats.resyncs;
+		stats->late_max  = max(stats->late_max, t->stats.late_max);
+
+		for (j=0; j<MCLOCK_HIST; j++) {
+			stats->jitter[j]  += t->stats.jitter[j];
+			stats->overrun[j] += t->stats.overrun[j];
+		}
+
+		pthread_mutex_unlock(&t->mutex);
+	}
+
+	return 0;
+}
+
+
+static int print_hist(struct re_printf *pf, const char *name,
+		      const uint64_t *hv)
+{
+	unsigned i;
+	int err;
+
+	err = re_hprintf(pf, " %-8s", name);
+
+	for (i=0; i<MCLOCK_HIST; i++) {
+		if (i < MCLOCK_HIST - 1)
+			err |= re_hprintf(pf, " <%uus:%llu", hist_edge[i],
+					  hv[i]);
+		else
+			err |= re_hprintf(pf, " more:%llu", hv[i]);
+	}
+
+	return err | re_hprintf(pf, "\n");
+}
+
+
+/**
+ * Print the statistics of the shared media clock
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mclock_debug(struct re_printf *pf, void *unused)
+{
+	struct mclock_stats st;
+	int err;
+	(void)unused;
+
+	err = mclock_stats(&st);
+	if (err)
+		return err;
+
+	err  = re_hprintf(pf, "Media clock: threads=%u clients=%u ticks=%llu"
+			  " calls=%llu overruns=%llu resyncs=%llu"
+			  " late_max=%lluus\n",
+			  st.threads, st.clients, st.ticks, st.calls,
+			  st.overruns, st.resyncs, st.late_max);
+	err |= print_hist(pf, "jitter:", st.jitter);
+	err |= print_hist(pf, "overrun:", st.overrun);
+
+	return err;
+}
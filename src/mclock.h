@@ -0,0 +1,46 @@
+/**
+ * @file mclock.h
+ * @brief Shared media clock
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAMCLOCK_H_INCLUDED
+#define UAMCLOCK_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+struct mclock;
+
+enum {
+	MCLOCK_HIST = 8,      /**< Number of histogram buckets */
+};
+
+/**
+ * Media clock tick handler, called from a media clock thread
+ *
+ * @param ts  Deadline of the tick, on the monotonic clock [us]
+ * @param arg Handler argument
+ */
+typedef void (mclock_h)(uint64_t ts, void *arg);
+
+/** Statistics of the media clock */
+struct mclock_stats {
+	uint32_t threads;     /**< Clock threads running              */
+	uint32_t clients;     /**< Registered clients                 */
+	uint64_t ticks;       /**< Wake-ups with clients due          */
+	uint64_t calls;       /**< Tick handlers called               */
+	uint64_t overruns;    /**< Batches which ran past a deadline  */
+	uint64_t resyncs;     /**< Clients which fell too far behind  */
+	uint64_t late_max;    /**< Latest wake-up [us]                */
+	uint64_t jitter[MCLOCK_HIST];  /**< Wake-up lateness histogram  */
+	uint64_t overrun[MCLOCK_HIST]; /**< Batch overrun histogram     */
+};
+
+int  mclock_alloc(struct mclock **mcp, uint32_t period, mclock_h *h,
+		  void *arg);
+uint32_t mclock_hist_edge(unsigned i);
+int  mclock_stats(struct mclock_stats *stats);
+int  mclock_debug(struct re_printf *pf, void *unused);
+
+#endif /* UAMCLOCK_H_INCLUDED */
@@ -6,106 +6,144 @@
  */
 
 #include "metric.h"
+#include <string.h>
 
 
-enum {TMR_INTERVAL = 3};
-static void tmr_handler(void *arg)
-{
-	struct metric *metric = arg;
-	const uint64_t now = tmr_jiffies();
-	uint32_t diff;
+enum {BITRATE_INTERVAL = 3000};  /* bitrate update interval [ms] */
 
-	tmr_start(&metric->tmr, TMR_INTERVAL * 1000, tmr_handler, metric);
 
-	lock_write_get(metric->lock);
+int metric_init(struct metric *metric)
+{
+	if (!metric)
+		return EINVAL;
 
-	if (!metric->started)
-		goto out;
+	memset(metric, 0, sizeof(*metric));
 
- 	if (now <= metric->ts_last)
-		goto out;
+	return 0;
+}
 
-	if (metric->ts_last) {
-		uint32_t bytes = metric->n_bytes - metric->n_bytes_last;
-		diff = (uint32_t)(now - metric->ts_last);
-		metric->cur_bitrate = 1000 * 8 * bytes / diff;
-	}
 
-	/* Update counters */
-	metric->ts_last = now;
-	metric->n_bytes_last = metric->n_bytes;
+void metric_reset(struct metric *metric)
+{
+	if (!metric)
+		return;
 
-out:
-	lock_rel(metric->lock);
+	memset(metric, 0, sizeof(*metric));
 }
 
 
-static void metric_start(struct metric *metric)
+/*
+ * NOTE: may be called from any thread
+ */
+void metric_add_packet(struct metric *metric, size_t packetsize)
 {
-	if (metric->started)
+	if (!metric)
 		return;
 
-	metric->ts_start = tmr_jiffies();
+	if (!__atomic_load_n(&metric->ts_start, __ATOMIC_RELAXED)) {
+
+		uint64_t expected = 0;
 
-	metric->started = true;
+		(void)__atomic_compare_exchange_n(&metric->ts_start, &expected,
+						  tmr_jiffies(), false,
+						  __ATOMIC_RELAXED,
+						  __ATOMIC_RELAXED);
+	}
+
+	__atomic_fetch_add(&metric->n_bytes, (uint32_t)packetsize,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&metric->n_packets, 1, __ATOMIC_RELAXED);
 }
 
 
-int metric_init(struct metric *metric)
+/*
+ * NOTE: may be called from any thread
+ */
+void metric_add_err(struct metric *metric)
 {
-	int err;
-
 	if (!metric)
-		return EINVAL;
+		return;
 
-	err = lock_alloc(&metric->lock);
-	if (err)
-		return err;
+	__atomic_fetch_add(&metric->n_err, 1, __ATOMIC_RELAXED);
+}
 
-	tmr_start(&metric->tmr, 100, tmr_handler, metric);
 
-	return 0;
+uint32_t metric_n_packets(const struct metric *metric)
+{
+	return metric ? __atomic_load_n(&metric->n_packets, __ATOMIC_RELAXED)
+		: 0;
 }
 
 
-void metric_reset(struct metric *metric)
+uint32_t metric_n_bytes(const struct metric *metric)
 {
-	if (!metric)
-		return;
+	return metric ? __atomic_load_n(&metric->n_bytes, __ATOMIC_RELAXED)
+		: 0;
+}
 
-	tmr_cancel(&metric->tmr);
-	metric->lock = mem_deref(metric->lock);
+
+uint32_t metric_n_err(const struct metric *metric)
+{
+	return metric ? __atomic_load_n(&metric->n_err, __ATOMIC_RELAXED)
+		: 0;
 }
 
 
-/*
- * NOTE: may be called from any thread
+/**
+ * Get the current bitrate, averaged over the last few seconds. The value
+ * is recalculated when read, at most once per interval.
+ *
+ * @param metric Metric object
+ *
+ * @return Bitrate in [bit/s]
+ *
+ * NOTE: must be called from one thread only (the reader)
  */
-void metric_add_packet(struct metric *metric, size_t packetsize)
+uint32_t metric_bitrate(struct metric *metric)
 {
+	uint64_t now, ts_start;
+	uint32_t bytes, diff;
+
 	if (!metric)
-		return;
+		return 0;
 
-	lock_write_get(metric->lock);
+	ts_start = __atomic_load_n(&metric->ts_start, __ATOMIC_RELAXED);
+	if (!ts_start)
+		return 0;
 
-	if (!metric->started)
-		metric_start(metric);
+	if (!metric->ts_last)
+		metric->ts_last = ts_start;
 
-	metric->n_bytes += (uint32_t)packetsize;
-	metric->n_packets++;
+	now = tmr_jiffies();
+	if (now < metric->ts_last + BITRATE_INTERVAL)
+		return metric->cur_bitrate;
 
-	lock_rel(metric->lock);
+	bytes = metric_n_bytes(metric) - metric->n_bytes_last;
+	diff  = (uint32_t)(now - metric->ts_last);
+
+	metric->cur_bitrate  = (uint32_t)(1000ULL * 8 * bytes / diff);
+	metric->ts_last      = now;
+	metric->n_bytes_last += bytes;
+
+	return metric->cur_bitrate;
 }
 
 
 double metric_avg_bitrate(const struct metric *metric)
 {
+	uint64_t ts_start;
 	int diff;
 
-	if (!metric || !metric->ts_start)
+	if (!metric)
+		return 0;
+
+	ts_start = __atomic_load_n(&metric->ts_start, __ATOMIC_RELAXED);
+	if (!ts_start)
 		return 0;
 
-	diff = (int)(tmr_jiffies() - metric->ts_start);
+	diff = (int)(tmr_jiffies() - ts_start);
+	if (diff <= 0)
+		return 0;
 
-	return 1000.0 * 8 * (double)metric->n_bytes / (double)diff;
+	return 1000.0 * 8 * (double)metric_n_bytes(metric) / (double)diff;
 }
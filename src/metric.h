@@ -14,19 +14,21 @@
 
 #ifndef UAMODAPI_USE		/* Internal API */
 
+/**
+ * Media metrics for one direction of a stream.
+ *
+ * The counters are updated with atomic operations from the media threads,
+ * no lock or timer is needed. The bitrate is calculated lazily by the
+ * reader, the bitrate fields are only touched from the reader side.
+ */
 struct metric {
-	/* internal stuff: */
-	struct tmr tmr;
-	struct lock *lock;
+	/* written by the media threads: */
 	uint64_t ts_start;
-	bool started;
-
-	/* counters: */
 	uint32_t n_packets;
 	uint32_t n_bytes;
 	uint32_t n_err;
 
-	/* bitrate calculation */
+	/* bitrate calculation, reader side: */
 	uint32_t cur_bitrate;
 	uint64_t ts_last;
 	uint32_t n_bytes_last;
@@ -35,6 +37,11 @@ struct metric {
 int      metric_init(struct metric *metric);
 void     metric_reset(struct metric *metric);
 void     metric_add_packet(struct metric *metric, size_t packetsize);
+void     metric_add_err(struct metric *metric);
+uint32_t metric_n_packets(const struct metric *metric);
+uint32_t metric_n_bytes(const struct metric *metric);
+uint32_t metric_n_err(const struct metric *metric);
+uint32_t metric_bitrate(struct metric *metric);
 double   metric_avg_bitrate(const struct metric *metric);
 
 #endif /* ifndef UAMODAPI_USE */
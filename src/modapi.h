@@ -31,26 +31,39 @@ extern "C" {
 #include "rsua-mod/aulevel.h"
 #include "rsua-mod/auplay.h"
 #include "rsua-mod/ausrc.h"
+#include "rsua-mod/bwe.h"
 #include "rsua-mod/call.h"
 #include "rsua-mod/cmd.h"
 #include "rsua-mod/conf.h"
+#include "rsua-mod/confmix.h"
 #include "rsua-mod/data.h"
+#include "rsua-mod/dsp.h"
 #include "rsua-mod/ept.h"
 #include "rsua-mod/ev.h"
 #include "rsua-mod/h264.h"
+#include "rsua-mod/lathist.h"
 #include "rsua-mod/log.h"
+#include "rsua-mod/mclock.h"
 #include "rsua-mod/mediadev.h"
 #include "rsua-mod/menc.h"
 #include "rsua-mod/message.h"
 #include "rsua-mod/mnat.h"
 #include "rsua-mod/net.h"
 #include "rsua-mod/play.h"
+#include "rsua-mod/regsched.h"
+#include "rsua-mod/rtprx.h"
+#include "rsua-mod/rtptx.h"
+#include "rsua-mod/rtxbuf.h"
 #include "rsua-mod/sdp.h"
+#include "rsua-mod/simulcast.h"
 #include "rsua-mod/sipreq.h"
 #include "rsua-mod/stream.h"
 #include "rsua-mod/stunuri.h"
 #include "rsua-mod/ui.h"
 #include "rsua-mod/vidcodec.h"
+#include "rsua-mod/vidcvt.h"
+#include "rsua-mod/viddecq.h"
+#include "rsua-mod/vidpool.h"
 #include "rsua-mod/video.h"
 #include "rsua-mod/vidfilt.h"
 #include "rsua-mod/vidisp.h"
@@ -0,0 +1,602 @@
+/**
+ * @file pcmcache.c  Cache of decoded audio files
+ *
+ * Audio files are decoded once to native-endian 16-bit PCM and kept in a
+ * cache, keyed by path. The entries are reference counted and read-only,
+ * so any number of players can share one entry without copying. An entry
+ * that is evicted stays valid for as long as a player holds it.
+ *
+ * The cache is bounded by the size of the samples. The least recently
+ * used entries are evicted first. An entry is reloaded if the file was
+ * modified since it was decoded.
+ *
+ * WAV files with 16-bit little-endian PCM can optionally be mapped into
+ * memory instead of being decoded, on little-endian hosts. A mapped file
+ * must never be modified in place, only replaced by rename. Truncating or
+ * rewriting it while it is mapped raises SIGBUS in the players that read
+ * it, since the modification time is only checked on lookup.
+ *
+ * The cache is used from the main thread only.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "pcmcache.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#include "rsua-rem/rem.h"
+#include "play.h"
+
+
+enum {
+	HASH_SIZE  = 32,
+	READ_CHUNK = 4096,
+};
+
+/** Decoded audio samples */
+struct pcm {
+	struct le he;             /**< Entry in the cache hash table     */
+	struct le le;             /**< Entry in the LRU list             */
+	struct pcmcache *cache;   /**< Cache, while the entry is cached  */
+	char *path;               /**< Path of the file                  */
+	time_t mtime;             /**< Modification time of the file     */
+	off_t fsize;              /**< Size of the file                  */
+	struct mbuf *mb;          /**< Decoded samples, or NULL          */
+	void *map;                /**< Mapped file, or NULL              */
+	size_t mapsz;             /**< Size of the mapping               */
+	const uint8_t *buf;       /**< Samples                           */
+	size_t size;              /**< Size of the samples in bytes      */
+	uint32_t srate;           /**< Sampling rate                     */
+	uint8_t ch;               /**< Number of channels                */
+};
+
+/** Cache of decoded audio files */
+struct pcmcache {
+	struct hash *ht;          /**< Entries by path                   */
+	struct list lru;          /**< Entries, least recently used first */
+	size_t bytes;             /**< Size of the cached samples        */
+	size_t max_bytes;         /**< Limit of the cached samples       */
+	bool mmap;                /**< Map raw PCM files                 */
+	uint64_t hits;            /**< Lookups served from the cache     */
+	uint64_t misses;          /**< Lookups which loaded the file     */
+	uint64_t evictions;       /**< Entries evicted to stay in limit  */
+};
+
+
+static void pcm_destructor(void *arg)
+{
+	struct pcm *pcm = arg;
+
+	mem_deref(pcm->mb);
+	mem_deref(pcm->path);
+
+#ifdef LINUX
+	if (pcm->map)
+		(void)munmap(pcm->map, pcm->mapsz);
+#endif
+}
+
+
+static void cache_unlink(struct pcm *pcm)
+{
+	struct pcmcache *cache = pcm->cache;
+
+	if (!cache)
+		return;
+
+	hash_unlink(&pcm->he);
+	list_unlink(&pcm->le);
+	cache->bytes -= pcm->size;
+	pcm->cache = NULL;
+
+	mem_deref(pcm);
+}
+
+
+static void cache_destructor(void *arg)
+{
+	struct pcmcache *cache = arg;
+
+	pcmcache_flush(cache);
+	mem_deref(cache->ht);
+}
+
+
+static void evict(struct pcmcache *cache)
+{
+	while (cache->bytes > cache->max_bytes && cache->lru.head) {
+
+		cache_unlink(list_ledata(cache->lru.head));
+		++cache->evictions;
+	}
+}
+
+
+static bool path_handler(struct le *le, void *arg)
+{
+	const struct pcm *pcm = le->data;
+
+	return 0 == str_cmp(pcm->path, arg);
+}
+
+
+/*
+ * Decode the file with aufile to native-endian 16-bit samples
+ */
+static int decode_file(struct pcm *pcm)
+{
+	struct aufile_prm prm;
+	struct aufile *af;
+	struct mbuf *mb;
+	uint8_t buf[READ_CHUNK];
+	int err;
+
+	err = aufile_open(&af, &prm, pcm->path, AUFILE_READ);
+	if (err)
+		return err;
+
+	mb = mbuf_alloc(sizeof(buf) * 2);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		size_t i, n = sizeof(buf);
+		size_t sampc;
+		int16_t *p;
+
+		err = aufile_read(af, buf, &n);
+		if (err || !n)
+			break;
+
+		sampc = (prm.fmt == AUFMT_S16LE) ? n / 2 : n;
+
+		if (mbuf_get_space(mb) < sampc * 2) {
+			err = mbuf_resize(mb, max(mb->size * 2,
+						  mb->end + sampc * 2));
+			if (err)
+				break;
+		}
+
+		p = (int16_t *)(void *)(mb->buf + mb->end);
+
+		switch (prm.fmt) {
+
+		case AUFMT_S16LE:
+			/* convert from Little-Endian to Native-Endian */
+			for (i=0; i<sampc; i++) {
+				uint16_t s = buf[2*i] | buf[2*i+1] << 8;
+				p[i] = (int16_t)s;
+			}
+			break;
+
+		case AUFMT_PCMA:
+			for (i=0; i<sampc; i++)
+				p[i] = g711_alaw2pcm(buf[i]);
+			break;
+
+		case AUFMT_PCMU:
+			for (i=0; i<sampc; i++)
+				p[i] = g711_ulaw2pcm(buf[i]);
+			break;
+
+		default:
+			err = ENOSYS;
+			break;
+		}
+
+		if (err)
+			break;
+
+		mb->end += sampc * 2;
+	}
+
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	pcm->mb    = mem_ref(mb);
+	pcm->buf   = mb->buf;
+	pcm->size  = mb->end;
+	pcm->srate = prm.srate;
+	pcm->ch    = prm.channels;
+
+ out:
+	mem_deref(mb);
+	mem_deref(af);
+
+	return err;
+}
+
+
+#if defined(LINUX) && defined(__BYTE_ORDER__) && \
+	__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint16_t le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+/*
+ * Map a WAV file with 16-bit PCM samples, which already are in the
+ * native format. Returns ENOTSUP for other files.
+ *
+ * The mapping is private but not a copy, so the file must not be
+ * truncated or rewritten while the entry is alive.
+ */
+static int map_file(struct pcm *pcm)
+{
+	uint8_t hdr[READ_CHUNK];
+	size_t pos = 12, datapos = 0, datasz = 0;
+	uint32_t srate = 0;
+	uint8_t ch = 0;
+	ssize_t n;
+	void *map;
+	int fd, err = 0;
+
+	fd = open(pcm->path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	n = read(fd, hdr, sizeof(hdr));
+	if (n < 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+		err = ENOTSUP;
+		goto out;
+	}
+
+	/* walk the chunks in the first block of the file */
+	while (pos + 8 <= (size_t)n) {
+
+		const uint8_t *chunk = hdr + pos;
+		uint32_t len = le32(chunk + 4);
+
+		if (!memcmp(chunk, "fmt ", 4)) {
+
+			if (pos + 8 + 16 > (size_t)n) {
+				err = ENOTSUP;
+				goto out;
+			}
+
+			/* PCM, 16 bits per sample */
+			if (le16(chunk + 8) != 1 || le16(chunk + 22) != 16) {
+				err = ENOTSUP;
+				goto out;
+			}
+
+			ch    = (uint8_t)le16(chunk + 10);
+			srate = le32(chunk + 12);
+		}
+		else if (!memcmp(chunk, "data", 4)) {
+			datapos = pos + 8;
+			datasz  = len;
+			break;
+		}
+
+		pos += 8 + len + (len & 1);
+	}
+
+	if (!datapos || !srate || !ch || datapos % 2 ||
+	    datapos > (size_t)pcm->fsize) {
+		err = ENOTSUP;
+		goto out;
+	}
+
+	datasz = min(datasz, (size_t)pcm->fsize - datapos) & ~(size_t)1;
+
+	map = mmap(NULL, datapos + datasz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		err = errno;
+		goto out;
+	}
+
+	pcm->map   = map;
+	pcm->mapsz = datapos + datasz;
+	pcm->buf   = (uint8_t *)map + datapos;
+	pcm->size  = datasz;
+	pcm->srate = srate;
+	pcm->ch    = ch;
+
+ out:
+	(void)close(fd);
+
+	return err;
+}
+
+
+#else
+
+
+static int map_file(struct pcm *pcm)
+{
+	(void)pcm;
+
+	return ENOTSUP;
+}
+
+
+#endif
+
+
+static int load(struct pcm **pcmp, struct pcmcache *cache,
+		const char *path, const struct stat *st)
+{
+	struct pcm *pcm;
+	int err;
+
+	pcm = mem_zalloc(sizeof(*pcm), pcm_destructor);
+	if (!pcm)
+		return ENOMEM;
+
+	pcm->mtime = st->st_mtime;
+	pcm->fsize = st->st_size;
+
+	err = str_dup(&pcm->path, path);
+	if (err)
+		goto out;
+
+	err = ENOTSUP;
+	if (cache->mmap)
+		err = map_file(pcm);
+
+	if (err == ENOTSUP)
+		err = decode_file(pcm);
+
+ out:
+	if (err)
+		mem_deref(pcm);
+	else
+		*pcmp = pcm;
+
+	return err;
+}
+
+
+/**
+ * Allocate a cache of decoded audio files
+ *
+ * @param cachep    Pointer to allocated cache
+ * @param max_bytes Maximum size of the cached samples, 0 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int pcmcache_alloc(struct pcmcache **cachep, size_t max_bytes)
+{
+	struct pcmcache *cache;
+	int err;
+
+	if (!cachep)
+		return EINVAL;
+
+	cache = mem_zalloc(sizeof(*cache), cache_destructor);
+	if (!cache)
+		return ENOMEM;
+
+	err = hash_alloc(&cache->ht, HASH_SIZE);
+	if (err) {
+		mem_deref(cache);
+		return err;
+	}
+
+	cache->max_bytes = max_bytes;
+
+	*cachep = cache;
+
+	return 0;
+}
+
+
+/**
+ * Set the limits of the cache. Entries are evicted if needed.
+ *
+ * @param cache     Cache of decoded audio files
+ * @param max_bytes Maximum size of the cached samples, 0 to disable
+ * @param mmap      True to map raw PCM files instead of decoding them
+ */
+void pcmcache_set_limit(struct pcmcache *cache, size_t max_bytes, bool mmap)
+{
+	if (!cache)
+		return;
+
+	cache->max_bytes = max_bytes;
+	cache->mmap      = mmap;
+
+	evict(cache);
+}
+
+
+/**
+ * Get the decoded samples of an audio file, from the cache or by loading
+ * the file
+ *
+ * @param pcmp  Pointer to referenced samples
+ * @param cache Cache of decoded audio files
+ * @param path  Path of the audio file
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int pcmcache_get(struct pcm **pcmp, struct pcmcache *cache, const char *path)
+{
+	struct stat st;
+	struct pcm *pcm;
+	int err;
+
+	if (!pcmp || !cache || !str_isset(path))
+		return EINVAL;
+
+	if (stat(path, &st) < 0)
+		return errno;
+
+	pcm = list_ledata(hash_lookup(cache->ht, hash_joaat_str(path),
+				      path_handler, (void *)path));
+	if (pcm) {
+		if (pcm->mtime == st.st_mtime && pcm->fsize == st.st_size) {
+
+			list_unlink(&pcm->le);
+			list_append(&cache->lru, &pcm->le, pcm);
+			++cache->hits;
+
+			*pcmp = mem_ref(pcm);
+			return 0;
+		}
+
+		/* the file was modified */
+		cache_unlink(pcm);
+	}
+
+	++cache->misses;
+
+	err = load(&pcm, cache, path, &st);
+	if (err)
+		return err;
+
+	if (pcm->size <= cache->max_bytes) {
+
+		hash_append(cache->ht, hash_joaat_str(path), &pcm->he, pcm);
+		list_append(&cache->lru, &pcm->le, pcm);
+		pcm->cache = cache;
+		cache->bytes += pcm->size;
+
+		evict(cache);
+
+		*pcmp = mem_ref(pcm);
+	}
+	else {
+		*pcmp = pcm;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Remove all entries from the cache. Entries still in use stay valid.
+ *
+ * @param cache Cache of decoded audio files
+ */
+void pcmcache_flush(struct pcmcache *cache)
+{
+	if (!cache)
+		return;
+
+	while (cache->lru.head)
+		cache_unlink(list_ledata(cache->lru.head));
+}
+
+
+/**
+ * Get the statistics of the cache
+ *
+ * @param cache Cache of decoded audio files
+ * @param stats Returned statistics
+ */
+void pcmcache_stats(const struct pcmcache *cache,
+		    struct play_cache_stats *stats)
+{
+	struct le *le;
+
+	if (!cache || !stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->hits      = cache->hits;
+	stats->misses    = cache->misses;
+	stats->evictions = cache->evictions;
+	stats->bytes     = cache->bytes;
+	stats->max_bytes = cache->max_bytes;
+
+	for (le = cache->lru.head; le; le = le->next) {
+		const struct pcm *pcm = le->data;
+
+		++stats->entries;
+		if (pcm->map)
+			++stats->mapped;
+	}
+}
+
+
+/**
+ * Wrap a buffer of native-endian 16-bit samples, without copying. The
+ * samples from the current position to the end are used.
+ *
+ * @param pcmp  Pointer to allocated samples
+ * @param mb    Buffer with the samples, referenced
+ * @param srate Sampling rate
+ * @param ch    Number of channels
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int pcm_wrap(struct pcm **pcmp, struct mbuf *mb, uint32_t srate, uint8_t ch)
+{
+	struct pcm *pcm;
+
+	if (!pcmp || !mb)
+		return EINVAL;
+
+	pcm = mem_zalloc(sizeof(*pcm), pcm_destructor);
+	if (!pcm)
+		return ENOMEM;
+
+	pcm->mb    = mem_ref(mb);
+	pcm->buf   = mbuf_buf(mb);
+	pcm->size  = mbuf_get_left(mb);
+	pcm->srate = srate;
+	pcm->ch    = ch;
+
+	*pcmp = pcm;
+
+	return 0;
+}
+
+
+/**
+ * Get the samples
+ *
+ * @param pcm   Decoded samples
+ * @param sizep Returned size of the samples in bytes
+ *
+ * @return Native-endian 16-bit samples
+ */
+const uint8_t *pcm_data(const struct pcm *pcm, size_t *sizep)
+{
+	if (!pcm) {
+		if (sizep)
+			*sizep = 0;
+		return NULL;
+	}
+
+	if (sizep)
+		*sizep = pcm->size;
+
+	return pcm->buf;
+}
+
+
+uint32_t pcm_srate(const struct pcm *pcm)
+{
+	return pcm ? pcm->srate : 0;
+}
+
+
+uint8_t pcm_channels(const struct pcm *pcm)
+{
+	return pcm ? pcm->ch : 0;
+}
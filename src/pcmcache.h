@@ -0,0 +1,37 @@
+/**
+ * @file pcmcache.h
+ * @brief Cache of decoded audio files
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAPCMCACHE_H_INCLUDED
+#define UAPCMCACHE_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+
+#ifndef UAMODAPI_USE		/* Internal API */
+
+struct pcm;
+struct pcmcache;
+struct play_cache_stats;
+
+int  pcmcache_alloc(struct pcmcache **cachep, size_t max_bytes);
+void pcmcache_set_limit(struct pcmcache *cache, size_t max_bytes,
+			bool mmap);
+int  pcmcache_get(struct pcm **pcmp, struct pcmcache *cache,
+		  const char *path);
+void pcmcache_flush(struct pcmcache *cache);
+void pcmcache_stats(const struct pcmcache *cache,
+		    struct play_cache_stats *stats);
+
+int  pcm_wrap(struct pcm **pcmp, struct mbuf *mb,
+	      uint32_t srate, uint8_t ch);
+const uint8_t *pcm_data(const struct pcm *pcm, size_t *sizep);
+uint32_t pcm_srate(const struct pcm *pcm);
+uint8_t  pcm_channels(const struct pcm *pcm);
+
+#endif /* ifndef UAMODAPI_USE */
+
+#endif /* UAPCMCACHE_H_INCLUDED */
@@ -15,16 +15,23 @@
 #include "data.h"
 #include "conf.h"
 #include "log.h"
+#include "pcmcache.h"
 
 
-enum {PTIME = 40};
+enum {
+	PTIME      = 40,
+	CACHE_SIZE = 8 * 1024 * 1024,
+};
 
 /** Audio file player */
 struct play {
 	struct le le;
 	struct play **playp;
 	struct lock *lock;
-	struct mbuf *mb;
+	struct pcm *pcm;
+	const uint8_t *buf;
+	size_t size;
+	size_t pos;
 	struct auplay_st *auplay;
 	char *mod;
 	char *dev;
@@ -52,6 +59,7 @@ static const char default_play_path[FS_PATH_MAX] = PREFIX "/share/baresip";
 
 struct player {
 	struct list playl;
+	struct pcmcache *cache;
 	char play_path[FS_PATH_MAX];
 };
 
@@ -132,18 +140,19 @@ static void write_handler(void *sampv, size_t sampc, void *arg)
 		goto silence;
 
 	while (pos < sz) {
-		left = mbuf_get_left(play->mb);
+		left = play->size - play->pos;
 		count = (left > sz - pos) ? sz - pos : left;
 
-		(void)mbuf_read_mem(play->mb, (uint8_t *)sampv + pos, count);
+		memcpy((uint8_t *)sampv + pos, play->buf + play->pos, count);
 
+		play->pos += count;
 		pos += count;
 
 		if (pos < sz) {
-			if (!check_restart(play))
+			if (!play->size || !check_restart(play))
 				goto silence;
 
-			play->mb->pos = 0;
+			play->pos = 0;
 		}
 	}
 
@@ -170,7 +179,7 @@ static void destructor(void *arg)
 	mem_deref(play->auplay);
 	mem_deref(play->mod);
 	mem_deref(play->dev);
-	mem_deref(play->mb);
+	mem_deref(play->pcm);
 	mem_deref(play->lock);
 	mem_deref(play->aubuf);
 	mem_deref(play->filename);
@@ -181,66 +190,48 @@ static void destructor(void *arg)
 }
 
 
-static int aufile_load(struct mbuf *mb, const char *filename,
-		       uint32_t *srate, uint8_t *channels)
+static int play_pcm(struct play **playp, struct player *player,
+		    struct pcm *pcm, int repeat,
+		    const char *play_mod, const char *play_dev)
 {
-	struct aufile_prm prm;
-	struct aufile *af;
+	struct auplay_prm wprm;
+	struct play *play;
 	int err;
 
-	err = aufile_open(&af, &prm, filename, AUFILE_READ);
+	play = mem_zalloc(sizeof(*play), destructor);
+	if (!play)
+		return ENOMEM;
+
+	tmr_init(&play->tmr);
+	play->repeat = repeat ? repeat : 1;
+	play->pcm    = mem_ref(pcm);
+	play->buf    = pcm_data(pcm, &play->size);
+
+	err = lock_alloc(&play->lock);
 	if (err)
-		return err;
+		goto out;
 
-	while (!err) {
-		uint8_t buf[4096];
-		size_t i, n;
-		int16_t *p = (void *)buf;
-
-		n = sizeof(buf);
-
-		err = aufile_read(af, buf, &n);
-		if (err || !n)
-			break;
-
-		switch (prm.fmt) {
-
-		case AUFMT_S16LE:
-			/* convert from Little-Endian to Native-Endian */
-			for (i=0; i<n/2; i++) {
-				int16_t s = sys_ltohs(*p++);
-				err |= mbuf_write_u16(mb, s);
-			}
-
-			break;
-
-		case AUFMT_PCMA:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_alaw2pcm(buf[i]));
-			}
-			break;
-
-		case AUFMT_PCMU:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_ulaw2pcm(buf[i]));
-			}
-			break;
-
-		default:
-			err = ENOSYS;
-			break;
-		}
-	}
+	wprm.ch         = pcm_channels(pcm);
+	wprm.srate      = pcm_srate(pcm);
+	wprm.ptime      = PTIME;
+	wprm.fmt        = AUFMT_S16LE;
 
-	mem_deref(af);
+	err = auplay_alloc(&play->auplay, data_auplayl(),
+			   play_mod, &wprm,
+			   play_dev, write_handler, play);
+	if (err)
+		goto out;
 
-	if (!err) {
-		mb->pos = 0;
+	list_append(&player->playl, &play->le, play);
+	tmr_start(&play->tmr, PTIME,  tmr_polling, play);
 
-		*srate    = prm.srate;
-		*channels = prm.channels;
+ out:
+	if (err) {
+		mem_deref(play);
+	}
+	else if (playp) {
+		play->playp = playp;
+		*playp = play;
 	}
 
 	return err;
@@ -266,8 +257,7 @@ int play_tone(struct play **playp, struct player *player,
 	      uint8_t ch, int repeat,
 	      const char *play_mod, const char *play_dev)
 {
-	struct auplay_prm wprm;
-	struct play *play;
+	struct pcm *pcm;
 	int err;
 
 	if (!player)
@@ -275,40 +265,14 @@ int play_tone(struct play **playp, struct player *player,
 	if (playp && *playp)
 		return EALREADY;
 
-	play = mem_zalloc(sizeof(*play), destructor);
-	if (!play)
-		return ENOMEM;
-
-	tmr_init(&play->tmr);
-	play->repeat = repeat ? repeat : 1;
-	play->mb     = mem_ref(tone);
-
-	err = lock_alloc(&play->lock);
+	/* the tone is played without copying */
+	err = pcm_wrap(&pcm, tone, srate, ch);
 	if (err)
-		goto out;
-
-	wprm.ch         = ch;
-	wprm.srate      = srate;
-	wprm.ptime      = PTIME;
-	wprm.fmt        = AUFMT_S16LE;
-
-	err = auplay_alloc(&play->auplay, data_auplayl(),
-			   play_mod, &wprm,
-			   play_dev, write_handler, play);
-	if (err)
-		goto out;
+		return err;
 
-	list_append(&player->playl, &play->le, play);
-	tmr_start(&play->tmr, PTIME,  tmr_polling, play);
+	err = play_pcm(playp, player, pcm, repeat, play_mod, play_dev);
 
- out:
-	if (err) {
-		mem_deref(play);
-	}
-	else if (playp) {
-		play->playp = playp;
-		*playp = play;
-	}
+	mem_deref(pcm);
 
 	return err;
 }
@@ -510,10 +474,8 @@ int play_file(struct play **playp, struct player *player,
 	char file[FS_PATH_MAX];
 	char path[FS_PATH_MAX];
 	const struct ausrc *ausrc;
-	struct mbuf *mb = NULL;
+	struct pcm *pcm = NULL;
 	int delay = 0;
-	uint32_t srate = 0;
-	uint8_t ch = 0;
 	struct play *play = NULL;
 
 	char srcn[FS_PATH_MAX];
@@ -544,21 +506,16 @@ int play_file(struct play **playp, struct player *player,
 		}
 	}
 
-	mb = mbuf_alloc(1024);
-	if (!mb)
-		return ENOMEM;
-
-	err = aufile_load(mb, path, &srate, &ch);
+	err = pcmcache_get(&pcm, player->cache, path);
 	if (err) {
 		warning("play: %s: %m\n", path, err);
 		goto out;
 	}
 
-	err = play_tone(&play, player, mb, srate,
-	                ch, repeat, play_mod, play_dev);
+	err = play_pcm(&play, player, pcm, repeat, play_mod, play_dev);
 
  out:
-	mem_deref(mb);
+	mem_deref(pcm);
 	if (play)
 		play->delay = delay;
 
@@ -579,6 +536,7 @@ static void player_destructor(void *data)
 	struct player *player = data;
 
 	list_flush(&player->playl);
+	mem_deref(player->cache);
 }
 
 
@@ -592,6 +550,7 @@ static void player_destructor(void *data)
 int play_init(struct player **playerp)
 {
 	struct player *player;
+	int err;
 
 	if (!playerp)
 		return EINVAL;
@@ -602,6 +561,12 @@ int play_init(struct player **playerp)
 
 	list_init(&player->playl);
 
+	err = pcmcache_alloc(&player->cache, CACHE_SIZE);
+	if (err) {
+		mem_deref(player);
+		return err;
+	}
+
 	str_ncpy(player->play_path, default_play_path,
 		 sizeof(player->play_path));
 
@@ -624,3 +589,58 @@ void play_set_path(struct player *player, const char *path)
 
 	str_ncpy(player->play_path, path, sizeof(player->play_path));
 }
+
+
+/**
+ * Set the limits of the cache of decoded audio files. Files which are
+ * larger than the limit are decoded for each play.
+ *
+ * @param player    Player state
+ * @param max_bytes Maximum size of the decoded samples, 0 to disable
+ * @param mmap      True to map WAV files with 16-bit PCM instead of
+ *                  decoding them. The files must only be replaced by
+ *                  rename, never modified in place.
+ */
+void play_set_cache_limit(struct player *player, size_t max_bytes,
+			  bool mmap)
+{
+	if (!player)
+		return;
+
+	pcmcache_set_limit(player->cache, max_bytes, mmap);
+}
+
+
+/**
+ * Remove all files from the cache of decoded audio files. Files which
+ * are playing are released when they complete.
+ *
+ * @param player Player state
+ */
+void play_cache_flush(struct player *player)
+{
+	if (!player)
+		return;
+
+	pcmcache_flush(player->cache);
+}
+
+
+/**
+ * Get the statistics of the cache of decoded audio files
+ *
+ * @param player Player state
+ * @param stats  Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int play_cache_stats(const struct player *player,
+		     struct play_cache_stats *stats)
+{
+	if (!player || !stats)
+		return EINVAL;
+
+	pcmcache_stats(player->cache, stats);
+
+	return 0;
+}
@@ -14,6 +14,17 @@
 struct play;
 struct player;
 
+/** Statistics of the cache of decoded audio files */
+struct play_cache_stats {
+	uint64_t hits;        /**< Plays served from the cache        */
+	uint64_t misses;      /**< Plays which loaded the file        */
+	uint64_t evictions;   /**< Files evicted to stay in the limit */
+	uint32_t entries;     /**< Cached files                       */
+	uint32_t mapped;      /**< Cached files mapped into memory    */
+	size_t bytes;         /**< Size of the cached samples         */
+	size_t max_bytes;     /**< Limit of the cached samples        */
+};
+
 int  play_file(struct play **playp, struct player *player,
 	       const char *filename, int repeat,
 	       const char *play_mod, const char *play_dev);
@@ -23,5 +34,10 @@ int  play_tone(struct play **playp, struct player *player,
 	       const char *play_mod, const char *play_dev);
 int  play_init(struct player **playerp);
 void play_set_path(struct player *player, const char *path);
+void play_set_cache_limit(struct player *player, size_t max_bytes,
+			  bool mmap);
+void play_cache_flush(struct player *player);
+int  play_cache_stats(const struct player *player,
+		      struct play_cache_stats *stats);
 
 #endif /* UAPLAY_H_INCLUDED */
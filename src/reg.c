@@ -10,6 +10,7 @@
 #include "ept.h"
 #include "ev.h"
 #include "log.h"
+#include "regsched.h"
 
 
 /** Register client */
@@ -19,6 +20,11 @@ struct reg {
 	struct sipreg *sipreg;       /**< SIP Register client                */
 	int id;                      /**< Registration ID (for SIP outbound) */
 	int regint;                  /**< Registration interval              */
+	struct regsched_ent sched;   /**< Entry in the register scheduler    */
+	char *reg_uri;               /**< Registrar URI, while scheduled     */
+	char *params;                /**< Contact params, while scheduled    */
+	char *outbound;              /**< Outbound proxy, while scheduled    */
+	bool failed;                 /**< Last registration had failed       */
 
 	/* status: */
 	uint16_t scode;              /**< Registration status code           */
@@ -32,8 +38,12 @@ static void destructor(void *arg)
 	struct reg *reg = arg;
 
 	list_unlink(&reg->le);
+	regsched_cancel(&reg->sched);
 	mem_deref(reg->sipreg);
 	mem_deref(reg->srv);
+	mem_deref(reg->reg_uri);
+	mem_deref(reg->params);
+	mem_deref(reg->outbound);
 }
 
 
@@ -110,6 +120,8 @@ static void register_handler(int err, const struct sip_msg *msg, void *arg)
 	enum ua_event evfail = reg->regint ?
 		UA_EVENT_REGISTER_FAIL : UA_EVENT_FALLBACK_FAIL;
 
+	regsched_done(uag_regsched(), &reg->sched);
+
 	if (err) {
 		if (reg->regint)
 			warning("reg: %s (prio %u): Register: %m\n",
@@ -194,37 +206,36 @@ int reg_add(struct list *lst, struct ua *ua, int regid)
 }
 
 
-int reg_register(struct reg *reg, const char *reg_uri, const char *params,
-		 uint32_t regint, const char *outbound)
+static void clear_params(struct reg *reg)
 {
-	struct account *acc;
+	reg->reg_uri  = mem_deref(reg->reg_uri);
+	reg->params   = mem_deref(reg->params);
+	reg->outbound = mem_deref(reg->outbound);
+}
+
+
+static int start_handler(bool queued, void *arg)
+{
+	struct reg *reg = arg;
+	struct account *acc = ua_account(reg->ua);
 	const char *routev[1];
 	int err;
-	bool failed;
-
-	if (!reg || !reg_uri)
-		return EINVAL;
 
-	reg->scode = 0;
-	reg->regint = regint;
-	routev[0] = outbound;
-	acc = ua_account(reg->ua);
+	routev[0] = reg->outbound;
 
-	failed = sipreg_failed(reg->sipreg);
-	reg->sipreg = mem_deref(reg->sipreg);
-	err = sipreg_register(&reg->sipreg, uag_sip(), reg_uri,
+	err = sipreg_register(&reg->sipreg, uag_sip(), reg->reg_uri,
 			      account_aor(acc),
 			      acc ? acc->dispname : NULL, account_aor(acc),
-			      regint, ua_local_cuser(reg->ua),
+			      reg->regint, ua_local_cuser(reg->ua),
 			      routev[0] ? routev : NULL,
 			      routev[0] ? 1 : 0,
 			      reg->id,
-			      sip_auth_handler, ua_account(reg->ua), true,
+			      sip_auth_handler, acc, true,
 			      register_handler, reg,
-			      params[0] ? &params[1] : NULL,
+			      reg->params[0] ? &reg->params[1] : NULL,
 			      "Allow: %H\r\n", ua_print_allowed, reg->ua);
 	if (err)
-		return err;
+		goto out;
 
 	if (acc->rwait)
 		err = sipreg_set_rwait(reg->sipreg, acc->rwait);
@@ -232,13 +243,71 @@ int reg_register(struct reg *reg, const char *reg_uri, const char *params,
 	if (acc->fbregint)
 		err = sipreg_set_fbregint(reg->sipreg, acc->fbregint);
 
-	if (failed)
+	if (reg->failed)
 		sipreg_incfailc(reg->sipreg);
 
+ out:
+	clear_params(reg);
+
+	if (err && queued) {
+		warning("reg: %s: SIP%s register failed: %m\n",
+			ua_aor(reg->ua), reg->regint ? "" : " fallback", err);
+
+		reg->scode = 999;
+
+		ua_event(reg->ua, reg->regint ?
+			 UA_EVENT_REGISTER_FAIL : UA_EVENT_FALLBACK_FAIL,
+			 NULL, "%m", err);
+	}
+
 	return err;
 }
 
 
+/**
+ * Start a registration. Failed and fallback registrations take
+ * priority in the register scheduler.
+ *
+ * @param reg      Registration object
+ * @param reg_uri  Registrar URI
+ * @param params   Contact parameters, each starting with ';'
+ * @param regint   Registration interval in seconds, 0 for fallback
+ * @param outbound Outbound proxy, or NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int reg_register(struct reg *reg, const char *reg_uri, const char *params,
+		 uint32_t regint, const char *outbound)
+{
+	struct regsched *rs = uag_regsched();
+	int err;
+
+	if (!reg || !reg_uri)
+		return EINVAL;
+
+	reg->scode  = 0;
+	reg->regint = regsched_regint(rs, regint);
+	/* keep the state of a registration which is still waiting */
+	if (reg->sipreg)
+		reg->failed = sipreg_failed(reg->sipreg);
+	reg->sipreg = mem_deref(reg->sipreg);
+
+	clear_params(reg);
+
+	err  = str_dup(&reg->reg_uri, reg_uri);
+	err |= str_dup(&reg->params, params ? params : "");
+	if (outbound)
+		err |= str_dup(&reg->outbound, outbound);
+	if (err) {
+		clear_params(reg);
+		return err;
+	}
+
+	return regsched_push(rs, &reg->sched, reg->failed || !regint,
+			     start_handler, reg);
+}
+
+
 void reg_unregister(struct reg *reg)
 {
 	if (!reg)
@@ -247,6 +316,10 @@ void reg_unregister(struct reg *reg)
 	reg->scode = 0;
 	reg->af    = 0;
 
+	regsched_cancel(&reg->sched);
+	clear_params(reg);
+	reg->failed = false;
+
 	reg->sipreg = mem_deref(reg->sipreg);
 }
 
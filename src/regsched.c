@@ -0,0 +1,344 @@
+/**
+ * @file regsched.c  Registration scheduler
+ *
+ * Starts the REGISTER transactions of all User-Agents at a limited rate,
+ * so that thousands of accounts which register at the same time, e.g.
+ * at startup or after a change of the network, do not flood the
+ * registrar and the local SIP stack.
+ *
+ * The rate is a token bucket which allows a burst of a tenth of a
+ * second. Registrations which exceed the rate wait in a queue, failed
+ * and fallback registrations in a queue of their own which is served
+ * first. The scheduler also spreads the registration intervals of the
+ * accounts at random, so that the refreshes do not stay in step.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "regsched.h"
+
+
+enum {
+	MAX_JITTER = 50,       /* [%] */
+};
+
+struct regsched {
+	struct list prioq;            /**< Failed and fallback registrations */
+	struct list q;                /**< Other registrations               */
+	struct tmr tmr;               /**< Timer for the next start          */
+	uint32_t rate;                /**< REGISTERs per second, 0=unlimited */
+	uint32_t jitter;              /**< Interval spread [%]               */
+	uint64_t next;                /**< Time of the next token [us]       */
+	struct regsched_stats stats;  /**< Statistics                        */
+};
+
+
+static void destructor(void *arg)
+{
+	struct regsched *rs = arg;
+
+	tmr_cancel(&rs->tmr);
+
+	/* the owners of the entries may outlive the scheduler */
+	while (rs->prioq.head || rs->q.head) {
+		struct le *le = rs->prioq.head ? rs->prioq.head : rs->q.head;
+		struct regsched_ent *ent = le->data;
+
+		list_unlink(le);
+		ent->rs = NULL;
+	}
+}
+
+
+/*
+ * Take a token from the bucket, if there is one
+ */
+static bool take(struct regsched *rs, uint64_t now)
+{
+	uint64_t ival, burst;
+
+	if (!rs->rate)
+		return true;
+
+	ival  = 1000000 / rs->rate;
+	burst = max(rs->rate / 10, 1u) * ival;
+
+	if (rs->next + burst < now + ival)
+		rs->next = now + ival - burst;
+
+	if (rs->next > now)
+		return false;
+
+	rs->next += ival;
+
+	return true;
+}
+
+
+static int start(struct regsched *rs, struct regsched_ent *ent,
+		 uint64_t now, bool queued)
+{
+	const uint64_t wait = now - ent->ts;
+
+	++rs->stats.started;
+	if (queued)
+		++rs->stats.queued;
+	if (ent->prio)
+		++rs->stats.prio;
+
+	rs->stats.wait_usec += wait;
+	rs->stats.wait_max   = max(rs->stats.wait_max, wait);
+
+	ent->ts      = now;
+	ent->pending = true;
+
+	return ent->h(queued, ent->arg);
+}
+
+
+static void tmr_handler(void *arg)
+{
+	struct regsched *rs = arg;
+	uint64_t now = tmr_jiffies_usec();
+
+	for (;;) {
+		struct regsched_ent *ent;
+		struct le *le;
+
+		le = rs->prioq.head ? rs->prioq.head : rs->q.head;
+		if (!le)
+			return;
+
+		if (!take(rs, now))
+			break;
+
+		ent = le->data;
+		list_unlink(le);
+		ent->rs = NULL;
+		--rs->stats.depth;
+
+		/* errors are reported by the owner */
+		(void)start(rs, ent, now, true);
+	}
+
+	tmr_start(&rs->tmr, (rs->next - now + 999) / 1000,
+		  tmr_handler, rs);
+}
+
+
+/**
+ * Allocate a registration scheduler
+ *
+ * @param rsp    Pointer to allocated scheduler
+ * @param rate   Maximum REGISTERs started per second, 0 for unlimited
+ * @param jitter Random reduction of the registration intervals [%]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int regsched_alloc(struct regsched **rsp, uint32_t rate, uint32_t jitter)
+{
+	struct regsched *rs;
+
+	if (!rsp)
+		return EINVAL;
+
+	rs = mem_zalloc(sizeof(*rs), destructor);
+	if (!rs)
+		return ENOMEM;
+
+	list_init(&rs->prioq);
+	list_init(&rs->q);
+	tmr_init(&rs->tmr);
+
+	rs->rate   = rate;
+	rs->jitter = min(jitter, (uint32_t)MAX_JITTER);
+
+	*rsp = rs;
+
+	return 0;
+}
+
+
+/**
+ * Set the rate of the registration scheduler
+ *
+ * @param rs     Registration scheduler
+ * @param rate   Maximum REGISTERs started per second, 0 for unlimited
+ * @param jitter Random reduction of the registration intervals [%]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int regsched_set_rate(struct regsched *rs, uint32_t rate, uint32_t jitter)
+{
+	if (!rs)
+		return EINVAL;
+
+	rs->rate   = rate;
+	rs->jitter = min(jitter, (uint32_t)MAX_JITTER);
+	rs->next   = 0;
+
+	if (rs->stats.depth)
+		tmr_start(&rs->tmr, 0, tmr_handler, rs);
+
+	return 0;
+}
+
+
+/**
+ * Spread a registration interval, so that the refreshes of the accounts
+ * do not stay in step
+ *
+ * @param rs     Registration scheduler
+ * @param regint Registration interval [s]
+ *
+ * @return Registration interval to use [s]
+ */
+uint32_t regsched_regint(const struct regsched *rs, uint32_t regint)
+{
+	if (!rs || !rs->jitter || !regint)
+		return regint;
+
+	return regint - rand_u32() % (regint * rs->jitter / 100 + 1);
+}
+
+
+/**
+ * Start a registration, now if the rate allows it or later from the queue
+ *
+ * @param rs   Registration scheduler, NULL to start now
+ * @param ent  Scheduler entry of the registration
+ * @param prio True for a failed or fallback registration
+ * @param h    Start handler
+ * @param arg  Handler argument
+ *
+ * @return 0 if success, otherwise the error of a start handler called now
+ */
+int regsched_push(struct regsched *rs, struct regsched_ent *ent, bool prio,
+		  regsched_h *h, void *arg)
+{
+	uint64_t now;
+
+	if (!ent || !h)
+		return EINVAL;
+
+	regsched_cancel(ent);
+
+	ent->h       = h;
+	ent->arg     = arg;
+	ent->prio    = prio;
+	ent->pending = false;
+
+	if (!rs)
+		return h(false, arg);
+
+	now = tmr_jiffies_usec();
+	ent->ts = now;
+
+	if (!rs->stats.depth && take(rs, now))
+		return start(rs, ent, now, false);
+
+	list_append(prio ? &rs->prioq : &rs->q, &ent->le, ent);
+	ent->rs = rs;
+
+	++rs->stats.depth;
+	rs->stats.max_depth = max(rs->stats.max_depth, rs->stats.depth);
+
+	if (!tmr_isrunning(&rs->tmr)) {
+		tmr_start(&rs->tmr, (rs->next - now + 999) / 1000,
+			  tmr_handler, rs);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Remove a registration from the queue
+ *
+ * @param ent Scheduler entry of the registration
+ */
+void regsched_cancel(struct regsched_ent *ent)
+{
+	if (!ent)
+		return;
+
+	ent->pending = false;
+
+	if (!ent->rs)
+		return;
+
+	list_unlink(&ent->le);
+	--ent->rs->stats.depth;
+	ent->rs = NULL;
+}
+
+
+/**
+ * Record the first answer to a started registration
+ *
+ * @param rs  Registration scheduler
+ * @param ent Scheduler entry of the registration
+ */
+void regsched_done(struct regsched *rs, struct regsched_ent *ent)
+{
+	uint64_t t;
+
+	if (!rs || !ent || !ent->pending)
+		return;
+
+	ent->pending = false;
+
+	t = tmr_jiffies_usec() - ent->ts;
+
+	++rs->stats.done;
+	rs->stats.done_usec += t;
+	rs->stats.done_max   = max(rs->stats.done_max, t);
+}
+
+
+/**
+ * Get the statistics of the registration scheduler
+ *
+ * @param rs    Registration scheduler
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int regsched_stats(const struct regsched *rs, struct regsched_stats *stats)
+{
+	if (!rs || !stats)
+		return EINVAL;
+
+	*stats = rs->stats;
+
+	return 0;
+}
+
+
+/**
+ * Print the registration scheduler
+ *
+ * @param pf Print function
+ * @param rs Registration scheduler
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int regsched_debug(struct re_printf *pf, const struct regsched *rs)
+{
+	const struct regsched_stats *st;
+
+	if (!rs)
+		return 0;
+
+	st = &rs->stats;
+
+	return re_hprintf(pf, "Register scheduler: rate=%u/s jitter=%u%%"
+			  " depth=%u (max %u) started=%llu prio=%llu"
+			  " wait=%llu/%llu ms answer=%llu/%llu ms\n",
+			  rs->rate, rs->jitter, st->depth, st->max_depth,
+			  st->started, st->prio,
+			  st->started ? st->wait_usec / st->started / 1000 : 0,
+			  st->wait_max / 1000,
+			  st->done ? st->done_usec / st->done / 1000 : 0,
+			  st->done_max / 1000);
+}
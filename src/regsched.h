@@ -0,0 +1,66 @@
+/**
+ * @file regsched.h
+ * @brief Registration scheduler
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAREGSCHED_H_INCLUDED
+#define UAREGSCHED_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+struct regsched;
+
+/** Statistics of the registration scheduler */
+struct regsched_stats {
+	uint32_t depth;       /**< Registrations waiting to start     */
+	uint32_t max_depth;   /**< Most registrations waiting         */
+	uint64_t started;     /**< Registrations started              */
+	uint64_t queued;      /**< Started after waiting for the rate */
+	uint64_t prio;        /**< Started from the priority queue    */
+	uint64_t wait_usec;   /**< Total waiting time [us]            */
+	uint64_t wait_max;    /**< Longest waiting time [us]          */
+	uint64_t done;        /**< Registrations answered             */
+	uint64_t done_usec;   /**< Total time from start to answer [us] */
+	uint64_t done_max;    /**< Longest time from start to answer [us] */
+};
+
+int  regsched_set_rate(struct regsched *rs, uint32_t rate, uint32_t jitter);
+int  regsched_stats(const struct regsched *rs, struct regsched_stats *stats);
+int  regsched_debug(struct re_printf *pf, const struct regsched *rs);
+
+
+#ifndef UAMODAPI_USE		/* Internal API */
+
+/**
+ * Start a registration
+ *
+ * @param queued True if the start was delayed by the scheduler
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+typedef int (regsched_h)(bool queued, void *arg);
+
+/** A registration in the scheduler, embedded in the owner */
+struct regsched_ent {
+	struct le le;         /**< Entry in the queue                 */
+	struct regsched *rs;  /**< Scheduler, while in the queue      */
+	regsched_h *h;        /**< Start handler                      */
+	void *arg;            /**< Handler argument                   */
+	uint64_t ts;          /**< Time queued, then started [us]     */
+	bool prio;            /**< In the priority queue              */
+	bool pending;         /**< Started, waiting for the answer    */
+};
+
+int  regsched_alloc(struct regsched **rsp, uint32_t rate, uint32_t jitter);
+uint32_t regsched_regint(const struct regsched *rs, uint32_t regint);
+int  regsched_push(struct regsched *rs, struct regsched_ent *ent, bool prio,
+		   regsched_h *h, void *arg);
+void regsched_cancel(struct regsched_ent *ent);
+void regsched_done(struct regsched *rs, struct regsched_ent *ent);
+
+#endif /* ifndef UAMODAPI_USE */
+
+#endif /* UAREGSCHED_H_INCLUDED */
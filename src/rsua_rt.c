@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include "rsua-re/re.h"
+#include "call.h"
 #include "data.h"
 #include "ept.h"
 #include "net.h"
@@ -21,6 +22,8 @@
 #include "message.h"
 #include "conf.h"
 #include "ui.h"
+#include "mclock.h"
+#include "workpool.h"
 
 static struct tmr tmr_quit;
 
@@ -115,10 +118,26 @@ static int rmmod_handler(struct re_printf *pf, void *arg)
 }
 
 
+static int cmd_callsetup(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+
+	if (0 == str_casecmp(carg->prm, "reset")) {
+		call_setup_reset();
+		return re_hprintf(pf, "call setup latency reset\n");
+	}
+
+	return call_setup_debug(pf, NULL);
+}
+
+
 static const struct cmd corecmdv[] = {
 	{"quit", 'q', 0, "Quit",                     cmd_quit             },
 	{"insmod", 0, CMD_PRM, "Load module",        insmod_handler       },
 	{"rmmod",  0, CMD_PRM, "Unload module",      rmmod_handler        },
+	{"mclock", 0, 0,       "Media clock stats",  mclock_debug         },
+	{"logstat", 0, 0,      "Log statistics",     log_debug            },
+	{"callsetup", 0, CMD_PRM, "Call setup latency", cmd_callsetup    },
 };
 
 
@@ -179,6 +198,17 @@ int rsua_start(struct rsua_opts *opts)
 			      data_config()->audio.audio_path);
 	}
 
+	/* Cache of decoded audio files, size in kB */
+	play_set_cache_limit(data_player(),
+			     data_config()->audio.file_cache_size * 1024,
+			     data_config()->audio.file_cache_mmap);
+
+	/* Worker threads shared by the decoders and converters */
+	workpool_shared_set_threads(WORKPOOL_AUDIO,
+				    data_config()->avt.worker_threads);
+	workpool_shared_set_threads(WORKPOOL_VIDEO,
+				    data_config()->avt.video_worker_threads);
+
 	/* NOTE: must be done after all arguments are processed */
 	if (opts->modc) {
 
@@ -272,6 +302,8 @@ void rsua_stop(void)
 	data_close();
 	libre_close();
 
+	log_flush();
+
 	/* Check for memory leaks */
 	tmr_debug();
 	mem_debug();
@@ -0,0 +1,480 @@
+/**
+ * @file rtprx.c  Batched RTP receive
+ *
+ * Takes over the read events of a UDP socket and drains up to a batch of
+ * datagrams per wakeup with recvmmsg(). The datagrams are received into a
+ * ring of preallocated buffers and passed up the normal receive path of
+ * the socket with udp_recv_packet(), so helpers such as SRTP and ICE still
+ * see every packet.
+ *
+ * The buffers are passed on without copying. A buffer that is still
+ * referenced after the upper layers returned, e.g. because it sits in the
+ * jitter buffer, is left to its new owner and replaced in the ring before
+ * the next read. When the owner releases it, the data of the buffer goes
+ * to a free list and the replacement takes it from there, so only a small
+ * mbuf header is allocated per held packet. The free list may be filled
+ * from another thread, e.g. the audio player, and outlives the receiver.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#define _GNU_SOURCE 1
+#include "rtprx.h"
+#include <string.h>
+#ifdef LINUX
+#include <sys/socket.h>
+#endif
+
+
+enum {
+	RX_PRESZ  = 64,      /* headroom of each buffer           */
+	RX_SIZE   = 8192,    /* same as the stream receive size   */
+	MAX_BATCH = 64,      /* upper limit of datagrams per read */
+	FREE_MAX  = 64,      /* released buffers kept for reuse   */
+};
+
+/** Released buffer data, shared by the receiver and its buffers */
+struct rxfree {
+	struct lock *lock;        /**< Lock, buffers are released anywhere */
+	uint8_t *bufv[FREE_MAX];  /**< Free data of RX_PRESZ + RX_SIZE     */
+	uint32_t n;               /**< Number of free data                 */
+};
+
+/** A receive buffer, which gives its data back to the free list */
+struct rxbuf {
+	struct mbuf mb;           /**< Buffer, must be first               */
+	struct rxfree *fl;        /**< Free list, referenced               */
+};
+
+struct rtprx {
+	struct udp_sock *us;      /**< Socket, referenced               */
+	int fd;                   /**< File descriptor of the socket    */
+	uint32_t batch;           /**< Datagrams per read               */
+	uint32_t nused;           /**< Buffers used by the last read    */
+	struct mbuf **mbv;        /**< Ring of receive buffers          */
+	struct rxfree *fl;        /**< Free list of released buffers    */
+	struct sa *srcv;          /**< Source addresses                 */
+#ifdef LINUX
+	struct mmsghdr *msgv;     /**< Message headers for recvmmsg()   */
+	struct iovec *iov;        /**< One I/O vector per buffer        */
+#endif
+	bool *stopp;              /**< Set when freed from a handler    */
+	struct rtprx_stats stats; /**< Receive statistics               */
+};
+
+
+#ifdef LINUX
+
+
+static void rxfree_destructor(void *arg)
+{
+	struct rxfree *fl = arg;
+	uint32_t i;
+
+	for (i=0; i<fl->n; i++)
+		mem_deref(fl->bufv[i]);
+
+	mem_deref(fl->lock);
+}
+
+
+static int rxfree_alloc(struct rxfree **flp)
+{
+	struct rxfree *fl;
+	int err;
+
+	fl = mem_zalloc(sizeof(*fl), rxfree_destructor);
+	if (!fl)
+		return ENOMEM;
+
+	err = lock_alloc(&fl->lock);
+	if (err)
+		mem_deref(fl);
+	else
+		*flp = fl;
+
+	return err;
+}
+
+
+/* may run in any thread, when the last user releases the buffer */
+static void rxbuf_destructor(void *arg)
+{
+	struct rxbuf *rb = arg;
+	struct rxfree *fl = rb->fl;
+
+	if (rb->mb.buf && rb->mb.size == RX_PRESZ + RX_SIZE) {
+
+		lock_write_get(fl->lock);
+
+		if (fl->n < FREE_MAX) {
+			fl->bufv[fl->n++] = rb->mb.buf;
+			rb->mb.buf = NULL;
+		}
+
+		lock_rel(fl->lock);
+	}
+
+	mem_deref(rb->mb.buf);
+	mem_deref(fl);
+}
+
+
+static struct mbuf *rxbuf_alloc(struct rtprx *rx)
+{
+	struct rxfree *fl = rx->fl;
+	uint8_t *buf = NULL;
+	struct rxbuf *rb;
+
+	rb = mem_zalloc(sizeof(*rb), rxbuf_destructor);
+	if (!rb)
+		return NULL;
+
+	rb->fl = mem_ref(fl);
+
+	lock_write_get(fl->lock);
+
+	if (fl->n)
+		buf = fl->bufv[--fl->n];
+
+	lock_rel(fl->lock);
+
+	if (buf) {
+		++rx->stats.reuses;
+	}
+	else {
+		buf = mem_alloc(RX_PRESZ + RX_SIZE, NULL);
+		if (!buf)
+			return mem_deref(rb);
+
+		++rx->stats.allocs;
+	}
+
+	rb->mb.buf  = buf;
+	rb->mb.size = RX_PRESZ + RX_SIZE;
+
+	return &rb->mb;
+}
+
+
+static void free_bufs(struct rtprx *rx)
+{
+	uint32_t i;
+
+	if (rx->mbv) {
+		for (i=0; i<rx->batch; i++)
+			mem_deref(rx->mbv[i]);
+	}
+
+	rx->mbv  = mem_deref(rx->mbv);
+	rx->srcv = mem_deref(rx->srcv);
+	rx->msgv = mem_deref(rx->msgv);
+	rx->iov  = mem_deref(rx->iov);
+
+	rx->batch = 0;
+	rx->nused = 0;
+}
+
+
+static void destructor(void *arg)
+{
+	struct rtprx *rx = arg;
+
+	if (rx->stopp)
+		*rx->stopp = true;
+
+	if (rx->fd >= 0)
+		fd_close(rx->fd);
+
+	free_bufs(rx);
+	mem_deref(rx->fl);
+	mem_deref(rx->us);
+}
+
+
+/*
+ * Make the buffers consumed by the last read ready for the next one.
+ * Buffers which are still referenced elsewhere are replaced, with the
+ * data of a released buffer if there is one.
+ */
+static int refill(struct rtprx *rx)
+{
+	uint32_t i;
+
+	for (i=0; i<rx->nused; i++) {
+
+		struct mbuf *mb = rx->mbv[i];
+
+		if (mem_nrefs(mb) > 1) {
+
+			mb = rxbuf_alloc(rx);
+			if (!mb)
+				return ENOMEM;
+
+			mem_deref(rx->mbv[i]);
+			rx->mbv[i] = mb;
+		}
+
+		mb->pos = RX_PRESZ;
+		mb->end = RX_PRESZ;
+
+		rx->iov[i].iov_base = mb->buf + RX_PRESZ;
+		rx->iov[i].iov_len  = mb->size - RX_PRESZ;
+	}
+
+	rx->nused = 0;
+
+	return 0;
+}
+
+
+static void read_handler(int flags, void *arg)
+{
+	struct rtprx *rx = arg;
+	bool stop = false;
+	uint32_t i;
+	int n;
+
+	if (!(flags & FD_READ) || !rx->batch)
+		return;
+
+	/* like a plain UDP socket, try again on the next wakeup */
+	if (refill(rx))
+		return;
+
+	for (i=0; i<rx->batch; i++) {
+		struct msghdr *hdr = &rx->msgv[i].msg_hdr;
+
+		hdr->msg_name    = &rx->srcv[i].u;
+		hdr->msg_namelen = sizeof(rx->srcv[i].u);
+		hdr->msg_iov     = &rx->iov[i];
+		hdr->msg_iovlen  = 1;
+		hdr->msg_control = NULL;
+		hdr->msg_controllen = 0;
+		hdr->msg_flags   = 0;
+	}
+
+	n = recvmmsg(rx->fd, rx->msgv, rx->batch, MSG_DONTWAIT, NULL);
+	if (n <= 0) {
+		if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+		    errno != EINTR)
+			++rx->stats.errors;
+		return;
+	}
+
+	rx->nused = n;
+	rx->stats.packets += n;
+	++rx->stats.wakeups;
+	rx->stats.max_batch = max(rx->stats.max_batch, (uint32_t)n);
+
+	rx->stopp = &stop;
+
+	for (i=0; i<(uint32_t)n; i++) {
+
+		struct mbuf *mb = rx->mbv[i];
+		struct sa *src = &rx->srcv[i];
+
+		if (rx->msgv[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			++rx->stats.errors;
+			continue;
+		}
+
+		src->len = rx->msgv[i].msg_hdr.msg_namelen;
+		mb->end  = RX_PRESZ + rx->msgv[i].msg_len;
+
+		/* the handlers may free the receiver */
+		mem_ref(mb);
+		udp_recv_packet(rx->us, src, mb);
+		mem_deref(mb);
+
+		if (stop)
+			return;
+	}
+
+	rx->stopp = NULL;
+}
+
+
+static int alloc_bufs(struct rtprx *rx, uint32_t batch)
+{
+	uint32_t i;
+
+	rx->mbv  = mem_zalloc(batch * sizeof(*rx->mbv), NULL);
+	rx->srcv = mem_zalloc(batch * sizeof(*rx->srcv), NULL);
+	rx->msgv = mem_zalloc(batch * sizeof(*rx->msgv), NULL);
+	rx->iov  = mem_zalloc(batch * sizeof(*rx->iov), NULL);
+	if (!rx->mbv || !rx->srcv || !rx->msgv || !rx->iov)
+		goto nomem;
+
+	rx->batch = batch;
+
+	for (i=0; i<batch; i++) {
+		rx->mbv[i] = rxbuf_alloc(rx);
+		if (!rx->mbv[i])
+			goto nomem;
+	}
+
+	/* mark all buffers as used, so that the first read sets them up */
+	rx->nused = batch;
+
+	return 0;
+
+ nomem:
+	free_bufs(rx);
+
+	return ENOMEM;
+}
+
+
+#endif
+
+
+/**
+ * Drain a UDP socket in batches of datagrams
+ *
+ * The receiver takes over the read events of the socket until it is
+ * freed. The datagrams are delivered to the receive handler of the socket
+ * as before, one by one.
+ *
+ * @param rxp   Pointer to allocated receiver
+ * @param us    UDP socket
+ * @param af    Address family of the socket
+ * @param batch Maximum number of datagrams per wakeup
+ *
+ * @return 0 if success, ENOSYS if not supported, otherwise errorcode
+ */
+int rtprx_alloc(struct rtprx **rxp, struct udp_sock *us, int af,
+		uint32_t batch)
+{
+#ifdef LINUX
+	struct rtprx *rx;
+	int fd, err;
+
+	if (!rxp || !us || !batch)
+		return EINVAL;
+
+	fd = udp_sock_fd(us, af);
+	if (fd < 0)
+		return EBADF;
+
+	rx = mem_zalloc(sizeof(*rx), destructor);
+	if (!rx)
+		return ENOMEM;
+
+	rx->fd = -1;
+	rx->us = mem_ref(us);
+
+	err = rxfree_alloc(&rx->fl);
+	if (err)
+		goto out;
+
+	err = alloc_bufs(rx, min(batch, (uint32_t)MAX_BATCH));
+	if (err)
+		goto out;
+
+	err = fd_listen(fd, FD_READ, read_handler, rx);
+	if (err)
+		goto out;
+
+	rx->fd = fd;
+
+ out:
+	if (err)
+		mem_deref(rx);
+	else
+		*rxp = rx;
+
+	return err;
+#else
+	(void)rxp;
+	(void)us;
+	(void)af;
+	(void)batch;
+
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Change the number of datagrams read per wakeup
+ *
+ * @param rx    Batched receiver
+ * @param batch Maximum number of datagrams per wakeup, 0 for one
+ *
+ * @note Must not be called from the receive handler of the socket
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtprx_set_batch(struct rtprx *rx, uint32_t batch)
+{
+	if (!rx)
+		return EINVAL;
+
+	if (rx->stopp)
+		return EBUSY;
+
+	batch = min(max(batch, 1u), (uint32_t)MAX_BATCH);
+	if (batch == rx->batch)
+		return 0;
+
+#ifdef LINUX
+	free_bufs(rx);
+
+	return alloc_bufs(rx, batch);
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Get the number of datagrams read per wakeup
+ *
+ * @param rx Batched receiver
+ *
+ * @return Batch size
+ */
+uint32_t rtprx_batch(const struct rtprx *rx)
+{
+	return rx ? rx->batch : 0;
+}
+
+
+/**
+ * Get the receive statistics
+ *
+ * @param rx Batched receiver
+ *
+ * @return Receive statistics
+ */
+const struct rtprx_stats *rtprx_stats(const struct rtprx *rx)
+{
+	return rx ? &rx->stats : NULL;
+}
+
+
+/**
+ * Print the batched receiver
+ *
+ * @param pf Print function
+ * @param rx Batched receiver
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtprx_debug(struct re_printf *pf, const struct rtprx *rx)
+{
+	const struct rtprx_stats *st;
+
+	if (!rx)
+		return 0;
+
+	st = &rx->stats;
+
+	return re_hprintf(pf, " rx batch: %u (max=%u avg=%.1f)"
+			  " packets=%llu allocs=%llu reuses=%llu"
+			  " errors=%llu\n",
+			  rx->batch, st->max_batch,
+			  st->wakeups ? 1.0 * st->packets / st->wakeups : 0.0,
+			  st->packets, st->allocs, st->reuses, st->errors);
+}
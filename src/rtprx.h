@@ -0,0 +1,32 @@
+/**
+ * @file rtprx.h
+ * @brief Batched RTP receive
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UARTPRX_H_INCLUDED
+#define UARTPRX_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+struct rtprx;
+
+/** Receive statistics of a batched receiver */
+struct rtprx_stats {
+	uint64_t packets;     /**< Datagrams received                  */
+	uint64_t wakeups;     /**< Socket wakeups with data            */
+	uint64_t allocs;      /**< Buffers allocated for the ring      */
+	uint64_t reuses;      /**< Released buffers taken for the ring */
+	uint64_t errors;      /**< Receive errors and truncations      */
+	uint32_t max_batch;   /**< Most datagrams read in one wakeup   */
+};
+
+int  rtprx_alloc(struct rtprx **rxp, struct udp_sock *us, int af,
+		 uint32_t batch);
+int  rtprx_set_batch(struct rtprx *rx, uint32_t batch);
+uint32_t rtprx_batch(const struct rtprx *rx);
+const struct rtprx_stats *rtprx_stats(const struct rtprx *rx);
+int  rtprx_debug(struct re_printf *pf, const struct rtprx *rx);
+
+#endif /* UARTPRX_H_INCLUDED */
@@ -57,12 +57,13 @@ int rtpstat_print(struct re_printf *pf, const struct call *call)
 			 call_setup_duration(call) * 1000,
 			 call_duration(call),
 
-			 s->metric_rx.n_packets,
-			 s->metric_tx.n_packets,
+			 metric_n_packets(&s->metric_rx),
+			 metric_n_packets(&s->metric_tx),
 
 			 rtcp->rx.lost, rtcp->tx.lost,
 
-			 s->metric_rx.n_err, s->metric_tx.n_err,
+			 metric_n_err(&s->metric_rx),
+			 metric_n_err(&s->metric_tx),
 
 			 /* timestamp units (ie: 8 ts units = 1 ms @ 8KHZ) */
 			 1.0 * rtcp->rx.jit/1000 * (srate_rx/1000),
@@ -0,0 +1,400 @@
+/**
+ * @file rtptx.c  Batched RTP transmit
+ *
+ * Registers a UDP helper below all other helpers of a socket, so that it
+ * sees each datagram last, after SRTP, TURN etc. While the sender is
+ * corked, the datagrams are copied into a queue instead of being sent.
+ * Uncorking sends the queue with as few sendmmsg() calls as possible.
+ *
+ * The queue is shared by all threads sending on the socket, which keeps
+ * the datagrams in order. A full queue, or a datagram too large for a
+ * queue slot, flushes the queue first.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#define _GNU_SOURCE 1
+#include "rtptx.h"
+#include <string.h>
+#include <pthread.h>
+#ifdef LINUX
+#include <sys/socket.h>
+#endif
+
+
+enum {
+	TX_SLOT     = 2048,    /* max size of a queued datagram    */
+	MAX_BATCH   = 64,      /* upper limit of queued datagrams  */
+	LAYER_RTPTX = -1000,   /* below all other helpers          */
+};
+
+struct rtptx {
+	struct udp_sock *us;      /**< Socket, referenced                */
+	struct udp_helper *uh;    /**< Send helper on the socket         */
+	int fd;                   /**< File descriptor of the socket     */
+	pthread_mutex_t mutex;    /**< Protects the queue and statistics */
+	uint32_t batch;           /**< Queue size in datagrams           */
+	uint32_t n;               /**< Queued datagrams                  */
+	uint32_t corked;          /**< Cork nesting level                */
+	uint32_t nerr;            /**< Send failures since last uncork   */
+	uint8_t *bufv;            /**< Queue slots, TX_SLOT bytes each   */
+	struct sa *dstv;          /**< Destination addresses             */
+#ifdef LINUX
+	struct mmsghdr *msgv;     /**< Message headers for sendmmsg()    */
+	struct iovec *iov;        /**< One I/O vector per slot           */
+#endif
+	struct rtptx_stats stats; /**< Transmit statistics               */
+};
+
+
+#ifdef LINUX
+
+
+static void flush(struct rtptx *tx)
+{
+	uint32_t i = 0;
+	int n;
+
+	while (i < tx->n) {
+
+		n = sendmmsg(tx->fd, &tx->msgv[i], tx->n - i, 0);
+		++tx->stats.syscalls;
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* drop the failing datagram, like udp_send() */
+			++tx->stats.errors;
+			++tx->nerr;
+			++i;
+			continue;
+		}
+
+		tx->stats.max_batch = max(tx->stats.max_batch, (uint32_t)n);
+		i += n;
+	}
+
+	tx->n = 0;
+}
+
+
+static bool send_handler(int *err, struct sa *dst, struct mbuf *mb,
+			 void *arg)
+{
+	struct rtptx *tx = arg;
+	const size_t len = mbuf_get_left(mb);
+	bool queued = false;
+	uint32_t i;
+	(void)err;
+
+	pthread_mutex_lock(&tx->mutex);
+
+	if (!tx->corked || !tx->batch) {
+		++tx->stats.direct;
+		goto out;
+	}
+
+	if (tx->n == tx->batch || len > TX_SLOT)
+		flush(tx);
+
+	/* sent by the socket, after the datagrams queued before */
+	if (len > TX_SLOT) {
+		++tx->stats.direct;
+		goto out;
+	}
+
+	i = tx->n++;
+
+	memcpy(tx->iov[i].iov_base, mbuf_buf(mb), len);
+	tx->iov[i].iov_len = len;
+
+	tx->dstv[i] = *dst;
+	tx->msgv[i].msg_hdr.msg_name    = &tx->dstv[i].u;
+	tx->msgv[i].msg_hdr.msg_namelen = dst->len;
+
+	++tx->stats.packets;
+	queued = true;
+
+ out:
+	pthread_mutex_unlock(&tx->mutex);
+
+	return queued;
+}
+
+
+static bool recv_handler(struct sa *src, struct mbuf *mb, void *arg)
+{
+	(void)src;
+	(void)mb;
+	(void)arg;
+
+	return false;
+}
+
+
+static void free_queue(struct rtptx *tx)
+{
+	tx->bufv = mem_deref(tx->bufv);
+	tx->dstv = mem_deref(tx->dstv);
+	tx->msgv = mem_deref(tx->msgv);
+	tx->iov  = mem_deref(tx->iov);
+
+	tx->batch = 0;
+	tx->n     = 0;
+}
+
+
+static int alloc_queue(struct rtptx *tx, uint32_t batch)
+{
+	uint32_t i;
+
+	tx->bufv = mem_alloc((size_t)batch * TX_SLOT, NULL);
+	tx->dstv = mem_zalloc(batch * sizeof(*tx->dstv), NULL);
+	tx->msgv = mem_zalloc(batch * sizeof(*tx->msgv), NULL);
+	tx->iov  = mem_zalloc(batch * sizeof(*tx->iov), NULL);
+	if (!tx->bufv || !tx->dstv || !tx->msgv || !tx->iov) {
+		free_queue(tx);
+		return ENOMEM;
+	}
+
+	for (i=0; i<batch; i++) {
+		tx->iov[i].iov_base = tx->bufv + (size_t)i * TX_SLOT;
+		tx->msgv[i].msg_hdr.msg_iov    = &tx->iov[i];
+		tx->msgv[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	tx->batch = batch;
+
+	return 0;
+}
+
+
+static void destructor(void *arg)
+{
+	struct rtptx *tx = arg;
+
+	mem_deref(tx->uh);
+
+	pthread_mutex_lock(&tx->mutex);
+	flush(tx);
+	pthread_mutex_unlock(&tx->mutex);
+
+	free_queue(tx);
+	mem_deref(tx->us);
+
+	pthread_mutex_destroy(&tx->mutex);
+}
+
+
+#endif
+
+
+/**
+ * Send the datagrams of a UDP socket in batches
+ *
+ * The sender passes datagrams on to the socket as before, unless it is
+ * corked with rtptx_cork().
+ *
+ * @param txp   Pointer to allocated sender
+ * @param us    UDP socket
+ * @param af    Address family of the socket
+ * @param batch Maximum number of datagrams per system call
+ *
+ * @return 0 if success, ENOSYS if not supported, otherwise errorcode
+ */
+int rtptx_alloc(struct rtptx **txp, struct udp_sock *us, int af,
+		uint32_t batch)
+{
+#ifdef LINUX
+	struct rtptx *tx;
+	int fd, err;
+
+	if (!txp || !us || !batch)
+		return EINVAL;
+
+	fd = udp_sock_fd(us, af);
+	if (fd < 0)
+		return EBADF;
+
+	tx = mem_zalloc(sizeof(*tx), destructor);
+	if (!tx)
+		return ENOMEM;
+
+	tx->fd = fd;
+	tx->us = mem_ref(us);
+
+	err = pthread_mutex_init(&tx->mutex, NULL);
+	if (err)
+		goto out;
+
+	err = alloc_queue(tx, min(batch, (uint32_t)MAX_BATCH));
+	if (err)
+		goto out;
+
+	err = udp_register_helper(&tx->uh, us, LAYER_RTPTX,
+				  send_handler, recv_handler, tx);
+
+ out:
+	if (err)
+		mem_deref(tx);
+	else
+		*txp = tx;
+
+	return err;
+#else
+	(void)txp;
+	(void)us;
+	(void)af;
+	(void)batch;
+
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Change the number of datagrams queued while corked
+ *
+ * @param tx    Batched sender
+ * @param batch Maximum number of datagrams per system call, 0 for one
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtptx_set_batch(struct rtptx *tx, uint32_t batch)
+{
+#ifdef LINUX
+	int err = 0;
+
+	if (!tx)
+		return EINVAL;
+
+	batch = min(max(batch, 1u), (uint32_t)MAX_BATCH);
+
+	pthread_mutex_lock(&tx->mutex);
+
+	if (batch != tx->batch) {
+		flush(tx);
+		free_queue(tx);
+		err = alloc_queue(tx, batch);
+	}
+
+	pthread_mutex_unlock(&tx->mutex);
+
+	return err;
+#else
+	(void)tx;
+	(void)batch;
+
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Get the number of datagrams queued while corked
+ *
+ * @param tx Batched sender
+ *
+ * @return Batch size
+ */
+uint32_t rtptx_batch(const struct rtptx *tx)
+{
+	return tx ? tx->batch : 0;
+}
+
+
+/**
+ * Start queueing the datagrams sent on the socket. Corking can be nested,
+ * the queue is sent when the last cork is removed.
+ *
+ * @param tx Batched sender
+ */
+void rtptx_cork(struct rtptx *tx)
+{
+	if (!tx)
+		return;
+
+#ifdef LINUX
+	pthread_mutex_lock(&tx->mutex);
+	++tx->corked;
+	pthread_mutex_unlock(&tx->mutex);
+#endif
+}
+
+
+/**
+ * Remove a cork, and send the queued datagrams if it was the last one
+ *
+ * @param tx Batched sender
+ *
+ * @return Number of datagrams which failed to send since the last uncork
+ */
+uint32_t rtptx_uncork(struct rtptx *tx)
+{
+	uint32_t nerr = 0;
+
+	if (!tx)
+		return 0;
+
+#ifdef LINUX
+	pthread_mutex_lock(&tx->mutex);
+
+	if (tx->corked && !--tx->corked) {
+		flush(tx);
+
+		nerr = tx->nerr;
+		tx->nerr = 0;
+	}
+
+	pthread_mutex_unlock(&tx->mutex);
+#endif
+
+	return nerr;
+}
+
+
+/**
+ * Get the transmit statistics
+ *
+ * @param tx    Batched sender
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtptx_stats(const struct rtptx *tx, struct rtptx_stats *stats)
+{
+	if (!tx || !stats)
+		return EINVAL;
+
+#ifdef LINUX
+	pthread_mutex_lock((pthread_mutex_t *)&tx->mutex);
+	*stats = tx->stats;
+	pthread_mutex_unlock((pthread_mutex_t *)&tx->mutex);
+#endif
+
+	return 0;
+}
+
+
+/**
+ * Print the batched sender
+ *
+ * @param pf Print function
+ * @param tx Batched sender
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtptx_debug(struct re_printf *pf, const struct rtptx *tx)
+{
+	struct rtptx_stats st;
+
+	if (rtptx_stats(tx, &st))
+		return 0;
+
+	return re_hprintf(pf, " tx batch: %u (max=%u avg=%.1f)"
+			  " packets=%llu direct=%llu errors=%llu\n",
+			  tx->batch, st.max_batch,
+			  st.syscalls ? 1.0 * st.packets / st.syscalls : 0.0,
+			  st.packets, st.direct, st.errors);
+}
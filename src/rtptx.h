@@ -0,0 +1,33 @@
+/**
+ * @file rtptx.h
+ * @brief Batched RTP transmit
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UARTPTX_H_INCLUDED
+#define UARTPTX_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+struct rtptx;
+
+/** Transmit statistics of a batched sender */
+struct rtptx_stats {
+	uint64_t packets;     /**< Datagrams sent through the queue   */
+	uint64_t direct;      /**< Datagrams passed on uncorked       */
+	uint64_t syscalls;    /**< Calls to sendmmsg()                */
+	uint64_t errors;      /**< Datagrams which failed to send     */
+	uint32_t max_batch;   /**< Most datagrams sent in one call    */
+};
+
+int  rtptx_alloc(struct rtptx **txp, struct udp_sock *us, int af,
+		 uint32_t batch);
+int  rtptx_set_batch(struct rtptx *tx, uint32_t batch);
+uint32_t rtptx_batch(const struct rtptx *tx);
+void rtptx_cork(struct rtptx *tx);
+uint32_t rtptx_uncork(struct rtptx *tx);
+int  rtptx_stats(const struct rtptx *tx, struct rtptx_stats *stats);
+int  rtptx_debug(struct re_printf *pf, const struct rtptx *tx);
+
+#endif /* UARTPTX_H_INCLUDED */
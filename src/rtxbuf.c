@@ -0,0 +1,326 @@
+/**
+ * @file rtxbuf.c  RTP retransmission history
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include "rtxbuf.h"
+
+
+/**
+ * The history is a ring of recently sent packets, indexed by the low bits
+ * of the sequence number. A packet is copied into the staging entry before
+ * it is sent, and swapped into its slot when the sequence number is known.
+ * The buffers of the slots are allocated on first use and then reused, the
+ * memory is bounded by the size of the ring and the largest packet.
+ */
+
+struct rtxent {
+	struct mbuf *mb;      /**< Payload at headroom, NULL if unused */
+	uint64_t jfs;         /**< Time when stored [ms]               */
+	uint32_t ts;          /**< RTP timestamp                       */
+	uint16_t seq;         /**< Sequence number                     */
+	uint8_t pt;           /**< Payload type                        */
+	bool marker;          /**< Marker bit                          */
+	bool valid;           /**< Entry holds a packet                */
+};
+
+struct rtxbuf {
+	struct rtxent *entv;          /**< Ring of sent packets        */
+	struct rtxent stage;          /**< Packet being sent           */
+	struct mbuf *mb_tx;           /**< Copy of a packet to resend  */
+	uint32_t size;                /**< Ring size, power of two     */
+	uint32_t max_age;             /**< Oldest packet resent [ms]   */
+	size_t headroom;              /**< Space before the payload    */
+	size_t tailroom;              /**< Space after the payload     */
+	struct rtxbuf_stats stats;    /**< Statistics                  */
+};
+
+
+static void destructor(void *arg)
+{
+	struct rtxbuf *buf = arg;
+	uint32_t i;
+
+	for (i=0; buf->entv && i<buf->size; i++)
+		mem_deref(buf->entv[i].mb);
+
+	mem_deref(buf->entv);
+	mem_deref(buf->stage.mb);
+	mem_deref(buf->mb_tx);
+}
+
+
+/* make room for a payload, the buffer is kept for the next packet */
+static int copy_payload(struct rtxbuf *buf, struct mbuf **mbp,
+			const uint8_t *pld, size_t len)
+{
+	const size_t need = buf->headroom + len + buf->tailroom;
+	struct mbuf *mb = *mbp;
+	int err;
+
+	if (!mb) {
+		mb = mbuf_alloc(need);
+		if (!mb)
+			return ENOMEM;
+
+		buf->stats.mem += mb->size;
+		*mbp = mb;
+	}
+	else if (mb->size < need) {
+		const size_t size = mb->size;
+
+		err = mbuf_resize(mb, need);
+		if (err)
+			return err;
+
+		buf->stats.mem += mb->size - size;
+	}
+
+	mb->pos = mb->end = buf->headroom;
+
+	err = mbuf_write_mem(mb, pld, len);
+	if (err)
+		return err;
+
+	mb->pos = buf->headroom;
+
+	return 0;
+}
+
+
+/**
+ * Allocate an RTP retransmission history
+ *
+ * @param bufp     Pointer to allocated history
+ * @param size     Number of packets, rounded up to a power of two
+ * @param max_age  Oldest packet which is resent [ms]
+ * @param headroom Space before the payload, for the RTP header
+ * @param tailroom Space after the payload, e.g. for SRTP
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtxbuf_alloc(struct rtxbuf **bufp, uint32_t size, uint32_t max_age,
+		 size_t headroom, size_t tailroom)
+{
+	struct rtxbuf *buf;
+	uint32_t n = 1;
+	int err = 0;
+
+	if (!bufp || !size || size > 32768)
+		return EINVAL;
+
+	while (n < size)
+		n <<= 1;
+
+	buf = mem_zalloc(sizeof(*buf), destructor);
+	if (!buf)
+		return ENOMEM;
+
+	buf->entv = mem_zalloc(n * sizeof(*buf->entv), NULL);
+	if (!buf->entv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	buf->size     = n;
+	buf->max_age  = max_age;
+	buf->headroom = headroom;
+	buf->tailroom = tailroom;
+
+	buf->stats.size = n;
+
+ out:
+	if (err)
+		mem_deref(buf);
+	else
+		*bufp = buf;
+
+	return err;
+}
+
+
+/**
+ * Copy a packet into the history before it is sent
+ *
+ * @param buf    Retransmission history
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     RTP timestamp
+ * @param pld    Payload
+ * @param len    Payload length
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtxbuf_stage(struct rtxbuf *buf, bool marker, uint8_t pt, uint32_t ts,
+		 const uint8_t *pld, size_t len)
+{
+	int err;
+
+	if (!buf || !pld)
+		return EINVAL;
+
+	buf->stage.valid = false;
+
+	err = copy_payload(buf, &buf->stage.mb, pld, len);
+	if (err)
+		return err;
+
+	buf->stage.marker = marker;
+	buf->stage.pt     = pt;
+	buf->stage.ts     = ts;
+	buf->stage.valid  = true;
+
+	return 0;
+}
+
+
+/**
+ * Store the staged packet with the sequence number it was sent with
+ *
+ * @param buf Retransmission history
+ * @param seq Sequence number
+ */
+void rtxbuf_commit(struct rtxbuf *buf, uint16_t seq)
+{
+	struct rtxent *ent;
+	struct mbuf *mb;
+
+	if (!buf || !buf->stage.valid)
+		return;
+
+	ent = &buf->entv[seq & (buf->size - 1)];
+
+	/* swap the buffers, the old one is staged next */
+	mb = ent->mb;
+	*ent = buf->stage;
+	ent->seq = seq;
+	ent->jfs = tmr_jiffies();
+
+	buf->stage.mb    = mb;
+	buf->stage.valid = false;
+
+	++buf->stats.stored;
+}
+
+
+/**
+ * Resend the packets of a Generic NACK (RFC 4585)
+ *
+ * @param buf   Retransmission history
+ * @param pid   Packet ID of the first lost packet
+ * @param blp   Bitmask of the following lost packets
+ * @param sendh Handler which sends a packet
+ * @param arg   Handler argument
+ *
+ * @return Number of packets which could not be resent
+ */
+uint32_t rtxbuf_nack(struct rtxbuf *buf, uint16_t pid, uint16_t blp,
+		     rtxbuf_send_h *sendh, void *arg)
+{
+	const uint64_t now = tmr_jiffies();
+	uint32_t i, misses = 0;
+
+	if (!buf || !sendh)
+		return 17;
+
+	for (i=0; i<17; i++) {
+
+		const uint16_t seq = pid + i;
+		const struct rtxent *ent;
+		size_t len;
+
+		if (i && !(blp & (1 << (i - 1))))
+			continue;
+
+		++buf->stats.nacked;
+
+		ent = &buf->entv[seq & (buf->size - 1)];
+
+		if (!ent->valid || ent->seq != seq ||
+		    now - ent->jfs > buf->max_age) {
+			++misses;
+			continue;
+		}
+
+		/* the sender may encrypt in place, keep the original */
+		len = mbuf_get_left(ent->mb);
+
+		if (copy_payload(buf, &buf->mb_tx, mbuf_buf(ent->mb), len) ||
+		    sendh(seq, ent->marker, ent->pt, ent->ts, buf->mb_tx,
+			  arg)) {
+			++misses;
+			continue;
+		}
+
+		++buf->stats.hits;
+		buf->stats.bytes += len;
+	}
+
+	buf->stats.misses += misses;
+
+	return misses;
+}
+
+
+/**
+ * Forget all packets in the history, the buffers are kept
+ *
+ * @param buf Retransmission history
+ */
+void rtxbuf_flush(struct rtxbuf *buf)
+{
+	uint32_t i;
+
+	if (!buf)
+		return;
+
+	for (i=0; i<buf->size; i++)
+		buf->entv[i].valid = false;
+
+	buf->stage.valid = false;
+}
+
+
+/**
+ * Get the statistics of a retransmission history
+ *
+ * @param buf   Retransmission history
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtxbuf_stats(const struct rtxbuf *buf, struct rtxbuf_stats *stats)
+{
+	if (!buf || !stats)
+		return EINVAL;
+
+	*stats = buf->stats;
+
+	return 0;
+}
+
+
+/**
+ * Print the statistics of a retransmission history
+ *
+ * @param pf  Print function
+ * @param buf Retransmission history
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtxbuf_debug(struct re_printf *pf, const struct rtxbuf *buf)
+{
+	const struct rtxbuf_stats *st;
+
+	if (!buf)
+		return 0;
+
+	st = &buf->stats;
+
+	return re_hprintf(pf, "rtx: size=%u mem=%zu stored=%llu nacked=%llu"
+			  " hits=%llu misses=%llu bytes=%llu\n",
+			  st->size, st->mem, st->stored, st->nacked,
+			  st->hits, st->misses, st->bytes);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file rtxbuf.h
+ * @brief RTP retransmission history
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UARTXBUF_H_INCLUDED
+#define UARTXBUF_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+struct rtxbuf;
+
+/**
+ * Resend a packet from the history
+ *
+ * @param seq    Sequence number of the packet
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     RTP timestamp
+ * @param mb     Payload, with headroom for the RTP header
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+typedef int (rtxbuf_send_h)(uint16_t seq, bool marker, uint8_t pt,
+			    uint32_t ts, struct mbuf *mb, void *arg);
+
+/** Statistics of a retransmission history */
+struct rtxbuf_stats {
+	uint64_t stored;      /**< Packets stored                     */
+	uint64_t nacked;      /**< Packets requested by NACK          */
+	uint64_t hits;        /**< Requested packets resent           */
+	uint64_t misses;      /**< Requested packets not in history   */
+	uint64_t bytes;       /**< Payload bytes resent               */
+	uint32_t size;        /**< History size in packets            */
+	size_t mem;           /**< Memory used by the packets [bytes] */
+};
+
+int  rtxbuf_alloc(struct rtxbuf **bufp, uint32_t size, uint32_t max_age,
+		  size_t headroom, size_t tailroom);
+int  rtxbuf_stage(struct rtxbuf *buf, bool marker, uint8_t pt, uint32_t ts,
+		  const uint8_t *pld, size_t len);
+void rtxbuf_commit(struct rtxbuf *buf, uint16_t seq);
+uint32_t rtxbuf_nack(struct rtxbuf *buf, uint16_t pid, uint16_t blp,
+		     rtxbuf_send_h *sendh, void *arg);
+void rtxbuf_flush(struct rtxbuf *buf);
+int  rtxbuf_stats(const struct rtxbuf *buf, struct rtxbuf_stats *stats);
+int  rtxbuf_debug(struct re_printf *pf, const struct rtxbuf *buf);
+
+#endif /* UARTXBUF_H_INCLUDED */
@@ -0,0 +1,336 @@
+/**
+ * @file simulcast.c  Simulcast layers of a video source
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "simulcast.h"
+#include <string.h>
+
+
+/**
+ * Each layer halves the width and height of the layer above it, and gets
+ * a share of the bitrate by its number of pixels. The shares are taken
+ * again over the layers the peer takes. The bitrate is allocated
+ * from the smallest layer up. A larger layer is only sent if it gets its
+ * minimum, so the full size is paused first when the bandwidth drops and
+ * the smallest enabled layer is always sent.
+ *
+ * The layers offered are negotiated with "a=simulcast" (RFC 8853), the
+ * peer lists the RTP stream IDs it takes in the recv direction.
+ */
+
+static const char *ridv[SIMULCAST_MAX] = {"f", "h", "q"};
+
+
+static uint32_t layer_weight(uint32_t i)
+{
+	return 1u << (2 * (SIMULCAST_MAX - 1 - i));
+}
+
+
+/* share the bitrate among the enabled layers */
+static void share(struct simulcast *sc)
+{
+	uint64_t weight = 0;
+	uint32_t i;
+
+	for (i=0; i<sc->n; i++) {
+		if (sc->layerv[i].enabled)
+			weight += layer_weight(i);
+	}
+
+	for (i=0; i<sc->n; i++) {
+
+		struct simulcast_layer *l = &sc->layerv[i];
+
+		if (!l->enabled || !weight) {
+			l->max_bitrate = 0;
+			l->min_bitrate = 0;
+			continue;
+		}
+
+		l->max_bitrate = (uint32_t)((uint64_t)sc->bitrate *
+					    layer_weight(i) / weight);
+		l->min_bitrate = l->max_bitrate / 4;
+	}
+}
+
+
+/**
+ * Initialize the layers of a source, all layers are enabled and get the
+ * most bitrate
+ *
+ * @param sc      Simulcast layers
+ * @param n       Number of layers
+ * @param bitrate Bitrate of all layers [bit/s]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int simulcast_init(struct simulcast *sc, uint32_t n, uint32_t bitrate)
+{
+	uint32_t i;
+
+	if (!sc || !n || n > SIMULCAST_MAX)
+		return EINVAL;
+
+	memset(sc, 0, sizeof(*sc));
+
+	for (i=0; i<n; i++) {
+
+		struct simulcast_layer *l = &sc->layerv[i];
+
+		str_ncpy(l->rid, ridv[i], sizeof(l->rid));
+
+		l->scale   = 1u << i;
+		l->enabled = true;
+		l->active  = true;
+	}
+
+	sc->n       = n;
+	sc->bitrate = bitrate;
+
+	share(sc);
+
+	for (i=0; i<n; i++)
+		sc->layerv[i].bitrate = sc->layerv[i].max_bitrate;
+
+	return 0;
+}
+
+
+/**
+ * Send the full size layer only, e.g. if the peer takes no simulcast. The
+ * layer gets all of the bitrate.
+ *
+ * @param sc Simulcast layers
+ */
+void simulcast_single(struct simulcast *sc)
+{
+	uint32_t i;
+
+	if (!sc)
+		return;
+
+	for (i=0; i<sc->n; i++)
+		sc->layerv[i].enabled = i == 0;
+
+	share(sc);
+}
+
+
+/**
+ * Get the size of a layer, the source size divided by the scale of the
+ * layer and rounded down to even
+ *
+ * @param sz    Returned size
+ * @param src   Size of the source
+ * @param layer Simulcast layer
+ *
+ * @return 0 if success, ERANGE if the layer is too small
+ */
+int simulcast_size(struct vidsz *sz, const struct vidsz *src,
+		   const struct simulcast_layer *layer)
+{
+	if (!sz || !src || !layer || !layer->scale)
+		return EINVAL;
+
+	if (layer->scale == 1) {
+		*sz = *src;
+		return 0;
+	}
+
+	sz->w = src->w / layer->scale & ~1u;
+	sz->h = src->h / layer->scale & ~1u;
+
+	if (sz->w < SIMULCAST_MIN_DIM || sz->h < SIMULCAST_MIN_DIM)
+		return ERANGE;
+
+	return 0;
+}
+
+
+/**
+ * Allocate a bitrate to the enabled layers
+ *
+ * @param sc      Simulcast layers
+ * @param bitrate Bitrate of all layers [bit/s]
+ *
+ * @return Number of layers to send
+ */
+uint32_t simulcast_allocate(struct simulcast *sc, uint32_t bitrate)
+{
+	uint32_t i, active = 0;
+	bool paused = false;
+
+	if (!sc)
+		return 0;
+
+	for (i=sc->n; i-- > 0;) {
+
+		struct simulcast_layer *l = &sc->layerv[i];
+
+		l->bitrate = 0;
+		l->active  = false;
+
+		if (!l->enabled || paused)
+			continue;
+
+		if (active && bitrate < l->min_bitrate) {
+			paused = true;
+			continue;
+		}
+
+		l->bitrate = min(bitrate, l->max_bitrate);
+		l->active  = true;
+
+		bitrate -= l->bitrate;
+		++active;
+	}
+
+	return active;
+}
+
+
+/* the list of RTP stream IDs the peer takes */
+static int recv_list(struct pl *list, const char *attr)
+{
+	struct pl dir, val, rest;
+
+	pl_set_str(&rest, attr);
+
+	while (0 == re_regex(rest.p, rest.l, "[^ ]+[ ]+[^ ]+",
+			     &dir, NULL, &val)) {
+
+		if (0 == pl_strcasecmp(&dir, "recv")) {
+			*list = val;
+			return 0;
+		}
+
+		rest.l -= val.p + val.l - rest.p;
+		rest.p  = val.p + val.l;
+	}
+
+	return ENOENT;
+}
+
+
+/**
+ * Enable the layers the peer takes, from its "a=simulcast" attribute. The
+ * layers keep their RTP stream IDs if the peer uses them, e.g. in an
+ * answer. Otherwise the layers take the IDs of the peer in order, from
+ * the full size down. Paused streams and alternatives are not used. The
+ * bitrate is shared among the enabled layers.
+ *
+ * @param sc   Simulcast layers
+ * @param attr Value of the simulcast attribute of the peer
+ *
+ * @return 0 if success, ENOENT if the peer takes no layers
+ */
+int simulcast_decode(struct simulcast *sc, const char *attr)
+{
+	char idv[SIMULCAST_MAX][SIMULCAST_RID_LEN];
+	struct simulcast_layer *layerv;
+	uint32_t i, j, n, idc = 0;
+	bool named = false;
+	struct pl list;
+	int err;
+
+	if (!sc || !attr)
+		return EINVAL;
+
+	layerv = sc->layerv;
+	n      = sc->n;
+
+	err = recv_list(&list, attr);
+	if (err)
+		return err;
+
+	while (list.l && idc < SIMULCAST_MAX) {
+
+		const char *sep = pl_strchr(&list, ';');
+		struct pl id = list;
+
+		if (sep) {
+			id.l    = sep - list.p;
+			list.l -= id.l + 1;
+			list.p  = sep + 1;
+		}
+		else {
+			list.l = 0;
+		}
+
+		sep = pl_strchr(&id, ',');
+		if (sep)
+			id.l = sep - id.p;
+
+		if (!id.l || id.l >= SIMULCAST_RID_LEN || id.p[0] == '~')
+			continue;
+
+		(void)pl_strcpy(&id, idv[idc++], SIMULCAST_RID_LEN);
+	}
+
+	if (!idc)
+		return ENOENT;
+
+	for (i=0; i<idc; i++) {
+		for (j=0; j<n; j++)
+			named |= 0 == str_casecmp(idv[i], layerv[j].rid);
+	}
+
+	for (j=0; j<n; j++)
+		layerv[j].enabled = false;
+
+	for (i=0; i<idc; i++) {
+
+		if (!named) {
+			if (i < n) {
+				str_ncpy(layerv[i].rid, idv[i],
+					 sizeof(layerv[i].rid));
+				layerv[i].enabled = true;
+			}
+			continue;
+		}
+
+		for (j=0; j<n; j++) {
+			if (0 == str_casecmp(idv[i], layerv[j].rid))
+				layerv[j].enabled = true;
+		}
+	}
+
+	share(sc);
+
+	return 0;
+}
+
+
+/**
+ * Print the "a=simulcast" attribute value of the enabled layers
+ *
+ * @param pf Print function
+ * @param sc Simulcast layers
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int simulcast_encode(struct re_printf *pf, const struct simulcast *sc)
+{
+	const char *sep = "send ";
+	uint32_t i;
+	int err = 0;
+
+	if (!sc)
+		return 0;
+
+	for (i=0; i<sc->n; i++) {
+
+		const struct simulcast_layer *l = &sc->layerv[i];
+
+		if (!l->enabled)
+			continue;
+
+		err |= re_hprintf(pf, "%s%s", sep, l->rid);
+		sep = ";";
+	}
+
+	return err;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file simulcast.h
+ * @brief Simulcast layers of a video source
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UASIMULCAST_H_INCLUDED
+#define UASIMULCAST_H_INCLUDED
+
+#include "rsua-re/re.h"
+#include "rsua-rem/rem.h"
+
+/** Simulcast limits */
+enum {
+	SIMULCAST_MAX     = 3,       /**< Layers per source               */
+	SIMULCAST_RID_LEN = 16,      /**< RTP stream ID incl. NUL         */
+	SIMULCAST_MIN_DIM = 16,      /**< Smallest width or height        */
+};
+
+/** A simulcast layer, layer 0 has the full size */
+struct simulcast_layer {
+	char rid[SIMULCAST_RID_LEN];  /**< RTP stream ID, RFC 8851       */
+	uint32_t scale;               /**< Downscale factor              */
+	uint32_t max_bitrate;         /**< Most bitrate [bit/s]          */
+	uint32_t min_bitrate;         /**< Least bitrate to send [bit/s] */
+	uint32_t bitrate;             /**< Allocated bitrate, 0=paused   */
+	bool enabled;                 /**< Negotiated with the peer      */
+	bool active;                  /**< Sent, not paused              */
+};
+
+/** The simulcast layers of a source */
+struct simulcast {
+	struct simulcast_layer layerv[SIMULCAST_MAX]; /**< Layers        */
+	uint32_t n;                                   /**< Layers in use */
+	uint32_t bitrate;                             /**< Total [bit/s] */
+};
+
+int  simulcast_init(struct simulcast *sc, uint32_t n, uint32_t bitrate);
+void simulcast_single(struct simulcast *sc);
+int  simulcast_size(struct vidsz *sz, const struct vidsz *src,
+		    const struct simulcast_layer *layer);
+uint32_t simulcast_allocate(struct simulcast *sc, uint32_t bitrate);
+int  simulcast_decode(struct simulcast *sc, const char *attr);
+int  simulcast_encode(struct re_printf *pf, const struct simulcast *sc);
+
+#endif /* UASIMULCAST_H_INCLUDED */
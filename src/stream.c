@@ -8,6 +8,7 @@
 #include "stream.h"
 #include <string.h>
 #include <time.h>
+#include "bwe.h"
 #include "menc.h"
 #include "mnat.h"
 #include "rtpext.h"
@@ -28,7 +29,8 @@ enum {
 
 static void print_rtp_stats(const struct stream *s)
 {
-	bool started = s->metric_tx.n_packets>0 || s->metric_rx.n_packets>0;
+	bool started = metric_n_packets(&s->metric_tx) > 0 ||
+		metric_n_packets(&s->metric_rx) > 0;
 
 	if (!started)
 		return;
@@ -39,10 +41,11 @@ static void print_rtp_stats(const struct stream *s)
 	     "errors:         %7d      %7d\n"
 	     ,
 	     sdp_media_name(s->sdp),
-	     s->metric_tx.n_packets, s->metric_rx.n_packets,
+	     metric_n_packets(&s->metric_tx),
+	     metric_n_packets(&s->metric_rx),
 	     1.0*metric_avg_bitrate(&s->metric_tx)/1000.0,
 	     1.0*metric_avg_bitrate(&s->metric_rx)/1000.0,
-	     s->metric_tx.n_err, s->metric_rx.n_err
+	     metric_n_err(&s->metric_tx), metric_n_err(&s->metric_rx)
 	     );
 
 	if (s->rtcp_stats.tx.sent || s->rtcp_stats.rx.sent) {
@@ -75,6 +78,9 @@ static void stream_destructor(void *arg)
 	mem_deref(s->mencs);
 	mem_deref(s->mns);
 	mem_deref(s->jbuf);
+	mem_deref(s->bwe);
+	mem_deref(s->rx);
+	mem_deref(s->tx);
 	mem_deref(s->rtp);
 	mem_deref(s->cname);
 }
@@ -183,57 +189,177 @@ static const char *media_name(enum media_type type)
 }
 
 
+/* RFC 5285 -- A General Mechanism for RTP Header Extensions */
+static int decode_rtpext(const struct rtp_header *hdr, struct mbuf *mb,
+			 struct rtpext *extv, size_t extn, size_t *extcp)
+{
+	const size_t pos = mb->pos;
+	const size_t end = mb->end;
+	const size_t ext_stop = mb->pos;
+	size_t ext_len;
+	size_t i;
+	int err;
+
+	*extcp = 0;
+
+	if (!hdr->ext || !hdr->x.len)
+		return 0;
+
+	if (hdr->x.type != RTPEXT_TYPE_MAGIC) {
+		debug("stream: unknown ext type ignored (0x%04x)\n",
+		     hdr->x.type);
+		return 0;
+	}
+
+	ext_len = hdr->x.len*sizeof(uint32_t);
+	if (mb->pos < ext_len) {
+		warning("stream: corrupt rtp packet,"
+			" not enough space for rtpext of %zu bytes\n",
+			ext_len);
+		return EBADMSG;
+	}
+
+	mb->pos = mb->pos - ext_len;
+	mb->end = ext_stop;
+
+	for (i=0; i<extn && mbuf_get_left(mb); i++) {
+
+		err = rtpext_decode(&extv[i], mb);
+		if (err) {
+			warning("stream: rtpext_decode failed (%m)\n",
+				err);
+			goto out;
+		}
+	}
+
+	*extcp = i;
+	err = 0;
+
+ out:
+	mb->pos = pos;
+	mb->end = end;
+
+	return err;
+}
+
+
 static void handle_rtp(struct stream *s, const struct rtp_header *hdr,
+		       struct rtpext *extv, size_t extc,
 		       struct mbuf *mb, unsigned lostc)
 {
-	struct rtpext extv[8];
-	size_t extc = 0;
+	s->rtph(hdr, extv, extc, mb, lostc, s->arg);
+}
 
-	/* RFC 5285 -- A General Mechanism for RTP Header Extensions */
-	if (hdr->ext && hdr->x.len && mb) {
 
-		const size_t pos = mb->pos;
-		const size_t end = mb->end;
-		const size_t ext_stop = mb->pos;
-		size_t ext_len;
-		size_t i;
-		int err;
+struct remb {
+	uint32_t bps;
+	uint32_t ssrc;
+};
 
-		if (hdr->x.type != RTPEXT_TYPE_MAGIC) {
-			debug("stream: unknown ext type ignored (0x%04x)\n",
-			     hdr->x.type);
-			goto handler;
-		}
 
-		ext_len = hdr->x.len*sizeof(uint32_t);
-		if (mb->pos < ext_len) {
-			warning("stream: corrupt rtp packet,"
-				" not enough space for rtpext of %zu bytes\n",
-				ext_len);
-			return;
-		}
+static int remb_encode_handler(struct mbuf *mb, void *arg)
+{
+	const struct remb *remb = arg;
 
-		mb->pos = mb->pos - ext_len;
-		mb->end = ext_stop;
+	return bwe_remb_encode(mb, remb->bps, &remb->ssrc, 1);
+}
 
-		for (i=0; i<ARRAY_SIZE(extv) && mbuf_get_left(mb); i++) {
 
-			err = rtpext_decode(&extv[i], mb);
-			if (err) {
-				warning("stream: rtpext_decode failed (%m)\n",
-					err);
-				return;
-			}
-		}
+struct nack {
+	const struct gnack *fciv;
+	uint32_t n;
+	uint16_t offset;
+};
 
-		extc = i;
 
-		mb->pos = pos;
-		mb->end = end;
+static int nack_encode_handler(struct mbuf *mb, void *arg)
+{
+	const struct nack *nack = arg;
+	uint32_t i;
+	int err = 0;
+
+	for (i=0; i<nack->n; i++) {
+
+		const uint16_t pid = nack->fciv[i].pid - nack->offset;
+
+		err |= mbuf_write_u16(mb, htons(pid));
+		err |= mbuf_write_u16(mb, htons(nack->fciv[i].blp));
 	}
 
- handler:
-	s->rtph(hdr, extv, extc, mb, lostc, s->arg);
+	return err;
+}
+
+
+/* send a feedback message to the sender of the received packets */
+static int send_fb(struct stream *s, enum rtcp_type type, uint32_t fmt,
+		   uint32_t ssrc_media, rtcp_encode_h *ench, void *arg)
+{
+	struct mbuf *mb;
+	void *sock;
+	int err;
+
+	mb = mbuf_alloc(64);
+	if (!mb)
+		return ENOMEM;
+
+	err = rtcp_encode(mb, type, fmt, rtp_sess_ssrc(s->rtp), ssrc_media,
+			  ench, arg);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	sock = s->rtcp_mux ? rtp_sock(s->rtp) : rtcp_sock(s->rtp);
+
+	err = udp_send(sock, &s->raddr_rtcp, mb);
+
+ out:
+	if (err)
+		metric_add_err(&s->metric_tx);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static void send_remb(struct stream *s, uint32_t bps)
+{
+	struct remb remb;
+	int err;
+
+	remb.bps  = bps;
+	remb.ssrc = s->ssrc_rx;
+
+	err = send_fb(s, RTCP_PSFB, RTCP_PSFB_AFB, 0, remb_encode_handler,
+		      &remb);
+	if (err)
+		warning("stream: failed to send RTCP REMB: %m\n", err);
+}
+
+
+/* the arrival time is taken here, before the jitter buffer */
+static void handle_bwe(struct stream *s, const struct rtpext *extv,
+		       size_t extc, struct mbuf *mb)
+{
+	const uint64_t now = tmr_jiffies_usec();
+	uint32_t bps;
+	size_t i;
+
+	for (i=0; i<extc; i++) {
+
+		const uint8_t *d = extv[i].data;
+
+		if (extv[i].id != s->extmap_ast || extv[i].len != 3)
+			continue;
+
+		bwe_rx_packet(s->bwe, now, d[0] << 16 | d[1] << 8 | d[2],
+			      RTP_HEADER_SIZE + mbuf_get_left(mb));
+		break;
+	}
+
+	if (bwe_rx_feedback(s->bwe, now, &bps))
+		send_remb(s, bps);
 }
 
 
@@ -247,6 +373,8 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 			struct mbuf *mb, void *arg)
 {
 	struct stream *s = arg;
+	struct rtpext extv[8];
+	size_t extc = 0;
 	bool flush = false;
 	int err;
 
@@ -301,6 +429,22 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 		flush = true;
 	}
 
+	/* the packets in the jitter buffer are decoded when taken out */
+	if (s->bwe || !s->jbuf) {
+
+		if (decode_rtpext(hdr, mb, extv, ARRAY_SIZE(extv), &extc))
+			return;
+	}
+
+	if (s->bwe)
+		handle_bwe(s, extv, extc, mb);
+
+	/* relayed as is, without jitter buffer and decoder */
+	if (s->relayh) {
+		s->relayh(s, hdr, mb, s->relay_arg);
+		return;
+	}
+
 	/* payload-type changed? */
 	if (s->pt_dec != hdr->pt) {
 		s->pt_dec = hdr->pt;
@@ -323,7 +467,7 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 			     " [seq=%u, ts=%u] (%m)\n",
 			     sdp_media_name(s->sdp), mb->end,
 			     src, hdr->seq, hdr->ts, err);
-			s->metric_rx.n_err++;
+			metric_add_err(&s->metric_rx);
 		}
 
 		if (s->type == MEDIA_VIDEO ||
@@ -334,15 +478,16 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 		}
 	}
 	else {
-		handle_rtp(s, hdr, mb, 0);
+		handle_rtp(s, hdr, extv, extc, mb, 0);
 	}
 }
 
 
 /**
  * Decodes one RTP packet. For audio streams this function is called by the
- * auplay write handler and runs in the auplay thread. For video streams there
- * is only the RTP thread which also does the decoding.
+ * auplay write handler and runs in the auplay thread. For video streams it
+ * runs in the RTP thread, the video object queues complete frames for its
+ * decoder on the worker pool.
  *
  * @param s The stream
  *
@@ -352,6 +497,8 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 int stream_decode(struct stream *s)
 {
 	struct rtp_header hdr;
+	struct rtpext extv[8];
+	size_t extc = 0;
 	void *mb;
 	int lostc;
 	int err;
@@ -366,7 +513,9 @@ int stream_decode(struct stream *s)
 	lostc = lostcalc(s, hdr.seq);
 	s->jbuf_started = true;
 
-	handle_rtp(s, &hdr, mb, lostc > 0 ? lostc : 0);
+	if (!mb || !decode_rtpext(&hdr, mb, extv, ARRAY_SIZE(extv), &extc))
+		handle_rtp(s, &hdr, extv, extc, mb, lostc > 0 ? lostc : 0);
+
 	mem_deref(mb);
 
 	return err;
@@ -395,8 +544,14 @@ static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg, void *arg)
 		break;
 	}
 
-	if (s->rtcph)
+	/* the packets sent are relayed, not from the encoder */
+	if (s->relayh) {
+		if (s->relay_rtcph)
+			s->relay_rtcph(s, msg, s->relay_arg);
+	}
+	else if (s->rtcph) {
 		s->rtcph(s, msg, s->arg);
+	}
 
 	if (s->sessrtcph)
 		s->sessrtcph(s, msg, s->sess_arg);
@@ -434,6 +589,22 @@ static int stream_sock_alloc(struct stream *s, int af)
 
 	udp_sockbuf_set(rtp_sock(s->rtp), 65536);
 
+	if (s->cfg.rtp_rx_batch) {
+		err = stream_set_rx_batch(s, s->cfg.rtp_rx_batch);
+		if (err) {
+			warning("stream: batched receive disabled (%m)\n",
+				err);
+		}
+	}
+
+	if (s->cfg.rtp_tx_batch) {
+		err = stream_set_tx_batch(s, s->cfg.rtp_tx_batch);
+		if (err) {
+			warning("stream: batched transmit disabled (%m)\n",
+				err);
+		}
+	}
+
 	return 0;
 }
 
@@ -642,25 +813,19 @@ struct sdp_media *stream_sdpmedia(const struct stream *strm)
 }
 
 
-/**
- * Write stream data to the network
- *
- * @param s		Stream object
- * @param ext		Extension bit
- * @param marker	Marker bit
- * @param pt		Payload type
- * @param ts		Timestamp
- * @param mb		Payload buffer
- *
- * @return int	0 if success, errorcode otherwise
+/*
+ * The sequence number of a packet is read back from its header, which
+ * rtp_send() leaves in the headroom. The header is not changed by SRTP
+ * or TURN, only the payload is encrypted and data is prepended.
  */
-int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
-		struct mbuf *mb)
+static int send_rtp(struct stream *s, bool ext, bool marker, int pt,
+		    uint32_t ts, struct mbuf *mb, int *seqp)
 {
+	size_t hpos;
 	int err = 0;
 
-	if (!s)
-		return EINVAL;
+	if (seqp)
+		*seqp = -1;
 
 	if (!sa_isset(&s->raddr_rtp, SA_ALL))
 		return 0;
@@ -688,16 +853,400 @@ int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 		pt = s->pt_enc;
 
 	if (pt >= 0) {
+		hpos = mb->pos - RTP_HEADER_SIZE;
+
 		err = rtp_send(s->rtp, &s->raddr_rtp, ext,
 			       marker, pt, ts, mb);
-		if (err)
-			s->metric_tx.n_err++;
+		if (err) {
+			metric_add_err(&s->metric_tx);
+		}
+		else {
+			s->seq_tx = mb->buf[hpos + 2] << 8 | mb->buf[hpos + 3];
+
+			if (seqp)
+				*seqp = s->seq_tx;
+		}
+
+		s->ts_tx = ts;
 	}
 
 	return err;
 }
 
 
+/**
+ * Write stream data to the network
+ *
+ * @param s		Stream object
+ * @param ext		Extension bit
+ * @param marker	Marker bit
+ * @param pt		Payload type
+ * @param ts		Timestamp
+ * @param mb		Payload buffer
+ *
+ * @return int	0 if success, errorcode otherwise
+ */
+int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
+		struct mbuf *mb)
+{
+	if (!s)
+		return EINVAL;
+
+	/* the stream only sends relayed packets */
+	if (s->relayh)
+		return 0;
+
+	return send_rtp(s, ext, marker, pt, ts, mb, NULL);
+}
+
+
+/**
+ * Write stream data to the network and get the sequence number it was
+ * sent with, e.g. to keep it for retransmission
+ *
+ * @param s      Stream object
+ * @param ext    Extension bit
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer
+ * @param seqp   Returned sequence number, -1 if the packet was not sent
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_send_seq(struct stream *s, bool ext, bool marker, int pt,
+		    uint32_t ts, struct mbuf *mb, int *seqp)
+{
+	if (!s || !seqp)
+		return EINVAL;
+
+	*seqp = -1;
+
+	if (s->relayh)
+		return 0;
+
+	return send_rtp(s, ext, marker, pt, ts, mb, seqp);
+}
+
+
+/* encode the RTP header into the headroom and send the packet as is */
+static int send_hdr(struct stream *s, uint32_t ssrc, uint16_t seq,
+		    bool ext, bool marker, int pt, uint32_t ts,
+		    struct mbuf *mb)
+{
+	struct rtp_header hdr;
+	size_t pos, len;
+	int err;
+
+	len = mbuf_get_left(mb);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.ext  = ext;
+	hdr.m    = marker;
+	hdr.pt   = pt;
+	hdr.seq  = seq;
+	hdr.ts   = ts;
+	hdr.ssrc = ssrc;
+
+	mb->pos -= RTP_HEADER_SIZE;
+	pos = mb->pos;
+
+	err = rtp_hdr_encode(mb, &hdr);
+	if (err)
+		return err;
+
+	mb->pos = pos;
+
+	metric_add_packet(&s->metric_tx, len);
+
+	err = udp_send(rtp_sock(s->rtp), &s->raddr_rtp, mb);
+	if (err)
+		metric_add_err(&s->metric_tx);
+
+	return err;
+}
+
+
+/**
+ * Send a packet again, with the sequence number it was first sent with
+ *
+ * @param s      Stream object
+ * @param seq    Sequence number
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer, with headroom for the RTP header
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_resend(struct stream *s, uint16_t seq, bool marker, int pt,
+		  uint32_t ts, struct mbuf *mb)
+{
+	if (!s || !mb || pt < 0)
+		return EINVAL;
+
+	if (mb->pos < RTP_HEADER_SIZE)
+		return EINVAL;
+
+	if (s->relayh || s->hold || !sa_isset(&s->raddr_rtp, SA_ALL))
+		return 0;
+
+	if (!stream_is_ready(s))
+		return EINTR;
+
+	return send_hdr(s, rtp_sess_ssrc(s->rtp), seq, false, marker, pt, ts,
+			mb);
+}
+
+
+/**
+ * Send a packet with another SSRC than the one of the stream, e.g. for a
+ * simulcast layer. The caller keeps the sequence numbers of the SSRC, the
+ * packet is sent the same way as with stream_resend(). RTCP is only sent
+ * for the SSRC of the stream.
+ *
+ * @param s      Stream object
+ * @param ssrc   Synchronization source
+ * @param seq    Sequence number
+ * @param ext    Extension bit
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer, with headroom for the RTP header
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_send_ssrc(struct stream *s, uint32_t ssrc, uint16_t seq,
+		     bool ext, bool marker, int pt, uint32_t ts,
+		     struct mbuf *mb)
+{
+	if (!s || !mb || pt < 0)
+		return EINVAL;
+
+	if (mb->pos < RTP_HEADER_SIZE)
+		return EINVAL;
+
+	if (s->relayh || s->hold || !sa_isset(&s->raddr_rtp, SA_ALL))
+		return 0;
+
+	if (!(sdp_media_rdir(s->sdp) & SDP_SENDONLY))
+		return 0;
+
+	if (!(sdp_media_ldir(s->sdp) & SDP_SENDONLY))
+		return 0;
+
+	if (!stream_is_ready(s))
+		return EINTR;
+
+	return send_hdr(s, ssrc, seq, ext, marker, pt, ts, mb);
+}
+
+
+/**
+ * Relay RTP packets received on this stream to a handler, instead of the
+ * jitter buffer and the decoder. While a handler is set, the packets sent
+ * with stream_send() are dropped, only stream_relay_send() sends. The
+ * RTCP messages received go to the RTCP relay handler instead of the
+ * media, e.g. to pass the feedback on with stream_relay_feedback().
+ *
+ * @param strm   Stream object
+ * @param relayh Relay handler, or NULL to stop relaying
+ * @param rtcph  RTCP relay handler, optional
+ * @param arg    Handler argument
+ */
+void stream_set_relay(struct stream *strm, stream_relay_h *relayh,
+		      stream_rtcp_h *rtcph, void *arg)
+{
+	if (!strm)
+		return;
+
+	strm->relayh      = relayh;
+	strm->relay_rtcph = relayh ? rtcph : NULL;
+	strm->relay_arg   = arg;
+	strm->relay_sync = false;
+
+	if (strm->jbuf) {
+		jbuf_flush(strm->jbuf);
+		strm->jbuf_started = false;
+	}
+}
+
+
+/**
+ * Send a relayed RTP packet. The packet gets the SSRC of this stream, the
+ * sequence numbers and timestamps of the relayed source are moved to
+ * continue from the last packet sent. The offsets are kept until the
+ * source changes, so a gap, a reordered or a duplicated packet of the
+ * source is seen as such by the receiver.
+ *
+ * @param strm Stream object
+ * @param hdr  RTP header of the relayed packet
+ * @param pt   Payload type on this stream
+ * @param mb   Payload buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_relay_send(struct stream *strm, const struct rtp_header *hdr,
+		      int pt, struct mbuf *mb)
+{
+	uint16_t seq;
+	uint32_t ts;
+	bool marker;
+	int err;
+
+	if (!strm || !hdr || !mb || pt < 0)
+		return EINVAL;
+
+	if (mb->pos < RTP_HEADER_SIZE)
+		return EINVAL;
+
+	if (strm->hold || !sa_isset(&strm->raddr_rtp, SA_ALL))
+		return 0;
+
+	if (!(sdp_media_rdir(strm->sdp) & SDP_SENDONLY))
+		return 0;
+
+	if (!(sdp_media_ldir(strm->sdp) & SDP_SENDONLY))
+		return 0;
+
+	if (!stream_is_ready(strm))
+		return EINTR;
+
+	marker = hdr->m;
+
+	if (!strm->relay_sync || hdr->ssrc != strm->relay_ssrc) {
+
+		strm->relay_ssrc = hdr->ssrc;
+		strm->relay_ts   = strm->ts_tx + 1 - hdr->ts;
+		strm->relay_seq  = strm->seq_tx + 1 - hdr->seq;
+		strm->relay_sync = true;
+
+		/* a new source starts a new talkspurt */
+		marker = true;
+	}
+
+	seq = hdr->seq + strm->relay_seq;
+	ts  = hdr->ts + strm->relay_ts;
+
+	err = send_hdr(strm, rtp_sess_ssrc(strm->rtp), seq, false, marker,
+		       pt, ts, mb);
+	if (err)
+		return err;
+
+	/* a late packet does not move the offsets of the next source */
+	if ((int16_t)(seq - strm->seq_tx) > 0) {
+		strm->seq_tx = seq;
+		strm->ts_tx  = ts;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Pass the feedback about relayed packets on to their source, so that the
+ * source recovers from a loss on this leg. A picture loss indication or a
+ * FIR asks the source for a key frame, the sequence numbers of a NACK are
+ * moved back to those of the source and a REMB is passed on.
+ *
+ * @param strm Stream which sent the relayed packets and got the feedback
+ * @param src  Stream which receives the packets from the source
+ * @param msg  RTCP message received on strm
+ *
+ * @return 0 if passed on, ENOENT if not relayed feedback, otherwise
+ * errorcode
+ */
+int stream_relay_feedback(struct stream *strm, struct stream *src,
+			  const struct rtcp_msg *msg)
+{
+	struct nack nack;
+	uint32_t ssrc, bps;
+
+	if (!strm || !src || !msg)
+		return EINVAL;
+
+	ssrc = rtp_sess_ssrc(strm->rtp);
+
+	/* the packets of strm come from the current source of src */
+	if (!strm->relay_sync || !src->pseq_set ||
+	    strm->relay_ssrc != src->ssrc_rx)
+		return ENOENT;
+
+	switch (msg->hdr.pt) {
+
+	case RTCP_FIR:
+		stream_send_fir(src, false);
+		return 0;
+
+	case RTCP_PSFB:
+		if (msg->hdr.count == RTCP_PSFB_AFB) {
+
+			if (bwe_remb_decode(&bps, msg->r.fb.fci.afb))
+				return ENOENT;
+
+			send_remb(src, bps);
+			return 0;
+		}
+
+		if (msg->hdr.count != RTCP_PSFB_PLI ||
+		    msg->r.fb.ssrc_media != ssrc)
+			return ENOENT;
+
+		stream_send_fir(src, true);
+		return 0;
+
+	case RTCP_RTPFB:
+		if (msg->hdr.count != RTCP_RTPFB_GNACK ||
+		    msg->r.fb.ssrc_media != ssrc || !msg->r.fb.n)
+			return ENOENT;
+
+		nack.fciv   = msg->r.fb.fci.gnackv;
+		nack.n      = msg->r.fb.n;
+		nack.offset = strm->relay_seq;
+
+		return send_fb(src, RTCP_RTPFB, RTCP_RTPFB_GNACK,
+			       src->ssrc_rx, nack_encode_handler, &nack);
+
+	default:
+		return ENOENT;
+	}
+}
+
+
+/**
+ * Queue the packets sent on the stream until stream_send_flush() is
+ * called, if batched transmit is enabled. Calls can be nested.
+ *
+ * @param s Stream object
+ */
+void stream_send_cork(struct stream *s)
+{
+	if (!s)
+		return;
+
+	rtptx_cork(s->tx);
+}
+
+
+/**
+ * Send the packets queued since stream_send_cork()
+ *
+ * @param s Stream object
+ */
+void stream_send_flush(struct stream *s)
+{
+	uint32_t nerr;
+
+	if (!s)
+		return;
+
+	/* the packets were counted when queued */
+	for (nerr = rtptx_uncork(s->tx); nerr; nerr--)
+		metric_add_err(&s->metric_tx);
+}
+
+
 static void stream_remote_set(struct stream *s)
 {
 	if (!s)
@@ -850,7 +1399,7 @@ void stream_send_fir(struct stream *s, bool pli)
 		err = rtcp_send_fir(s->rtp, rtp_sess_ssrc(s->rtp));
 
 	if (err) {
-		s->metric_tx.n_err++;
+		metric_add_err(&s->metric_tx);
 
 		warning("stream: failed to send RTCP %s: %m\n",
 			pli ? "PLI" : "FIR", err);
@@ -897,6 +1446,99 @@ void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms)
 }
 
 
+/**
+ * Enable the receiver side bandwidth estimation. The estimate is based on
+ * the abs-send-time header extension of the incoming RTP packets, and is
+ * sent to the peer with RTCP REMB. Can be called again when the extension
+ * ID is renegotiated.
+ *
+ * @param strm      Stream object
+ * @param extmap_id Extension ID of abs-send-time, 0 to disable
+ * @param start_bps Initial estimate [bit/s]
+ * @param min_bps   Lowest estimate [bit/s]
+ * @param max_bps   Highest estimate [bit/s]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_enable_bwe(struct stream *strm, unsigned extmap_id,
+		      uint32_t start_bps, uint32_t min_bps, uint32_t max_bps)
+{
+	int err = 0;
+
+	if (!strm || extmap_id > RTPEXT_ID_MAX)
+		return EINVAL;
+
+	strm->extmap_ast = extmap_id;
+
+	if (!extmap_id) {
+		strm->bwe = mem_deref(strm->bwe);
+		return 0;
+	}
+
+	if (!strm->bwe)
+		err = bwe_rx_alloc(&strm->bwe, start_bps, min_bps, max_bps);
+
+	return err;
+}
+
+
+/**
+ * Set the number of RTP packets read from the socket per wakeup
+ *
+ * Batched receive reads the packets into a pool of buffers with one
+ * system call, and passes them on without copying. Once enabled, the
+ * stream keeps the pool; a batch size of 0 then reads one packet at a
+ * time.
+ *
+ * @param strm  Stream object
+ * @param batch Maximum number of packets per wakeup, 0 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_set_rx_batch(struct stream *strm, uint32_t batch)
+{
+	if (!strm || !strm->rtp)
+		return EINVAL;
+
+	if (strm->rx)
+		return rtprx_set_batch(strm->rx, batch);
+
+	if (!batch)
+		return 0;
+
+	return rtprx_alloc(&strm->rx, rtp_sock(strm->rtp),
+			   sa_af(rtp_local(strm->rtp)), batch);
+}
+
+
+/**
+ * Set the number of RTP packets sent with one system call
+ *
+ * Packets sent between stream_send_cork() and stream_send_flush() are
+ * queued, and sent together. Once enabled, the stream keeps the queue; a
+ * batch size of 0 then sends one packet at a time.
+ *
+ * @param strm  Stream object
+ * @param batch Maximum number of packets per system call, 0 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_set_tx_batch(struct stream *strm, uint32_t batch)
+{
+	if (!strm || !strm->rtp)
+		return EINVAL;
+
+	if (strm->tx)
+		return rtptx_set_batch(strm->tx, batch);
+
+	if (!batch)
+		return 0;
+
+	return rtptx_alloc(&strm->tx, rtp_sock(strm->rtp),
+			   sa_af(rtp_local(strm->rtp)), batch);
+}
+
+
 /**
  * Set optional session handlers
  *
@@ -956,20 +1598,28 @@ int stream_debug(struct re_printf *pf, const struct stream *s)
 			  s->menc_secure ? "yes" : "no");
 
 	err |= rtp_debug(pf, s->rtp);
+	err |= rtprx_debug(pf, s->rx);
+	err |= rtptx_debug(pf, s->tx);
 	err |= jbuf_debug(pf, s->jbuf);
 
+	if (s->relayh)
+		err |= re_hprintf(pf, " relay: ssrc=0x%08x\n", s->relay_ssrc);
+
+	if (s->bwe)
+		err |= re_hprintf(pf, " %H", bwe_rx_debug, s->bwe);
+
 	return err;
 }
 
 
-int stream_print(struct re_printf *pf, const struct stream *s)
+int stream_print(struct re_printf *pf, struct stream *s)
 {
 	if (!s)
 		return 0;
 
 	return re_hprintf(pf, " %s=%u/%u", sdp_media_name(s->sdp),
-			  s->metric_tx.cur_bitrate,
-			  s->metric_rx.cur_bitrate);
+			  metric_bitrate(&s->metric_tx),
+			  metric_bitrate(&s->metric_rx));
 }
 
 
@@ -995,7 +1645,7 @@ const struct rtcp_stats *stream_rtcp_stats(const struct stream *strm)
  */
 uint32_t stream_metric_get_tx_n_packets(const struct stream *strm)
 {
-	return strm ? strm->metric_tx.n_packets : 0;
+	return strm ? metric_n_packets(&strm->metric_tx) : 0;
 }
 
 
@@ -1008,7 +1658,7 @@ uint32_t stream_metric_get_tx_n_packets(const struct stream *strm)
  */
 uint32_t stream_metric_get_tx_n_bytes(const struct stream *strm)
 {
-	return strm ? strm->metric_tx.n_bytes : 0;
+	return strm ? metric_n_bytes(&strm->metric_tx) : 0;
 }
 
 
@@ -1021,7 +1671,7 @@ uint32_t stream_metric_get_tx_n_bytes(const struct stream *strm)
  */
 uint32_t stream_metric_get_tx_n_err(const struct stream *strm)
 {
-	return strm ? strm->metric_tx.n_err : 0;
+	return strm ? metric_n_err(&strm->metric_tx) : 0;
 }
 
 
@@ -1034,7 +1684,7 @@ uint32_t stream_metric_get_tx_n_err(const struct stream *strm)
  */
 uint32_t stream_metric_get_rx_n_packets(const struct stream *strm)
 {
-	return strm ? strm->metric_rx.n_packets : 0;
+	return strm ? metric_n_packets(&strm->metric_rx) : 0;
 }
 
 
@@ -1047,7 +1697,7 @@ uint32_t stream_metric_get_rx_n_packets(const struct stream *strm)
  */
 uint32_t stream_metric_get_rx_n_bytes(const struct stream *strm)
 {
-	return strm ? strm->metric_rx.n_bytes : 0;
+	return strm ? metric_n_bytes(&strm->metric_rx) : 0;
 }
 
 
@@ -1060,7 +1710,7 @@ uint32_t stream_metric_get_rx_n_bytes(const struct stream *strm)
  */
 uint32_t stream_metric_get_rx_n_err(const struct stream *strm)
 {
-	return strm ? strm->metric_rx.n_err : 0;
+	return strm ? metric_n_err(&strm->metric_rx) : 0;
 }
 
 
@@ -1208,3 +1858,16 @@ const char *stream_name(const struct stream *strm)
 
 	return media_name(strm->type);
 }
+
+
+/**
+ * Get the RTP socket of the stream
+ *
+ * @param strm Stream object
+ *
+ * @return RTP socket
+ */
+struct rtp_sock *stream_rtp_sock(const struct stream *strm)
+{
+	return strm ? strm->rtp : NULL;
+}
@@ -11,6 +11,7 @@
 
 #include "rsua-re/re.h"
 
+struct bwe_rx;
 struct mnat;
 struct mnat_sess;
 struct rtpext;
@@ -28,6 +29,9 @@ typedef void (stream_rtpestab_h)(struct stream *strm, void *arg);
 typedef void (stream_rtcp_h)(struct stream *strm,
 			     struct rtcp_msg *msg, void *arg);
 typedef void (stream_error_h)(struct stream *strm, int err, void *arg);
+typedef void (stream_relay_h)(struct stream *strm,
+			      const struct rtp_header *hdr,
+			      struct mbuf *mb, void *arg);
 
 void stream_update(struct stream *s);
 const struct rtcp_stats *stream_rtcp_stats(const struct stream *strm);
@@ -39,6 +43,14 @@ uint32_t stream_metric_get_rx_n_packets(const struct stream *strm);
 uint32_t stream_metric_get_rx_n_bytes(const struct stream *strm);
 uint32_t stream_metric_get_rx_n_err(const struct stream *strm);
 void stream_set_secure(struct stream *strm, bool secure);
+int  stream_set_rx_batch(struct stream *strm, uint32_t batch);
+int  stream_set_tx_batch(struct stream *strm, uint32_t batch);
+void stream_set_relay(struct stream *strm, stream_relay_h *relayh,
+		      stream_rtcp_h *rtcph, void *arg);
+int  stream_relay_send(struct stream *strm, const struct rtp_header *hdr,
+		       int pt, struct mbuf *mb);
+int  stream_relay_feedback(struct stream *strm, struct stream *src,
+			   const struct rtcp_msg *msg);
 bool stream_is_secure(const struct stream *strm);
 int  stream_start_mediaenc(struct stream *strm);
 int  stream_start(const struct stream *strm);
@@ -49,6 +61,7 @@ void stream_set_session_handlers(struct stream *strm,
 				 stream_rtcp_h *rtcph,
 				 stream_error_h *errorh, void *arg);
 const char *stream_name(const struct stream *strm);
+struct rtp_sock *stream_rtp_sock(const struct stream *strm);
 int  stream_debug(struct re_printf *pf, const struct stream *s);
 
 
@@ -56,6 +69,8 @@ int  stream_debug(struct re_printf *pf, const struct stream *s);
 
 #include "data.h"
 #include "metric.h"
+#include "rtprx.h"
+#include "rtptx.h"
 
 enum media_type {
 	MEDIA_AUDIO = 0,
@@ -82,6 +97,8 @@ struct stream {
 	struct sdp_media *sdp;   /**< SDP Media line                        */
 	enum sdp_dir ldir;       /**< SDP direction of the stream           */
 	struct rtp_sock *rtp;    /**< RTP Socket                            */
+	struct rtprx *rx;        /**< Batched RTP receive (optional)        */
+	struct rtptx *tx;        /**< Batched RTP transmit (optional)       */
 	struct rtcp_stats rtcp_stats;/**< RTCP statistics                   */
 	struct jbuf *jbuf;       /**< Jitter Buffer for incoming RTP        */
 	const struct mnat *mnat; /**< Media NAT traversal module            */
@@ -119,6 +136,21 @@ struct stream {
 	stream_rtcp_h *sessrtcph;    /**< Stream RTCP handler               */
 	stream_error_h *errorh;  /**< Stream error handler                  */
 	void *sess_arg;          /**< Session handlers argument             */
+	uint32_t ts_tx;          /**< Timestamp of last sent RTP packet     */
+	uint16_t seq_tx;         /**< Sequence no. of last sent RTP packet  */
+
+	/* RTP relay: */
+	stream_relay_h *relayh;  /**< Relay handler for incoming RTP        */
+	stream_rtcp_h *relay_rtcph; /**< Relay handler for incoming RTCP    */
+	void *relay_arg;         /**< Relay handler argument                */
+	uint32_t relay_ssrc;     /**< SSRC of the relayed source            */
+	uint32_t relay_ts;       /**< Timestamp offset to the relayed source */
+	uint16_t relay_seq;      /**< Sequence no. offset to relayed source */
+	bool relay_sync;         /**< Offsets are set                       */
+
+	/* Bandwidth estimation: */
+	struct bwe_rx *bwe;      /**< Receive bandwidth estimator           */
+	unsigned extmap_ast;     /**< Extension ID of abs-send-time         */
 };
 
 int  stream_alloc(struct stream **sp, struct list *streaml,
@@ -133,6 +165,15 @@ int  stream_alloc(struct stream **sp, struct list *streaml,
 		  void *arg);
 int  stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 		 struct mbuf *mb);
+int  stream_send_seq(struct stream *s, bool ext, bool marker, int pt,
+		     uint32_t ts, struct mbuf *mb, int *seqp);
+int  stream_resend(struct stream *s, uint16_t seq, bool marker, int pt,
+		   uint32_t ts, struct mbuf *mb);
+int  stream_send_ssrc(struct stream *s, uint32_t ssrc, uint16_t seq,
+		      bool ext, bool marker, int pt, uint32_t ts,
+		      struct mbuf *mb);
+void stream_send_cork(struct stream *s);
+void stream_send_flush(struct stream *s);
 void stream_update_encoder(struct stream *s, int pt_enc);
 int  stream_jbuf_stat(struct re_printf *pf, const struct stream *s);
 void stream_hold(struct stream *s, bool hold);
@@ -141,8 +182,11 @@ void stream_set_srate(struct stream *s, uint32_t srate_tx, uint32_t srate_rx);
 void stream_send_fir(struct stream *s, bool pli);
 void stream_reset(struct stream *s);
 void stream_set_bw(struct stream *s, uint32_t bps);
-int  stream_print(struct re_printf *pf, const struct stream *s);
+int  stream_print(struct re_printf *pf, struct stream *s);
 void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms);
+int  stream_enable_bwe(struct stream *strm, unsigned extmap_id,
+		       uint32_t start_bps, uint32_t min_bps,
+		       uint32_t max_bps);
 bool stream_is_ready(const struct stream *strm);
 int  stream_decode(struct stream *s);
 void stream_silence_on(struct stream *s, bool on);
@@ -43,6 +43,7 @@ typedef int (viddec_update_h)(struct viddec_state **vdsp,
 typedef int (viddec_decode_h)(struct viddec_state *vds, struct vidframe *frame,
                               bool *intra, bool marker, uint16_t seq,
                               struct mbuf *mb);
+typedef bool (viddec_keyframe_h)(const struct mbuf *mb);
 
 struct vidcodec {
 	struct le le;
@@ -56,6 +57,7 @@ struct vidcodec {
 	viddec_decode_h *dech;
 	sdp_fmtp_enc_h *fmtp_ench;
 	sdp_fmtp_cmp_h *fmtp_cmph;
+	viddec_keyframe_h *keyh;
 };
 
 void vidcodec_register(struct list *vidcodecl, struct vidcodec *vc);
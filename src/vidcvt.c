@@ -0,0 +1,1462 @@
+/**
+ * @file vidcvt.c  Video pixel format conversion and scaling
+ *
+ * Converts the common camera formats to YUV420P and scales YUV420P frames.
+ * The work is done by row kernels, one set per instruction set, and the
+ * best set supported by the CPU is selected at the first use. All kernels
+ * give the same result as the scalar kernels.
+ *
+ * A frame is split into horizontal slices of whole row pairs, so that the
+ * rows of a slice stay in the cache of the thread working on it. The
+ * calling thread converts slices itself, and helper jobs on the shared
+ * worker pool take the other slices. Slices are claimed one at a time, so
+ * the caller never waits for a job which has not started yet.
+ *
+ * Chroma is averaged over each 2x2 block with rounding. Scaling is
+ * bilinear with 8-bit weights, the centres of the pixels are aligned.
+ * Other formats, odd sizes and cropping are left to vidconv().
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "vidcvt.h"
+#include <string.h>
+#include <pthread.h>
+#include "lathist.h"
+#include "workpool.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define USE_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined (__aarch64__) && defined (__ARM_NEON) && \
+	(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+enum {
+	SLICE_MIN_ROWS = 32,     /**< Smallest slice in luma rows        */
+	SLICES_PER_THREAD = 2,   /**< Slices per thread, for balance     */
+	MAX_THREADS = 16,        /**< Upper limit of threads per frame   */
+};
+
+
+/*
+ * Scalar kernels
+ */
+
+static inline uint8_t avg2(uint8_t a, uint8_t b)
+{
+	return (uint8_t)((a + b + 1) >> 1);
+}
+
+
+/* BT.601, studio swing */
+static inline uint8_t rgb_y(int r, int g, int b)
+{
+	return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+
+static inline uint8_t rgb_u(int r, int g, int b)
+{
+	return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+
+static inline uint8_t rgb_v(int r, int g, int b)
+{
+	return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+
+static void packed422_c(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+			const uint8_t *s0, const uint8_t *s1, unsigned w,
+			unsigned yo, unsigned co)
+{
+	unsigned x;
+
+	for (x=0; x<w; x+=2, s0+=4, s1+=4) {
+
+		*y0++ = s0[yo];
+		*y0++ = s0[yo + 2];
+		*y1++ = s1[yo];
+		*y1++ = s1[yo + 2];
+		*u++  = avg2(s0[co], s1[co]);
+		*v++  = avg2(s0[co + 2], s1[co + 2]);
+	}
+}
+
+
+static void yuyv422_c(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		      const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		      unsigned w)
+{
+	(void)c;
+
+	packed422_c(y0, y1, u, v, s0, s1, w, 0, 1);
+}
+
+
+static void uyvy422_c(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		      const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		      unsigned w)
+{
+	(void)c;
+
+	packed422_c(y0, y1, u, v, s0, s1, w, 1, 0);
+}
+
+
+/* split interleaved bytes into two planes */
+static void split_c(uint8_t *a, uint8_t *b, const uint8_t *c, size_t n)
+{
+	while (n--) {
+		*a++ = *c++;
+		*b++ = *c++;
+	}
+}
+
+
+static void nv12_c(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		   const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		   unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_c(u, v, c, w / 2);
+}
+
+
+static void nv21_c(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		   const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		   unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_c(v, u, c, w / 2);
+}
+
+
+/* RGB32 is a native endian 0x00RRGGBB word per pixel */
+static inline void rgb_get(const uint8_t *p, int *r, int *g, int *b)
+{
+	uint32_t px;
+
+	memcpy(&px, p, sizeof(px));
+
+	*r = (px >> 16) & 0xff;
+	*g = (px >> 8) & 0xff;
+	*b = px & 0xff;
+}
+
+
+static void rgb32_c(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		    const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		    unsigned w)
+{
+	unsigned x;
+	(void)c;
+
+	for (x=0; x<w; x+=2, s0+=8, s1+=8) {
+
+		int r[4], g[4], b[4];
+		int ra, ga, ba;
+
+		rgb_get(s0,     &r[0], &g[0], &b[0]);
+		rgb_get(s0 + 4, &r[1], &g[1], &b[1]);
+		rgb_get(s1,     &r[2], &g[2], &b[2]);
+		rgb_get(s1 + 4, &r[3], &g[3], &b[3]);
+
+		*y0++ = rgb_y(r[0], g[0], b[0]);
+		*y0++ = rgb_y(r[1], g[1], b[1]);
+		*y1++ = rgb_y(r[2], g[2], b[2]);
+		*y1++ = rgb_y(r[3], g[3], b[3]);
+
+		ra = (r[0] + r[1] + r[2] + r[3] + 2) >> 2;
+		ga = (g[0] + g[1] + g[2] + g[3] + 2) >> 2;
+		ba = (b[0] + b[1] + b[2] + b[3] + 2) >> 2;
+
+		*u++ = rgb_u(ra, ga, ba);
+		*v++ = rgb_v(ra, ga, ba);
+	}
+}
+
+
+static void blend_c(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		    unsigned w, size_t n)
+{
+	const unsigned wa = 256 - w;
+
+	while (n--)
+		*dst++ = (uint8_t)((*a++ * wa + *b++ * w + 128) >> 8);
+}
+
+
+#ifdef USE_X86
+
+/*
+ * SSE2, 16 pixels per iteration
+ */
+
+static inline TARGET_SSE2 unsigned packed422_sse2(uint8_t *y0, uint8_t *y1,
+						  uint8_t *u, uint8_t *v,
+						  const uint8_t *s0,
+						  const uint8_t *s1,
+						  unsigned w, bool uyvy)
+{
+	const __m128i m = _mm_set1_epi16(0xff);
+	const __m128i zero = _mm_setzero_si128();
+	unsigned x;
+
+	for (x=0; x + 16 <= w; x += 16) {
+
+		const __m128i a0 = _mm_loadu_si128((const void *)&s0[2*x]);
+		const __m128i a1 = _mm_loadu_si128((const void *)&s0[2*x+16]);
+		const __m128i b0 = _mm_loadu_si128((const void *)&s1[2*x]);
+		const __m128i b1 = _mm_loadu_si128((const void *)&s1[2*x+16]);
+		__m128i ya, yb, ca, cb, uv;
+
+		if (uyvy) {
+			ya = _mm_packus_epi16(_mm_srli_epi16(a0, 8),
+					      _mm_srli_epi16(a1, 8));
+			yb = _mm_packus_epi16(_mm_srli_epi16(b0, 8),
+					      _mm_srli_epi16(b1, 8));
+			ca = _mm_packus_epi16(_mm_and_si128(a0, m),
+					      _mm_and_si128(a1, m));
+			cb = _mm_packus_epi16(_mm_and_si128(b0, m),
+					      _mm_and_si128(b1, m));
+		}
+		else {
+			ya = _mm_packus_epi16(_mm_and_si128(a0, m),
+					      _mm_and_si128(a1, m));
+			yb = _mm_packus_epi16(_mm_and_si128(b0, m),
+					      _mm_and_si128(b1, m));
+			ca = _mm_packus_epi16(_mm_srli_epi16(a0, 8),
+					      _mm_srli_epi16(a1, 8));
+			cb = _mm_packus_epi16(_mm_srli_epi16(b0, 8),
+					      _mm_srli_epi16(b1, 8));
+		}
+
+		_mm_storeu_si128((void *)&y0[x], ya);
+		_mm_storeu_si128((void *)&y1[x], yb);
+
+		uv = _mm_avg_epu8(ca, cb);
+
+		_mm_storel_epi64((void *)&u[x/2],
+				 _mm_packus_epi16(_mm_and_si128(uv, m), zero));
+		_mm_storel_epi64((void *)&v[x/2],
+				 _mm_packus_epi16(_mm_srli_epi16(uv, 8),
+						  zero));
+	}
+
+	return x;
+}
+
+
+static TARGET_SSE2 void yuyv422_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				     uint8_t *v, const uint8_t *s0,
+				     const uint8_t *s1, const uint8_t *c,
+				     unsigned w)
+{
+	unsigned x = packed422_sse2(y0, y1, u, v, s0, s1, w, false);
+
+	yuyv422_c(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 2*x, s1 + 2*x, c,
+		  w - x);
+}
+
+
+static TARGET_SSE2 void uyvy422_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				     uint8_t *v, const uint8_t *s0,
+				     const uint8_t *s1, const uint8_t *c,
+				     unsigned w)
+{
+	unsigned x = packed422_sse2(y0, y1, u, v, s0, s1, w, true);
+
+	uyvy422_c(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 2*x, s1 + 2*x, c,
+		  w - x);
+}
+
+
+static TARGET_SSE2 void split_sse2(uint8_t *a, uint8_t *b, const uint8_t *c,
+				   size_t n)
+{
+	const __m128i m = _mm_set1_epi16(0xff);
+
+	for (; n >= 16; n -= 16, a += 16, b += 16, c += 32) {
+
+		const __m128i c0 = _mm_loadu_si128((const void *)c);
+		const __m128i c1 = _mm_loadu_si128((const void *)(c + 16));
+
+		_mm_storeu_si128((void *)a,
+				 _mm_packus_epi16(_mm_and_si128(c0, m),
+						  _mm_and_si128(c1, m)));
+		_mm_storeu_si128((void *)b,
+				 _mm_packus_epi16(_mm_srli_epi16(c0, 8),
+						  _mm_srli_epi16(c1, 8)));
+	}
+
+	split_c(a, b, c, n);
+}
+
+
+static TARGET_SSE2 void nv12_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				  uint8_t *v, const uint8_t *s0,
+				  const uint8_t *s1, const uint8_t *c,
+				  unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_sse2(u, v, c, w / 2);
+}
+
+
+static TARGET_SSE2 void nv21_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				  uint8_t *v, const uint8_t *s0,
+				  const uint8_t *s1, const uint8_t *c,
+				  unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_sse2(v, u, c, w / 2);
+}
+
+
+/* R, G and B of 8 pixels as 16-bit lanes */
+static inline TARGET_SSE2 void rgb_split_sse2(const uint8_t *p, __m128i *r,
+					      __m128i *g, __m128i *b)
+{
+	const __m128i m = _mm_set1_epi32(0xff);
+	const __m128i lo = _mm_loadu_si128((const void *)p);
+	const __m128i hi = _mm_loadu_si128((const void *)(p + 16));
+
+	*r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), m),
+			     _mm_and_si128(_mm_srli_epi32(hi, 16), m));
+	*g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), m),
+			     _mm_and_si128(_mm_srli_epi32(hi, 8), m));
+	*b = _mm_packs_epi32(_mm_and_si128(lo, m), _mm_and_si128(hi, m));
+}
+
+
+/* the sum fits in 16 bits unsigned, the products wrap around */
+static inline TARGET_SSE2 __m128i rgb_y_sse2(__m128i r, __m128i g,
+					     __m128i b)
+{
+	__m128i y;
+
+	y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+			  _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+	y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+
+	return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+
+static inline TARGET_SSE2 __m128i rgb_uv_sse2(__m128i r, __m128i g,
+					      __m128i b, short kr, short kg,
+					      short kb)
+{
+	__m128i c;
+
+	c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(kr)),
+			  _mm_mullo_epi16(g, _mm_set1_epi16(kg)));
+	c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(kb)));
+	c = _mm_srai_epi16(_mm_add_epi16(c, _mm_set1_epi16(128)), 8);
+
+	return _mm_add_epi16(c, _mm_set1_epi16(128));
+}
+
+
+/* rounded mean of 2x2 blocks, 8 pixels of two rows to 4 x 32-bit */
+static inline TARGET_SSE2 __m128i avg4_sse2(__m128i a, __m128i b)
+{
+	__m128i s;
+
+	s = _mm_madd_epi16(_mm_add_epi16(a, b), _mm_set1_epi16(1));
+
+	return _mm_srli_epi32(_mm_add_epi32(s, _mm_set1_epi32(2)), 2);
+}
+
+
+static TARGET_SSE2 void rgb32_sse2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				   uint8_t *v, const uint8_t *s0,
+				   const uint8_t *s1, const uint8_t *c,
+				   unsigned w)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned x;
+
+	for (x=0; x + 16 <= w; x += 16) {
+
+		__m128i r[4], g[4], b[4], ra, ga, ba;
+
+		/* 0, 1: first row; 2, 3: second row */
+		rgb_split_sse2(&s0[4*x],      &r[0], &g[0], &b[0]);
+		rgb_split_sse2(&s0[4*x + 32], &r[1], &g[1], &b[1]);
+		rgb_split_sse2(&s1[4*x],      &r[2], &g[2], &b[2]);
+		rgb_split_sse2(&s1[4*x + 32], &r[3], &g[3], &b[3]);
+
+		_mm_storeu_si128((void *)&y0[x],
+				 _mm_packus_epi16(rgb_y_sse2(r[0], g[0], b[0]),
+						  rgb_y_sse2(r[1], g[1],
+							     b[1])));
+		_mm_storeu_si128((void *)&y1[x],
+				 _mm_packus_epi16(rgb_y_sse2(r[2], g[2], b[2]),
+						  rgb_y_sse2(r[3], g[3],
+							     b[3])));
+
+		ra = _mm_packs_epi32(avg4_sse2(r[0], r[2]),
+				     avg4_sse2(r[1], r[3]));
+		ga = _mm_packs_epi32(avg4_sse2(g[0], g[2]),
+				     avg4_sse2(g[1], g[3]));
+		ba = _mm_packs_epi32(avg4_sse2(b[0], b[2]),
+				     avg4_sse2(b[1], b[3]));
+
+		_mm_storel_epi64((void *)&u[x/2],
+				 _mm_packus_epi16(rgb_uv_sse2(ra, ga, ba,
+							      -38, -74, 112),
+						  zero));
+		_mm_storel_epi64((void *)&v[x/2],
+				 _mm_packus_epi16(rgb_uv_sse2(ra, ga, ba,
+							      112, -94, -18),
+						  zero));
+	}
+
+	rgb32_c(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 4*x, s1 + 4*x, c,
+		w - x);
+}
+
+
+static TARGET_SSE2 void blend_sse2(uint8_t *dst, const uint8_t *a,
+				   const uint8_t *b, unsigned w, size_t n)
+{
+	const __m128i wa = _mm_set1_epi16((short)(256 - w));
+	const __m128i wb = _mm_set1_epi16((short)w);
+	const __m128i rnd = _mm_set1_epi16(128);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; n >= 16; n -= 16, dst += 16, a += 16, b += 16) {
+
+		const __m128i va = _mm_loadu_si128((const void *)a);
+		const __m128i vb = _mm_loadu_si128((const void *)b);
+		__m128i lo, hi;
+
+		lo = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+		hi = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, rnd), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, rnd), 8);
+
+		_mm_storeu_si128((void *)dst, _mm_packus_epi16(lo, hi));
+	}
+
+	blend_c(dst, a, b, w, n);
+}
+
+
+/*
+ * AVX2, 32 pixels per iteration
+ *
+ * The pack instructions work within 128-bit lanes, the 64-bit quarters
+ * are put back in order afterwards.
+ */
+
+static inline TARGET_AVX2 __m256i packus_avx2(__m256i a, __m256i b)
+{
+	return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+
+static inline TARGET_AVX2 unsigned packed422_avx2(uint8_t *y0, uint8_t *y1,
+						  uint8_t *u, uint8_t *v,
+						  const uint8_t *s0,
+						  const uint8_t *s1,
+						  unsigned w, bool uyvy)
+{
+	const __m256i m = _mm256_set1_epi16(0xff);
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned x;
+
+	for (x=0; x + 32 <= w; x += 32) {
+
+		const __m256i a0 = _mm256_loadu_si256((const void *)&s0[2*x]);
+		const __m256i a1 = _mm256_loadu_si256((const void *)
+						      &s0[2*x + 32]);
+		const __m256i b0 = _mm256_loadu_si256((const void *)&s1[2*x]);
+		const __m256i b1 = _mm256_loadu_si256((const void *)
+						      &s1[2*x + 32]);
+		__m256i ya, yb, ca, cb, uv;
+
+		if (uyvy) {
+			ya = packus_avx2(_mm256_srli_epi16(a0, 8),
+					 _mm256_srli_epi16(a1, 8));
+			yb = packus_avx2(_mm256_srli_epi16(b0, 8),
+					 _mm256_srli_epi16(b1, 8));
+			ca = packus_avx2(_mm256_and_si256(a0, m),
+					 _mm256_and_si256(a1, m));
+			cb = packus_avx2(_mm256_and_si256(b0, m),
+					 _mm256_and_si256(b1, m));
+		}
+		else {
+			ya = packus_avx2(_mm256_and_si256(a0, m),
+					 _mm256_and_si256(a1, m));
+			yb = packus_avx2(_mm256_and_si256(b0, m),
+					 _mm256_and_si256(b1, m));
+			ca = packus_avx2(_mm256_srli_epi16(a0, 8),
+					 _mm256_srli_epi16(a1, 8));
+			cb = packus_avx2(_mm256_srli_epi16(b0, 8),
+					 _mm256_srli_epi16(b1, 8));
+		}
+
+		_mm256_storeu_si256((void *)&y0[x], ya);
+		_mm256_storeu_si256((void *)&y1[x], yb);
+
+		uv = _mm256_avg_epu8(ca, cb);
+
+		_mm_storeu_si128((void *)&u[x/2], _mm256_castsi256_si128(
+				 packus_avx2(_mm256_and_si256(uv, m), zero)));
+		_mm_storeu_si128((void *)&v[x/2], _mm256_castsi256_si128(
+				 packus_avx2(_mm256_srli_epi16(uv, 8), zero)));
+	}
+
+	return x;
+}
+
+
+static TARGET_AVX2 void yuyv422_avx2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				     uint8_t *v, const uint8_t *s0,
+				     const uint8_t *s1, const uint8_t *c,
+				     unsigned w)
+{
+	unsigned x = packed422_avx2(y0, y1, u, v, s0, s1, w, false);
+
+	yuyv422_sse2(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 2*x, s1 + 2*x,
+		     c, w - x);
+}
+
+
+static TARGET_AVX2 void uyvy422_avx2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				     uint8_t *v, const uint8_t *s0,
+				     const uint8_t *s1, const uint8_t *c,
+				     unsigned w)
+{
+	unsigned x = packed422_avx2(y0, y1, u, v, s0, s1, w, true);
+
+	uyvy422_sse2(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 2*x, s1 + 2*x,
+		     c, w - x);
+}
+
+
+static TARGET_AVX2 void split_avx2(uint8_t *a, uint8_t *b, const uint8_t *c,
+				   size_t n)
+{
+	const __m256i m = _mm256_set1_epi16(0xff);
+
+	for (; n >= 32; n -= 32, a += 32, b += 32, c += 64) {
+
+		const __m256i c0 = _mm256_loadu_si256((const void *)c);
+		const __m256i c1 = _mm256_loadu_si256((const void *)(c + 32));
+
+		_mm256_storeu_si256((void *)a,
+				    packus_avx2(_mm256_and_si256(c0, m),
+						_mm256_and_si256(c1, m)));
+		_mm256_storeu_si256((void *)b,
+				    packus_avx2(_mm256_srli_epi16(c0, 8),
+						_mm256_srli_epi16(c1, 8)));
+	}
+
+	split_sse2(a, b, c, n);
+}
+
+
+static TARGET_AVX2 void nv12_avx2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				  uint8_t *v, const uint8_t *s0,
+				  const uint8_t *s1, const uint8_t *c,
+				  unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_avx2(u, v, c, w / 2);
+}
+
+
+static TARGET_AVX2 void nv21_avx2(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				  uint8_t *v, const uint8_t *s0,
+				  const uint8_t *s1, const uint8_t *c,
+				  unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_avx2(v, u, c, w / 2);
+}
+
+
+/* unpack and pack both stay within the 128-bit lanes, no permute */
+static TARGET_AVX2 void blend_avx2(uint8_t *dst, const uint8_t *a,
+				   const uint8_t *b, unsigned w, size_t n)
+{
+	const __m256i wa = _mm256_set1_epi16((short)(256 - w));
+	const __m256i wb = _mm256_set1_epi16((short)w);
+	const __m256i rnd = _mm256_set1_epi16(128);
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (; n >= 32; n -= 32, dst += 32, a += 32, b += 32) {
+
+		const __m256i va = _mm256_loadu_si256((const void *)a);
+		const __m256i vb = _mm256_loadu_si256((const void *)b);
+		__m256i lo, hi;
+
+		lo = _mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero),
+					   wb));
+		hi = _mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero),
+					   wb));
+
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, rnd), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, rnd), 8);
+
+		_mm256_storeu_si256((void *)dst, _mm256_packus_epi16(lo, hi));
+	}
+
+	blend_sse2(dst, a, b, w, n);
+}
+
+#endif /* USE_X86 */
+
+
+#ifdef USE_NEON
+
+/*
+ * NEON, the structure loads split the packed formats
+ */
+
+static inline unsigned packed422_neon(uint8_t *y0, uint8_t *y1, uint8_t *u,
+				      uint8_t *v, const uint8_t *s0,
+				      const uint8_t *s1, unsigned w,
+				      unsigned yo, unsigned co)
+{
+	unsigned x;
+
+	for (x=0; x + 32 <= w; x += 32) {
+
+		const uint8x16x4_t a = vld4q_u8(&s0[2*x]);
+		const uint8x16x4_t b = vld4q_u8(&s1[2*x]);
+		uint8x16x2_t ya, yb;
+
+		ya.val[0] = a.val[yo];
+		ya.val[1] = a.val[yo + 2];
+		yb.val[0] = b.val[yo];
+		yb.val[1] = b.val[yo + 2];
+
+		vst2q_u8(&y0[x], ya);
+		vst2q_u8(&y1[x], yb);
+
+		vst1q_u8(&u[x/2], vrhaddq_u8(a.val[co], b.val[co]));
+		vst1q_u8(&v[x/2], vrhaddq_u8(a.val[co + 2], b.val[co + 2]));
+	}
+
+	return x;
+}
+
+
+static void yuyv422_neon(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+			 const uint8_t *s0, const uint8_t *s1,
+			 const uint8_t *c, unsigned w)
+{
+	unsigned x = packed422_neon(y0, y1, u, v, s0, s1, w, 0, 1);
+
+	yuyv422_c(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 2*x, s1 + 2*x, c,
+		  w - x);
+}
+
+
+static void uyvy422_neon(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+			 const uint8_t *s0, const uint8_t *s1,
+			 const uint8_t *c, unsigned w)
+{
+	unsigned x = packed422_neon(y0, y1, u, v, s0, s1, w, 1, 0);
+
+	uyvy422_c(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 2*x, s1 + 2*x, c,
+		  w - x);
+}
+
+
+static void split_neon(uint8_t *a, uint8_t *b, const uint8_t *c, size_t n)
+{
+	for (; n >= 16; n -= 16, a += 16, b += 16, c += 32) {
+
+		const uint8x16x2_t s = vld2q_u8(c);
+
+		vst1q_u8(a, s.val[0]);
+		vst1q_u8(b, s.val[1]);
+	}
+
+	split_c(a, b, c, n);
+}
+
+
+static void nv12_neon(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		      const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		      unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_neon(u, v, c, w / 2);
+}
+
+
+static void nv21_neon(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		      const uint8_t *s0, const uint8_t *s1, const uint8_t *c,
+		      unsigned w)
+{
+	memcpy(y0, s0, w);
+	memcpy(y1, s1, w);
+	split_neon(v, u, c, w / 2);
+}
+
+
+static inline uint8x8_t rgb_y_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+	uint16x8_t y;
+
+	y = vmull_u8(r, vdup_n_u8(66));
+	y = vmlal_u8(y, g, vdup_n_u8(129));
+	y = vmlal_u8(y, b, vdup_n_u8(25));
+	y = vaddq_u16(y, vdupq_n_u16(128));
+
+	return vadd_u8(vshrn_n_u16(y, 8), vdup_n_u8(16));
+}
+
+
+static inline uint8x8_t rgb_uv_neon(uint16x8_t r, uint16x8_t g,
+				    uint16x8_t b, int16_t kr, int16_t kg,
+				    int16_t kb)
+{
+	int16x8_t c;
+
+	c = vmulq_n_s16(vreinterpretq_s16_u16(r), kr);
+	c = vmlaq_n_s16(c, vreinterpretq_s16_u16(g), kg);
+	c = vmlaq_n_s16(c, vreinterpretq_s16_u16(b), kb);
+	c = vshrq_n_s16(vaddq_s16(c, vdupq_n_s16(128)), 8);
+
+	return vqmovun_s16(vaddq_s16(c, vdupq_n_s16(128)));
+}
+
+
+/* rounded mean of 2x2 blocks */
+static inline uint16x8_t avg4_neon(uint8x16_t a, uint8x16_t b)
+{
+	return vrshrq_n_u16(vaddq_u16(vpaddlq_u8(a), vpaddlq_u8(b)), 2);
+}
+
+
+/* the bytes of a pixel are B, G, R, X in memory */
+static void rgb32_neon(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+		       const uint8_t *s0, const uint8_t *s1,
+		       const uint8_t *c, unsigned w)
+{
+	unsigned x;
+
+	for (x=0; x + 16 <= w; x += 16) {
+
+		const uint8x16x4_t a = vld4q_u8(&s0[4*x]);
+		const uint8x16x4_t b = vld4q_u8(&s1[4*x]);
+		uint16x8_t ra, ga, ba;
+
+		vst1q_u8(&y0[x],
+			 vcombine_u8(rgb_y_neon(vget_low_u8(a.val[2]),
+						vget_low_u8(a.val[1]),
+						vget_low_u8(a.val[0])),
+				     rgb_y_neon(vget_high_u8(a.val[2]),
+						vget_high_u8(a.val[1]),
+						vget_high_u8(a.val[0]))));
+		vst1q_u8(&y1[x],
+			 vcombine_u8(rgb_y_neon(vget_low_u8(b.val[2]),
+						vget_low_u8(b.val[1]),
+						vget_low_u8(b.val[0])),
+				     rgb_y_neon(vget_high_u8(b.val[2]),
+						vget_high_u8(b.val[1]),
+						vget_high_u8(b.val[0]))));
+
+		ra = avg4_neon(a.val[2], b.val[2]);
+		ga = avg4_neon(a.val[1], b.val[1]);
+		ba = avg4_neon(a.val[0], b.val[0]);
+
+		vst1_u8(&u[x/2], rgb_uv_neon(ra, ga, ba, -38, -74, 112));
+		vst1_u8(&v[x/2], rgb_uv_neon(ra, ga, ba, 112, -94, -18));
+	}
+
+	rgb32_c(y0 + x, y1 + x, u + x/2, v + x/2, s0 + 4*x, s1 + 4*x, c,
+		w - x);
+}
+
+
+static void blend_neon(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		       unsigned w, size_t n)
+{
+	uint8x8_t wa, wb;
+
+	/* a weight of 256 does not fit in 8 bits */
+	if (!w) {
+		memcpy(dst, a, n);
+		return;
+	}
+
+	wa = vdup_n_u8((uint8_t)(256 - w));
+	wb = vdup_n_u8((uint8_t)w);
+
+	for (; n >= 16; n -= 16, dst += 16, a += 16, b += 16) {
+
+		const uint8x16_t va = vld1q_u8(a);
+		const uint8x16_t vb = vld1q_u8(b);
+		uint16x8_t lo, hi;
+
+		lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa),
+			      vget_low_u8(vb), wb);
+		hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa),
+			      vget_high_u8(vb), wb);
+
+		vst1q_u8(dst, vcombine_u8(vrshrn_n_u16(lo, 8),
+					  vrshrn_n_u16(hi, 8)));
+	}
+
+	blend_c(dst, a, b, w, n);
+}
+
+#endif /* USE_NEON */
+
+
+static const struct vidcvt_kernel kernel_c = {
+	"c",
+	yuyv422_c, uyvy422_c, nv12_c, nv21_c, rgb32_c, blend_c
+};
+
+#ifdef USE_X86
+static const struct vidcvt_kernel kernel_sse2 = {
+	"sse2",
+	yuyv422_sse2, uyvy422_sse2, nv12_sse2, nv21_sse2, rgb32_sse2,
+	blend_sse2
+};
+
+static const struct vidcvt_kernel kernel_avx2 = {
+	"avx2",
+	yuyv422_avx2, uyvy422_avx2, nv12_avx2, nv21_avx2, rgb32_sse2,
+	blend_avx2
+};
+#endif
+
+#ifdef USE_NEON
+static const struct vidcvt_kernel kernel_neon = {
+	"neon",
+	yuyv422_neon, uyvy422_neon, nv12_neon, nv21_neon, rgb32_neon,
+	blend_neon
+};
+#endif
+
+
+/* supported kernels, in order of preference -- the scalar kernel is last */
+static const struct vidcvt_kernel *kernelv[4];
+static size_t kernelc;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+
+static void kernel_init(void)
+{
+#ifdef USE_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		kernelv[kernelc++] = &kernel_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		kernelv[kernelc++] = &kernel_sse2;
+#endif
+
+#ifdef USE_NEON
+	kernelv[kernelc++] = &kernel_neon;
+#endif
+
+	kernelv[kernelc++] = &kernel_c;
+}
+
+
+/**
+ * Get the conversion kernel set in use
+ *
+ * @return Fastest kernel set supported by the CPU
+ */
+const struct vidcvt_kernel *vidcvt_kernel(void)
+{
+	pthread_once(&kernel_once, kernel_init);
+
+	return kernelv[0];
+}
+
+
+/**
+ * Get a supported conversion kernel set by index, for testing and
+ * benchmarks
+ *
+ * @param i Index, 0 is the kernel set in use and the last is scalar
+ *
+ * @return Kernel set, or NULL if the index is out of range
+ */
+const struct vidcvt_kernel *vidcvt_kernel_get(size_t i)
+{
+	pthread_once(&kernel_once, kernel_init);
+
+	return i < kernelc ? kernelv[i] : NULL;
+}
+
+
+/*
+ * Converter
+ */
+
+struct vidcvt;
+
+typedef void (slice_h)(struct vidcvt *cvt, unsigned r0, unsigned r1,
+		       uint8_t *line);
+
+/** Bilinear positions of the columns of a plane */
+struct scale_tab {
+	uint32_t *idxv;               /**< Left source column            */
+	uint8_t *fracv;               /**< Weight of the right column    */
+	unsigned sw;                  /**< Source width                  */
+	unsigned dw;                  /**< Destination width             */
+};
+
+struct vidcvt {
+	const struct vidcvt_kernel *kern; /**< Kernel set in use         */
+	struct workpool_job **jobv;   /**< Helper jobs, one per thread   */
+	uint32_t nthreads;            /**< Threads per frame             */
+	struct vidframe *tmp;         /**< Converted frame to be scaled  */
+	struct scale_tab tabv[2];     /**< Luma and chroma columns       */
+	uint8_t *linev;               /**< Blended rows, one per slice   */
+	size_t line_size;             /**< Size of a blended row         */
+
+	/* the frame being converted, guarded by the mutex: */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;          /**< Signalled when all are done   */
+	slice_h *sliceh;              /**< Slice handler                 */
+	struct vidframe *dst;         /**< Destination frame             */
+	const struct vidframe *src;   /**< Source frame                  */
+	unsigned rows;                /**< Luma rows to do               */
+	unsigned slicec;              /**< Number of slices              */
+	unsigned next;                /**< Next slice to claim           */
+	unsigned done;                /**< Slices finished               */
+
+	struct vidcvt_stats stats;    /**< Statistics                    */
+	struct lathist time;          /**< Time per frame [us]           */
+};
+
+
+static void destructor(void *arg)
+{
+	struct vidcvt *cvt = arg;
+	uint32_t i;
+
+	/* cancelling waits for a running job */
+	for (i=0; cvt->jobv && i<cvt->nthreads - 1; i++)
+		mem_deref(cvt->jobv[i]);
+
+	mem_deref(cvt->jobv);
+	mem_deref(cvt->tmp);
+	mem_deref(cvt->tabv[0].idxv);
+	mem_deref(cvt->tabv[0].fracv);
+	mem_deref(cvt->tabv[1].idxv);
+	mem_deref(cvt->tabv[1].fracv);
+	mem_deref(cvt->linev);
+
+	pthread_cond_destroy(&cvt->cond);
+	pthread_mutex_destroy(&cvt->mutex);
+}
+
+
+/* claim and run slices until there are none left */
+static void run_slices(struct vidcvt *cvt)
+{
+	for (;;) {
+		unsigned i, r0, r1;
+		slice_h *h;
+
+		pthread_mutex_lock(&cvt->mutex);
+
+		if (cvt->next >= cvt->slicec) {
+			pthread_mutex_unlock(&cvt->mutex);
+			break;
+		}
+
+		i  = cvt->next++;
+		h  = cvt->sliceh;
+		r0 = (cvt->rows * i / cvt->slicec) & ~1u;
+		r1 = (cvt->rows * (i + 1) / cvt->slicec) & ~1u;
+		if (i == cvt->slicec - 1)
+			r1 = cvt->rows;
+
+		pthread_mutex_unlock(&cvt->mutex);
+
+		h(cvt, r0, r1, cvt->linev ? cvt->linev + i * cvt->line_size
+		  : NULL);
+
+		pthread_mutex_lock(&cvt->mutex);
+
+		if (++cvt->done == cvt->slicec)
+			pthread_cond_signal(&cvt->cond);
+
+		pthread_mutex_unlock(&cvt->mutex);
+	}
+}
+
+
+static void job_handler(void *arg)
+{
+	run_slices(arg);
+}
+
+
+/* split the rows of the destination and wait until all slices are done */
+static void run(struct vidcvt *cvt, slice_h *h, struct vidframe *dst,
+		const struct vidframe *src, unsigned rows)
+{
+	unsigned slicec, i;
+
+	slicec = min(cvt->nthreads * SLICES_PER_THREAD,
+		     max(rows / SLICE_MIN_ROWS, 1u));
+
+	pthread_mutex_lock(&cvt->mutex);
+
+	cvt->sliceh = h;
+	cvt->dst    = dst;
+	cvt->src    = src;
+	cvt->rows   = rows;
+	cvt->slicec = slicec;
+	cvt->next   = 0;
+	cvt->done   = 0;
+
+	pthread_mutex_unlock(&cvt->mutex);
+
+	for (i=0; i<min(cvt->nthreads, slicec) - 1; i++)
+		workpool_job_post(cvt->jobv[i]);
+
+	run_slices(cvt);
+
+	pthread_mutex_lock(&cvt->mutex);
+
+	while (cvt->done < cvt->slicec)
+		pthread_cond_wait(&cvt->cond, &cvt->mutex);
+
+	pthread_mutex_unlock(&cvt->mutex);
+}
+
+
+static void convert_slice(struct vidcvt *cvt, unsigned r0, unsigned r1,
+			  uint8_t *line)
+{
+	const struct vidframe *src = cvt->src;
+	struct vidframe *dst = cvt->dst;
+	const unsigned w = src->size.w;
+	vidcvt_row_h *rowh;
+	bool semi = false;
+	unsigned y;
+	(void)line;
+
+	switch (src->fmt) {
+
+	case VID_FMT_YUYV422: rowh = cvt->kern->yuyv422; break;
+	case VID_FMT_UYVY422: rowh = cvt->kern->uyvy422; break;
+	case VID_FMT_RGB32:   rowh = cvt->kern->rgb32;   break;
+	case VID_FMT_NV12:    rowh = cvt->kern->nv12; semi = true; break;
+	case VID_FMT_NV21:    rowh = cvt->kern->nv21; semi = true; break;
+	default: return;
+	}
+
+	for (y=r0; y<r1; y+=2) {
+
+		const uint8_t *s0 = src->data[0] + y * src->linesize[0];
+		uint8_t *d0 = dst->data[0] + y * dst->linesize[0];
+
+		rowh(d0, d0 + dst->linesize[0],
+		     dst->data[1] + y/2 * dst->linesize[1],
+		     dst->data[2] + y/2 * dst->linesize[2],
+		     s0, s0 + src->linesize[0],
+		     semi ? src->data[1] + y/2 * src->linesize[1] : NULL, w);
+	}
+}
+
+
+/* source position of an output pixel, pixel centres are aligned */
+static void scale_pos(unsigned i, unsigned sn, unsigned dn, uint32_t *idx,
+		      unsigned *frac)
+{
+	int64_t pos;
+
+	pos = (int64_t)(2 * i + 1) * sn * 65536 / (2 * dn) - 32768;
+	if (pos < 0)
+		pos = 0;
+
+	*idx  = (uint32_t)(pos >> 16);
+	*frac = (unsigned)(pos >> 8) & 0xff;
+
+	if (*idx >= sn - 1) {
+		*idx  = sn - 1;
+		*frac = 0;
+	}
+}
+
+
+static void scale_plane(const struct vidcvt_kernel *kern,
+			const struct scale_tab *tab, uint8_t *dst,
+			unsigned dls, const uint8_t *src, unsigned sls,
+			unsigned sh, unsigned dh, unsigned r0, unsigned r1,
+			uint8_t *line)
+{
+	unsigned x, y;
+
+	for (y=r0; y<r1; y++) {
+
+		const uint8_t *row, *a;
+		uint8_t *d = dst + y * dls;
+		uint32_t sy;
+		unsigned wy;
+
+		scale_pos(y, sh, dh, &sy, &wy);
+
+		a = src + sy * sls;
+
+		if (wy) {
+			kern->blend(line, a, a + sls, wy, tab->sw);
+			row = line;
+		}
+		else {
+			row = a;
+		}
+
+		if (tab->sw == tab->dw) {
+			memcpy(d, row, tab->dw);
+			continue;
+		}
+
+		/* the right column has no weight at the right edge */
+		for (x=0; x<tab->dw; x++) {
+
+			const uint8_t *t = row + tab->idxv[x];
+			const unsigned f = tab->fracv[x];
+
+			d[x] = f ? (uint8_t)((t[0] * (256 - f) + t[1] * f
+					      + 128) >> 8) : t[0];
+		}
+	}
+}
+
+
+static void scale_slice(struct vidcvt *cvt, unsigned r0, unsigned r1,
+			uint8_t *line)
+{
+	const struct vidframe *src = cvt->src;
+	struct vidframe *dst = cvt->dst;
+	const unsigned sh = src->size.h, dh = dst->size.h;
+	int i;
+
+	scale_plane(cvt->kern, &cvt->tabv[0], dst->data[0], dst->linesize[0],
+		    src->data[0], src->linesize[0], sh, dh, r0, r1, line);
+
+	for (i=1; i<3; i++) {
+		scale_plane(cvt->kern, &cvt->tabv[1], dst->data[i],
+			    dst->linesize[i], src->data[i], src->linesize[i],
+			    sh / 2, dh / 2, r0 / 2, r1 / 2, line);
+	}
+}
+
+
+static int tab_update(struct scale_tab *tab, unsigned sw, unsigned dw)
+{
+	uint32_t *idxv;
+	uint8_t *fracv;
+	unsigned x;
+
+	if (tab->sw == sw && tab->dw == dw)
+		return 0;
+
+	idxv  = mem_realloc(tab->idxv, dw * sizeof(*idxv));
+	if (!idxv)
+		return ENOMEM;
+
+	tab->idxv = idxv;
+
+	fracv = mem_realloc(tab->fracv, dw * sizeof(*fracv));
+	if (!fracv)
+		return ENOMEM;
+
+	tab->fracv = fracv;
+
+	for (x=0; x<dw; x++) {
+		unsigned frac;
+
+		scale_pos(x, sw, dw, &idxv[x], &frac);
+		fracv[x] = (uint8_t)frac;
+	}
+
+	tab->sw = sw;
+	tab->dw = dw;
+
+	return 0;
+}
+
+
+static int scale(struct vidcvt *cvt, struct vidframe *dst,
+		 const struct vidframe *src)
+{
+	const size_t slicec = cvt->nthreads * SLICES_PER_THREAD;
+	int err;
+
+	err  = tab_update(&cvt->tabv[0], src->size.w, dst->size.w);
+	err |= tab_update(&cvt->tabv[1], src->size.w / 2, dst->size.w / 2);
+	if (err)
+		return err;
+
+	if (cvt->line_size < src->size.w) {
+
+		uint8_t *linev = mem_realloc(cvt->linev,
+					     slicec * src->size.w);
+		if (!linev)
+			return ENOMEM;
+
+		cvt->linev     = linev;
+		cvt->line_size = src->size.w;
+	}
+
+	run(cvt, scale_slice, dst, src, dst->size.h);
+
+	return 0;
+}
+
+
+/**
+ * Allocate a pixel format converter
+ *
+ * @param cvtp     Pointer to allocated converter
+ * @param nthreads Threads per frame including the caller, 1 to convert on
+ *                 the calling thread only
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidcvt_alloc(struct vidcvt **cvtp, uint32_t nthreads)
+{
+	struct workpool *pool = NULL;
+	struct vidcvt *cvt;
+	uint32_t i;
+	int err = 0;
+
+	if (!cvtp)
+		return EINVAL;
+
+	nthreads = min(max(nthreads, 1u), (uint32_t)MAX_THREADS);
+
+	cvt = mem_zalloc(sizeof(*cvt), destructor);
+	if (!cvt)
+		return ENOMEM;
+
+	err  = pthread_mutex_init(&cvt->mutex, NULL);
+	err |= pthread_cond_init(&cvt->cond, NULL);
+	if (err)
+		goto out;
+
+	cvt->kern     = vidcvt_kernel();
+	cvt->nthreads = nthreads;
+
+	cvt->stats.threads = nthreads;
+
+	if (nthreads == 1)
+		goto out;
+
+	cvt->jobv = mem_zalloc((nthreads - 1) * sizeof(*cvt->jobv), NULL);
+	if (!cvt->jobv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = workpool_shared(&pool, WORKPOOL_VIDEO);
+	if (err)
+		goto out;
+
+	for (i=0; i<nthreads - 1; i++) {
+
+		err = workpool_job_alloc(&cvt->jobv[i], pool, job_handler,
+					 cvt);
+		if (err)
+			goto out;
+	}
+
+ out:
+	mem_deref(pool);
+
+	if (err)
+		mem_deref(cvt);
+	else
+		*cvtp = cvt;
+
+	return err;
+}
+
+
+/**
+ * Check if a conversion is done by the kernels
+ *
+ * @param dst Destination pixel format
+ * @param src Source pixel format
+ *
+ * @return True if supported, otherwise vidcvt_convert() uses vidconv()
+ */
+bool vidcvt_supported(enum vidfmt dst, enum vidfmt src)
+{
+	if (dst != VID_FMT_YUV420P)
+		return false;
+
+	switch (src) {
+
+	case VID_FMT_YUV420P:
+	case VID_FMT_YUYV422:
+	case VID_FMT_UYVY422:
+	case VID_FMT_NV12:
+	case VID_FMT_NV21:
+	case VID_FMT_RGB32:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+
+/**
+ * Convert a video frame to the format and size of the destination frame
+ *
+ * @param cvt Pixel format converter
+ * @param dst Destination frame
+ * @param src Source frame
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note Calls on the same converter must be serialized by the caller
+ */
+int vidcvt_convert(struct vidcvt *cvt, struct vidframe *dst,
+		   const struct vidframe *src)
+{
+	const uint64_t start = tmr_jiffies_usec();
+	bool scaled;
+	int err = 0;
+
+	if (!cvt || !dst || !src)
+		return EINVAL;
+
+	if (!src->size.w || !src->size.h || !dst->size.w || !dst->size.h)
+		return EINVAL;
+
+	if (!vidcvt_supported(dst->fmt, src->fmt) ||
+	    (src->size.w | src->size.h | dst->size.w | dst->size.h) & 1) {
+
+		vidconv(dst, src, NULL);
+		++cvt->stats.fallback;
+		return 0;
+	}
+
+	scaled = !vidsz_cmp(&dst->size, &src->size);
+
+	if (src->fmt == VID_FMT_YUV420P) {
+
+		if (scaled)
+			err = scale(cvt, dst, src);
+		else
+			vidframe_copy(dst, src);
+	}
+	else if (!scaled) {
+		run(cvt, convert_slice, dst, src, src->size.h);
+	}
+	else {
+		if (!cvt->tmp || !vidsz_cmp(&cvt->tmp->size, &src->size)) {
+
+			cvt->tmp = mem_deref(cvt->tmp);
+
+			err = vidframe_alloc(&cvt->tmp, VID_FMT_YUV420P,
+					     &src->size);
+			if (err)
+				return err;
+		}
+
+		run(cvt, convert_slice, cvt->tmp, src, src->size.h);
+
+		err = scale(cvt, dst, cvt->tmp);
+	}
+
+	if (err)
+		return err;
+
+	++cvt->stats.frames;
+	if (scaled)
+		++cvt->stats.scaled;
+
+	lathist_add(&cvt->time, tmr_jiffies_usec() - start);
+
+	return 0;
+}
+
+
+/**
+ * Get the statistics of a converter
+ *
+ * @param cvt   Pixel format converter
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidcvt_stats(const struct vidcvt *cvt, struct vidcvt_stats *stats)
+{
+	if (!cvt || !stats)
+		return EINVAL;
+
+	*stats = cvt->stats;
+
+	return 0;
+}
+
+
+/**
+ * Print the statistics of a converter
+ *
+ * @param pf  Print function
+ * @param cvt Pixel format converter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidcvt_debug(struct re_printf *pf, const struct vidcvt *cvt)
+{
+	const struct vidcvt_stats *st;
+	int err;
+
+	if (!cvt)
+		return 0;
+
+	st = &cvt->stats;
+
+	err  = re_hprintf(pf, "cvt: kernel=%s threads=%u frames=%llu"
+			  " scaled=%llu fallback=%llu\n",
+			  cvt->kern->name, st->threads, st->frames,
+			  st->scaled, st->fallback);
+	err |= re_hprintf(pf, "      time [us]: %H\n", lathist_debug,
+			  &cvt->time);
+
+	return err;
+}
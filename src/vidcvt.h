@@ -0,0 +1,64 @@
+/**
+ * @file vidcvt.h
+ * @brief Video pixel format conversion and scaling
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAVIDCVT_H_INCLUDED
+#define UAVIDCVT_H_INCLUDED
+
+#include "rsua-re/re.h"
+#include "rsua-rem/rem.h"
+
+struct vidcvt;
+
+/**
+ * Convert two rows of a source frame to YUV420P
+ *
+ * @param y0 First luma row
+ * @param y1 Second luma row
+ * @param u  Cb row
+ * @param v  Cr row
+ * @param s0 First source row
+ * @param s1 Second source row
+ * @param c  Chroma row of a semi-planar source, otherwise NULL
+ * @param w  Width in pixels, even
+ */
+typedef void (vidcvt_row_h)(uint8_t *y0, uint8_t *y1, uint8_t *u,
+			    uint8_t *v, const uint8_t *s0, const uint8_t *s1,
+			    const uint8_t *c, unsigned w);
+
+/** A set of conversion kernels for one instruction set */
+struct vidcvt_kernel {
+	const char *name;             /**< Instruction set name         */
+	vidcvt_row_h *yuyv422;        /**< YUYV422 to YUV420P           */
+	vidcvt_row_h *uyvy422;        /**< UYVY422 to YUV420P           */
+	vidcvt_row_h *nv12;           /**< NV12 to YUV420P              */
+	vidcvt_row_h *nv21;           /**< NV21 to YUV420P              */
+	vidcvt_row_h *rgb32;          /**< RGB32 to YUV420P, BT.601     */
+
+	/** Blend two rows, dst = (a * (256 - w) + b * w + 128) >> 8 */
+	void (*blend)(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		      unsigned w, size_t n);
+};
+
+/** Statistics of a converter */
+struct vidcvt_stats {
+	uint64_t frames;          /**< Frames converted by the kernels    */
+	uint64_t scaled;          /**< Frames which were scaled           */
+	uint64_t fallback;        /**< Frames converted by vidconv()      */
+	uint32_t threads;         /**< Threads per frame                  */
+};
+
+const struct vidcvt_kernel *vidcvt_kernel(void);
+const struct vidcvt_kernel *vidcvt_kernel_get(size_t i);
+
+int  vidcvt_alloc(struct vidcvt **cvtp, uint32_t nthreads);
+bool vidcvt_supported(enum vidfmt dst, enum vidfmt src);
+int  vidcvt_convert(struct vidcvt *cvt, struct vidframe *dst,
+		    const struct vidframe *src);
+int  vidcvt_stats(const struct vidcvt *cvt, struct vidcvt_stats *stats);
+int  vidcvt_debug(struct re_printf *pf, const struct vidcvt *cvt);
+
+#endif /* UAVIDCVT_H_INCLUDED */
@@ -0,0 +1,495 @@
+/**
+ * @file viddecq.c  Video decode queue
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include "viddecq.h"
+
+
+/**
+ * The queue hands complete frames from the receive thread to a decoder
+ * thread. The packets of a frame are collected in a staging frame until the
+ * marker bit or the next RTP timestamp, and the staging frame is swapped
+ * into the ring as a whole. There is one producer and one consumer, head
+ * and tail are only written by their owner and no lock is taken.
+ *
+ * When the ring is full the decoder is too slow. The frame is dropped, the
+ * queued frames are marked stale and the following frames are dropped
+ * until a keyframe, which the decoder can start from. The buffers of the
+ * packets are kept and reused.
+ *
+ * The stale slots are filled again before the decoder has skipped them,
+ * so that the keyframe is not dropped while the decoder is still busy with
+ * an old frame. Only the slot at tail is left alone, the decoder may hold
+ * it. The decoder checks the drop mark again after it has taken a slot, and
+ * the receive thread reads tail after moving the mark, so one of them sees
+ * the other.
+ */
+
+struct viddecq {
+	struct viddecq_frame *ringv;  /**< Ring of frames, power of two   */
+	struct viddecq_frame stage;   /**< Frame being received           */
+	uint32_t size;                /**< Ring size                      */
+	uint32_t max_pkts;            /**< Largest frame in packets       */
+	viddecq_key_h *keyh;          /**< Keyframe check, optional       */
+
+	/* receive thread: */
+	uint32_t head;                /**< Next slot to fill              */
+	uint32_t drop;                /**< Frames before are stale        */
+	bool wait_key;                /**< Drop frames until a keyframe   */
+	bool oversize;                /**< Staging frame is too large     */
+
+	/* decoder thread: */
+	uint32_t tail;                /**< Next slot to take              */
+
+	struct viddecq_stats stats;   /**< Statistics                     */
+};
+
+
+static void frame_reset(struct viddecq_frame *f)
+{
+	f->pktc     = 0;
+	f->lostc    = 0;
+	f->complete = false;
+}
+
+
+static void frame_destroy(struct viddecq_frame *f)
+{
+	uint32_t i;
+
+	for (i=0; i<f->pkt_alloc; i++)
+		mem_deref(f->pktv[i].mb);
+
+	mem_deref(f->pktv);
+}
+
+
+static void destructor(void *arg)
+{
+	struct viddecq *q = arg;
+	uint32_t i;
+
+	for (i=0; q->ringv && i<q->size; i++)
+		frame_destroy(&q->ringv[i]);
+
+	mem_deref(q->ringv);
+	frame_destroy(&q->stage);
+}
+
+
+static int frame_append(struct viddecq_frame *f, uint32_t max_pkts,
+			const struct rtp_header *hdr, struct mbuf *mb)
+{
+	struct viddecq_pkt *pkt;
+	size_t len = mbuf_get_left(mb);
+	int err;
+
+	if (f->pktc == f->pkt_alloc) {
+
+		const uint32_t n = min(max(f->pkt_alloc * 2, 16), max_pkts);
+		struct viddecq_pkt *pktv;
+
+		if (n <= f->pkt_alloc)
+			return EOVERFLOW;
+
+		pktv = mem_realloc(f->pktv, n * sizeof(*pktv));
+		if (!pktv)
+			return ENOMEM;
+
+		memset(&pktv[f->pkt_alloc], 0,
+		       (n - f->pkt_alloc) * sizeof(*pktv));
+
+		f->pktv      = pktv;
+		f->pkt_alloc = n;
+	}
+
+	pkt = &f->pktv[f->pktc];
+
+	if (!pkt->mb) {
+		pkt->mb = mbuf_alloc(len);
+		if (!pkt->mb)
+			return ENOMEM;
+	}
+
+	mbuf_rewind(pkt->mb);
+
+	err = mbuf_write_mem(pkt->mb, mbuf_buf(mb), len);
+	if (err)
+		return err;
+
+	pkt->mb->pos = 0;
+	pkt->seq     = hdr->seq;
+	pkt->marker  = hdr->m;
+
+	++f->pktc;
+
+	return 0;
+}
+
+
+static bool frame_is_key(const struct viddecq_frame *f, viddecq_key_h *keyh)
+{
+	uint32_t i;
+
+	for (i=0; i<f->pktc; i++) {
+
+		if (keyh(f->pktv[i].mb))
+			return true;
+	}
+
+	return false;
+}
+
+
+/* mark the queued frames stale, the decoder skips them */
+static void drop_queued(struct viddecq *q)
+{
+	__atomic_store_n(&q->drop, q->head, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Find the ring position for the next frame. The stale slots are reused,
+ * the slot at tail is stepped over if no live frames are queued.
+ */
+static bool ring_reserve(struct viddecq *q, uint32_t *posp)
+{
+	uint32_t tail, live, pos = q->head;
+
+	/* pairs with the fence in viddecq_get() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	live = (int32_t)(tail - q->drop) < 0 ? q->drop : tail;
+
+	if (pos - live >= q->size)
+		return false;
+
+	if (pos != tail && ((pos - tail) & (q->size - 1)) == 0) {
+
+		if (pos != q->drop || q->size == 1)
+			return false;
+
+		/* the position is skipped as stale */
+		++pos;
+		__atomic_store_n(&q->drop, pos, __ATOMIC_RELEASE);
+	}
+
+	*posp = pos;
+
+	return true;
+}
+
+
+/* hand the staging frame over to the decoder thread */
+static int publish(struct viddecq *q, bool *queued)
+{
+	struct viddecq_frame *slot, tmp;
+	uint32_t pos;
+	int err = 0;
+
+	if (q->oversize) {
+		++q->stats.oversize;
+		drop_queued(q);
+		q->wait_key = true;
+		err = EOVERFLOW;
+		goto out;
+	}
+
+	if (q->wait_key) {
+
+		if (q->keyh && !frame_is_key(&q->stage, q->keyh)) {
+			++q->stats.skipped;
+			goto out;
+		}
+
+		q->wait_key = false;
+	}
+
+	if (!ring_reserve(q, &pos)) {
+		++q->stats.overflows;
+		drop_queued(q);
+		q->wait_key = true;
+		err = ENOSPC;
+		goto out;
+	}
+
+	/* swap the buffers, the old ones are staged next */
+	slot = &q->ringv[pos & (q->size - 1)];
+
+	tmp      = *slot;
+	*slot    = q->stage;
+	q->stage = tmp;
+
+	slot->jfs = tmr_jiffies_usec();
+
+	__atomic_store_n(&q->head, pos + 1, __ATOMIC_RELEASE);
+
+	++q->stats.frames;
+
+	if (queued)
+		*queued = true;
+
+ out:
+	frame_reset(&q->stage);
+	q->oversize = false;
+
+	return err;
+}
+
+
+/**
+ * Allocate a video decode queue
+ *
+ * @param qp       Pointer to allocated decode queue
+ * @param size     Number of frames, rounded up to a power of two
+ * @param max_pkts Largest frame in packets
+ * @param keyh     Keyframe check, NULL to pass any frame after a drop
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int viddecq_alloc(struct viddecq **qp, uint32_t size, uint32_t max_pkts,
+		  viddecq_key_h *keyh)
+{
+	struct viddecq *q;
+	uint32_t n = 1;
+	int err = 0;
+
+	if (!qp || !size || size > 1024 || !max_pkts)
+		return EINVAL;
+
+	while (n < size)
+		n <<= 1;
+
+	q = mem_zalloc(sizeof(*q), destructor);
+	if (!q)
+		return ENOMEM;
+
+	q->ringv = mem_zalloc(n * sizeof(*q->ringv), NULL);
+	if (!q->ringv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	q->size     = n;
+	q->max_pkts = max_pkts;
+	q->keyh     = keyh;
+
+	q->stats.size = n;
+
+ out:
+	if (err)
+		mem_deref(q);
+	else
+		*qp = q;
+
+	return err;
+}
+
+
+/**
+ * Put a received packet into the decode queue. A frame is queued when its
+ * last packet is received, or when the first packet of the next frame is.
+ *
+ * @param q      Decode queue
+ * @param hdr    RTP header
+ * @param mb     RTP payload
+ * @param lostc  Number of packets lost before this one
+ * @param queued Set to true if a frame was queued (optional)
+ *
+ * @return 0 if success, ENOSPC or EOVERFLOW if a frame was dropped and the
+ * queue waits for a keyframe, otherwise errorcode
+ *
+ * @note Must be called from the receive thread only
+ */
+int viddecq_put(struct viddecq *q, const struct rtp_header *hdr,
+		struct mbuf *mb, unsigned lostc, bool *queued)
+{
+	int err = 0, perr;
+
+	if (!q || !hdr || !mb)
+		return EINVAL;
+
+	if (queued)
+		*queued = false;
+
+	/* the marker bit was lost, queue the frame as it is */
+	if (q->stage.pktc && hdr->ts != q->stage.ts)
+		err = publish(q, queued);
+
+	if (!q->stage.pktc && !q->oversize)
+		q->stage.ts = hdr->ts;
+
+	q->stage.lostc += lostc;
+
+	if (!q->oversize) {
+		perr = frame_append(&q->stage, q->max_pkts, hdr, mb);
+		if (perr == EOVERFLOW)
+			q->oversize = true;
+		else if (perr)
+			return perr;
+	}
+
+	if (hdr->m) {
+		q->stage.complete = true;
+
+		perr = publish(q, queued);
+		if (perr)
+			err = perr;
+	}
+
+	return err;
+}
+
+
+/**
+ * Set the keyframe check, e.g. when the decoder changes
+ *
+ * @param q    Decode queue
+ * @param keyh Keyframe check, NULL to pass any frame after a drop
+ *
+ * @note Must be called from the receive thread only
+ */
+void viddecq_set_keyh(struct viddecq *q, viddecq_key_h *keyh)
+{
+	if (!q)
+		return;
+
+	q->keyh = keyh;
+}
+
+
+/**
+ * Drop the queued frames and the frame being received, e.g. when the
+ * decoder changes
+ *
+ * @param q Decode queue
+ *
+ * @note Must be called from the receive thread only
+ */
+void viddecq_flush(struct viddecq *q)
+{
+	if (!q)
+		return;
+
+	frame_reset(&q->stage);
+	q->oversize = false;
+
+	drop_queued(q);
+}
+
+
+/**
+ * Get the next frame to decode. The frame stays valid until it is given
+ * back with viddecq_release().
+ *
+ * @param q Decode queue
+ *
+ * @return Next frame, NULL if the queue is empty
+ *
+ * @note Must be called from the decoder thread only
+ */
+struct viddecq_frame *viddecq_get(struct viddecq *q)
+{
+	struct viddecq_frame *f;
+	uint32_t head, drop;
+
+	if (!q)
+		return NULL;
+
+	head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+	do {
+		drop = __atomic_load_n(&q->drop, __ATOMIC_ACQUIRE);
+
+		/* skip the stale frames */
+		while (q->tail != head && (int32_t)(q->tail - drop) < 0) {
+			++q->stats.flushed;
+			__atomic_store_n(&q->tail, q->tail + 1,
+					 __ATOMIC_RELEASE);
+		}
+
+		if (q->tail == head)
+			return NULL;
+
+		/* the slot may have turned stale and be filled again */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	} while (__atomic_load_n(&q->drop, __ATOMIC_ACQUIRE) != drop);
+
+	f = &q->ringv[q->tail & (q->size - 1)];
+
+	lathist_add(&q->stats.wait, tmr_jiffies_usec() - f->jfs);
+
+	return f;
+}
+
+
+/**
+ * Give back the frame from viddecq_get(), the slot can be filled again
+ *
+ * @param q Decode queue
+ *
+ * @note Must be called from the decoder thread only
+ */
+void viddecq_release(struct viddecq *q)
+{
+	if (!q)
+		return;
+
+	++q->stats.decoded;
+	__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Get the statistics of a decode queue. The counters are written by both
+ * threads without a lock and may be slightly inconsistent.
+ *
+ * @param q     Decode queue
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int viddecq_stats(const struct viddecq *q, struct viddecq_stats *stats)
+{
+	if (!q || !stats)
+		return EINVAL;
+
+	*stats = q->stats;
+
+	return 0;
+}
+
+
+/**
+ * Print the statistics of a decode queue
+ *
+ * @param pf Print function
+ * @param q  Decode queue
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int viddecq_debug(struct re_printf *pf, const struct viddecq *q)
+{
+	const struct viddecq_stats *st;
+	int err;
+
+	if (!q)
+		return 0;
+
+	st = &q->stats;
+
+	err  = re_hprintf(pf, "decq: size=%u frames=%llu decoded=%llu"
+			  " overflows=%llu flushed=%llu skipped=%llu"
+			  " oversize=%llu\n",
+			  st->size, st->frames, st->decoded, st->overflows,
+			  st->flushed, st->skipped, st->oversize);
+	err |= re_hprintf(pf, "      wait [us]: %H\n", lathist_debug,
+			  &st->wait);
+
+	return err;
+}
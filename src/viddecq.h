@@ -0,0 +1,66 @@
+/**
+ * @file viddecq.h
+ * @brief Video decode queue
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAVIDDECQ_H_INCLUDED
+#define UAVIDDECQ_H_INCLUDED
+
+#include "rsua-re/re.h"
+#include "rsua-mod/lathist.h"
+
+struct viddecq;
+
+/** Received packet of a queued frame */
+struct viddecq_pkt {
+	struct mbuf *mb;      /**< Payload, the buffer is reused      */
+	uint16_t seq;         /**< Sequence number                    */
+	bool marker;          /**< Marker bit                         */
+};
+
+/** Frame of packets with the same RTP timestamp */
+struct viddecq_frame {
+	struct viddecq_pkt *pktv;  /**< Packets in receive order      */
+	uint32_t pktc;             /**< Number of packets             */
+	uint32_t pkt_alloc;        /**< Allocated packets             */
+	uint32_t ts;               /**< RTP timestamp                 */
+	unsigned lostc;            /**< Packets lost within the frame */
+	uint64_t jfs;              /**< Time when queued [us]         */
+	bool complete;             /**< Ended with the marker bit     */
+};
+
+/**
+ * Check if a packet starts a keyframe
+ *
+ * @param mb Packet payload
+ *
+ * @return True if the packet starts a keyframe
+ */
+typedef bool (viddecq_key_h)(const struct mbuf *mb);
+
+/** Statistics of a decode queue */
+struct viddecq_stats {
+	uint64_t frames;          /**< Frames queued                      */
+	uint64_t overflows;       /**< Times the queue was full           */
+	uint64_t skipped;         /**< Frames dropped waiting for a key   */
+	uint64_t oversize;        /**< Frames with too many packets       */
+	uint64_t decoded;         /**< Frames taken by the decoder        */
+	uint64_t flushed;         /**< Queued frames dropped              */
+	uint32_t size;            /**< Queue size in frames               */
+	struct lathist wait;      /**< Time in the queue [us]             */
+};
+
+int  viddecq_alloc(struct viddecq **qp, uint32_t size, uint32_t max_pkts,
+		   viddecq_key_h *keyh);
+int  viddecq_put(struct viddecq *q, const struct rtp_header *hdr,
+		 struct mbuf *mb, unsigned lostc, bool *queued);
+void viddecq_set_keyh(struct viddecq *q, viddecq_key_h *keyh);
+void viddecq_flush(struct viddecq *q);
+struct viddecq_frame *viddecq_get(struct viddecq *q);
+void viddecq_release(struct viddecq *q);
+int  viddecq_stats(const struct viddecq *q, struct viddecq_stats *stats);
+int  viddecq_debug(struct re_printf *pf, const struct viddecq *q);
+
+#endif /* UAVIDDECQ_H_INCLUDED */
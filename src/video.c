@@ -10,14 +10,22 @@
 #include "video.h"
 #include <string.h>
 #include <stdlib.h>
+#include "bwe.h"
 #include "stream.h"
 #include "timestamp.h"
 #include "log.h"
+#include "rtpext.h"
+#include "rtxbuf.h"
+#include "simulcast.h"
 #include "vidcodec.h"
+#include "vidcvt.h"
+#include "viddecq.h"
+#include "vidpool.h"
 #include "vidisp.h"
 #include "vidfilt.h"
 #include "vidsrc.h"
 #include "vidutil.h"
+#include "workpool.h"
 
 /** Magic number */
 #define MAGIC 0x00070d10
@@ -28,11 +36,30 @@
 enum {
 	MEDIA_POLL_RATE = 250,                 /**< in [Hz]             */
 	BURST_MAX       = 8192,                /**< in bytes            */
-	RTP_PRESZ       = 4 + RTP_HEADER_SIZE, /**< TURN and RTP header */
+	RTP_EXTSZ       = RTPEXT_HDR_SIZE + 4
+			  + SIMULCAST_RID_LEN, /**< abs-send-time, RID  */
+	RTP_PRESZ       = 4 + RTP_HEADER_SIZE
+			  + RTP_EXTSZ,         /**< TURN, RTP header    */
 	RTP_TRAILSZ     = 12 + 4,              /**< SRTP/SRTCP trailer  */
+	SENDQ_SIZE      = 1024,                /**< Tx-Queue packets    */
+	SENDQ_PKTSZ     = 1280,                /**< Initial packet size */
+	RTX_HIST_SIZE   = 512,                 /**< Resendable packets  */
+	RTX_MAX_AGE     = 1000,                /**< Oldest resent [ms]  */
+	CC_MIN_BITRATE  = 50000,               /**< in [bit/s]          */
+	CC_MAX_ESTIMATE = 20000000,            /**< in [bit/s]          */
+	ENC_UPDATE_MIN  = 1000,                /**< Encoder raise [ms]  */
+	EXTMAP_AST      = 1,                   /**< Offered ext. ID     */
+	EXTMAP_RID      = 2,                   /**< Offered ext. ID     */
+	DECQ_MAX_PKTS   = 2048,                /**< Packets per frame   */
+	POOL_FRAMES     = 4,                   /**< Frames per pool     */
 	PICUP_INTERVAL  = 500,
 };
 
+static const char *uri_abs_send_time =
+	"http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time";
+static const char *uri_rtp_stream_id =
+	"urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id";
+
 
 /**
  * \page GenericVideoStream Generic Video Stream
@@ -76,25 +103,67 @@ enum {
  '         '--------'   '- - - - -'   '---------'   '---------'
                          (optional)
  \endverbatim
+
+ With simulcast the filtered frame is fed to one encoder per layer. Each
+ smaller layer is downscaled once, from the next larger layer.
  */
+
+/**
+ * Simulcast layer of the transmitter, with its own encoder, SSRC,
+ * Tx-Queue, pacer and retransmission history. Layer 0 has the full size
+ * and the SSRC of the stream, without simulcast it is the only layer.
+ */
+struct vlayer {
+	struct vtx *vtx;                   /**< Parent                    */
+	struct simulcast_layer *sl;        /**< Size and bitrate          */
+	struct videnc_state *enc;          /**< Video encoder state       */
+	struct videnc_param enc_prm;       /**< Current encoder params    */
+	uint64_t enc_upd;                  /**< Last encoder update [ms]  */
+	uint32_t ssrc;                     /**< SSRC, unused for layer 0  */
+	uint16_t seq;                      /**< Next RTP sequence number  */
+	struct vidqent *sendq;             /**< Tx-Queue ring of packets  */
+	uint32_t sendq_head;               /**< Next packet to send       */
+	uint32_t sendq_n;                  /**< Packets in the Tx-Queue   */
+	struct rtxbuf *rtx;                /**< Retransmission history    */
+	uint32_t bitrate;                  /**< Pacing bitrate [bit/s]    */
+	bool active;                       /**< Encoded, not paused       */
+	bool picup;                        /**< Send picture update       */
+	bool drop_frame;                   /**< Drop the rest of a frame  */
+	uint32_t drop_ts;                  /**< Timestamp of that frame   */
+	unsigned skipc;                    /**< Number of frames skipped  */
+
+	/** Statistics */
+	struct {
+		uint64_t frames;           /**< Frames encoded            */
+		uint64_t sendq_pkts;       /**< Packets queued for send   */
+		uint64_t sendq_drops;      /**< Packets dropped when full */
+		uint32_t sendq_max;        /**< Max depth of the Tx-Queue */
+		uint64_t nack_picup;       /**< NACKs answered with FIR   */
+		uint64_t enc_updates;      /**< Encoder bitrate changes   */
+	} stats;
+};
+
 struct vtx {
 	struct video *video;               /**< Parent                    */
 	const struct vidcodec *vc;         /**< Current Video encoder     */
-	struct videnc_state *enc;          /**< Video encoder state       */
 	struct vidsrc_prm vsrc_prm;        /**< Video source parameters   */
 	struct vidsz vsrc_size;            /**< Video source size         */
 	struct vidsrc_st *vsrc;            /**< Video source              */
 	struct lock *lock_enc;             /**< Lock for encoder          */
-	struct vidframe *frame;            /**< Source frame              */
+	struct vidpool *pool;              /**< Frames for conversion     */
+	struct vidcvt *cvt;                /**< Pixel format converter    */
 	struct lock *lock_tx;              /**< Protect the sendq         */
-	struct list sendq;                 /**< Tx-Queue (struct vidqent) */
 	struct tmr tmr_rtp;                /**< Timer for sending RTP     */
-	unsigned skipc;                    /**< Number of frames skipped  */
+	struct simulcast sc;               /**< Simulcast layers          */
+	struct vlayer layerv[SIMULCAST_MAX];/**< Layers, full size first  */
+	bool simulcast;                    /**< Simulcast negotiated      */
+	struct bwe_tx *bwe;                /**< Congestion control        */
+	uint32_t bitrate;                  /**< Target bitrate [bit/s]    */
+	char *enc_params;                  /**< Encoder SDP parameters    */
 	struct list filtl;                 /**< Filters in encoding order */
 	enum vidfmt fmt;                   /**< Outgoing pixel format     */
 	char device[128];                  /**< Source device name        */
 	uint32_t ts_offset;                /**< Random timestamp offset   */
-	bool picup;                        /**< Send picture update       */
 	int frames;                        /**< Number of frames sent     */
 	double efps;                       /**< Estimated frame-rate      */
 	uint64_t ts_base;                  /**< First RTP timestamp sent  */
@@ -103,6 +172,7 @@ struct vtx {
 	/** Statistics */
 	struct {
 		uint64_t src_frames;       /**< Total frames from vidsrc  */
+		uint64_t remb;             /**< REMB messages received    */
 	} stats;
 };
 
@@ -131,6 +201,7 @@ struct vrx {
 	struct vidisp_st *vidisp;          /**< Video display             */
 	struct lock *lock;                 /**< Lock for decoder          */
 	struct list filtl;                 /**< Filters in decoding order */
+	struct vidpool *pool;              /**< Frames for the filters    */
 	struct tmr tmr_picup;              /**< Picture update timer      */
 	struct vidsz size;                 /**< Incoming video resolution */
 	enum vidfmt fmt;                   /**< Incoming pixel format     */
@@ -142,6 +213,12 @@ struct vrx {
 	unsigned n_intra;                  /**< Intra-frames decoded      */
 	unsigned n_picup;                  /**< Picture updates sent      */
 	struct timestamp_recv ts_recv;     /**< Receive timestamp state   */
+#ifdef HAVE_PTHREAD
+	struct viddecq *decq;              /**< Frames for the decoder    */
+	struct workpool_job *job;          /**< Decode job on worker pool */
+	struct mqueue *mq;                 /**< Events from the decoder   */
+	struct lathist dec_time;           /**< Decode time/frame [us]    */
+#endif
 
 	/** Statistics */
 	struct {
@@ -150,6 +227,14 @@ struct vrx {
 };
 
 
+/** Events of the decoder, handled on the main thread */
+enum vrx_event {
+	VRX_PICUP = 0,
+	VRX_INTRA,
+	VRX_DISP_CLOSED,
+};
+
+
 /** Generic Video stream */
 struct video {
 	MAGIC_DECL              /**< Magic number for debugging           */
@@ -160,14 +245,16 @@ struct video {
 	struct tmr tmr;         /**< Timer for frame-rate estimation      */
 	char *peer;             /**< Peer URI                             */
 	bool nack_pli;          /**< Send NACK/PLI to peer                */
+	bool remb;              /**< Peer supports REMB                   */
+	unsigned extmap_ast;    /**< abs-send-time extension ID, or 0     */
+	unsigned extmap_rid;    /**< rtp-stream-id extension ID, or 0     */
 	video_err_h *errh;      /**< Error handler                        */
 	void *arg;              /**< Error handler argument               */
 };
 
 
+/** Tx-Queue slot, the buffer is kept and reused */
 struct vidqent {
-	struct le le;
-	struct sa dst;
 	bool marker;
 	uint8_t pt;
 	uint32_t ts;
@@ -179,16 +266,49 @@ static void request_picture_update(struct vrx *vrx);
 static void video_stop_display(struct video *v);
 static void video_stop_source(struct video *v);
 
-static void vidqent_destructor(void *arg)
+static void sendq_destructor(void *arg)
 {
-	struct vidqent *qent = arg;
+	struct vidqent *sendq = arg;
+	size_t i;
+
+	for (i=0; i<SENDQ_SIZE; i++)
+		mem_deref(sendq[i].mb);
+}
+
+
+/*
+ * Drop a frame with a packet that did not fit into the Tx-Queue. Its
+ * queued packets and the rest of its packets are dropped, the next frame
+ * is a key frame. Must be called with lock_tx held
+ */
+static void vidqueue_drop_frame(struct vlayer *vl, bool marker, uint32_t ts)
+{
+	while (vl->sendq_n) {
+
+		struct vidqent *qent;
 
-	list_unlink(&qent->le);
-	mem_deref(qent->mb);
+		qent = &vl->sendq[(vl->sendq_head + vl->sendq_n - 1) %
+				  SENDQ_SIZE];
+		if (qent->ts != ts)
+			break;
+
+		--vl->sendq_n;
+		++vl->stats.sendq_drops;
+	}
+
+	vl->drop_frame = !marker;
+	vl->drop_ts    = ts;
+	vl->picup      = true;
 }
 
 
-static int vidqent_alloc(struct vidqent **qentp,
+/*
+ * Append a packet to the Tx-Queue, writing it into the buffer of the next
+ * free slot. The buffer is allocated the first time the slot is used.
+ *
+ * Must be called with lock_tx held
+ */
+static int vidqueue_push(struct vlayer *vl,
 			 bool marker, uint8_t pt, uint32_t ts,
 			 const uint8_t *hdr, size_t hdr_len,
 			 const uint8_t *pld, size_t pld_len)
@@ -196,83 +316,190 @@ static int vidqent_alloc(struct vidqent **qentp,
 	struct vidqent *qent;
 	int err = 0;
 
-	if (!qentp || !pld)
+	if (!pld)
 		return EINVAL;
 
-	qent = mem_zalloc(sizeof(*qent), vidqent_destructor);
-	if (!qent)
-		return ENOMEM;
+	/* the rest of a dropped frame, up to its marker */
+	if (vl->drop_frame && ts == vl->drop_ts) {
+		vl->drop_frame = !marker;
+		++vl->stats.sendq_drops;
+		return ENOBUFS;
+	}
 
-	qent->marker = marker;
-	qent->pt     = pt;
-	qent->ts     = ts;
+	vl->drop_frame = false;
+
+	if (vl->sendq_n >= SENDQ_SIZE) {
+		++vl->stats.sendq_drops;
+		vidqueue_drop_frame(vl, marker, ts);
+		return ENOBUFS;
+	}
+
+	qent = &vl->sendq[(vl->sendq_head + vl->sendq_n) % SENDQ_SIZE];
 
-	qent->mb = mbuf_alloc(RTP_PRESZ + hdr_len + pld_len + RTP_TRAILSZ);
 	if (!qent->mb) {
-		err = ENOMEM;
-		goto out;
+		qent->mb = mbuf_alloc(RTP_PRESZ + SENDQ_PKTSZ + RTP_TRAILSZ);
+		if (!qent->mb)
+			return ENOMEM;
 	}
 
+	qent->marker = marker;
+	qent->pt     = pt;
+	qent->ts     = ts;
+
 	qent->mb->pos = qent->mb->end = RTP_PRESZ;
 
 	if (hdr)
-		(void)mbuf_write_mem(qent->mb, hdr, hdr_len);
+		err |= mbuf_write_mem(qent->mb, hdr, hdr_len);
 
-	(void)mbuf_write_mem(qent->mb, pld, pld_len);
+	err |= mbuf_write_mem(qent->mb, pld, pld_len);
+	if (err)
+		return err;
 
 	qent->mb->pos = RTP_PRESZ;
 
- out:
-	if (err)
-		mem_deref(qent);
-	else
-		*qentp = qent;
+	++vl->sendq_n;
+	++vl->stats.sendq_pkts;
+	vl->stats.sendq_max = max(vl->stats.sendq_max, vl->sendq_n);
+
+	return 0;
+}
+
+
+/*
+ * Write the header extensions in front of the payload, abs-send-time if
+ * the peer takes it and the RTP stream ID of a simulcast layer
+ */
+static int prepend_ext(struct vlayer *vl, struct mbuf *mb, uint64_t now)
+{
+	const struct video *v = vl->vtx->video;
+	const char *rid = NULL;
+	size_t len = 0, rid_len = 0, pos;
+	int err;
+
+	if (v->extmap_ast)
+		len += 4;
+
+	if (v->extmap_rid && vl->vtx->simulcast) {
+		rid     = vl->sl->rid;
+		rid_len = str_len(rid);
+		len    += (1 + rid_len + 3) & ~(size_t)3;
+	}
+
+	if (!len)
+		return ENOENT;
+
+	pos = mb->pos - RTPEXT_HDR_SIZE - len;
+
+	mb->pos = pos;
+
+	err = rtpext_hdr_encode(mb, len);
+
+	if (v->extmap_ast) {
+		const uint32_t ast = bwe_abs_send_time(now);
+		uint8_t data[3];
+
+		data[0] = ast >> 16;
+		data[1] = ast >> 8;
+		data[2] = ast;
+
+		err |= rtpext_encode(mb, v->extmap_ast, sizeof(data), data);
+	}
+
+	if (rid_len) {
+		err |= rtpext_encode(mb, v->extmap_rid, (unsigned)rid_len,
+				     (const uint8_t *)rid);
+	}
+
+	mb->pos = err ? pos + RTPEXT_HDR_SIZE + len : pos;
 
 	return err;
 }
 
 
-static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
+/* send a packet of a layer, layer 0 is sent with the SSRC of the stream */
+static void vlayer_send(struct vlayer *vl, bool staged, bool ext,
+			struct vidqent *qent)
 {
-	size_t burst, sent;
-	uint64_t bandwidth_kbps;
-	struct le *le;
+	struct stream *strm = vl->vtx->video->strm;
+	int seq;
+
+	if (vl == &vl->vtx->layerv[0]) {
+
+		if (staged) {
+			stream_send_seq(strm, ext, qent->marker, qent->pt,
+					qent->ts, qent->mb, &seq);
+			if (seq >= 0)
+				rtxbuf_commit(vl->rtx, seq);
+		}
+		else {
+			stream_send(strm, ext, qent->marker, qent->pt,
+				    qent->ts, qent->mb);
+		}
 
-	if (!vtx)
 		return;
+	}
+
+	seq = vl->seq++;
+
+	stream_send_ssrc(strm, vl->ssrc, seq, ext, qent->marker, qent->pt,
+			 qent->ts, qent->mb);
+
+	if (staged)
+		rtxbuf_commit(vl->rtx, seq);
+}
+
+
+/* each layer is paced at its own bitrate */
+static void vidqueue_poll(struct vlayer *vl, uint64_t jfs, uint64_t prev_jfs)
+{
+	const uint64_t now = tmr_jiffies_usec();
+	struct vtx *vtx = vl->vtx;
+	size_t burst, sent;
+	uint64_t bandwidth_kbps;
 
 	lock_write_get(vtx->lock_tx);
 
-	le = vtx->sendq.head;
-	if (!le)
+	if (!vl->sendq_n)
 		goto out;
 
 	/*
 	 * time [ms] * bitrate [kbps] / 8 = bytes
 	 */
-	bandwidth_kbps = vtx->video->cfg.bitrate / 1000;
+	bandwidth_kbps = vl->bitrate / 1000;
 	burst = (size_t)((1 + jfs - prev_jfs) * bandwidth_kbps / 4);
 
 	burst = min(burst, BURST_MAX);
 	sent  = 0;
 
-	while (le) {
+	stream_send_cork(vtx->video->strm);
+
+	while (vl->sendq_n) {
 
-		struct vidqent *qent = le->data;
+		struct vidqent *qent = &vl->sendq[vl->sendq_head];
+		bool staged, ext;
+
+		/* keep the packet, if the peer can NACK it */
+		staged = vtx->video->nack_pli &&
+			!rtxbuf_stage(vl->rtx, qent->marker, qent->pt,
+				      qent->ts, mbuf_buf(qent->mb),
+				      mbuf_get_left(qent->mb));
+
+		ext = !prepend_ext(vl, qent->mb, now);
 
 		sent += mbuf_get_left(qent->mb);
 
-		stream_send(vtx->video->strm, false, qent->marker, qent->pt,
-			    qent->ts, qent->mb);
+		vlayer_send(vl, staged, ext, qent);
 
-		le = le->next;
-		mem_deref(qent);
+		vl->sendq_head = (vl->sendq_head + 1) % SENDQ_SIZE;
+		--vl->sendq_n;
 
 		if (sent > burst) {
 			break;
 		}
 	}
 
+	stream_send_flush(vtx->video->strm);
+
  out:
 	lock_rel(vtx->lock_tx);
 }
@@ -282,12 +509,14 @@ static void rtp_tmr_handler(void *arg)
 {
 	struct vtx *vtx = arg;
 	uint64_t pjfs;
+	uint32_t i;
 
 	pjfs = vtx->tmr_rtp.jfs;
 
 	tmr_start(&vtx->tmr_rtp, 1000/MEDIA_POLL_RATE, rtp_tmr_handler, vtx);
 
-	vidqueue_poll(vtx, vtx->tmr_rtp.jfs, pjfs);
+	for (i=0; i<vtx->sc.n; i++)
+		vidqueue_poll(&vtx->layerv[i], vtx->tmr_rtp.jfs, pjfs);
 }
 
 
@@ -296,28 +525,43 @@ static void video_destructor(void *arg)
 	struct video *v = arg;
 	struct vtx *vtx = &v->vtx;
 	struct vrx *vrx = &v->vrx;
+	uint32_t i;
 
 	/* transmit */
 	lock_write_get(vtx->lock_tx);
-	list_flush(&vtx->sendq);
+	for (i=0; i<SIMULCAST_MAX; i++) {
+		vtx->layerv[i].sendq = mem_deref(vtx->layerv[i].sendq);
+		vtx->layerv[i].sendq_n = 0;
+		vtx->layerv[i].rtx = mem_deref(vtx->layerv[i].rtx);
+	}
 	lock_rel(vtx->lock_tx);
 	mem_deref(vtx->lock_tx);
 
 	tmr_cancel(&vtx->tmr_rtp);
+	mem_deref(vtx->bwe);
 	mem_deref(vtx->vsrc);
 	lock_write_get(vtx->lock_enc);
-	mem_deref(vtx->frame);
-	mem_deref(vtx->enc);
+	mem_deref(vtx->cvt);
+	mem_deref(vtx->pool);
+	for (i=0; i<SIMULCAST_MAX; i++)
+		mem_deref(vtx->layerv[i].enc);
+	mem_deref(vtx->enc_params);
 	list_flush(&vtx->filtl);
 	lock_rel(vtx->lock_enc);
 	mem_deref(vtx->lock_enc);
 
 	/* receive */
+#ifdef HAVE_PTHREAD
+	mem_deref(vrx->job);
+	mem_deref(vrx->mq);
+	mem_deref(vrx->decq);
+#endif
 	tmr_cancel(&vrx->tmr_picup);
 	lock_write_get(vrx->lock);
 	mem_deref(vrx->dec);
 	mem_deref(vrx->vidisp);
 	list_flush(&vrx->filtl);
+	mem_deref(vrx->pool);
 	lock_rel(vrx->lock);
 	mem_deref(vrx->lock);
 
@@ -346,9 +590,9 @@ static int packet_handler(bool marker, uint64_t ts,
 			  const uint8_t *pld, size_t pld_len,
 			  void *arg)
 {
-	struct vtx *vtx = arg;
+	struct vlayer *vl = arg;
+	struct vtx *vtx = vl->vtx;
 	struct stream *strm = vtx->video->strm;
-	struct vidqent *qent;
 	uint32_t rtp_ts;
 	int err;
 
@@ -358,17 +602,12 @@ static int packet_handler(bool marker, uint64_t ts,
 		vtx->ts_base = ts;
 	vtx->ts_last = ts;
 
-	/* add random timestamp offset */
+	/* add random timestamp offset, the same for all layers */
 	rtp_ts = vtx->ts_offset + (ts & 0xffffffff);
 
-	err = vidqent_alloc(&qent, marker, strm->pt_enc, rtp_ts,
-			    hdr, hdr_len, pld, pld_len);
-	if (err)
-		return err;
-
 	lock_write_get(vtx->lock_tx);
-	qent->dst = *sdp_media_raddr(strm->sdp);
-	list_append(&vtx->sendq, &qent->le, qent);
+	err = vidqueue_push(vl, marker, strm->pt_enc, rtp_ts,
+			    hdr, hdr_len, pld, pld_len);
 	lock_rel(vtx->lock_tx);
 
 	return err;
@@ -387,40 +626,50 @@ static int packet_handler(bool marker, uint64_t ts,
 static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 			    uint64_t timestamp)
 {
+	struct vidframe *frame_conv = NULL, *frame_scaled = NULL;
+	const struct vidframe *src;
+	bool sendv[SIMULCAST_MAX];
+	uint32_t i, sendc = 0;
 	struct le *le;
 	int err = 0;
-	bool sendq_empty;
-
-	if (!vtx->enc)
-		return;
 
+	/* a layer skips the frame while it still has packets queued */
 	lock_write_get(vtx->lock_tx);
-	sendq_empty = (vtx->sendq.head == NULL);
+
+	for (i=0; i<vtx->sc.n; i++) {
+
+		struct vlayer *vl = &vtx->layerv[i];
+
+		sendv[i] = vl->active && vl->sendq_n == 0;
+
+		if (vl->active && vl->sendq_n)
+			++vl->skipc;
+
+		sendc += sendv[i];
+	}
+
 	lock_rel(vtx->lock_tx);
 
-	if (!sendq_empty) {
-		++vtx->skipc;
+	if (!sendc)
 		return;
-	}
 
 	lock_write_get(vtx->lock_enc);
 
-	/* Convert image */
+	/* Convert image, the pool follows changes of the source size */
 	if (frame->fmt != (enum vidfmt)vtx->video->cfg.enc_fmt) {
 
 		vtx->vsrc_size = frame->size;
 
-		if (!vtx->frame) {
+		err = vidpool_get(vtx->pool, &frame_conv,
+				  vtx->video->cfg.enc_fmt, &frame->size);
+		if (err)
+			goto out;
 
-			err = vidframe_alloc(&vtx->frame,
-					     vtx->video->cfg.enc_fmt,
-					     &vtx->vsrc_size);
-			if (err)
-				goto out;
-		}
+		err = vidcvt_convert(vtx->cvt, frame_conv, frame);
+		if (err)
+			goto out;
 
-		vidconv(vtx->frame, frame, 0);
-		frame = vtx->frame;
+		frame = frame_conv;
 	}
 
 	/* Process video frame through all Video Filters */
@@ -438,15 +687,50 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 	if (frame)
 		vtx->fmt = frame->fmt;
 
-	/* Encode the whole picture frame */
-	err = vtx->vc->ench(vtx->enc, vtx->picup, frame, timestamp);
-	if (err)
-		goto out;
+	/* Encode the whole picture frame, once per layer */
+	src = frame;
+
+	for (i=0; i<vtx->sc.n; i++) {
+
+		struct vlayer *vl = &vtx->layerv[i];
+		struct vidframe *scaled = NULL;
+		struct vidsz sz;
+
+		if (!sendv[i] || !vl->enc)
+			continue;
+
+		if (simulcast_size(&sz, &frame->size, vl->sl))
+			continue;
 
-	vtx->picup = false;
+		/* scale from the next larger layer */
+		if (!vidsz_cmp(&sz, &src->size)) {
+
+			err = vidpool_get(vtx->pool, &scaled, src->fmt, &sz);
+			if (err)
+				goto out;
+
+			err = vidcvt_convert(vtx->cvt, scaled, src);
+			if (err) {
+				mem_deref(scaled);
+				goto out;
+			}
+
+			mem_deref(frame_scaled);
+			src = frame_scaled = scaled;
+		}
+
+		err = vtx->vc->ench(vl->enc, vl->picup, src, timestamp);
+		if (err)
+			goto out;
+
+		vl->picup = false;
+		++vl->stats.frames;
+	}
 
  out:
 	lock_rel(vtx->lock_enc);
+	mem_deref(frame_scaled);
+	mem_deref(frame_conv);
 }
 
 
@@ -489,8 +773,69 @@ static void vidsrc_error_handler(int err, void *arg)
 }
 
 
+/*
+ * Set the pacers of the layers from the bitrate allocation, a layer which
+ * is resumed starts with a key frame. Must be called with lock_tx held
+ */
+static void vtx_allocate(struct vtx *vtx)
+{
+	uint32_t i;
+
+	(void)simulcast_allocate(&vtx->sc, vtx->bitrate);
+
+	for (i=0; i<vtx->sc.n; i++) {
+
+		struct vlayer *vl = &vtx->layerv[i];
+
+		if (vl->sl->active && !vl->active)
+			vl->picup = true;
+
+		vl->active  = vl->sl->active;
+		vl->bitrate = vl->sl->bitrate;
+	}
+}
+
+
+static int vlayer_alloc(struct vlayer *vl, struct vtx *vtx, uint32_t i)
+{
+	uint32_t j;
+	int err;
+
+	vl->sendq = mem_zalloc(SENDQ_SIZE * sizeof(*vl->sendq),
+			       sendq_destructor);
+	if (!vl->sendq)
+		return ENOMEM;
+
+	err = rtxbuf_alloc(&vl->rtx, RTX_HIST_SIZE, RTX_MAX_AGE,
+			   RTP_PRESZ, RTP_TRAILSZ);
+	if (err)
+		return err;
+
+	vl->vtx = vtx;
+	vl->sl  = &vtx->sc.layerv[i];
+	vl->seq = rand_u16();
+
+	/* the other layers get an SSRC of their own */
+	while (i && !vl->ssrc) {
+
+		vl->ssrc = rand_u32();
+
+		if (vl->ssrc == rtp_sess_ssrc(vtx->video->strm->rtp))
+			vl->ssrc = 0;
+
+		for (j=1; j<i; j++) {
+			if (vl->ssrc == vtx->layerv[j].ssrc)
+				vl->ssrc = 0;
+		}
+	}
+
+	return 0;
+}
+
+
 static int vtx_alloc(struct vtx *vtx, struct video *video)
 {
+	uint32_t i, layerc;
 	int err;
 
 	err  = lock_alloc(&vtx->lock_enc);
@@ -498,10 +843,42 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	if (err)
 		return err;
 
-	tmr_init(&vtx->tmr_rtp);
-
 	vtx->video = video;
 
+	layerc = min(max(video->cfg.simulcast, 1u), (uint32_t)SIMULCAST_MAX);
+
+	err = simulcast_init(&vtx->sc, layerc, video->cfg.bitrate);
+	if (err)
+		return err;
+
+	for (i=0; i<layerc; i++) {
+		err = vlayer_alloc(&vtx->layerv[i], vtx, i);
+		if (err)
+			return err;
+	}
+
+	/* a frame for each scaled layer */
+	err = vidpool_alloc(&vtx->pool, POOL_FRAMES + layerc - 1);
+	if (err)
+		return err;
+
+	err = vidcvt_alloc(&vtx->cvt, video->cfg.conv_threads);
+	if (err)
+		return err;
+
+	vtx->bitrate = video->cfg.bitrate;
+	vtx_allocate(vtx);
+
+	if (video->cfg.cc && vtx->bitrate) {
+		err = bwe_tx_alloc(&vtx->bwe, vtx->bitrate,
+				   min(CC_MIN_BITRATE, vtx->bitrate),
+				   vtx->bitrate);
+		if (err)
+			return err;
+	}
+
+	tmr_init(&vtx->tmr_rtp);
+
 	/* The initial value of the timestamp SHOULD be random */
 	vtx->ts_offset = rand_u16();
 
@@ -519,7 +896,8 @@ static int vrx_alloc(struct vrx *vrx, struct video *video)
 {
 	int err;
 
-	err = lock_alloc(&vrx->lock);
+	err  = lock_alloc(&vrx->lock);
+	err |= vidpool_alloc(&vrx->pool, POOL_FRAMES);
 	if (err)
 		return err;
 
@@ -596,8 +974,69 @@ static void update_rtp_timestamp(struct timestamp_recv *tsr, uint32_t rtp_ts)
 }
 
 
+static void vrx_event_handle(struct vrx *vrx, enum vrx_event ev)
+{
+	struct video *v = vrx->video;
+	bool closed;
+
+	switch (ev) {
+
+	case VRX_PICUP:
+		request_picture_update(vrx);
+		break;
+
+	case VRX_INTRA:
+		tmr_cancel(&vrx->tmr_picup);
+		break;
+
+	case VRX_DISP_CLOSED:
+		lock_write_get(vrx->lock);
+		closed = vrx->vidisp != NULL;
+		vrx->vidisp = mem_deref(vrx->vidisp);
+		lock_rel(vrx->lock);
+
+		if (!closed)
+			break;
+
+		warning("video: video-display was closed\n");
+
+		if (v->errh)
+			v->errh(ENODEV, "display closed", v->arg);
+		break;
+	}
+}
+
+
+#ifdef HAVE_PTHREAD
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct vrx *vrx = arg;
+	(void)data;
+
+	MAGIC_CHECK(vrx->video);
+
+	vrx_event_handle(vrx, id);
+}
+#endif
+
+
+/* timers and handlers are used on the main thread only */
+static void vrx_event(struct vrx *vrx, enum vrx_event ev)
+{
+#ifdef HAVE_PTHREAD
+	if (vrx->mq) {
+		(void)mqueue_push(vrx->mq, ev, NULL);
+		return;
+	}
+#endif
+
+	vrx_event_handle(vrx, ev);
+}
+
+
 /**
- * Decode incoming RTP packets using the Video decoder
+ * Decode incoming RTP packets using the Video decoder. Runs on the decode
+ * worker if the decode queue is used, otherwise on the RTP thread.
  *
  * NOTE: mb=NULL if no packet received
  *
@@ -615,7 +1054,7 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	struct vidframe frame_store, *frame = &frame_store;
 	struct le *le;
 	uint64_t timestamp;
-	bool intra;
+	bool intra, closed = false;
 	int err = 0;
 
 	if (!hdr || !mbuf_get_left(mb))
@@ -647,13 +1086,13 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 				mbuf_get_left(mb), err);
 		}
 
-		request_picture_update(vrx);
+		vrx_event(vrx, VRX_PICUP);
 
 		goto out;
 	}
 
 	if (intra) {
-		tmr_cancel(&vrx->tmr_picup);
+		vrx_event(vrx, VRX_INTRA);
 		++vrx->n_intra;
 	}
 
@@ -673,7 +1112,8 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 
 	if (!list_isempty(&vrx->filtl)) {
 
-		err = vidframe_alloc(&frame_filt, frame->fmt, &frame->size);
+		err = vidpool_get(vrx->pool, &frame_filt, frame->fmt,
+				  &frame->size);
 		if (err)
 			goto out;
 
@@ -696,25 +1136,103 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	err = vidisp_display(vrx->vidisp, v->peer, frame, timestamp);
 	frame_filt = mem_deref(frame_filt);
 	if (err == ENODEV) {
-		warning("video: video-display was closed\n");
-		vrx->vidisp = mem_deref(vrx->vidisp);
+		closed = true;
+		goto out;
+	}
 
-		lock_rel(vrx->lock);
+	++vrx->frames;
 
-		if (v->errh) {
-			v->errh(err, "display closed", v->arg);
+out:
+	lock_rel(vrx->lock);
+
+	if (closed)
+		vrx_event(vrx, VRX_DISP_CLOSED);
+
+	return err;
+}
+
+
+#ifdef HAVE_PTHREAD
+/* decode the queued frames on the worker pool */
+static void vrx_decode(void *arg)
+{
+	struct vrx *vrx = arg;
+	struct viddecq_frame *f;
+
+	while (!workpool_job_stopping(vrx->job) &&
+	       (f = viddecq_get(vrx->decq))) {
+
+		const uint64_t start = tmr_jiffies_usec();
+		struct rtp_header hdr;
+		uint32_t i;
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.ts = f->ts;
+
+		for (i=0; i<f->pktc; i++) {
+
+			hdr.seq = f->pktv[i].seq;
+			hdr.m   = f->pktv[i].marker;
+
+			if (video_stream_decode(vrx, &hdr,
+						f->pktv[i].mb) == ENODEV)
+				break;
 		}
 
-		return err;
+		lathist_add(&vrx->dec_time, tmr_jiffies_usec() - start);
+
+		viddecq_release(vrx->decq);
 	}
+}
 
-	++vrx->frames;
 
-out:
-	lock_rel(vrx->lock);
+/* collect the packets of a frame, the worker decodes complete frames */
+static void vrx_queue(struct vrx *vrx, const struct rtp_header *hdr,
+		      struct mbuf *mb, unsigned lostc)
+{
+	bool queued;
+	int err;
+
+	if (!mbuf_get_left(mb))
+		return;
+
+	err = viddecq_put(vrx->decq, hdr, mb, lostc, &queued);
+	if (err == ENOSPC || err == EOVERFLOW) {
+		debug("video: decoder is behind, waiting for keyframe"
+		      " (%m)\n", err);
+		request_picture_update(vrx);
+	}
+	else if (err) {
+		warning("video: decode queue (seq=%u): %m\n", hdr->seq, err);
+	}
+
+	if (queued)
+		workpool_job_post(vrx->job);
+}
+
+
+static int vrx_decq_alloc(struct vrx *vrx, uint32_t size)
+{
+	struct workpool *pool;
+	int err;
+
+	err  = viddecq_alloc(&vrx->decq, size, DECQ_MAX_PKTS, NULL);
+	err |= mqueue_alloc(&vrx->mq, mqueue_handler, vrx);
+	if (err)
+		return err;
+
+	/* the display may block for a frame, the audio decoders have a
+	   pool of their own */
+	err = workpool_shared(&pool, WORKPOOL_VIDEO);
+	if (err)
+		return err;
+
+	err = workpool_job_alloc(&vrx->job, pool, vrx_decode, vrx);
+	mem_deref(pool);
 
 	return err;
 }
+#endif
 
 
 static int stream_pt_handler(uint8_t pt, struct mbuf *mb, void *arg)
@@ -761,10 +1279,201 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 		goto out;
 
  out:
+#ifdef HAVE_PTHREAD
+	if (v->vrx.decq) {
+		vrx_queue(&v->vrx, hdr, mb, lostc);
+		return;
+	}
+#endif
+
 	(void)video_stream_decode(&v->vrx, hdr, mb);
 }
 
 
+static int rtx_send_handler(uint16_t seq, bool marker, uint8_t pt,
+			    uint32_t ts, struct mbuf *mb, void *arg)
+{
+	struct vlayer *vl = arg;
+	struct stream *strm = vl->vtx->video->strm;
+
+	if (vl == &vl->vtx->layerv[0])
+		return stream_resend(strm, seq, marker, pt, ts, mb);
+
+	return stream_send_ssrc(strm, vl->ssrc, seq, false, marker, pt, ts,
+				mb);
+}
+
+
+static uint32_t vlayer_ssrc(const struct vlayer *vl)
+{
+	if (vl == &vl->vtx->layerv[0])
+		return rtp_sess_ssrc(vl->vtx->video->strm->rtp);
+
+	return vl->ssrc;
+}
+
+
+/* the layer sent with an SSRC, or NULL */
+static struct vlayer *vtx_layer(struct vtx *vtx, uint32_t ssrc)
+{
+	uint32_t i;
+
+	for (i=0; i<vtx->sc.n; i++) {
+		if (ssrc == vlayer_ssrc(&vtx->layerv[i]))
+			return &vtx->layerv[i];
+	}
+
+	return NULL;
+}
+
+
+/* a picture update of one layer, or of all if the SSRC is 0 or unknown */
+static void vtx_picup(struct vtx *vtx, uint32_t ssrc)
+{
+	struct vlayer *vl = ssrc ? vtx_layer(vtx, ssrc) : NULL;
+	uint32_t i;
+
+	if (vl) {
+		vl->picup = true;
+		return;
+	}
+
+	for (i=0; i<vtx->sc.n; i++)
+		vtx->layerv[i].picup = true;
+}
+
+
+/* resend the lost packets, a picture update only if some are gone */
+static void handle_nack(struct vtx *vtx, const struct rtcp_msg *msg)
+{
+	struct vlayer *vl = vtx_layer(vtx, msg->r.fb.ssrc_media);
+	uint32_t i, misses = 0;
+
+	if (!vl)
+		vl = &vtx->layerv[0];
+
+	lock_write_get(vtx->lock_tx);
+
+	for (i=0; i<msg->r.fb.n; i++) {
+
+		const struct gnack *fci = &msg->r.fb.fci.gnackv[i];
+
+		misses += rtxbuf_nack(vl->rtx, fci->pid, fci->blp,
+				      rtx_send_handler, vl);
+	}
+
+	if (misses)
+		++vl->stats.nack_picup;
+
+	lock_rel(vtx->lock_tx);
+
+	if (misses)
+		vl->picup = true;
+}
+
+
+/*
+ * Change the bitrate of an encoder in larger steps only, it may restart.
+ * A paused layer keeps its encoder. Must be called with lock_enc held
+ */
+static void vlayer_update_encoder(struct vlayer *vl, uint32_t bps,
+				  uint64_t now)
+{
+	const struct vidcodec *vc = vl->vtx->vc;
+	struct videnc_param prm;
+	uint64_t cur;
+	int err;
+
+	if (!vc || !vl->enc || !bps)
+		return;
+
+	cur = vl->enc_prm.bitrate;
+
+	if (bps * 10ULL > cur * 9 && bps * 10ULL < cur * 11)
+		return;
+
+	if (bps > cur && now - vl->enc_upd < ENC_UPDATE_MIN)
+		return;
+
+	prm = vl->enc_prm;
+	prm.bitrate = bps;
+
+	err = vc->encupdh(&vl->enc, vc, &prm, vl->vtx->enc_params,
+			  packet_handler, vl);
+	if (err) {
+		warning("video: encoder update: %m\n", err);
+		return;
+	}
+
+	vl->enc_prm = prm;
+	vl->enc_upd = now;
+	++vl->stats.enc_updates;
+}
+
+
+/*
+ * Follow the target of the congestion control. The bitrate is allocated
+ * to the layers, the pacers change at once.
+ */
+static void vtx_update_bitrate(struct vtx *vtx)
+{
+	const uint32_t bps = bwe_tx_target(vtx->bwe);
+	const uint64_t now = tmr_jiffies();
+	uint32_t i, bpsv[SIMULCAST_MAX];
+
+	if (!bps)
+		return;
+
+	lock_write_get(vtx->lock_tx);
+
+	vtx->bitrate = bps;
+	vtx_allocate(vtx);
+
+	for (i=0; i<vtx->sc.n; i++)
+		bpsv[i] = vtx->layerv[i].bitrate;
+
+	lock_rel(vtx->lock_tx);
+
+	lock_write_get(vtx->lock_enc);
+
+	for (i=0; i<vtx->sc.n; i++)
+		vlayer_update_encoder(&vtx->layerv[i], bpsv[i], now);
+
+	lock_rel(vtx->lock_enc);
+}
+
+
+static void handle_rr(struct video *v, const struct rtcp_rr *rrv,
+		      uint32_t n)
+{
+	const uint32_t ssrc = rtp_sess_ssrc(v->strm->rtp);
+	uint32_t i;
+
+	for (i=0; i<n; i++) {
+
+		if (rrv[i].ssrc != ssrc)
+			continue;
+
+		bwe_tx_loss(v->vtx.bwe, tmr_jiffies_usec(), rrv[i].fraction);
+		vtx_update_bitrate(&v->vtx);
+	}
+}
+
+
+static void handle_remb(struct video *v, const struct rtcp_msg *msg)
+{
+	uint32_t bps;
+
+	if (bwe_remb_decode(&bps, msg->r.fb.fci.afb))
+		return;
+
+	++v->vtx.stats.remb;
+
+	bwe_tx_remb(v->vtx.bwe, bps);
+	vtx_update_bitrate(&v->vtx);
+}
+
+
 static void rtcp_handler(struct stream *strm, struct rtcp_msg *msg, void *arg)
 {
 	struct video *v = arg;
@@ -775,17 +1484,29 @@ static void rtcp_handler(struct stream *strm, struct rtcp_msg *msg, void *arg)
 	switch (msg->hdr.pt) {
 
 	case RTCP_FIR:
-		v->vtx.picup = true;
+		vtx_picup(&v->vtx, 0);
+		break;
+
+	case RTCP_SR:
+		if (v->vtx.bwe)
+			handle_rr(v, msg->r.sr.rrv, msg->hdr.count);
+		break;
+
+	case RTCP_RR:
+		if (v->vtx.bwe)
+			handle_rr(v, msg->r.rr.rrv, msg->hdr.count);
 		break;
 
 	case RTCP_PSFB:
 		if (msg->hdr.count == RTCP_PSFB_PLI)
-			v->vtx.picup = true;
+			vtx_picup(&v->vtx, msg->r.fb.ssrc_media);
+		else if (msg->hdr.count == RTCP_PSFB_AFB && v->vtx.bwe)
+			handle_remb(v, msg);
 		break;
 
 	case RTCP_RTPFB:
 		if (msg->hdr.count == RTCP_RTPFB_GNACK)
-			v->vtx.picup = true;
+			handle_nack(&v->vtx, msg);
 		break;
 
 	default:
@@ -811,45 +1532,120 @@ static int vtx_print_pipeline(struct re_printf *pf, const struct vtx *vtx)
 	for (le = list_head(&vtx->filtl); le; le = le->next) {
 		struct vidfilt_enc_st *st = le->data;
 
-		if (st->vf->ench)
-			err |= re_hprintf(pf, " ---> %s", st->vf->name);
+		if (st->vf->ench)
+			err |= re_hprintf(pf, " ---> %s", st->vf->name);
+	}
+
+	err |= re_hprintf(pf, " ---> %s\n",
+			  vtx->vc ? vtx->vc->name : "encoder");
+
+	return err;
+}
+
+
+static int vrx_print_pipeline(struct re_printf *pf, const struct vrx *vrx)
+{
+	struct le *le;
+	struct vidisp *vd;
+	int err;
+
+	if (!vrx)
+		return 0;
+
+	vd = vidisp_get(vrx->vidisp);
+
+	err = re_hprintf(pf, "video rx pipeline: %10s",
+			 vd ? vd->name : "disp");
+
+	for (le = list_head(&vrx->filtl); le; le = le->next) {
+		struct vidfilt_dec_st *st = le->data;
+
+		if (st->vf->dech)
+			err |= re_hprintf(pf, " <--- %s", st->vf->name);
+	}
+
+	err |= re_hprintf(pf, " <--- %s\n",
+			  vrx->vc ? vrx->vc->name : "decoder");
+
+	return err;
+}
+
+
+/* the SSRCs of the enabled layers, from the smallest up */
+static int ssrc_group_print(struct re_printf *pf, const struct vtx *vtx)
+{
+	uint32_t i;
+	int err;
+
+	err = re_hprintf(pf, "SIM");
+
+	for (i=vtx->sc.n; i-- > 0;) {
+		if (vtx->sc.layerv[i].enabled)
+			err |= re_hprintf(pf, " %u",
+					  vlayer_ssrc(&vtx->layerv[i]));
 	}
 
-	err |= re_hprintf(pf, " ---> %s\n",
-			  vtx->vc ? vtx->vc->name : "encoder");
-
 	return err;
 }
 
 
-static int vrx_print_pipeline(struct re_printf *pf, const struct vrx *vrx)
+/*
+ * RFC 8851 and RFC 8853, the layers are sent with an RTP stream ID each.
+ * The SSRCs are grouped for peers which use the SSRCs instead, and listed
+ * next to the one of the stream (RFC 5576) if they are sent.
+ */
+static int vtx_sdp_simulcast(struct video *v)
 {
-	struct le *le;
-	struct vidisp *vd;
-	int err;
+	struct sdp_media *m = stream_sdpmedia(v->strm);
+	const struct vtx *vtx = &v->vtx;
+	bool replace = true;
+	uint32_t i;
+	int err = 0;
 
-	if (!vrx)
-		return 0;
+	err = sdp_media_set_lattr(m, true, "ssrc", "%u cname:%s",
+				  rtp_sess_ssrc(v->strm->rtp),
+				  v->strm->cname);
 
-	vd = vidisp_get(vrx->vidisp);
+	if (!vtx->simulcast) {
+		sdp_media_del_lattr(m, "rid");
+		sdp_media_del_lattr(m, "simulcast");
+		sdp_media_del_lattr(m, "ssrc-group");
+		return err;
+	}
 
-	err = re_hprintf(pf, "video rx pipeline: %10s",
-			 vd ? vd->name : "disp");
+	for (i=1; i<vtx->sc.n; i++) {
 
-	for (le = list_head(&vrx->filtl); le; le = le->next) {
-		struct vidfilt_dec_st *st = le->data;
+		if (!vtx->sc.layerv[i].enabled)
+			continue;
 
-		if (st->vf->dech)
-			err |= re_hprintf(pf, " <--- %s", st->vf->name);
+		err |= sdp_media_set_lattr(m, false, "ssrc", "%u cname:%s",
+					   vtx->layerv[i].ssrc,
+					   v->strm->cname);
 	}
 
-	err |= re_hprintf(pf, " <--- %s\n",
-			  vrx->vc ? vrx->vc->name : "decoder");
+	for (i=0; i<vtx->sc.n; i++) {
+
+		const struct simulcast_layer *l = &vtx->sc.layerv[i];
+
+		if (!l->enabled)
+			continue;
+
+		err |= sdp_media_set_lattr(m, replace, "rid",
+					   "%s send max-width=%u;"
+					   "max-height=%u", l->rid,
+					   v->cfg.width / l->scale,
+					   v->cfg.height / l->scale);
+		replace = false;
+	}
+
+	err |= sdp_media_set_lattr(m, true, "simulcast", "%H",
+				   simulcast_encode, &vtx->sc);
+	err |= sdp_media_set_lattr(m, true, "ssrc-group", "%H",
+				   ssrc_group_print, vtx);
 
 	return err;
 }
 
-
 /**
  * Allocate a video stream
  *
@@ -923,6 +1719,19 @@ int video_alloc(struct video **vp, struct list *streaml,
 	err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), true,
 				   "rtcp-fb", "* nack pli");
 
+	/* REMB with abs-send-time, the answer follows the peer */
+	if (v->cfg.cc) {
+		err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), false,
+					   "rtcp-fb", "* goog-remb");
+
+		if (offerer) {
+			err |= sdp_media_set_lattr(stream_sdpmedia(v->strm),
+						   true, "extmap", "%u %s",
+						   EXTMAP_AST,
+						   uri_abs_send_time);
+		}
+	}
+
 	/* RFC 4796 */
 	if (content) {
 		err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), true,
@@ -940,6 +1749,27 @@ int video_alloc(struct video **vp, struct list *streaml,
 	if (err)
 		goto out;
 
+	/* Simulcast, the answer follows the peer */
+	if (v->vtx.sc.n > 1 && offerer) {
+
+		v->vtx.simulcast = true;
+
+		err  = vtx_sdp_simulcast(v);
+		err |= sdp_media_set_lattr(stream_sdpmedia(v->strm),
+					   false, "extmap", "%u %s",
+					   EXTMAP_RID, uri_rtp_stream_id);
+		if (err)
+			goto out;
+	}
+
+#ifdef HAVE_PTHREAD
+	if (v->cfg.dec_queue) {
+		err = vrx_decq_alloc(&v->vrx, v->cfg.dec_queue);
+		if (err)
+			goto out;
+	}
+#endif
+
 	/* Video codecs */
 	for (le = list_head(vidcodecl); le; le = le->next) {
 		struct vidcodec *vc = le->data;
@@ -994,18 +1824,29 @@ static void vidisp_resize_handler(const struct vidsz *sz, void *arg)
 static int set_vidisp(struct vrx *vrx)
 {
 	struct vidisp *vd;
+	int err;
+
+	vd = (struct vidisp *)vidisp_find(data_vidispl(),
+					  vrx->video->cfg.disp_mod);
+
+	/* the decoder may be running on a worker */
+	lock_write_get(vrx->lock);
 
 	vrx->vidisp = mem_deref(vrx->vidisp);
 
 	vrx->vidisp_prm.fullscreen = vrx->video->cfg.fullscreen;
 
-	vd = (struct vidisp *)vidisp_find(data_vidispl(),
-					  vrx->video->cfg.disp_mod);
-	if (!vd)
-		return ENOENT;
+	if (vd) {
+		err = vd->alloch(&vrx->vidisp, vd, &vrx->vidisp_prm,
+				 vrx->device, vidisp_resize_handler, vrx);
+	}
+	else {
+		err = ENOENT;
+	}
 
-	return vd->alloch(&vrx->vidisp, vd, &vrx->vidisp_prm, vrx->device,
-			  vidisp_resize_handler, vrx);
+	lock_rel(vrx->lock);
+
+	return err;
 }
 
 
@@ -1236,7 +2077,9 @@ static void video_stop_display(struct video *v)
 
 	debug("video: stopping video display ..\n");
 
+	lock_write_get(v->vrx.lock);
 	v->vrx.vidisp = mem_deref(v->vrx.vidisp);
+	lock_rel(v->vrx.lock);
 }
 
 
@@ -1294,6 +2137,30 @@ static void vidsrc_update(struct vtx *vtx, const char *dev)
 }
 
 
+/* must be called with lock_enc held */
+static int vlayer_encoder_alloc(struct vlayer *vl, double fps)
+{
+	const struct vidcodec *vc = vl->vtx->vc;
+	struct videnc_param prm;
+	int err;
+
+	prm.bitrate = vl->bitrate ? vl->bitrate : vl->sl->max_bitrate;
+	prm.pktsize = 1024;
+	prm.fps     = fps;
+	prm.max_fs  = -1;
+
+	err = vc->encupdh(&vl->enc, vc, &prm, vl->vtx->enc_params,
+			  packet_handler, vl);
+	if (err)
+		return err;
+
+	vl->enc_prm = prm;
+	vl->enc_upd = tmr_jiffies();
+
+	return 0;
+}
+
+
 /**
  * Set the video encoder used
  *
@@ -1308,6 +2175,7 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		      int pt_tx, const char *params)
 {
 	struct vtx *vtx;
+	uint32_t i;
 	int err = 0;
 
 	if (!v)
@@ -1324,25 +2192,37 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 
 	if (vc != vtx->vc) {
 
-		struct videnc_param prm;
+		info("Set video encoder: %s %s (%u bit/s, %.2f fps,"
+		     " %u layers)\n", vc->name, vc->variant, vtx->bitrate,
+		     get_fps(v), vtx->sc.n);
+
+		for (i=0; i<SIMULCAST_MAX; i++)
+			vtx->layerv[i].enc = mem_deref(vtx->layerv[i].enc);
+
+		vtx->vc = vc;
+
+		/* kept for bitrate updates and new layers */
+		vtx->enc_params = mem_deref(vtx->enc_params);
+		if (params) {
+			err = str_dup(&vtx->enc_params, params);
+			if (err)
+				goto out;
+		}
+	}
+
+	/* an encoder for each layer the peer takes */
+	for (i=0; i<vtx->sc.n; i++) {
 
-		prm.bitrate = v->cfg.bitrate;
-		prm.pktsize = 1024;
-		prm.fps     = get_fps(v);
-		prm.max_fs  = -1;
+		struct vlayer *vl = &vtx->layerv[i];
 
-		info("Set video encoder: %s %s (%u bit/s, %.2f fps)\n",
-		     vc->name, vc->variant, prm.bitrate, prm.fps);
+		if (vl->enc || !vl->sl->enabled)
+			continue;
 
-		vtx->enc = mem_deref(vtx->enc);
-		err = vc->encupdh(&vtx->enc, vc, &prm, params,
-				  packet_handler, vtx);
+		err = vlayer_encoder_alloc(vl, get_fps(v));
 		if (err) {
 			warning("video: encoder alloc: %m\n", err);
 			goto out;
 		}
-
-		vtx->vc = vc;
 	}
 
 	stream_update_encoder(v->strm, pt_tx);
@@ -1389,15 +2269,26 @@ int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 
 		info("Set video decoder: %s %s\n", vc->name, vc->variant);
 
+#ifdef HAVE_PTHREAD
+		/* frames of the old decoder */
+		viddecq_flush(vrx->decq);
+		viddecq_set_keyh(vrx->decq, vc->keyh);
+#endif
+
+		lock_write_get(vrx->lock);
+
 		vrx->dec = mem_deref(vrx->dec);
 
 		err = vc->decupdh(&vrx->dec, vc, fmtp);
+		if (!err)
+			vrx->vc = vc;
+
+		lock_rel(vrx->lock);
+
 		if (err) {
 			warning("video: decoder alloc: %m\n", err);
 			return err;
 		}
-
-		vrx->vc = vc;
 	}
 
 	return err;
@@ -1417,11 +2308,128 @@ struct stream *video_strm(const struct video *v)
 }
 
 
+/**
+ * Get the statistics of the video transmit queue, of all simulcast layers
+ *
+ * @param v  Video object
+ * @param st Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int video_sendq_stats(const struct video *v, struct video_sendq_stats *st)
+{
+	const struct vtx *vtx;
+	uint32_t i;
+
+	if (!v || !st)
+		return EINVAL;
+
+	vtx = &v->vtx;
+
+	memset(st, 0, sizeof(*st));
+
+	lock_read_get(vtx->lock_tx);
+
+	for (i=0; i<vtx->sc.n; i++) {
+
+		const struct vlayer *vl = &vtx->layerv[i];
+
+		st->depth    += vl->sendq_n;
+		st->max_depth = max(st->max_depth, vl->stats.sendq_max);
+		st->capacity += SENDQ_SIZE;
+		st->packets  += vl->stats.sendq_pkts;
+		st->drops    += vl->stats.sendq_drops;
+	}
+
+	lock_rel(vtx->lock_tx);
+
+	return 0;
+}
+
+
+/**
+ * Get the statistics of the retransmission history of a video stream, of
+ * all simulcast layers
+ *
+ * @param v  Video object
+ * @param st Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int video_rtx_stats(const struct video *v, struct rtxbuf_stats *st)
+{
+	struct rtxbuf_stats lst;
+	uint32_t i;
+	int err = 0;
+
+	if (!v || !st)
+		return EINVAL;
+
+	memset(st, 0, sizeof(*st));
+
+	lock_read_get(v->vtx.lock_tx);
+
+	for (i=0; i<v->vtx.sc.n; i++) {
+
+		err = rtxbuf_stats(v->vtx.layerv[i].rtx, &lst);
+		if (err)
+			break;
+
+		st->stored += lst.stored;
+		st->nacked += lst.nacked;
+		st->hits   += lst.hits;
+		st->misses += lst.misses;
+		st->bytes  += lst.bytes;
+		st->size   += lst.size;
+		st->mem    += lst.mem;
+	}
+
+	lock_rel(v->vtx.lock_tx);
+
+	return err;
+}
+
+
+/**
+ * Get the statistics of the congestion control of a video stream
+ *
+ * @param v  Video object
+ * @param st Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int video_cc_stats(const struct video *v, struct video_cc_stats *st)
+{
+	const struct vtx *vtx;
+	uint32_t i;
+
+	if (!v || !st)
+		return EINVAL;
+
+	vtx = &v->vtx;
+
+	memset(st, 0, sizeof(*st));
+
+	st->estimate = bwe_rx_estimate(v->strm->bwe);
+	st->target   = bwe_tx_target(vtx->bwe);
+	st->remb     = vtx->stats.remb;
+
+	lock_read_get(vtx->lock_enc);
+
+	for (i=0; i<vtx->sc.n; i++)
+		st->enc_updates += vtx->layerv[i].stats.enc_updates;
+
+	lock_rel(vtx->lock_enc);
+
+	return 0;
+}
+
+
 void video_update_picture(struct video *v)
 {
 	if (!v)
 		return;
-	v->vtx.picup = true;
+	vtx_picup(&v->vtx, 0);
 }
 
 
@@ -1449,19 +2457,183 @@ static bool nack_handler(const char *name, const char *value, void *arg)
 }
 
 
+static bool remb_handler(const char *name, const char *value, void *arg)
+{
+	(void)name;
+	(void)arg;
+
+	return 0 == re_regex(value, str_len(value), "goog-remb");
+}
+
+
+static bool extmap_handler(const char *name, const char *value, void *arg)
+{
+	struct video *v = arg;
+	struct sdp_extmap extmap;
+	unsigned *idp = NULL;
+	int err;
+	(void)name;
+
+	MAGIC_CHECK(v);
+
+	err = sdp_extmap_decode(&extmap, value);
+	if (err) {
+		warning("video: sdp_extmap_decode error (%m)\n", err);
+		return false;
+	}
+
+	if (!pl_strcasecmp(&extmap.name, uri_abs_send_time))
+		idp = v->cfg.cc ? &v->extmap_ast : NULL;
+	else if (!pl_strcasecmp(&extmap.name, uri_rtp_stream_id))
+		idp = v->vtx.simulcast ? &v->extmap_rid : NULL;
+
+	if (!idp)
+		return false;
+
+	if (extmap.id < RTPEXT_ID_MIN || extmap.id > RTPEXT_ID_MAX) {
+		warning("video: extmap id out of range (%u)\n", extmap.id);
+		return false;
+	}
+
+	*idp = extmap.id;
+
+	return false;
+}
+
+
+/* the extensions the peer takes, the answer follows the peer */
+static int extmap_decode(struct video *v)
+{
+	struct sdp_media *m = stream_sdpmedia(v->strm);
+	int err = 0;
+
+	v->extmap_ast = 0;
+	v->extmap_rid = 0;
+
+	sdp_media_rattr_apply(m, "extmap", extmap_handler, v);
+
+	if (v->extmap_ast) {
+		err |= sdp_media_set_lattr(m, true, "extmap", "%u %s",
+					   v->extmap_ast, uri_abs_send_time);
+	}
+
+	if (v->extmap_rid) {
+		err |= sdp_media_set_lattr(m, !v->extmap_ast, "extmap",
+					   "%u %s", v->extmap_rid,
+					   uri_rtp_stream_id);
+	}
+
+	return err;
+}
+
+
+/* RFC 8853, only the layers the peer takes are sent */
+static void simulcast_sdp_decode(struct video *v)
+{
+	const uint64_t now = tmr_jiffies();
+	struct vtx *vtx = &v->vtx;
+	uint32_t i, bpsv[SIMULCAST_MAX];
+	const char *attr;
+	int err;
+
+	if (vtx->sc.n < 2)
+		return;
+
+	attr = sdp_media_rattr(stream_sdpmedia(v->strm), "simulcast");
+
+	lock_write_get(vtx->lock_tx);
+
+	err = attr ? simulcast_decode(&vtx->sc, attr) : ENOENT;
+	if (err)
+		simulcast_single(&vtx->sc);
+
+	vtx->simulcast = !err;
+	vtx_allocate(vtx);
+
+	for (i=0; i<vtx->sc.n; i++)
+		bpsv[i] = vtx->layerv[i].bitrate;
+
+	lock_rel(vtx->lock_tx);
+
+	/* the encoders follow the new shares */
+	lock_write_get(vtx->lock_enc);
+
+	for (i=0; i<vtx->sc.n; i++)
+		vlayer_update_encoder(&vtx->layerv[i], bpsv[i], now);
+
+	lock_rel(vtx->lock_enc);
+
+	if (err && attr)
+		warning("video: simulcast: %s (%m)\n", attr, err);
+
+	err = vtx_sdp_simulcast(v);
+	if (err)
+		warning("video: simulcast attributes: %m\n", err);
+}
+
+
 void video_sdp_attr_decode(struct video *v)
 {
+	int err;
+
 	if (!v)
 		return;
 
 	/* RFC 4585 */
 	if (sdp_media_rattr_apply(v->strm->sdp, "rtcp-fb", nack_handler, 0))
 		v->nack_pli = true;
+
+	simulcast_sdp_decode(v);
+
+	err = extmap_decode(v);
+	if (err)
+		warning("video: extmap: %m\n", err);
+
+	if (!v->cfg.cc)
+		return;
+
+	v->remb = NULL != sdp_media_rattr_apply(v->strm->sdp, "rtcp-fb",
+						remb_handler, 0);
+
+	/* the peer sends abs-send-time and takes REMB */
+	err = stream_enable_bwe(v->strm, v->remb ? v->extmap_ast : 0,
+				v->cfg.bitrate, CC_MIN_BITRATE,
+				CC_MAX_ESTIMATE);
+	if (err)
+		warning("video: bandwidth estimation: %m\n", err);
+}
+
+
+static int vlayer_debug(struct re_printf *pf, const struct vlayer *vl)
+{
+	int err = 0;
+
+	err |= re_hprintf(pf, "     layer %s: ssrc=0x%08x %s scale=1/%u"
+			  " frames=%llu\n",
+			  vl->sl->rid, vlayer_ssrc(vl),
+			  !vl->sl->enabled ? "disabled" :
+			  vl->active ? "active" : "paused",
+			  vl->sl->scale, vl->stats.frames);
+	err |= re_hprintf(pf, "       skipc=%u sendq=%u/%u (max=%u"
+			  " packets=%llu drops=%llu)\n",
+			  vl->skipc, vl->sendq_n, SENDQ_SIZE,
+			  vl->stats.sendq_max, vl->stats.sendq_pkts,
+			  vl->stats.sendq_drops);
+	err |= re_hprintf(pf, "       %H", rtxbuf_debug, vl->rtx);
+	err |= re_hprintf(pf, "       nack_picup=%llu\n",
+			  vl->stats.nack_picup);
+	err |= re_hprintf(pf, "       bitrate=%u encoder=%u"
+			  " (updates=%llu)\n",
+			  vl->bitrate, vl->enc_prm.bitrate,
+			  vl->stats.enc_updates);
+
+	return err;
 }
 
 
 static int vtx_debug(struct re_printf *pf, const struct vtx *vtx)
 {
+	uint32_t i;
 	int err = 0;
 
 	err |= re_hprintf(pf, " tx: encode: %s %s\n",
@@ -1473,8 +2645,14 @@ static int vtx_debug(struct re_printf *pf, const struct vtx *vtx)
 			  vtx->vsrc_size.w,
 			  vtx->vsrc_size.h, vtx->vsrc_prm.fps,
 			  vtx->stats.src_frames);
-	err |= re_hprintf(pf, "     skipc=%u sendq=%u\n",
-			  vtx->skipc, list_count(&vtx->sendq));
+	for (i=0; i<vtx->sc.n; i++)
+		err |= vlayer_debug(pf, &vtx->layerv[i]);
+	err |= re_hprintf(pf, "     %H", vidpool_debug, vtx->pool);
+	err |= re_hprintf(pf, "     %H", vidcvt_debug, vtx->cvt);
+	err |= re_hprintf(pf, "     bitrate=%u simulcast=%s\n",
+			  vtx->bitrate, vtx->simulcast ? "yes" : "no");
+	if (vtx->bwe)
+		err |= re_hprintf(pf, "     %H", bwe_tx_debug, vtx->bwe);
 
 	if (vtx->ts_base) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -1501,6 +2679,16 @@ static int vrx_debug(struct re_printf *pf, const struct vrx *vrx)
 			  vrx->stats.disp_frames);
 	err |= re_hprintf(pf, "     n_keyframes=%u, n_picup=%u\n",
 			  vrx->n_intra, vrx->n_picup);
+	err |= re_hprintf(pf, "     %H", vidpool_debug, vrx->pool);
+#ifdef HAVE_PTHREAD
+	if (vrx->decq) {
+		err |= re_hprintf(pf, "     %H", viddecq_debug, vrx->decq);
+		err |= re_hprintf(pf, "      decode [us]: %H\n",
+				  lathist_debug, &vrx->dec_time);
+		err |= re_hprintf(pf, "      decode pool: %H\n",
+				  workpool_debug, workpool_job_pool(vrx->job));
+	}
+#endif
 
 	if (vrx->ts_recv.is_set) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -1628,3 +2816,22 @@ const struct vidcodec *video_codec(const struct video *vid, bool tx)
 
 	return tx ? vid->vtx.vc : vid->vrx.vc;
 }
+
+
+/**
+ * Get the frame pool of a video stream. The frames of the pool may be used
+ * by the filters and the format conversion of that direction, while the
+ * encoder or decoder lock is held.
+ *
+ * @param vid Video object
+ * @param tx  True to get the transmit pool, false to get the receive pool
+ *
+ * @return Frame pool if success, otherwise NULL
+ */
+struct vidpool *video_frame_pool(const struct video *vid, bool tx)
+{
+	if (!vid)
+		return NULL;
+
+	return tx ? vid->vtx.pool : vid->vrx.pool;
+}
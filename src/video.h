@@ -17,9 +17,28 @@ struct mnat_sess;
 struct media_ctx;
 struct menc;
 struct menc_sess;
+struct rtxbuf_stats;
 struct stream_param;
 struct vidcodec;
 struct video;
+struct vidpool;
+
+/** Video transmit queue statistics */
+struct video_sendq_stats {
+	uint32_t depth;       /**< Packets in the queue now         */
+	uint32_t max_depth;   /**< Most packets queued at once      */
+	uint32_t capacity;    /**< Size of the queue in packets     */
+	uint64_t packets;     /**< Packets queued in total          */
+	uint64_t drops;       /**< Packets dropped, queue was full  */
+};
+
+/** Video congestion control statistics */
+struct video_cc_stats {
+	uint32_t estimate;    /**< Receive estimate [bit/s], 0=none */
+	uint32_t target;      /**< Send target [bit/s], 0=off       */
+	uint64_t remb;        /**< REMB messages received           */
+	uint64_t enc_updates; /**< Encoder bitrate changes          */
+};
 
 typedef void (video_err_h)(int err, const char *str, void *arg);
 
@@ -45,7 +64,11 @@ void  video_set_devicename(struct video *v, const char *src, const char *disp);
 int   video_debug(struct re_printf *pf, const struct video *v);
 struct stream *video_strm(const struct video *v);
 const struct vidcodec *video_codec(const struct video *vid, bool tx);
+struct vidpool *video_frame_pool(const struct video *vid, bool tx);
 void video_sdp_attr_decode(struct video *v);
+int  video_sendq_stats(const struct video *v, struct video_sendq_stats *st);
+int  video_rtx_stats(const struct video *v, struct rtxbuf_stats *st);
+int  video_cc_stats(const struct video *v, struct video_cc_stats *st);
 
 
 #ifndef UAMODAPI_USE		/* Internal API */
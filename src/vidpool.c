@@ -0,0 +1,238 @@
+/**
+ * @file vidpool.c  Video frame pool
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "vidpool.h"
+
+
+/**
+ * The pool keeps a few frames, keyed by format and size. A frame is
+ * handed out with a reference and is free again when the caller releases
+ * it with mem_deref(), only the pool holds it then. A free frame of the
+ * requested format and size is reused. Otherwise a free frame of an old
+ * format or size is replaced, e.g. after a resolution change, and a frame
+ * still held by a caller is released by its last user. If all frames are
+ * in use a frame outside of the pool is allocated.
+ *
+ * A user of a frame may point it at another buffer, e.g. a filter which
+ * scales into a frame of its own. The pool keeps the format, size and
+ * buffer of each frame and sets the frame up again when it is handed out.
+ *
+ * The pool is not thread safe, the owner serializes the calls.
+ */
+
+/** A pooled frame, with the buffer after the frame */
+struct pframe {
+	struct vidframe *frame;       /**< Frame, NULL if unused          */
+	uint8_t *buf;                 /**< Buffer of the frame            */
+	enum vidfmt fmt;              /**< Pixel format of the buffer     */
+	struct vidsz size;            /**< Size of the buffer             */
+};
+
+struct vidpool {
+	struct pframe *framev;        /**< Pooled frames                  */
+	uint32_t max;                 /**< Number of frames               */
+	struct vidpool_stats stats;   /**< Statistics                     */
+};
+
+
+static void destructor(void *arg)
+{
+	struct vidpool *pool = arg;
+	uint32_t i;
+
+	for (i=0; pool->framev && i<pool->max; i++)
+		mem_deref(pool->framev[i].frame);
+
+	mem_deref(pool->framev);
+}
+
+
+static bool frame_match(const struct pframe *pf, enum vidfmt fmt,
+			const struct vidsz *sz)
+{
+	return pf->fmt == fmt && vidsz_cmp(&pf->size, sz);
+}
+
+
+/* the frame is set up from its buffer, whatever the last user did */
+static struct vidframe *frame_reset(struct pframe *pf)
+{
+	vidframe_init_buf(pf->frame, pf->fmt, &pf->size, pf->buf);
+
+	return mem_ref(pf->frame);
+}
+
+
+static int frame_alloc(struct pframe *pf, enum vidfmt fmt,
+		       const struct vidsz *sz)
+{
+	struct vidframe *f;
+
+	if (!sz->w || !sz->h)
+		return EINVAL;
+
+	f = mem_zalloc(sizeof(*f) + vidframe_size(fmt, sz), NULL);
+	if (!f)
+		return ENOMEM;
+
+	pf->frame = f;
+	pf->buf   = (uint8_t *)(f + 1);
+	pf->fmt   = fmt;
+	pf->size  = *sz;
+
+	return 0;
+}
+
+
+/**
+ * Allocate a video frame pool
+ *
+ * @param poolp Pointer to allocated frame pool
+ * @param max   Number of frames in the pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_alloc(struct vidpool **poolp, uint32_t max)
+{
+	struct vidpool *pool;
+	int err = 0;
+
+	if (!poolp || !max || max > 64)
+		return EINVAL;
+
+	pool = mem_zalloc(sizeof(*pool), destructor);
+	if (!pool)
+		return ENOMEM;
+
+	pool->framev = mem_zalloc(max * sizeof(*pool->framev), NULL);
+	if (!pool->framev) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pool->max       = max;
+	pool->stats.max = max;
+
+ out:
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+}
+
+
+/**
+ * Get a frame of the given format and size. The content of the frame is
+ * undefined, release it with mem_deref() when done.
+ *
+ * @param pool   Frame pool, NULL to allocate a frame
+ * @param framep Pointer to the frame
+ * @param fmt    Pixel format
+ * @param sz     Size of the frame
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_get(struct vidpool *pool, struct vidframe **framep,
+		enum vidfmt fmt, const struct vidsz *sz)
+{
+	struct pframe *empty = NULL, *stale = NULL, *slot;
+	uint32_t i;
+	int err;
+
+	if (!framep || !sz)
+		return EINVAL;
+
+	for (i=0; pool && i<pool->max; i++) {
+
+		struct pframe *pf = &pool->framev[i];
+
+		if (!pf->frame) {
+			if (!empty)
+				empty = pf;
+			continue;
+		}
+
+		if (mem_nrefs(pf->frame) > 1)
+			continue;
+
+		if (frame_match(pf, fmt, sz)) {
+			++pool->stats.reuses;
+			*framep = frame_reset(pf);
+			return 0;
+		}
+
+		if (!stale)
+			stale = pf;
+	}
+
+	/* a free frame of an old format or size is replaced first */
+	if (stale) {
+		stale->frame = mem_deref(stale->frame);
+		++pool->stats.reconfigs;
+	}
+
+	slot = stale ? stale : empty;
+	if (!slot) {
+		if (pool)
+			++pool->stats.unpooled;
+
+		return vidframe_alloc(framep, fmt, sz);
+	}
+
+	err = frame_alloc(slot, fmt, sz);
+	if (err)
+		return err;
+
+	++pool->stats.allocs;
+	*framep = frame_reset(slot);
+
+	return 0;
+}
+
+
+/**
+ * Get the statistics of a frame pool
+ *
+ * @param pool  Frame pool
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_stats(const struct vidpool *pool, struct vidpool_stats *stats)
+{
+	if (!pool || !stats)
+		return EINVAL;
+
+	*stats = pool->stats;
+
+	return 0;
+}
+
+
+/**
+ * Print the statistics of a frame pool
+ *
+ * @param pf   Print function
+ * @param pool Frame pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_debug(struct re_printf *pf, const struct vidpool *pool)
+{
+	const struct vidpool_stats *st;
+
+	if (!pool)
+		return 0;
+
+	st = &pool->stats;
+
+	return re_hprintf(pf, "pool: max=%u allocs=%llu reuses=%llu"
+			  " unpooled=%llu reconfigs=%llu\n",
+			  st->max, st->allocs, st->reuses, st->unpooled,
+			  st->reconfigs);
+}
@@ -0,0 +1,31 @@
+/**
+ * @file vidpool.h
+ * @brief Video frame pool
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAVIDPOOL_H_INCLUDED
+#define UAVIDPOOL_H_INCLUDED
+
+#include "rsua-re/re.h"
+#include "rsua-rem/rem.h"
+
+struct vidpool;
+
+/** Statistics of a frame pool */
+struct vidpool_stats {
+	uint64_t allocs;          /**< Frames allocated in the pool       */
+	uint64_t reuses;          /**< Frames reused from the pool        */
+	uint64_t unpooled;        /**< Frames allocated, the pool is full */
+	uint64_t reconfigs;       /**< Frames freed on a format change    */
+	uint32_t max;             /**< Number of frames in the pool       */
+};
+
+int  vidpool_alloc(struct vidpool **poolp, uint32_t max);
+int  vidpool_get(struct vidpool *pool, struct vidframe **framep,
+		 enum vidfmt fmt, const struct vidsz *sz);
+int  vidpool_stats(const struct vidpool *pool, struct vidpool_stats *stats);
+int  vidpool_debug(struct re_printf *pf, const struct vidpool *pool);
+
+#endif /* UAVIDPOOL_H_INCLUDED */
@@ -0,0 +1,558 @@
+/**
+ * @file workpool.c  Shared worker thread pool
+ *
+ * A fixed number of worker threads, each with its own job queue. Every job
+ * has a home queue, assigned round-robin when the job is allocated. Idle
+ * workers steal jobs from the other queues, so a busy worker does not hold
+ * back the jobs homed on it.
+ *
+ * A job is queued at most once and never runs on two workers at the same
+ * time. Posting a job that is already running makes it run once more when
+ * the current run is finished.
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include "workpool.h"
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+
+
+enum {
+	IDLE_WAIT = 500,     /* max idle wait of a worker [ms] */
+	MAX_THREADS = 64,    /* upper limit of worker threads  */
+};
+
+enum job_state {
+	JOB_IDLE = 0,
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_RERUN,
+};
+
+struct workq {
+	struct workpool *pool;    /**< Parent pool                         */
+	pthread_t tid;            /**< Worker thread                       */
+	bool started;             /**< Worker thread was created           */
+	bool busy;                /**< Worker is running a job             */
+	pthread_mutex_t mutex;    /**< Protects the queue and job states   */
+	pthread_cond_t cond;      /**< Signalled when work is available    */
+	pthread_cond_t done;      /**< Signalled when a job has finished   */
+	struct list jobl;         /**< Queued jobs (struct workpool_job)   */
+	uint64_t n_run;           /**< Number of job runs                  */
+	uint64_t n_steal;         /**< Number of jobs stolen from others   */
+};
+
+struct workpool {
+	struct workq *qv;         /**< Worker queues                       */
+	uint32_t qc;              /**< Number of worker queues             */
+	uint32_t next;            /**< Next home queue for a new job       */
+	bool run;                 /**< Workers are running                 */
+};
+
+struct workpool_job {
+	struct le le;             /**< Element in home queue               */
+	struct workpool *pool;    /**< Worker pool (ref.)                  */
+	struct workq *home;       /**< Home queue, guards the job state    */
+	enum job_state state;     /**< Job state                           */
+	bool stop;                /**< Job is being cancelled              */
+	workpool_h *h;            /**< Job handler                         */
+	void *arg;                /**< Handler argument                    */
+};
+
+
+static struct workpool *shared_pool[WORKPOOL_SHARED_MAX];
+static uint32_t shared_threads[WORKPOOL_SHARED_MAX];
+
+
+static uint32_t cpu_count(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? (uint32_t)n : 1;
+}
+
+
+/* must be called with the mutex of the job's home queue held */
+static struct workpool_job *dequeue(struct workq *q)
+{
+	struct workpool_job *job = list_ledata(list_head(&q->jobl));
+
+	if (!job)
+		return NULL;
+
+	list_unlink(&job->le);
+	job->state = JOB_RUNNING;
+
+	return job;
+}
+
+
+static struct workpool_job *steal(struct workq *q)
+{
+	struct workpool *pool = q->pool;
+	struct workpool_job *job = NULL;
+	uint32_t i;
+
+	for (i=1; i<pool->qc && !job; i++) {
+
+		struct workq *v = &pool->qv[(q - pool->qv + i) % pool->qc];
+
+		pthread_mutex_lock(&v->mutex);
+		job = dequeue(v);
+		pthread_mutex_unlock(&v->mutex);
+	}
+
+	return job;
+}
+
+
+static void run_job(struct workq *q, struct workpool_job *job)
+{
+	struct workq *home = job->home;
+
+	for (;;) {
+		++q->n_run;
+		job->h(job->arg);
+
+		pthread_mutex_lock(&home->mutex);
+
+		if (job->state == JOB_RERUN && !job->stop) {
+			job->state = JOB_RUNNING;
+			pthread_mutex_unlock(&home->mutex);
+			continue;
+		}
+
+		job->state = JOB_IDLE;
+		pthread_cond_broadcast(&home->done);
+		pthread_mutex_unlock(&home->mutex);
+		break;
+	}
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct workq *q = arg;
+	struct workpool *pool = q->pool;
+
+	for (;;) {
+		struct workpool_job *job;
+		bool stolen = false;
+
+		pthread_mutex_lock(&q->mutex);
+		job = dequeue(q);
+		q->busy = job != NULL;
+		pthread_mutex_unlock(&q->mutex);
+
+		if (!job) {
+			job = steal(q);
+			stolen = job != NULL;
+		}
+
+		if (job) {
+			if (stolen)
+				++q->n_steal;
+
+			run_job(q, job);
+			continue;
+		}
+
+		pthread_mutex_lock(&q->mutex);
+
+		if (!pool->run) {
+			pthread_mutex_unlock(&q->mutex);
+			break;
+		}
+
+		q->busy = false;
+
+		if (list_isempty(&q->jobl)) {
+			struct timespec ts;
+			uint64_t ms = tmr_jiffies() + IDLE_WAIT;
+
+			ts.tv_sec  = ms / 1000;
+			ts.tv_nsec = (ms % 1000) * 1000000UL;
+
+			pthread_cond_timedwait(&q->cond, &q->mutex, &ts);
+		}
+
+		pthread_mutex_unlock(&q->mutex);
+	}
+
+	return NULL;
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct workpool *pool = arg;
+	uint32_t i;
+
+	for (i=0; i<WORKPOOL_SHARED_MAX; i++) {
+		if (shared_pool[i] == pool)
+			shared_pool[i] = NULL;
+	}
+
+	for (i=0; i<pool->qc; i++) {
+		struct workq *q = &pool->qv[i];
+
+		pthread_mutex_lock(&q->mutex);
+		pool->run = false;
+		pthread_cond_signal(&q->cond);
+		pthread_mutex_unlock(&q->mutex);
+	}
+
+	for (i=0; i<pool->qc; i++) {
+		struct workq *q = &pool->qv[i];
+
+		if (q->started)
+			pthread_join(q->tid, NULL);
+
+		pthread_mutex_destroy(&q->mutex);
+		pthread_cond_destroy(&q->cond);
+		pthread_cond_destroy(&q->done);
+	}
+
+	mem_deref(pool->qv);
+}
+
+
+/**
+ * Allocate a worker pool
+ *
+ * @param poolp    Pointer to allocated worker pool
+ * @param nthreads Number of worker threads, 0 for one per online CPU
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int workpool_alloc(struct workpool **poolp, uint32_t nthreads)
+{
+	struct workpool *pool;
+	uint32_t i;
+	int err = 0;
+
+	if (!poolp)
+		return EINVAL;
+
+	if (!nthreads)
+		nthreads = cpu_count();
+
+	nthreads = min(nthreads, MAX_THREADS);
+
+	pool = mem_zalloc(sizeof(*pool), pool_destructor);
+	if (!pool)
+		return ENOMEM;
+
+	pool->qv = mem_zalloc(nthreads * sizeof(*pool->qv), NULL);
+	if (!pool->qv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pool->run = true;
+
+	for (i=0; i<nthreads; i++) {
+		struct workq *q = &pool->qv[i];
+
+		q->pool = pool;
+
+		err  = pthread_mutex_init(&q->mutex, NULL);
+		err |= pthread_cond_init(&q->cond, NULL);
+		err |= pthread_cond_init(&q->done, NULL);
+		if (err)
+			goto out;
+
+		++pool->qc;
+	}
+
+	for (i=0; i<pool->qc; i++) {
+		struct workq *q = &pool->qv[i];
+
+		err = pthread_create(&q->tid, NULL, worker_thread, q);
+		if (err) {
+			warning("workpool: could not create thread (%m)\n",
+				err);
+			goto out;
+		}
+
+		q->started = true;
+	}
+
+	debug("workpool: started %u worker threads\n", pool->qc);
+
+ out:
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+}
+
+
+/**
+ * Set the number of worker threads of a shared pool. The setting is used
+ * when the shared pool is allocated, a pool that is in use keeps its size.
+ *
+ * @param id       Shared pool
+ * @param nthreads Number of worker threads, 0 for one per online CPU
+ */
+void workpool_shared_set_threads(enum workpool_shared_id id,
+				 uint32_t nthreads)
+{
+	struct workpool *pool;
+
+	if ((unsigned)id >= WORKPOOL_SHARED_MAX)
+		return;
+
+	shared_threads[id] = nthreads;
+
+	pool = shared_pool[id];
+	if (!pool)
+		return;
+
+	nthreads = min(nthreads ? nthreads : cpu_count(), MAX_THREADS);
+	if (nthreads != pool->qc) {
+		info("workpool: shared pool %d in use, keeping %u threads\n",
+		     id, pool->qc);
+	}
+}
+
+
+/**
+ * Get a reference to a shared worker pool. The pool is allocated by the
+ * first caller and freed with the last reference. The jobs of one pool do
+ * not wait for the jobs of another, e.g. the audio decoders do not wait
+ * for a video display.
+ *
+ * @param poolp Pointer to shared worker pool
+ * @param id    Shared pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int workpool_shared(struct workpool **poolp, enum workpool_shared_id id)
+{
+	int err;
+
+	if (!poolp || (unsigned)id >= WORKPOOL_SHARED_MAX)
+		return EINVAL;
+
+	if (shared_pool[id]) {
+		*poolp = mem_ref(shared_pool[id]);
+		return 0;
+	}
+
+	err = workpool_alloc(&shared_pool[id], shared_threads[id]);
+	if (err)
+		return err;
+
+	*poolp = shared_pool[id];
+
+	return 0;
+}
+
+
+/**
+ * Get the number of worker threads
+ *
+ * @param pool Worker pool
+ *
+ * @return Number of worker threads
+ */
+uint32_t workpool_threads(const struct workpool *pool)
+{
+	return pool ? pool->qc : 0;
+}
+
+
+/**
+ * Print the worker statistics
+ *
+ * @param pf   Print handler
+ * @param pool Worker pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int workpool_debug(struct re_printf *pf, const struct workpool *pool)
+{
+	uint32_t i;
+	int err;
+
+	if (!pool)
+		return 0;
+
+	err = re_hprintf(pf, "%u workers:", pool->qc);
+
+	for (i=0; i<pool->qc; i++) {
+		const struct workq *q = &pool->qv[i];
+
+		err |= re_hprintf(pf, " [run=%llu steal=%llu]",
+				  q->n_run, q->n_steal);
+	}
+
+	return err;
+}
+
+
+static void job_destructor(void *arg)
+{
+	struct workpool_job *job = arg;
+
+	workpool_job_cancel(job);
+	mem_deref(job->pool);
+}
+
+
+/**
+ * Allocate a job on a worker pool
+ *
+ * @param jobp Pointer to allocated job
+ * @param pool Worker pool
+ * @param h    Job handler
+ * @param arg  Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int workpool_job_alloc(struct workpool_job **jobp, struct workpool *pool,
+		       workpool_h *h, void *arg)
+{
+	struct workpool_job *job;
+	uint32_t n;
+
+	if (!jobp || !pool || !h)
+		return EINVAL;
+
+	job = mem_zalloc(sizeof(*job), job_destructor);
+	if (!job)
+		return ENOMEM;
+
+	n = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+
+	job->pool = mem_ref(pool);
+	job->home = &pool->qv[n % pool->qc];
+	job->h    = h;
+	job->arg  = arg;
+
+	*jobp = job;
+
+	return 0;
+}
+
+
+/**
+ * Schedule a job to run on the worker pool
+ *
+ * @param job Job to run
+ *
+ * @note This function may be called from any thread
+ */
+void workpool_job_post(struct workpool_job *job)
+{
+	struct workq *home;
+	bool nudge = false;
+
+	if (!job)
+		return;
+
+	home = job->home;
+
+	pthread_mutex_lock(&home->mutex);
+
+	if (job->stop) {
+		pthread_mutex_unlock(&home->mutex);
+		return;
+	}
+
+	switch (job->state) {
+
+	case JOB_IDLE:
+		list_append(&home->jobl, &job->le, job);
+		job->state = JOB_QUEUED;
+		pthread_cond_signal(&home->cond);
+		nudge = home->busy;
+		break;
+
+	case JOB_RUNNING:
+		job->state = JOB_RERUN;
+		break;
+
+	default:
+		break;
+	}
+
+	pthread_mutex_unlock(&home->mutex);
+
+	/* the home worker is busy, wake up the next one to steal the job */
+	if (nudge && job->pool->qc > 1) {
+		struct workpool *pool = job->pool;
+		struct workq *q = &pool->qv[(home - pool->qv + 1) % pool->qc];
+
+		pthread_mutex_lock(&q->mutex);
+		pthread_cond_signal(&q->cond);
+		pthread_mutex_unlock(&q->mutex);
+	}
+}
+
+
+/**
+ * Cancel a job. A queued job is removed from the queue, a running job is
+ * waited for. The job can be posted again afterwards.
+ *
+ * @param job Job to cancel
+ *
+ * @note Must not be called from the job handler
+ */
+void workpool_job_cancel(struct workpool_job *job)
+{
+	struct workq *home;
+
+	if (!job)
+		return;
+
+	home = job->home;
+
+	pthread_mutex_lock(&home->mutex);
+
+	__atomic_store_n(&job->stop, true, __ATOMIC_RELAXED);
+
+	if (job->state == JOB_QUEUED) {
+		list_unlink(&job->le);
+		job->state = JOB_IDLE;
+	}
+
+	while (job->state != JOB_IDLE)
+		pthread_cond_wait(&home->done, &home->mutex);
+
+	__atomic_store_n(&job->stop, false, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&home->mutex);
+}
+
+
+/**
+ * Check if a job is being cancelled. Long running job handlers should
+ * return early when this is true.
+ *
+ * @param job Job
+ *
+ * @return True if the job is being cancelled, otherwise false
+ */
+bool workpool_job_stopping(const struct workpool_job *job)
+{
+	return job ? __atomic_load_n(&job->stop, __ATOMIC_RELAXED) : false;
+}
+
+
+/**
+ * Get the worker pool of a job
+ *
+ * @param job Job
+ *
+ * @return Worker pool
+ */
+struct workpool *workpool_job_pool(const struct workpool_job *job)
+{
+	return job ? job->pool : NULL;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file workpool.h
+ * @brief Shared worker thread pool
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#ifndef UAWORKPOOL_H_INCLUDED
+#define UAWORKPOOL_H_INCLUDED
+
+#include "rsua-re/re.h"
+
+
+#ifndef UAMODAPI_USE		/* Internal API */
+
+struct workpool;
+struct workpool_job;
+
+/** Shared pools, media with different deadlines do not share a pool */
+enum workpool_shared_id {
+	WORKPOOL_AUDIO = 0,  /**< Audio decoders                          */
+	WORKPOOL_VIDEO,      /**< Video decoders, displays and converters */
+
+	WORKPOOL_SHARED_MAX
+};
+
+/**
+ * Job handler, called from one of the pool's worker threads
+ *
+ * @param arg Handler argument
+ */
+typedef void (workpool_h)(void *arg);
+
+int  workpool_alloc(struct workpool **poolp, uint32_t nthreads);
+int  workpool_shared(struct workpool **poolp, enum workpool_shared_id id);
+void workpool_shared_set_threads(enum workpool_shared_id id,
+				 uint32_t nthreads);
+uint32_t workpool_threads(const struct workpool *pool);
+int  workpool_debug(struct re_printf *pf, const struct workpool *pool);
+
+int  workpool_job_alloc(struct workpool_job **jobp, struct workpool *pool,
+			workpool_h *h, void *arg);
+void workpool_job_post(struct workpool_job *job);
+void workpool_job_cancel(struct workpool_job *job);
+bool workpool_job_stopping(const struct workpool_job *job);
+struct workpool *workpool_job_pool(const struct workpool_job *job);
+
+#endif /* ifndef UAMODAPI_USE */
+
+#endif /* UAWORKPOOL_H_INCLUDED */
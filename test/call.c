@@ -355,6 +355,8 @@ int test_call_answer(void)
 
 	f->behaviour = BEHAVIOUR_ANSWER;
 
+	call_setup_reset();
+
 	/* Make a call from A to B */
 	err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_OFF);
 	TEST_ERR(err);
@@ -373,6 +375,12 @@ int test_call_answer(void)
 	ASSERT_EQ(1, fix.b.n_established);
 	ASSERT_EQ(0, fix.b.n_closed);
 
+	/* the setup phases of both calls, only B was admitted */
+	ASSERT_TRUE(1 == call_setup_hist(CALL_PHASE_ADMIT)->count);
+	ASSERT_TRUE(2 == call_setup_hist(CALL_PHASE_ALLOC)->count);
+	ASSERT_TRUE(2 == call_setup_hist(CALL_PHASE_SDP)->count);
+	ASSERT_TRUE(2 == call_setup_hist(CALL_PHASE_ESTAB)->count);
+
  out:
 	fixture_close(f);
 
@@ -544,6 +552,32 @@ static bool linenum_are_sequential(const struct ua *ua)
 }
 
 
+/* verify that every call is found by line-number and call-id */
+static bool calls_are_indexed(const struct ua *ua, const struct ua *peer)
+{
+	struct le *le;
+
+	for (le = list_head(ua_calls(ua)) ; le ; le = le->next) {
+		struct call *call = le->data;
+		struct call *pcall;
+
+		pcall = call_find_linenum(ua_calls(ua), call_linenum(call));
+		if (pcall != call)
+			return false;
+
+		if (call != call_find_id(ua_calls(ua), call_id(call)))
+			return false;
+
+		/* both ends share the call-id, but not the call list */
+		pcall = call_find_id(ua_calls(peer), call_id(call));
+		if (!pcall || pcall == call)
+			return false;
+	}
+
+	return true;
+}
+
+
 int test_call_multiple(void)
 {
 	struct fixture fix, *f = &fix;
@@ -578,8 +612,10 @@ int test_call_multiple(void)
 
 	ASSERT_EQ(4, list_count(ua_calls(f->a.ua)));
 	ASSERT_EQ(4, list_count(ua_calls(f->b.ua)));
+	ASSERT_EQ(8, uag_call_count());
 	ASSERT_TRUE(linenum_are_sequential(f->a.ua));
 	ASSERT_TRUE(linenum_are_sequential(f->b.ua));
+	ASSERT_TRUE(calls_are_indexed(f->a.ua, f->b.ua));
 
 
 	/*
@@ -604,8 +640,11 @@ int test_call_multiple(void)
 
 	ASSERT_EQ(2, list_count(ua_calls(f->a.ua)));
 	ASSERT_EQ(2, list_count(ua_calls(f->b.ua)));
+	ASSERT_EQ(4, uag_call_count());
 	ASSERT_TRUE(linenum_are_sequential(f->a.ua));
 	ASSERT_TRUE(linenum_are_sequential(f->b.ua));
+	ASSERT_TRUE(calls_are_indexed(f->a.ua, f->b.ua));
+	ASSERT_TRUE(call_find_linenum(ua_calls(f->a.ua), 2) == NULL);
 
 
 	/*
@@ -626,6 +665,8 @@ int test_call_multiple(void)
 
 	ASSERT_EQ(4, list_count(ua_calls(f->a.ua)));
 	ASSERT_EQ(4, list_count(ua_calls(f->b.ua)));
+	ASSERT_TRUE(call_find_linenum(ua_calls(f->a.ua), 2) != NULL);
+	ASSERT_TRUE(calls_are_indexed(f->a.ua, f->b.ua));
 
  out:
 	fixture_close(f);
@@ -753,6 +794,7 @@ int test_call_video(void)
 	struct fixture fix, *f = &fix;
 	struct vidsrc *vidsrc = NULL;
 	struct vidisp *vidisp = NULL;
+	struct video_sendq_stats st;
 	int err = 0;
 
 	conf_config()->video.fps = 100;
@@ -786,6 +828,14 @@ int test_call_video(void)
 	ASSERT_TRUE(call_has_video(ua_call(f->a.ua)));
 	ASSERT_TRUE(call_has_video(ua_call(f->b.ua)));
 
+	/* the packets went through the transmit queue, none dropped */
+	err = video_sendq_stats(call_video(ua_call(f->a.ua)), &st);
+	TEST_ERR(err);
+	ASSERT_TRUE(st.packets > 0);
+	ASSERT_EQ(0, st.drops);
+	ASSERT_TRUE(st.max_depth > 0 && st.max_depth <= st.capacity);
+	ASSERT_TRUE(st.depth <= st.capacity);
+
  out:
 	fixture_close(f);
 	mem_deref(vidisp);
@@ -796,6 +846,680 @@ int test_call_video(void)
 }
 
 
+static struct tmr tmr_cc;
+
+
+/* stop when both sides have changed the encoder bitrate after a REMB */
+static void cc_poll_handler(void *arg)
+{
+	struct fixture *fix = arg;
+	struct video_cc_stats sta, stb;
+
+	if (!video_cc_stats(call_video(ua_call(fix->a.ua)), &sta) &&
+	    !video_cc_stats(call_video(ua_call(fix->b.ua)), &stb) &&
+	    sta.enc_updates && stb.enc_updates) {
+
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&tmr_cc, 10, cc_poll_handler, fix);
+}
+
+
+static bool attr_handler(const char *name, const char *value, void *arg)
+{
+	(void)name;
+
+	return NULL != strstr(value, arg);
+}
+
+
+static int cc_check(const struct call *call, uint32_t bitrate)
+{
+	const struct video *vid = call_video(call);
+	struct sdp_media *m = stream_sdpmedia(video_strm(vid));
+	struct video_cc_stats st;
+	int err;
+
+	/* the peer offered or answered REMB with abs-send-time */
+	ASSERT_TRUE(NULL != sdp_media_rattr_apply(m, "rtcp-fb", attr_handler,
+						  "goog-remb"));
+	ASSERT_TRUE(NULL != sdp_media_rattr_apply(m, "extmap", attr_handler,
+						  "abs-send-time"));
+
+	err = video_cc_stats(vid, &st);
+	TEST_ERR(err);
+
+	/* the estimate starts below the bitrate, the encoder follows it */
+	ASSERT_TRUE(st.estimate > 0);
+	ASSERT_TRUE(st.remb > 0);
+	ASSERT_TRUE(st.target > 0 && st.target < bitrate);
+	ASSERT_TRUE(st.enc_updates > 0);
+
+ out:
+	return err;
+}
+
+
+int test_call_video_cc(void)
+{
+	struct fixture fix, *f = &fix;
+	struct config_video vcfg = conf_config()->video;
+	struct vidsrc *vidsrc = NULL;
+	const uint32_t bitrate = 30000000;
+	int err = 0;
+
+	/* above the highest estimate, the first REMB lowers the target */
+	conf_config()->video.fps     = 100;
+	conf_config()->video.bitrate = bitrate;
+	conf_config()->video.cc      = true;
+
+	tmr_init(&tmr_cc);
+
+	fixture_init(f);
+
+	mock_vidcodec_register();
+	err = mock_vidsrc_register(&vidsrc);
+	TEST_ERR(err);
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+	f->estab_action = ACTION_NOTHING;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_ON);
+	TEST_ERR(err);
+
+	tmr_start(&tmr_cc, 10, cc_poll_handler, f);
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	ASSERT_TRUE(call_has_video(ua_call(f->a.ua)));
+	ASSERT_TRUE(call_has_video(ua_call(f->b.ua)));
+
+	err = cc_check(ua_call(f->a.ua), bitrate);
+	TEST_ERR(err);
+	err = cc_check(ua_call(f->b.ua), bitrate);
+	TEST_ERR(err);
+
+ out:
+	tmr_cancel(&tmr_cc);
+	fixture_close(f);
+	mem_deref(vidsrc);
+	mock_vidcodec_unregister();
+
+	conf_config()->video = vcfg;
+
+	return err;
+}
+
+
+/*
+ * B NACKs the last video packet of A. The packet is resent from the
+ * history of A, with the sequence number and SSRC it was first sent with.
+ */
+struct nack_test {
+	struct fixture *fix;
+	struct udp_helper *uh;
+	struct tmr tmr;
+	uint32_t ssrc;          /* SSRC of the packets sent by A   */
+	uint16_t seq;           /* last sequence number sent by A  */
+	unsigned n_sent;
+	bool nacked;
+	uint32_t resent_ssrc;
+	unsigned n_resent;
+};
+
+
+static bool nack_send_handler(int *err, struct sa *dst, struct mbuf *mb,
+			      void *arg)
+{
+	struct nack_test *nt = arg;
+	struct rtp_header hdr;
+	size_t pos = mb->pos;
+	(void)err;
+	(void)dst;
+
+	/* the RTP header is in the headroom of the payload */
+	if (rtp_hdr_decode(&hdr, mb) || rtp_pt_is_rtcp(hdr.pt))
+		goto out;
+
+	if (!nt->nacked) {
+		nt->ssrc = hdr.ssrc;
+		nt->seq  = hdr.seq;
+		++nt->n_sent;
+	}
+	else if (hdr.seq == nt->seq) {
+		nt->resent_ssrc = hdr.ssrc;
+		++nt->n_resent;
+		re_cancel();
+	}
+
+ out:
+	mb->pos = pos;
+
+	return false;  /* continue processing */
+}
+
+
+static int nack_encode_handler(struct mbuf *mb, void *arg)
+{
+	const uint16_t *seq = arg;
+	int err;
+
+	err  = mbuf_write_u16(mb, htons(*seq));
+	err |= mbuf_write_u16(mb, 0);
+
+	return err;
+}
+
+
+static void nack_poll_handler(void *arg)
+{
+	struct nack_test *nt = arg;
+	struct fixture *fix = nt->fix;
+	struct rtxbuf_stats st;
+	struct rtp_sock *rtp;
+	struct mbuf *mb;
+	int err;
+
+	if (video_rtx_stats(call_video(ua_call(fix->a.ua)), &st) ||
+	    !st.stored || !nt->n_sent || !fix->b.n_rtpestab) {
+
+		tmr_start(&nt->tmr, 10, nack_poll_handler, nt);
+		return;
+	}
+
+	rtp = stream_rtp_sock(video_strm(call_video(ua_call(fix->b.ua))));
+
+	mb = mbuf_alloc(64);
+	if (!mb) {
+		fixture_abort(fix, ENOMEM);
+		return;
+	}
+
+	err = rtcp_encode(mb, RTCP_RTPFB, RTCP_RTPFB_GNACK,
+			  rtp_sess_ssrc(rtp), nt->ssrc,
+			  nack_encode_handler, &nt->seq);
+	if (!err) {
+		mb->pos = 0;
+		nt->nacked = true;
+		err = rtcp_send(rtp, mb);
+	}
+
+	mem_deref(mb);
+
+	if (err)
+		fixture_abort(fix, err);
+}
+
+
+int test_call_video_nack(void)
+{
+	struct fixture fix, *f = &fix;
+	struct nack_test nt;
+	struct vidsrc *vidsrc = NULL;
+	struct rtxbuf_stats st;
+	struct rtp_sock *rtp;
+	int err = 0;
+
+	memset(&nt, 0, sizeof(nt));
+	tmr_init(&nt.tmr);
+
+	conf_config()->video.fps = 100;
+
+	fixture_init(f);
+
+	nt.fix = f;
+
+	mock_vidcodec_register();
+	err = mock_vidsrc_register(&vidsrc);
+	TEST_ERR(err);
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+	f->estab_action = ACTION_NOTHING;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_ON);
+	TEST_ERR(err);
+
+	/* see the packets of A before they are sent */
+	rtp = stream_rtp_sock(video_strm(call_video(ua_call(f->a.ua))));
+	ASSERT_TRUE(rtp != NULL);
+
+	err = udp_register_helper(&nt.uh, rtp_sock(rtp), 1000,
+				  nack_send_handler, NULL, &nt);
+	TEST_ERR(err);
+
+	tmr_start(&nt.tmr, 10, nack_poll_handler, &nt);
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	/* the NACKed packet was resent once, as it was first sent */
+	ASSERT_TRUE(nt.nacked);
+	ASSERT_EQ(1, nt.n_resent);
+	ASSERT_EQ(nt.ssrc, nt.resent_ssrc);
+	ASSERT_EQ(rtp_sess_ssrc(rtp), nt.resent_ssrc);
+
+	err = video_rtx_stats(call_video(ua_call(f->a.ua)), &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(1, st.nacked);
+	ASSERT_EQ(1, st.hits);
+	ASSERT_EQ(0, st.misses);
+
+ out:
+	tmr_cancel(&nt.tmr);
+	mem_deref(nt.uh);
+	fixture_close(f);
+	mem_deref(vidsrc);
+	mock_vidcodec_unregister();
+
+	return err;
+}
+
+
+/*
+ * A relays the video of B back to B, with a lost packet, a late packet
+ * and a change of the source. The relayed packets get the SSRC of A and
+ * sequence numbers and timestamps moved by one offset per source. The
+ * feedback about the relayed packets goes back to the source of B.
+ */
+enum {
+	RELAY_PKTS = 10,        /* packets of B taken for the relay        */
+	RELAY_SWITCH = 5,       /* first packet sent as another source     */
+	RELAY_REMB = 500000,    /* bitrate of the REMB passed on [bit/s]   */
+};
+
+struct relay_pkt {
+	uint16_t seq;
+	uint32_t ts;
+	uint32_t ssrc;
+	bool marker;
+};
+
+struct relay_test {
+	struct fixture *fix;
+	struct stream *strm;
+	struct udp_helper *uh_rtp;
+	struct udp_helper *uh_rtcp;
+	struct tmr tmr;
+	struct mbuf *held;          /* the packet sent late             */
+	struct rtp_header held_hdr;
+	unsigned n_recv;            /* packets of B received by A       */
+	unsigned n_in;
+	unsigned n_out;
+	struct relay_pkt inv[RELAY_PKTS];
+	struct relay_pkt outv[RELAY_PKTS];
+	uint32_t ssrc_src;          /* SSRC of the video of B           */
+	uint16_t nack_seq;          /* sequence number expected in NACK */
+	bool in_fb;                 /* the feedback is being passed on  */
+	int fb_err;
+	unsigned n_nack;
+	unsigned n_pli;
+	unsigned n_fir;
+	unsigned n_remb;
+	bool nack_ok;
+	bool remb_ok;
+};
+
+
+static bool relay_rtp_send_handler(int *err, struct sa *dst,
+				   struct mbuf *mb, void *arg)
+{
+	struct relay_test *rt = arg;
+	struct rtp_header hdr;
+	size_t pos = mb->pos;
+	(void)err;
+	(void)dst;
+
+	/* only the relayed packets, the encoder of A is not sending */
+	if (rt->n_out >= rt->n_in ||
+	    rtp_hdr_decode(&hdr, mb) || rtp_pt_is_rtcp(hdr.pt))
+		goto out;
+
+	rt->outv[rt->n_out].seq    = hdr.seq;
+	rt->outv[rt->n_out].ts     = hdr.ts;
+	rt->outv[rt->n_out].ssrc   = hdr.ssrc;
+	rt->outv[rt->n_out].marker = hdr.m;
+	++rt->n_out;
+
+ out:
+	mb->pos = pos;
+
+	return false;  /* continue processing */
+}
+
+
+static void relay_rtcp_msg(struct relay_test *rt, const struct rtcp_msg *msg)
+{
+	uint32_t bps;
+
+	switch (msg->hdr.pt) {
+
+	case RTCP_FIR:
+		++rt->n_fir;
+		break;
+
+	case RTCP_PSFB:
+		if (msg->hdr.count == RTCP_PSFB_PLI &&
+		    msg->r.fb.ssrc_media == rt->ssrc_src) {
+			++rt->n_pli;
+		}
+		else if (msg->hdr.count == RTCP_PSFB_AFB &&
+			 !bwe_remb_decode(&bps, msg->r.fb.fci.afb)) {
+			++rt->n_remb;
+			rt->remb_ok = bps == RELAY_REMB;
+		}
+		break;
+
+	case RTCP_RTPFB:
+		if (msg->hdr.count != RTCP_RTPFB_GNACK)
+			break;
+
+		++rt->n_nack;
+		rt->nack_ok = msg->r.fb.ssrc_media == rt->ssrc_src &&
+			msg->r.fb.n == 1 &&
+			msg->r.fb.fci.gnackv[0].pid == rt->nack_seq;
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static bool relay_rtcp_send_handler(int *err, struct sa *dst,
+				    struct mbuf *mb, void *arg)
+{
+	struct relay_test *rt = arg;
+	size_t pos = mb->pos;
+	(void)err;
+	(void)dst;
+
+	if (!rt->in_fb)
+		return false;
+
+	while (mbuf_get_left(mb) >= 4) {
+
+		struct rtcp_msg *msg = NULL;
+
+		if (rtcp_decode(&msg, mb))
+			break;
+
+		relay_rtcp_msg(rt, msg);
+		mem_deref(msg);
+	}
+
+	mb->pos = pos;
+
+	return false;  /* continue processing */
+}
+
+
+static void relay_send(struct relay_test *rt, const struct rtp_header *hdr,
+		       struct mbuf *mb)
+{
+	if (rt->n_in >= RELAY_PKTS)
+		return;
+
+	rt->inv[rt->n_in].seq  = hdr->seq;
+	rt->inv[rt->n_in].ts   = hdr->ts;
+	rt->inv[rt->n_in].ssrc = hdr->ssrc;
+	++rt->n_in;
+
+	(void)stream_relay_send(rt->strm, hdr, hdr->pt, mb);
+}
+
+
+/* the feedback of B about the relayed packet with index i */
+static void relay_feedback(struct relay_test *rt, unsigned i)
+{
+	const uint32_t ssrc = rtp_sess_ssrc(stream_rtp_sock(rt->strm));
+	struct rtcp_msg msg;
+	struct gnack gnack;
+	struct mbuf *mb;
+	int err;
+
+	memset(&msg, 0, sizeof(msg));
+
+	rt->in_fb = true;
+	rt->nack_seq = rt->inv[i].seq;
+
+	gnack.pid = rt->outv[i].seq;
+	gnack.blp = 0;
+
+	msg.hdr.pt          = RTCP_RTPFB;
+	msg.hdr.count       = RTCP_RTPFB_GNACK;
+	msg.r.fb.ssrc_media = ssrc;
+	msg.r.fb.n          = 1;
+	msg.r.fb.fci.gnackv = &gnack;
+	err = stream_relay_feedback(rt->strm, rt->strm, &msg);
+
+	msg.hdr.pt          = RTCP_PSFB;
+	msg.hdr.count       = RTCP_PSFB_PLI;
+	msg.r.fb.n          = 0;
+	msg.r.fb.fci.gnackv = NULL;
+	err |= stream_relay_feedback(rt->strm, rt->strm, &msg);
+
+	msg.hdr.pt          = RTCP_FIR;
+	msg.hdr.count       = 0;
+	err |= stream_relay_feedback(rt->strm, rt->strm, &msg);
+
+	mb = mbuf_alloc(32);
+	if (!mb) {
+		rt->in_fb  = false;
+		rt->fb_err = ENOMEM;
+		return;
+	}
+
+	err |= bwe_remb_encode(mb, RELAY_REMB, &ssrc, 1);
+	mb->pos = 0;
+
+	msg.hdr.pt          = RTCP_PSFB;
+	msg.hdr.count       = RTCP_PSFB_AFB;
+	msg.r.fb.ssrc_media = 0;
+	msg.r.fb.fci.afb    = mb;
+	err |= stream_relay_feedback(rt->strm, rt->strm, &msg);
+
+	mem_deref(mb);
+
+	rt->in_fb  = false;
+	rt->fb_err = err;
+}
+
+
+static void relay_test_handler(struct stream *strm,
+			       const struct rtp_header *hdr,
+			       struct mbuf *mb, void *arg)
+{
+	struct relay_test *rt = arg;
+	struct rtp_header hdr2;
+	(void)strm;
+
+	rt->ssrc_src = hdr->ssrc;
+
+	switch (rt->n_recv++) {
+
+	case 2:
+		/* lost */
+		break;
+
+	case 3:
+		relay_send(rt, hdr, mb);
+		relay_feedback(rt, 1);
+		break;
+
+	case 4:
+		/* sent after the next one */
+		rt->held_hdr = *hdr;
+		rt->held = mbuf_alloc(RTP_HEADER_SIZE + mbuf_get_left(mb));
+		if (!rt->held)
+			break;
+
+		rt->held->pos = RTP_HEADER_SIZE;
+		rt->held->end = RTP_HEADER_SIZE;
+		(void)mbuf_write_mem(rt->held, mbuf_buf(mb),
+				     mbuf_get_left(mb));
+		rt->held->pos = RTP_HEADER_SIZE;
+		break;
+
+	case 5:
+		relay_send(rt, hdr, mb);
+		if (rt->held)
+			relay_send(rt, &rt->held_hdr, rt->held);
+		break;
+
+	default:
+		if (rt->n_in < RELAY_SWITCH) {
+			relay_send(rt, hdr, mb);
+			break;
+		}
+
+		/* another source */
+		hdr2 = *hdr;
+		hdr2.ssrc = ~hdr->ssrc;
+		hdr2.seq  = hdr->seq + 1000;
+		hdr2.ts   = hdr->ts + 90000;
+
+		relay_send(rt, &hdr2, mb);
+
+		if (rt->n_in >= RELAY_PKTS)
+			re_cancel();
+		break;
+	}
+}
+
+
+static void relay_poll_handler(void *arg)
+{
+	struct relay_test *rt = arg;
+	struct fixture *fix = rt->fix;
+
+	if (!fix->a.n_rtpestab || !fix->b.n_rtpestab) {
+		tmr_start(&rt->tmr, 10, relay_poll_handler, rt);
+		return;
+	}
+
+	stream_set_relay(rt->strm, relay_test_handler, NULL, rt);
+}
+
+
+static int relay_check(const struct relay_test *rt)
+{
+	const struct relay_pkt *in = rt->inv, *out = rt->outv;
+	const uint32_t ssrc = rtp_sess_ssrc(stream_rtp_sock(rt->strm));
+	unsigned i;
+	int err = 0;
+
+	ASSERT_EQ(RELAY_PKTS, rt->n_in);
+	ASSERT_EQ(RELAY_PKTS, rt->n_out);
+
+	/* the first source keeps its gap and its late packet */
+	ASSERT_TRUE(out[0].marker);
+
+	for (i=0; i<RELAY_SWITCH; i++) {
+		ASSERT_EQ(ssrc, out[i].ssrc);
+		ASSERT_EQ((uint16_t)(in[i].seq - in[0].seq),
+			  (uint16_t)(out[i].seq - out[0].seq));
+		ASSERT_TRUE(in[i].ts - in[0].ts == out[i].ts - out[0].ts);
+	}
+
+	ASSERT_EQ((uint16_t)(out[1].seq + 2), out[2].seq);
+	ASSERT_EQ((uint16_t)(out[3].seq - 1), out[4].seq);
+
+	/* the next source continues after the highest packet, not after
+	   the late one */
+	ASSERT_TRUE(out[RELAY_SWITCH].marker);
+	ASSERT_EQ(ssrc, out[RELAY_SWITCH].ssrc);
+	ASSERT_EQ((uint16_t)(out[3].seq + 1), out[RELAY_SWITCH].seq);
+	ASSERT_TRUE(out[3].ts + 1 == out[RELAY_SWITCH].ts);
+
+	for (i=RELAY_SWITCH; i<RELAY_PKTS; i++) {
+		ASSERT_EQ(ssrc, out[i].ssrc);
+		ASSERT_EQ((uint16_t)(in[i].seq - in[RELAY_SWITCH].seq),
+			  (uint16_t)(out[i].seq - out[RELAY_SWITCH].seq));
+		ASSERT_TRUE(in[i].ts - in[RELAY_SWITCH].ts ==
+			    out[i].ts - out[RELAY_SWITCH].ts);
+	}
+
+	/* the feedback went to the source with its sequence numbers */
+	TEST_ERR(rt->fb_err);
+	ASSERT_EQ(1, rt->n_nack);
+	ASSERT_TRUE(rt->nack_ok);
+	ASSERT_EQ(1, rt->n_pli);
+	ASSERT_EQ(1, rt->n_fir);
+	ASSERT_EQ(1, rt->n_remb);
+	ASSERT_TRUE(rt->remb_ok);
+
+ out:
+	return err;
+}
+
+
+int test_call_video_relay(void)
+{
+	struct fixture fix, *f = &fix;
+	struct relay_test rt;
+	struct vidsrc *vidsrc = NULL;
+	struct rtp_sock *rtp;
+	int err = 0;
+
+	memset(&rt, 0, sizeof(rt));
+	tmr_init(&rt.tmr);
+
+	conf_config()->video.fps = 100;
+
+	fixture_init(f);
+
+	rt.fix = f;
+
+	mock_vidcodec_register();
+	err = mock_vidsrc_register(&vidsrc);
+	TEST_ERR(err);
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+	f->estab_action = ACTION_NOTHING;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_ON);
+	TEST_ERR(err);
+
+	/* see the packets and the feedback sent by A */
+	rt.strm = video_strm(call_video(ua_call(f->a.ua)));
+	rtp = stream_rtp_sock(rt.strm);
+	ASSERT_TRUE(rtp != NULL);
+
+	err  = udp_register_helper(&rt.uh_rtp, rtp_sock(rtp), 1000,
+				   relay_rtp_send_handler, NULL, &rt);
+	err |= udp_register_helper(&rt.uh_rtcp, rtcp_sock(rtp), 1000,
+				   relay_rtcp_send_handler, NULL, &rt);
+	TEST_ERR(err);
+
+	tmr_start(&rt.tmr, 10, relay_poll_handler, &rt);
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	err = relay_check(&rt);
+	TEST_ERR(err);
+
+ out:
+	stream_set_relay(rt.strm, NULL, NULL, NULL);
+	tmr_cancel(&rt.tmr);
+	mem_deref(rt.uh_rtcp);
+	mem_deref(rt.uh_rtp);
+	mem_deref(rt.held);
+	fixture_close(f);
+	mem_deref(vidsrc);
+	mock_vidcodec_unregister();
+
+	return err;
+}
+
+
 static void mock_sample_handler(const void *sampv, size_t sampc, void *arg)
 {
 	struct fixture *fix = arg;
@@ -965,6 +1689,10 @@ static int test_media_base(enum audio_mode txmode)
 	ASSERT_EQ(1, fix.b.n_established);
 	ASSERT_EQ(0, fix.b.n_closed);
 
+	/* sample format conversion must not allocate in the hot path */
+	ASSERT_EQ(0, audio_rt_alloc_count(call_audio(ua_call(f->a.ua))));
+	ASSERT_EQ(0, audio_rt_alloc_count(call_audio(ua_call(f->b.ua))));
+
  out:
 	conf_config()->audio.src_fmt = AUFMT_S16LE;
 	conf_config()->audio.play_fmt = AUFMT_S16LE;
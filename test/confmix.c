@@ -0,0 +1,231 @@
+/**
+ * @file test/confmix.c  Baresip selftest -- audio conference mixer
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338328
+#endif
+
+
+enum {
+	SRATE = 48000,
+	PTIME = 20,
+	N_PARTS = 4,
+	PERF_TICKS = 100,
+};
+
+struct part {
+	struct confmix_part *part;
+	int16_t in;          /* constant input sample, or 0 for a sine */
+	unsigned freq;       /* sine frequency [Hz]                    */
+	uint32_t phase;
+	int16_t out;         /* last output sample                     */
+	size_t out_sampc;
+	uint64_t ts;
+	unsigned n_out;
+};
+
+
+static void read_handler(void *sampv, size_t sampc, void *arg)
+{
+	struct part *p = arg;
+	int16_t *v = sampv;
+	size_t i;
+
+	if (!p->freq) {
+		for (i=0; i<sampc; i++)
+			v[i] = p->in;
+		return;
+	}
+
+	/* stereo sine, like ausine */
+	for (i=0; i<sampc; i += 2) {
+		v[i] = v[i+1] = (int16_t)(16383 *
+				 sin(2 * M_PI * p->freq * p->phase / SRATE));
+		p->phase = (p->phase + 1) % SRATE;
+	}
+}
+
+
+static void write_handler(struct auframe *af, void *arg)
+{
+	struct part *p = arg;
+	const int16_t *v = af->sampv;
+
+	p->out       = v[af->sampc - 1];
+	p->out_sampc = af->sampc;
+	p->ts        = af->timestamp;
+	++p->n_out;
+}
+
+
+int test_confmix(void)
+{
+	static const int16_t inv[N_PARTS] = {8000, 4000, 0, 30000};
+	struct part partv[N_PARTS];
+	struct confmix *mix = NULL;
+	struct confmix_stats st;
+	unsigned i;
+	int err = 0;
+
+	memset(partv, 0, sizeof(partv));
+
+	err = confmix_alloc(&mix, SRATE, PTIME, 2, -60);
+	TEST_ERR(err);
+
+	for (i=0; i<N_PARTS; i++) {
+
+		struct part *p = &partv[i];
+
+		p->in = inv[i];
+
+		err = confmix_part_alloc(&p->part, mix);
+		TEST_ERR(err);
+
+		/* the last participant only listens */
+		if (i < N_PARTS - 1) {
+			err = confmix_part_set_input(p->part, SRATE, 1,
+						     read_handler, p);
+			TEST_ERR(err);
+		}
+
+		err = confmix_part_set_output(p->part, SRATE, 1,
+					      write_handler, p);
+		TEST_ERR(err);
+	}
+
+	confmix_process(mix, 1000);
+
+	/* the speakers hear each other, the others hear both speakers */
+	ASSERT_TRUE(confmix_part_speaking(partv[0].part));
+	ASSERT_TRUE(confmix_part_speaking(partv[1].part));
+	ASSERT_TRUE(!confmix_part_speaking(partv[2].part));
+	ASSERT_TRUE(!confmix_part_speaking(partv[3].part));
+
+	ASSERT_EQ(4000, partv[0].out);
+	ASSERT_EQ(8000, partv[1].out);
+	ASSERT_EQ(12000, partv[2].out);
+	ASSERT_EQ(12000, partv[3].out);
+	ASSERT_EQ(SRATE * PTIME / 1000, partv[3].out_sampc);
+	ASSERT_TRUE(1000 == partv[3].ts);
+
+	/* a loud speaker replaces a softer one, the mix saturates */
+	err = confmix_part_set_input(partv[3].part, SRATE, 1,
+				     read_handler, &partv[3]);
+	TEST_ERR(err);
+
+	confmix_process(mix, 2000);
+
+	ASSERT_TRUE(confmix_part_speaking(partv[3].part));
+	ASSERT_TRUE(!confmix_part_speaking(partv[1].part));
+	ASSERT_EQ(30000, partv[0].out);
+	ASSERT_EQ(32767, partv[1].out);
+	ASSERT_EQ(8000, partv[3].out);
+
+	/* resampled output */
+	err = confmix_part_set_output(partv[2].part, 16000, 2,
+				      write_handler, &partv[2]);
+	TEST_ERR(err);
+
+	confmix_process(mix, 3000);
+
+	ASSERT_EQ(16000 * 2 * PTIME / 1000, partv[2].out_sampc);
+
+	err = confmix_stats(mix, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(N_PARTS, st.parts);
+	ASSERT_TRUE(3 == st.ticks);
+	ASSERT_TRUE(6 == st.speakers);
+
+ out:
+	for (i=0; i<N_PARTS; i++)
+		mem_deref(partv[i].part);
+	mem_deref(mix);
+
+	return err;
+}
+
+
+static int perf_confmix(unsigned n)
+{
+	struct part *partv;
+	struct confmix *mix = NULL;
+	struct confmix_stats st;
+	unsigned i;
+	int err;
+
+	partv = mem_zalloc(n * sizeof(*partv), NULL);
+	if (!partv)
+		return ENOMEM;
+
+	err = confmix_alloc(&mix, SRATE, PTIME, 3, -50);
+	if (err)
+		goto out;
+
+	for (i=0; i<n; i++) {
+
+		struct part *p = &partv[i];
+
+		p->freq = 200 + 10 * i;
+
+		err = confmix_part_alloc(&p->part, mix);
+		if (err)
+			goto out;
+
+		err |= confmix_part_set_input(p->part, SRATE, 2,
+					      read_handler, p);
+		err |= confmix_part_set_output(p->part, SRATE, 2,
+					       write_handler, p);
+		if (err)
+			goto out;
+	}
+
+	for (i=0; i<PERF_TICKS; i++)
+		confmix_process(mix, i * PTIME * 1000);
+
+	err = confmix_stats(mix, &st);
+	if (err)
+		goto out;
+
+	re_printf("  %4u participants: %6llu us per %u ms (max %llu us)\n",
+		  n, st.tick_usec / st.ticks, PTIME, st.tick_max);
+
+ out:
+	for (i=0; i<n; i++)
+		mem_deref(partv[i].part);
+	mem_deref(mix);
+	mem_deref(partv);
+
+	return err;
+}
+
+
+int test_perf_confmix(void)
+{
+	static const unsigned nv[] = {10, 100, 500};
+	size_t i;
+	int err = 0;
+
+	re_printf("confmix: %u Hz stereo sines, 3 active speakers\n",
+		  SRATE);
+
+	for (i=0; i<ARRAY_SIZE(nv); i++) {
+
+		err = perf_confmix(nv[i]);
+		if (err)
+			break;
+	}
+
+	return err;
+}
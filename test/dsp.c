@@ -0,0 +1,248 @@
+/**
+ * @file test/dsp.c  Baresip selftest -- audio DSP kernels
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "dsp"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	N_SAMP = 1003,     /* odd, to exercise the scalar tails */
+	N_PERF = 960,      /* 20ms stereo at 24000 Hz           */
+};
+
+struct dsp_bufs {
+	int16_t s16[N_SAMP];
+	float flt[N_SAMP];
+	int16_t s16_out[N_SAMP];
+	int16_t s16_ref[N_SAMP];
+	float flt_out[N_SAMP];
+	float flt_ref[N_SAMP];
+	uint8_t s24_out[3 * N_SAMP];
+	uint8_t s24_ref[3 * N_SAMP];
+	int32_t acc[N_SAMP];
+	int32_t acc_ref[N_SAMP];
+};
+
+
+static void fill_bufs(struct dsp_bufs *b)
+{
+	size_t i;
+
+	for (i=0; i<N_SAMP; i++) {
+		b->s16[i] = (int16_t)rand_u16();
+		b->flt[i] = (float)((int32_t)rand_u32() / 1800000000.0);
+	}
+
+	/* edge cases */
+	b->s16[3] = -32768;
+	b->s16[4] = 32767;
+	b->flt[5] = -1.0f;
+	b->flt[6] = 1.0f;
+	b->flt[7] = 1.0f / 65536;
+	b->flt[8] = -1.0f / 65536;
+}
+
+
+static int check_kernel(const struct dsp_kernel *k,
+			const struct dsp_kernel *ref, struct dsp_bufs *b)
+{
+	size_t n, i;
+	int err = 0;
+
+	for (n=0; n<=N_SAMP; n += n < 40 ? 1 : 97) {
+
+		double sq, sq_ref;
+
+		ASSERT_TRUE(ref->sumsq_s16(b->s16, n) ==
+			    k->sumsq_s16(b->s16, n));
+		ASSERT_EQ(ref->peak_s16(b->s16, n), k->peak_s16(b->s16, n));
+		ASSERT_TRUE(ref->peak_float(b->flt, n) ==
+			    k->peak_float(b->flt, n));
+
+		sq     = k->sumsq_float(b->flt, n);
+		sq_ref = ref->sumsq_float(b->flt, n);
+		ASSERT_TRUE(fabs(sq - sq_ref) <= 1e-9 * sq_ref);
+
+		k->float_to_s16(b->s16_out, b->flt, n);
+		ref->float_to_s16(b->s16_ref, b->flt, n);
+		TEST_MEMCMP(b->s16_ref, n * 2, b->s16_out, n * 2);
+
+		k->s16_to_float(b->flt_out, b->s16, n);
+		ref->s16_to_float(b->flt_ref, b->s16, n);
+		TEST_MEMCMP(b->flt_ref, n * 4, b->flt_out, n * 4);
+
+		k->s16_to_s24(b->s24_out, b->s16, n);
+		ref->s16_to_s24(b->s24_ref, b->s16, n);
+		TEST_MEMCMP(b->s24_ref, n * 3, b->s24_out, n * 3);
+
+		k->s24_to_s16(b->s16_out, b->s24_out, n);
+		TEST_MEMCMP(b->s16, n * 2, b->s16_out, n * 2);
+
+		/* three speakers, so that the mix saturates */
+		memset(b->acc, 0, sizeof(b->acc));
+		memset(b->acc_ref, 0, sizeof(b->acc_ref));
+		for (i=0; i<3; i++) {
+			k->mix_add_s16(b->acc, b->s16, n);
+			ref->mix_add_s16(b->acc_ref, b->s16, n);
+		}
+		TEST_MEMCMP(b->acc_ref, n * 4, b->acc, n * 4);
+
+		k->mix_out_s16(b->s16_out, b->acc, b->s16, n);
+		ref->mix_out_s16(b->s16_ref, b->acc, b->s16, n);
+		TEST_MEMCMP(b->s16_ref, n * 2, b->s16_out, n * 2);
+	}
+
+ out:
+	if (err)
+		warning("test: dsp kernel %s differs from %s\n",
+			k->name, ref->name);
+
+	return err;
+}
+
+
+int test_dsp(void)
+{
+	static const int16_t loud[4] = {-32768, -32768, -32768, -32768};
+	static const float flt[4] = {0.5f, -0.5f, 2.0f, -2.0f};
+	static const int16_t own[4] = {0, 0, 50, -1};
+	int32_t acc[4] = {40000, -40000, 0, 0};
+	const struct dsp_kernel *k, *ref = NULL;
+	struct dsp_bufs *b;
+	int16_t s16[4];
+	size_t i;
+	int err = 0;
+
+	b = mem_zalloc(sizeof(*b), NULL);
+	if (!b)
+		return ENOMEM;
+
+	fill_bufs(b);
+
+	/* the scalar kernel is the last one */
+	for (i=0; (k = dsp_kernel_get(i)); i++)
+		ref = k;
+
+	ASSERT_TRUE(ref != NULL);
+	ASSERT_TRUE(dsp_kernel() == dsp_kernel_get(0));
+
+	for (i=0; (k = dsp_kernel_get(i)); i++) {
+
+		err = check_kernel(k, ref, b);
+		TEST_ERR(err);
+	}
+
+	/* known values, using the kernel in use */
+	ASSERT_TRUE(4ULL * 32768 * 32768 == dsp_sumsq_s16(loud, 4));
+	ASSERT_EQ(32768, dsp_peak_s16(loud, 4));
+	ASSERT_TRUE(2.0f == dsp_peak_float(flt, 4));
+	ASSERT_EQ(0, dsp_sumsq_s16(NULL, 4));
+
+	dsp_to_s16(s16, AUFMT_FLOAT, flt, 4);
+	ASSERT_EQ(16384, s16[0]);
+	ASSERT_EQ(-16384, s16[1]);
+	ASSERT_EQ(32767, s16[2]);
+	ASSERT_EQ(-32768, s16[3]);
+
+	dsp_mix_add_s16(acc, own, 4);
+	ASSERT_EQ(50, acc[2]);
+	dsp_mix_add_s16(&acc[2], &own[2], 1);
+	dsp_mix_out_s16(s16, acc, own, 4);
+	ASSERT_EQ(32767, s16[0]);
+	ASSERT_EQ(-32768, s16[1]);
+	ASSERT_EQ(50, s16[2]);
+	ASSERT_EQ(0, s16[3]);
+
+ out:
+	mem_deref(b);
+
+	return err;
+}
+
+
+static double msamp_per_sec(uint64_t n, uint64_t usec)
+{
+	return usec ? (double)n / (double)usec : 0;
+}
+
+
+int test_perf_dsp(void)
+{
+	const struct dsp_kernel *k;
+	struct dsp_bufs *b;
+	const unsigned rounds = 20000;
+	uint64_t n = (uint64_t)rounds * N_PERF;
+	volatile uint64_t sink = 0;
+	size_t i;
+	int err = 0;
+
+	b = mem_zalloc(sizeof(*b), NULL);
+	if (!b)
+		return ENOMEM;
+
+	fill_bufs(b);
+
+	re_printf("dsp kernels [Msamples/s]:\n"
+		  "  %-6s %8s %8s %8s %8s %8s %8s\n",
+		  "kernel", "sumsq", "peak", "s16>flt", "flt>s16",
+		  "s16>s24", "s24>s16");
+
+	for (i=0; (k = dsp_kernel_get(i)); i++) {
+
+		uint64_t t[7];
+		unsigned r;
+
+		t[0] = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++)
+			sink += k->sumsq_s16(b->s16, N_PERF);
+
+		t[1] = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++)
+			sink += k->peak_s16(b->s16, N_PERF);
+
+		t[2] = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++)
+			k->s16_to_float(b->flt_out, b->s16, N_PERF);
+
+		t[3] = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++)
+			k->float_to_s16(b->s16_out, b->flt, N_PERF);
+
+		t[4] = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++)
+			k->s16_to_s24(b->s24_out, b->s16, N_PERF);
+
+		t[5] = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++)
+			k->s24_to_s16(b->s16_out, b->s24_out, N_PERF);
+
+		t[6] = tmr_jiffies_usec();
+
+		re_printf("  %-6s %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f\n",
+			  k->name,
+			  msamp_per_sec(n, t[1] - t[0]),
+			  msamp_per_sec(n, t[2] - t[1]),
+			  msamp_per_sec(n, t[3] - t[2]),
+			  msamp_per_sec(n, t[4] - t[3]),
+			  msamp_per_sec(n, t[5] - t[4]),
+			  msamp_per_sec(n, t[6] - t[5]));
+	}
+
+	(void)sink;
+
+	mem_deref(b);
+
+	return err;
+}
@@ -53,3 +53,123 @@ int test_event(void)
 
 	return err;
 }
+
+
+static struct {
+	unsigned n_legacy;
+	unsigned n_rec;
+	char *json;
+	char *json_dict;
+	int err;
+} evbus;
+
+
+static void legacy_handler(struct ua *ua, enum ua_event ev,
+			   struct call *call, const char *prm, void *arg)
+{
+	(void)ua;
+	(void)ev;
+	(void)call;
+	(void)prm;
+	(void)arg;
+
+	++evbus.n_legacy;
+}
+
+
+static void rec_handler(struct ua_event_rec *rec, void *arg)
+{
+	const struct odict *od = NULL;
+	char *json = NULL;
+	int err;
+	(void)arg;
+
+	++evbus.n_rec;
+
+	evbus.json      = mem_deref(evbus.json);
+	evbus.json_dict = mem_deref(evbus.json_dict);
+
+	/* the second encoding is from the cache */
+	err  = re_sdprintf(&json, "{%H}", ua_event_rec_encode, rec);
+	err |= re_sdprintf(&evbus.json, "{%H}", ua_event_rec_encode, rec);
+	err |= ua_event_rec_dict(rec, &od);
+	if (err)
+		goto out;
+
+	err = re_sdprintf(&evbus.json_dict, "%H", json_encode_odict, od);
+	if (err)
+		goto out;
+
+	if (str_cmp(json, evbus.json))
+		err = EBADMSG;
+
+ out:
+	mem_deref(json);
+	evbus.err |= err;
+}
+
+
+int test_event_bus(void)
+{
+	char prm[200];
+	uint32_t classes;
+	struct pl pl;
+	int err = 0;
+
+	memset(&evbus, 0, sizeof(evbus));
+
+	pl_set_str(&pl, "register, call");
+	err = uag_event_class_decode(&classes, &pl);
+	TEST_ERR(err);
+	ASSERT_EQ(UA_EVCLASS_REGISTER | UA_EVCLASS_CALL, classes);
+
+	pl_set_str(&pl, "all");
+	err = uag_event_class_decode(&classes, &pl);
+	TEST_ERR(err);
+	ASSERT_EQ(UA_EVCLASS_ALL, classes);
+
+	pl_set_str(&pl, "register,bogus");
+	ASSERT_EQ(EINVAL, uag_event_class_decode(&classes, &pl));
+
+	err  = uag_event_register(legacy_handler, NULL);
+	err |= uag_event_subscribe(UA_EVCLASS_REGISTER, rec_handler, NULL);
+	TEST_ERR(err);
+
+	/* events of other classes are not delivered */
+	ua_event(NULL, UA_EVENT_SHUTDOWN, NULL, NULL);
+	ASSERT_EQ(1, evbus.n_legacy);
+	ASSERT_EQ(0, evbus.n_rec);
+
+	/* the JSON is the same as from the dictionary */
+	ua_event(NULL, UA_EVENT_REGISTER_FAIL, NULL, "%s",
+		 "408 \"Request\\Timeout\"\n");
+	TEST_ERR(evbus.err);
+	ASSERT_EQ(2, evbus.n_legacy);
+	ASSERT_EQ(1, evbus.n_rec);
+	ASSERT_STREQ(evbus.json_dict, evbus.json);
+
+	/* escaped JSON larger than the stack buffer */
+	memset(prm, 0x01, sizeof(prm) - 1);
+	prm[sizeof(prm) - 1] = '\0';
+
+	ua_event(NULL, UA_EVENT_REGISTER_OK, NULL, "%s", prm);
+	TEST_ERR(evbus.err);
+	ASSERT_EQ(2, evbus.n_rec);
+	ASSERT_TRUE(str_len(evbus.json) > 1024);
+	ASSERT_STREQ(evbus.json_dict, evbus.json);
+
+	/* nothing is formatted without handlers */
+	uag_event_unregister(legacy_handler);
+	uag_event_unsubscribe(rec_handler);
+
+	ua_event(NULL, UA_EVENT_REGISTER_OK, NULL, NULL);
+	ASSERT_EQ(2, evbus.n_rec);
+
+ out:
+	uag_event_unregister(legacy_handler);
+	uag_event_unsubscribe(rec_handler);
+	mem_deref(evbus.json);
+	mem_deref(evbus.json_dict);
+
+	return err;
+}
@@ -4,12 +4,248 @@
  * Copyright (C) 2020 Alfred E. Heggestad
  */
 
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
 
+enum {
+	MAX_NALS = 32,
+	STREAM_SIZE = 1 << 18,
+	PERF_SIZE = 1 << 20,
+};
+
+/* byte stream with the NAL units it was made of */
+struct stream {
+	uint8_t buf[STREAM_SIZE];
+	size_t len;
+	size_t nal_pos[MAX_NALS];
+	size_t nal_len[MAX_NALS];
+	unsigned nalc;
+};
+
+/* NAL units reassembled from the packets */
+struct depack {
+	uint8_t buf[STREAM_SIZE];
+	size_t len;
+	size_t nal_pos[MAX_NALS];
+	unsigned nalc;
+	unsigned pktc;
+	unsigned markerc;
+	bool marker_last;
+	size_t pld_max;
+	int err;
+};
+
+
+/*
+ * Make a byte stream of random NAL units, with emulation prevention, so
+ * that the only start codes are the ones between the NAL units. Zero bytes
+ * are frequent, to exercise the scanners.
+ */
+static void stream_make(struct stream *st, unsigned nalc, size_t len_max)
+{
+	unsigned i;
+
+	st->len  = 0;
+	st->nalc = nalc;
+
+	for (i=0; i<nalc; i++) {
+
+		size_t len = rand_u32() % len_max;
+		unsigned zeros = 0;
+		uint8_t *p;
+
+		/* the first start code is long sometimes */
+		if (i == 0 && rand_u16() & 1)
+			st->buf[st->len++] = 0;
+
+		st->buf[st->len++] = 0;
+		st->buf[st->len++] = 0;
+		st->buf[st->len++] = 1;
+
+		st->nal_pos[i] = st->len;
+		p = &st->buf[st->len++];
+		*p = (rand_u16() & 0x60) | (1 + rand_u16() % 23);
+
+		while (len--) {
+			uint8_t v = (rand_u16() & 3) ? (uint8_t)rand_u16() : 0;
+
+			if (zeros >= 2 && v <= 3) {
+				st->buf[st->len++] = 3;
+				zeros = 0;
+			}
+
+			st->buf[st->len++] = v;
+			zeros = v ? 0 : zeros + 1;
+		}
+
+		/* a NAL unit does not end with a zero byte */
+		if (zeros)
+			st->buf[st->len++] = 0x80;
+
+		st->nal_len[i] = st->len - st->nal_pos[i];
+	}
+}
+
+
+static const uint8_t *find_startcode_naive(const uint8_t *p,
+					   const uint8_t *end)
+{
+	for (; p + 3 < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	return end;
+}
+
+
+static int depack_handler(bool marker, uint64_t rtp_ts,
+			  const uint8_t *hdr, size_t hdr_len,
+			  const uint8_t *pld, size_t pld_len,
+			  void *arg)
+{
+	struct depack *dp = arg;
+	(void)rtp_ts;
+
+	++dp->pktc;
+	dp->markerc += marker;
+	dp->marker_last = marker;
+	dp->pld_max = max(dp->pld_max, hdr_len + pld_len);
+
+	if (dp->len + pld_len + 1 > sizeof(dp->buf) || dp->nalc >= MAX_NALS) {
+		dp->err = EOVERFLOW;
+		return dp->err;
+	}
+
+	if (hdr_len == 1) {
+		dp->nal_pos[dp->nalc++] = dp->len;
+		dp->buf[dp->len++] = hdr[0];
+	}
+	else if (hdr_len == 2 && (hdr[0] & 0x1f) == H264_NALU_FU_A) {
+
+		if (hdr[1] & 0x80) {
+			dp->nal_pos[dp->nalc++] = dp->len;
+			dp->buf[dp->len++] = (hdr[0] & 0xe0) | (hdr[1] & 0x1f);
+		}
+	}
+	else {
+		dp->err = EPROTO;
+		return dp->err;
+	}
+
+	memcpy(&dp->buf[dp->len], pld, pld_len);
+	dp->len += pld_len;
+
+	return 0;
+}
+
+
+static int test_h264_startcode(struct stream *st)
+{
+	const struct h264_scanner *sc;
+	size_t i;
+	int err = 0;
+
+	for (i=0; (sc = h264_scanner_get(i)); i++) {
+
+		const uint8_t *end = st->buf + st->len;
+		size_t pos;
+
+		for (pos=0; pos < st->len; pos += 1 + rand_u16() % 61) {
+
+			const uint8_t *p   = st->buf + pos;
+			const uint8_t *e   = end - rand_u16() % 4;
+
+			ASSERT_TRUE(find_startcode_naive(p, e) ==
+				    sc->find(p, e));
+		}
+	}
+
+ out:
+	if (err)
+		warning("test: h264 scanner %s is wrong\n", sc->name);
+
+	return err;
+}
+
+
+static int test_h264_packetize(struct stream *st)
+{
+	struct depack *dp;
+	unsigned i;
+	int err = 0;
+
+	dp = mem_zalloc(sizeof(*dp), NULL);
+	if (!dp)
+		return ENOMEM;
+
+	for (i=0; i<8; i++) {
+
+		const size_t pktsize = 3 + rand_u16() % 1400;
+		unsigned j;
+
+		memset(dp, 0, sizeof(*dp));
+
+		err = h264_packetize(0, st->buf, st->len, pktsize,
+				     depack_handler, dp);
+		TEST_ERR(err);
+		TEST_ERR(dp->err);
+
+		ASSERT_EQ(st->nalc, dp->nalc);
+		ASSERT_EQ(1, dp->markerc);
+		ASSERT_TRUE(dp->marker_last);
+		ASSERT_TRUE(dp->pld_max <= pktsize + 1);
+
+		for (j=0; j<st->nalc; j++) {
+			size_t end = j + 1 < dp->nalc ?
+				dp->nal_pos[j + 1] : dp->len;
+
+			TEST_MEMCMP(&st->buf[st->nal_pos[j]], st->nal_len[j],
+				    &dp->buf[dp->nal_pos[j]],
+				    end - dp->nal_pos[j]);
+		}
+	}
+
+ out:
+	mem_deref(dp);
+
+	return err;
+}
+
+
+static int test_h264_stream(void)
+{
+	struct stream *st;
+	unsigned i;
+	int err = 0;
+
+	st = mem_zalloc(sizeof(*st), NULL);
+	if (!st)
+		return ENOMEM;
+
+	for (i=0; i<50; i++) {
+
+		stream_make(st, 1 + rand_u16() % MAX_NALS,
+			    i & 1 ? 4000 : 100);
+
+		err = test_h264_startcode(st);
+		TEST_ERR(err);
+
+		err = test_h264_packetize(st);
+		TEST_ERR(err);
+	}
+
+ out:
+	mem_deref(st);
+
+	return err;
+}
+
+
 int test_h264(void)
 {
 	struct h264_nal_header hdr, hdr2;
@@ -49,7 +285,93 @@ int test_h264(void)
 	ASSERT_TRUE( h264_is_keyframe(H264_NALU_IDR_SLICE));
 	ASSERT_TRUE(!h264_is_keyframe(H264_NALU_SLICE));
 
+	err = test_h264_stream();
+	TEST_ERR(err);
+
  out:
 	mem_deref(mb);
 	return err;
 }
+
+
+static int count_handler(bool marker, uint64_t rtp_ts,
+			 const uint8_t *hdr, size_t hdr_len,
+			 const uint8_t *pld, size_t pld_len,
+			 void *arg)
+{
+	size_t *n = arg;
+	(void)marker;
+	(void)rtp_ts;
+	(void)hdr;
+	(void)pld;
+
+	*n += hdr_len + pld_len;
+
+	return 0;
+}
+
+
+static double mbyte_per_sec(uint64_t n, uint64_t usec)
+{
+	return usec ? (double)n / (double)usec : 0;
+}
+
+
+int test_perf_h264(void)
+{
+	const struct h264_scanner *sc;
+	const unsigned rounds = 200;
+	uint8_t *buf;
+	uint64_t t0, t1;
+	size_t len = 0, i, n = 0;
+	unsigned r;
+	int err = 0;
+
+	buf = mem_alloc(PERF_SIZE, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	/* 1 kB slices of encoder-like data */
+	while (len + 1024 <= PERF_SIZE) {
+
+		buf[len++] = 0;
+		buf[len++] = 0;
+		buf[len++] = 1;
+		buf[len++] = H264_NALU_SLICE;
+
+		for (i=0; i<1020; i++)
+			buf[len++] = 4 | (uint8_t)rand_u16();
+	}
+
+	re_printf("h264: %zu kB access unit [MB/s]\n", len / 1024);
+
+	for (i=0; (sc = h264_scanner_get(i)); i++) {
+
+		t0 = tmr_jiffies_usec();
+		for (r=0; r<rounds; r++) {
+
+			const uint8_t *p = buf, *end = buf + len;
+
+			while ((p = sc->find(p, end)) < end) {
+				p += 3;
+				++n;
+			}
+		}
+		t1 = tmr_jiffies_usec();
+
+		re_printf("  scan %-6s %8.0f\n", sc->name,
+			  mbyte_per_sec((uint64_t)rounds * len, t1 - t0));
+	}
+
+	t0 = tmr_jiffies_usec();
+	for (r=0; r<rounds; r++)
+		err |= h264_packetize(0, buf, len, 1200, count_handler, &n);
+	t1 = tmr_jiffies_usec();
+
+	re_printf("  packetize   %8.0f\n",
+		  mbyte_per_sec((uint64_t)rounds * len, t1 - t0));
+
+	mem_deref(buf);
+
+	return err;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file test/lathist.c  Baresip selftest -- latency histogram
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+int test_lathist(void)
+{
+	struct lathist h;
+	struct odict *od = NULL;
+	const struct odict_entry *e;
+	uint64_t val, p;
+	unsigned i;
+	int err = 0;
+
+	lathist_reset(&h);
+
+	ASSERT_TRUE(0 == lathist_percentile(&h, 50));
+	ASSERT_TRUE(0 == lathist_mean(&h));
+
+	/* small values are exact */
+	for (i=1; i<=10; i++)
+		lathist_add(&h, i);
+
+	ASSERT_TRUE(10 == h.count);
+	ASSERT_TRUE(1 == h.min);
+	ASSERT_TRUE(10 == h.max);
+	ASSERT_TRUE(5 == lathist_mean(&h));
+	ASSERT_TRUE(5 == lathist_percentile(&h, 50));
+	ASSERT_TRUE(9 == lathist_percentile(&h, 90));
+	ASSERT_TRUE(10 == lathist_percentile(&h, 99));
+	ASSERT_TRUE(1 == lathist_percentile(&h, 0));
+
+	/* large values within the relative error */
+	for (val = 17; val < (1ULL << 36); val = val * 3 + 1) {
+
+		lathist_reset(&h);
+		lathist_add(&h, val);
+		lathist_add(&h, val * 2);
+
+		p = lathist_percentile(&h, 50);
+		ASSERT_TRUE(p >= val);
+		ASSERT_TRUE(p - val <= val / 16);
+		ASSERT_TRUE(val * 2 == lathist_percentile(&h, 100));
+	}
+
+	/* a rare outlier shows in the tail only */
+	lathist_reset(&h);
+	for (i=0; i<1000; i++)
+		lathist_add(&h, i < 995 ? 1000 : 1000000);
+
+	ASSERT_TRUE(lathist_percentile(&h, 99) <= 1000 + 1000 / 16);
+	ASSERT_TRUE(1000000 == lathist_percentile(&h, 99.9));
+
+	err = odict_alloc(&od, 8);
+	TEST_ERR(err);
+
+	err = lathist_encode_dict(od, &h);
+	TEST_ERR(err);
+
+	e = odict_lookup(od, "max");
+	ASSERT_TRUE(e != NULL);
+	ASSERT_EQ(ODICT_INT, e->type);
+	ASSERT_TRUE(1000000 == e->u.integer);
+
+ out:
+	mem_deref(od);
+
+	return err;
+}
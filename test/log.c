@@ -0,0 +1,230 @@
+/**
+ * @file test/log.c  Baresip selftest -- logging
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	N_THREADS = 4,
+	N_MSGS = 200,
+	N_BUSY = 5000,
+};
+
+static struct {
+	unsigned last[N_THREADS];
+	unsigned n[N_THREADS];
+	unsigned n_storm;
+	unsigned n_collide[3];
+	unsigned n_once;
+	unsigned n_busy;
+	unsigned n_bad;
+	unsigned n_thread;
+} rx;
+
+/* the handlers are called on the thread that registered them */
+static pthread_t main_tid;
+
+/* format strings a table size apart, the call sites hash to one slot */
+static char collidev[3][4096];
+
+
+static void log_handler(uint32_t level, const char *msg)
+{
+	unsigned t, i;
+
+	if (!pthread_equal(main_tid, pthread_self()))
+		++rx.n_thread;
+
+	if (level != LEVEL_WARN)
+		return;
+
+	if (0 == strncmp(msg, "storm", 5)) {
+		++rx.n_storm;
+	}
+	else if (1 == sscanf(msg, "collide %u", &t) &&
+		 t < ARRAY_SIZE(rx.n_collide)) {
+		++rx.n_collide[t];
+	}
+	else if (2 == sscanf(msg, "logtest %u %u", &t, &i) && t < N_THREADS) {
+
+		/* the messages of a thread keep their order */
+		if (i <= rx.last[t])
+			++rx.n_bad;
+
+		rx.last[t] = i;
+		++rx.n[t];
+	}
+}
+
+
+static struct log lg_once;
+
+
+static void once_handler(uint32_t level, const char *msg)
+{
+	(void)level;
+	(void)msg;
+
+	++rx.n_once;
+
+	log_unregister_handler(&lg_once);
+}
+
+
+static void busy_handler(uint32_t level, const char *msg)
+{
+	(void)level;
+
+	if (0 == strncmp(msg, "busy", 4))
+		++rx.n_busy;
+}
+
+
+static void *busy_thread(void *arg)
+{
+	unsigned i;
+	(void)arg;
+
+	for (i=0; i<N_BUSY; i++)
+		warning("busy %u\n", i);
+
+	return NULL;
+}
+
+
+static void *log_thread(void *arg)
+{
+	unsigned t = (unsigned)(uintptr_t)arg;
+	unsigned i;
+
+	for (i=1; i<=N_MSGS; i++)
+		warning("logtest %u %u\n", t, i);
+
+	return NULL;
+}
+
+
+int test_log(void)
+{
+	static struct log lg = {
+		.h = log_handler,
+	};
+	static struct log lg_busy = {
+		.h = busy_handler,
+	};
+	pthread_t tidv[N_THREADS], tid;
+	struct log_stats st0, st;
+	unsigned i, n;
+	int err = 0;
+
+	memset(&rx, 0, sizeof(rx));
+	main_tid = pthread_self();
+
+	log_enable_stdout(false);
+	log_set_ratelimit(0);
+	log_register_handler(&lg);
+	log_stats(&st0);
+
+	for (i=0; i<N_THREADS; i++) {
+		err = pthread_create(&tidv[i], NULL, log_thread,
+				     (void *)(uintptr_t)i);
+		if (err)
+			break;
+	}
+
+	while (i--)
+		pthread_join(tidv[i], NULL);
+
+	TEST_ERR(err);
+
+	log_flush();
+	log_stats(&st);
+
+	/* a message is either printed or dropped, the ring may fill up */
+	ASSERT_EQ(0, rx.n_bad);
+	ASSERT_TRUE(st.msgs - st0.msgs + st.drops - st0.drops ==
+		    N_THREADS * N_MSGS);
+	for (i=0; i<N_THREADS; i++)
+		ASSERT_TRUE(rx.n[i] > 0);
+
+	/* one call site is limited to a burst per second */
+	log_set_ratelimit(10);
+
+	for (i=0; i<100; i++)
+		warning("storm %u\n", i);
+
+	log_flush();
+	log_stats(&st);
+
+	ASSERT_TRUE(rx.n_storm <= 20);
+	ASSERT_TRUE(st.suppressed - st0.suppressed >= 80);
+
+	/* call sites in the same hash slot are limited one by one */
+	for (i=0; i<ARRAY_SIZE(collidev); i++)
+		str_ncpy(collidev[i], "collide %u\n", sizeof(collidev[i]));
+
+	for (i=0; i<100; i++) {
+
+		unsigned j;
+
+		for (j=0; j<ARRAY_SIZE(collidev); j++)
+			warning(collidev[j], j);
+	}
+
+	log_flush();
+
+	for (i=0; i<ARRAY_SIZE(collidev); i++) {
+		ASSERT_TRUE(rx.n_collide[i] > 0);
+		ASSERT_TRUE(rx.n_collide[i] <= 20);
+	}
+
+	/* a handler is unregistered while the writer is running */
+	log_set_ratelimit(0);
+	log_register_handler(&lg_busy);
+
+	err = pthread_create(&tid, NULL, busy_thread, NULL);
+	TEST_ERR(err);
+
+	for (i=0; i<1000 && !rx.n_busy; i++) {
+		sys_msleep(1);
+		log_flush();
+	}
+
+	log_unregister_handler(&lg_busy);
+	n = rx.n_busy;
+
+	pthread_join(tid, NULL);
+	log_flush();
+
+	ASSERT_TRUE(n > 0);
+	ASSERT_EQ(n, rx.n_busy);
+
+	/* a handler can unregister itself */
+	lg_once.h = once_handler;
+	log_register_handler(&lg_once);
+
+	warning("once 1\n");
+	warning("once 2\n");
+	log_flush();
+
+	ASSERT_EQ(1, rx.n_once);
+
+	/* no handler was called on the writer thread */
+	ASSERT_EQ(0, rx.n_thread);
+
+ out:
+	log_unregister_handler(&lg_busy);
+	log_unregister_handler(&lg_once);
+	log_unregister_handler(&lg);
+	log_set_ratelimit(20);
+	log_enable_stdout(true);
+
+	return err;
+}
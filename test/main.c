@@ -40,23 +40,58 @@ static const struct test tests[] = {
 	TEST(test_call_tcp),
 	TEST(test_call_transfer),
 	TEST(test_call_video),
+	TEST(test_call_video_cc),
+	TEST(test_call_video_nack),
+	TEST(test_call_video_relay),
 	TEST(test_call_webrtc),
 	TEST(test_cmd),
 	TEST(test_cmd_long),
+	TEST(test_confmix),
 	TEST(test_contact),
+	TEST(test_dsp),
 	TEST(test_event),
+	TEST(test_event_bus),
 	TEST(test_h264),
+	TEST(test_lathist),
+	TEST(test_log),
+	TEST(test_mclock),
 	TEST(test_message),
 	TEST(test_network),
 	TEST(test_play),
+	TEST(test_play_file_cache),
+	TEST(test_rtprx),
+	TEST(test_rtptx),
 	TEST(test_ua_alloc),
 	TEST(test_ua_options),
 	TEST(test_ua_register),
 	TEST(test_ua_register_auth),
 	TEST(test_ua_register_auth_dns),
 	TEST(test_ua_register_dns),
+	TEST(test_ua_register_paced),
+	TEST(test_uag_find),
 	TEST(test_uag_find_param),
+	TEST(test_vidcvt),
 	TEST(test_video),
+	TEST(test_video_cc),
+	TEST(test_video_decq),
+	TEST(test_video_decq_worker),
+	TEST(test_video_pool),
+	TEST(test_video_pool_filter),
+	TEST(test_video_rtx),
+	TEST(test_video_simulcast),
+};
+
+
+/* performance tests, only run with -p */
+static const struct test perf_tests[] = {
+	TEST(test_perf_confmix),
+	TEST(test_perf_dsp),
+	TEST(test_perf_h264),
+	TEST(test_perf_rtprx),
+	TEST(test_perf_rtptx),
+	TEST(test_perf_ua_register),
+	TEST(test_perf_uag_find),
+	TEST(test_perf_vidcvt),
 };
 
 
@@ -79,19 +114,19 @@ static int run_one_test(const struct test *test)
 }
 
 
-static int run_tests(void)
+static int run_tests(const struct test *testv, size_t testc)
 {
 	size_t i;
 	int err;
 
-	for (i=0; i<ARRAY_SIZE(tests); i++) {
+	for (i=0; i<testc; i++) {
 
-		re_printf("[ RUN      ] %s\n", tests[i].name);
+		re_printf("[ RUN      ] %s\n", testv[i].name);
 
-		err = tests[i].exec();
+		err = testv[i].exec();
 		if (err) {
 			warning("%s: test failed (%m)\n",
-				tests[i].name, err);
+				testv[i].name, err);
 			return err;
 		}
 
@@ -131,6 +166,12 @@ static const struct test *find_test(const char *name)
 			return &tests[i];
 	}
 
+	for (i=0; i<ARRAY_SIZE(perf_tests); i++) {
+
+		if (0 == str_casecmp(name, perf_tests[i].name))
+			return &perf_tests[i];
+	}
+
 	return NULL;
 }
 
@@ -150,6 +191,7 @@ static void usage(void)
 			 "Usage: selftest [options] <testcases..>\n"
 			 "options:\n"
 			 "\t-l               List all testcases and exit\n"
+			 "\t-p               Run performance tests\n"
 			 "\t-v               Verbose output (INFO level)\n"
 			 );
 }
@@ -160,6 +202,7 @@ int main(int argc, char *argv[])
 	struct config *config;
 	size_t i, ntests;
 	bool verbose = false;
+	bool perf = false;
 	int err;
 
 	err = libre_init();
@@ -169,7 +212,7 @@ int main(int argc, char *argv[])
 	log_enable_info(false);
 
 	for (;;) {
-		const int c = getopt(argc, argv, "hlv");
+		const int c = getopt(argc, argv, "hlpv");
 		if (0 > c)
 			break;
 
@@ -184,6 +227,10 @@ int main(int argc, char *argv[])
 			test_listcases();
 			return 0;
 
+		case 'p':
+			perf = true;
+			break;
+
 		case 'v':
 			if (verbose)
 				log_enable_debug(true);
@@ -199,6 +246,8 @@ int main(int argc, char *argv[])
 
 	if (argc >= (optind + 1))
 		ntests = argc - optind;
+	else if (perf)
+		ntests = ARRAY_SIZE(perf_tests);
 	else
 		ntests = ARRAY_SIZE(tests);
 
@@ -243,8 +292,13 @@ int main(int argc, char *argv[])
 			}
 		}
 	}
+	else if (perf) {
+		err = run_tests(perf_tests, ARRAY_SIZE(perf_tests));
+		if (err)
+			goto out;
+	}
 	else {
-		err = run_tests();
+		err = run_tests(tests, ARRAY_SIZE(tests));
 		if (err)
 			goto out;
 	}
@@ -0,0 +1,86 @@
+/**
+ * @file test/mclock.c  Baresip selftest -- shared media clock
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	N_CLIENTS = 8,
+	PERIOD = 10000,    /* [us] */
+	RUN_TIME = 200,    /* [ms] */
+};
+
+struct client {
+	uint32_t n;
+	uint64_t last;
+	uint32_t n_bad;
+};
+
+
+static void tick_handler(uint64_t ts, void *arg)
+{
+	struct client *cl = arg;
+
+	if (cl->n && ts != cl->last + PERIOD)
+		++cl->n_bad;
+
+	cl->last = ts;
+	__atomic_add_fetch(&cl->n, 1, __ATOMIC_RELEASE);
+}
+
+
+int test_mclock(void)
+{
+	struct client clv[N_CLIENTS];
+	struct mclock *mcv[N_CLIENTS];
+	struct mclock_stats st;
+	unsigned i;
+	int err = 0;
+
+	memset(clv, 0, sizeof(clv));
+	memset(mcv, 0, sizeof(mcv));
+
+	for (i=0; i<N_CLIENTS; i++) {
+		err = mclock_alloc(&mcv[i], PERIOD, tick_handler, &clv[i]);
+		TEST_ERR(err);
+	}
+
+	sys_msleep(RUN_TIME);
+
+	err = mclock_stats(&st);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(st.threads > 0);
+	ASSERT_EQ(N_CLIENTS, st.clients);
+
+	/* the clients share the wake-ups of their clock thread */
+	ASSERT_TRUE(st.calls >= st.ticks * 2);
+
+	for (i=0; i<N_CLIENTS; i++)
+		mcv[i] = mem_deref(mcv[i]);
+
+	for (i=0; i<N_CLIENTS; i++) {
+		uint32_t n = __atomic_load_n(&clv[i].n, __ATOMIC_ACQUIRE);
+
+		ASSERT_TRUE(n >= RUN_TIME * 1000 / PERIOD / 2);
+		ASSERT_TRUE(n <= RUN_TIME * 1000 / PERIOD + 1);
+		ASSERT_EQ(0, clv[i].n_bad);
+	}
+
+	/* the clock threads are stopped with the last client */
+	err = mclock_stats(&st);
+	TEST_ERR(err);
+	ASSERT_EQ(0, st.threads);
+
+ out:
+	for (i=0; i<N_CLIENTS; i++)
+		mem_deref(mcv[i]);
+
+	return err;
+}
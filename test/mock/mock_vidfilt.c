@@ -0,0 +1,141 @@
+/**
+ * @file mock/mock_vidfilt.c Mock video filter
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../test.h"
+
+
+/*
+ * Scales like the swscale module: the output frame is taken from a frame
+ * pool and the input frame is pointed at it.
+ */
+struct mock_enc {
+	struct vidfilt_enc_st vf;  /* inheritance */
+
+	struct vidpool *pool;
+	struct vidframe *frame;
+	struct vidsz dst_size;
+	enum vidfmt dst_fmt;
+};
+
+
+static struct vidpool *mock_pool;
+
+
+static void enc_destructor(void *arg)
+{
+	struct mock_enc *st = arg;
+
+	list_unlink(&st->vf.le);
+
+	mem_deref(st->frame);
+	mem_deref(st->pool);
+}
+
+
+static int mock_encode_update(struct vidfilt_enc_st **stp, void **ctx,
+			      const struct vidfilt *vf,
+			      struct vidfilt_prm *prm,
+			      const struct video *vid)
+{
+	struct mock_enc *st;
+	(void)ctx;
+
+	if (!stp || !vf || !prm)
+		return EINVAL;
+
+	if (!prm->width || !prm->height) {
+		warning("mock_vidfilt: enc: invalid size\n");
+		return EINVAL;
+	}
+
+	if (*stp)
+		return 0;
+
+	st = mem_zalloc(sizeof(*st), enc_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->dst_size.w = prm->width;
+	st->dst_size.h = prm->height;
+	st->dst_fmt    = prm->fmt;
+
+	st->pool = mem_ref(vid ? video_frame_pool(vid, true) : mock_pool);
+
+	*stp = (struct vidfilt_enc_st *)st;
+
+	return 0;
+}
+
+
+static int mock_encode(struct vidfilt_enc_st *st, struct vidframe *frame,
+		       uint64_t *timestamp)
+{
+	struct mock_enc *enc = (struct mock_enc *)st;
+	int i, err;
+	(void)timestamp;
+
+	if (!st)
+		return EINVAL;
+
+	if (!frame)
+		return 0;
+
+	enc->frame = mem_deref(enc->frame);
+
+	err = vidpool_get(enc->pool, &enc->frame, enc->dst_fmt,
+			  &enc->dst_size);
+	if (err)
+		return err;
+
+	vidconv(enc->frame, frame, NULL);
+
+	for (i=0; i<4; i++) {
+		frame->data[i]     = enc->frame->data[i];
+		frame->linesize[i] = enc->frame->linesize[i];
+	}
+	frame->size = enc->frame->size;
+	frame->fmt  = enc->frame->fmt;
+
+	return 0;
+}
+
+
+static struct vidfilt vf_dummy = {
+	.name    = "MOCK-VIDFILT",
+	.encupdh = mock_encode_update,
+	.ench    = mock_encode,
+};
+
+
+/**
+ * Register the mock video filter
+ *
+ * @param vidfiltl List of video filters
+ * @param pool     Frame pool of the filter if it has no video object
+ *
+ * @return The mock video filter
+ */
+const struct vidfilt *mock_vidfilt_register(struct list *vidfiltl,
+					    struct vidpool *pool)
+{
+	mock_pool = pool;
+
+	vidfilt_register(vidfiltl, &vf_dummy);
+
+	return &vf_dummy;
+}
+
+
+void mock_vidfilt_unregister(void)
+{
+	vidfilt_unregister(&vf_dummy);
+
+	mock_pool = NULL;
+}
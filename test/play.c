@@ -4,12 +4,14 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <string.h>
+#include <unistd.h>
 #include <re.h>
 #include <baresip.h>
 #include "test.h"
 
 
 #define NUM_SAMPLES 320  /* 8000 Hz, 1 channel, 40ms */
+#define TMP_DIR "/tmp"
 
 
 struct test {
@@ -101,3 +103,115 @@ int test_play(void)
 	mem_deref(auplay);
 	return err;
 }
+
+
+static int write_wav(const char *path, const struct mbuf *mb)
+{
+	struct aufile_prm prm;
+	struct aufile *af;
+	int err;
+
+	prm.srate    = 8000;
+	prm.channels = 1;
+	prm.fmt      = AUFMT_S16LE;
+
+	err = aufile_open(&af, &prm, path, AUFILE_WRITE);
+	if (err)
+		return err;
+
+	err = aufile_write(af, mb->buf, mb->end);
+
+	mem_deref(af);
+
+	return err;
+}
+
+
+int test_play_file_cache(void)
+{
+	struct auplay *auplay = NULL;
+	struct player *player = NULL;
+	struct play *play = NULL;
+	struct mbuf *mb_tone = NULL;
+	struct play_cache_stats st;
+	struct test test = {0};
+	char file[64];
+	char path[256] = "";
+	int err;
+
+	err = mock_auplay_register(&auplay, baresip_auplayl(),
+				   sample_handler, &test);
+	ASSERT_EQ(0, err);
+
+	err = play_init(&player);
+	ASSERT_EQ(0, err);
+
+	mb_tone = generate_tone();
+	ASSERT_TRUE(mb_tone != NULL);
+
+	re_snprintf(file, sizeof(file), "play-%08x.wav", rand_u32());
+	re_snprintf(path, sizeof(path), "%s/%s", TMP_DIR, file);
+
+	err = write_wav(path, mb_tone);
+	TEST_ERR(err);
+
+	play_set_path(player, TMP_DIR);
+
+	/* the first play decodes the file */
+	err = play_file(&play, player, file, 0, NULL, NULL);
+	TEST_ERR(err);
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+
+	TEST_MEMCMP(mb_tone->buf, NUM_SAMPLES*2,
+		    test.mb_samp->buf, test.mb_samp->end);
+
+	play = mem_deref(play);
+
+	err = play_cache_stats(player, &st);
+	TEST_ERR(err);
+	ASSERT_EQ(0, st.hits);
+	ASSERT_EQ(1, st.misses);
+	ASSERT_EQ(1, st.entries);
+	ASSERT_EQ(NUM_SAMPLES*2, st.bytes);
+
+	/* the next play shares the decoded samples */
+	err = play_file(&play, player, file, 0, NULL, NULL);
+	TEST_ERR(err);
+	play = mem_deref(play);
+
+	err = play_cache_stats(player, &st);
+	TEST_ERR(err);
+	ASSERT_EQ(1, st.hits);
+	ASSERT_EQ(1, st.misses);
+
+	play_cache_flush(player);
+
+	err = play_cache_stats(player, &st);
+	TEST_ERR(err);
+	ASSERT_EQ(0, st.entries);
+	ASSERT_EQ(0, st.bytes);
+
+	/* a file larger than the limit is not cached */
+	play_set_cache_limit(player, NUM_SAMPLES, false);
+
+	err = play_file(&play, player, file, 0, NULL, NULL);
+	TEST_ERR(err);
+	play = mem_deref(play);
+
+	err = play_cache_stats(player, &st);
+	TEST_ERR(err);
+	ASSERT_EQ(2, st.misses);
+	ASSERT_EQ(0, st.entries);
+
+ out:
+	if (path[0])
+		(void)unlink(path);
+	mem_deref(test.mb_samp);
+	mem_deref(mb_tone);
+	mem_deref(play);
+	mem_deref(player);
+	mem_deref(auplay);
+	return err;
+}
@@ -0,0 +1,318 @@
+/**
+ * @file test/rtprx.c  Baresip selftest -- batched RTP receive
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "rtprx"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	PKT_SIZE  = 172,       /* 20ms of G.711 with RTP header */
+	SOCKBUF   = 1 << 20,
+	TIMEOUT   = 5000,      /* [ms] */
+	N_KEEP    = 64,
+};
+
+struct fixture {
+	struct udp_sock *us_rx;
+	struct udp_sock *us_tx;
+	struct rtprx *rx;
+	struct sa laddr;
+	struct tmr tmr;
+	struct mbuf *keepv[N_KEEP];
+	size_t n_keep;
+	uint32_t n_recv;
+	uint32_t n_want;
+	int err;
+};
+
+
+static void timeout_handler(void *arg)
+{
+	struct fixture *f = arg;
+
+	f->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static void recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct fixture *f = arg;
+	uint32_t seq;
+	(void)src;
+
+	if (mbuf_get_left(mb) != PKT_SIZE) {
+		f->err = EPROTO;
+		re_cancel();
+		return;
+	}
+
+	/* packets must arrive in order */
+	seq = ntohl(mbuf_read_u32(mb));
+	if (seq != f->n_recv) {
+		f->err = EPROTO;
+		re_cancel();
+		return;
+	}
+
+	/* hold on to some buffers, like the jitter buffer does */
+	if (seq % 4 == 0 && f->n_keep < N_KEEP) {
+		mb->pos -= 4;
+		f->keepv[f->n_keep++] = mem_ref(mb);
+	}
+
+	if (++f->n_recv >= f->n_want)
+		re_cancel();
+}
+
+
+static int fixture_init(struct fixture *f, uint32_t batch)
+{
+	struct sa laddr;
+	int err;
+
+	memset(f, 0, sizeof(*f));
+
+	sa_set_str(&laddr, "127.0.0.1", 0);
+
+	err  = udp_listen(&f->us_rx, &laddr, recv_handler, f);
+	err |= udp_listen(&f->us_tx, &laddr, NULL, NULL);
+	if (err)
+		return err;
+
+	err = udp_local_get(f->us_rx, &f->laddr);
+	if (err)
+		return err;
+
+	udp_sockbuf_set(f->us_rx, SOCKBUF);
+	udp_sockbuf_set(f->us_tx, SOCKBUF);
+
+	if (batch)
+		err = rtprx_alloc(&f->rx, f->us_rx, AF_INET, batch);
+
+	return err;
+}
+
+
+static void fixture_close(struct fixture *f)
+{
+	size_t i;
+
+	tmr_cancel(&f->tmr);
+
+	for (i=0; i<f->n_keep; i++)
+		mem_deref(f->keepv[i]);
+
+	mem_deref(f->rx);
+	mem_deref(f->us_tx);
+	mem_deref(f->us_rx);
+}
+
+
+static int send_burst(struct fixture *f, uint32_t seq, uint32_t n)
+{
+	struct mbuf *mb;
+	int err = 0;
+
+	mb = mbuf_alloc(PKT_SIZE);
+	if (!mb)
+		return ENOMEM;
+
+	while (n--) {
+		mb->pos = 0;
+		mb->end = 0;
+
+		err  = mbuf_write_u32(mb, htonl(seq++));
+		err |= mbuf_fill(mb, 0xd5, PKT_SIZE - 4);
+		if (err)
+			break;
+
+		mb->pos = 0;
+
+		err = udp_send(f->us_tx, &f->laddr, mb);
+		if (err)
+			break;
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int receive(struct fixture *f, uint32_t n)
+{
+	f->n_want += n;
+
+	tmr_start(&f->tmr, TIMEOUT, timeout_handler, f);
+
+	(void)re_main(NULL);
+
+	tmr_cancel(&f->tmr);
+
+	return f->err;
+}
+
+
+int test_rtprx(void)
+{
+	struct fixture f;
+	const struct rtprx_stats *st;
+	const uint32_t n = 200;
+	uint64_t allocs;
+	size_t i, keepc;
+	int err;
+
+	err = fixture_init(&f, 8);
+	if (err == ENOSYS) {
+		/* batched receive is not supported on this platform */
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	ASSERT_EQ(8, rtprx_batch(f.rx));
+
+	err = send_burst(&f, 0, n);
+	TEST_ERR(err);
+
+	err = receive(&f, n);
+	TEST_ERR(err);
+
+	st = rtprx_stats(f.rx);
+	ASSERT_EQ(n, st->packets);
+	ASSERT_EQ(0, st->errors);
+	ASSERT_TRUE(st->max_batch > 1 && st->max_batch <= 8);
+	ASSERT_TRUE(st->wakeups < n);
+
+	/* the kept buffers were replaced in the ring, not overwritten */
+	for (i=0; i<f.n_keep; i++) {
+		struct mbuf *mb = f.keepv[i];
+
+		ASSERT_EQ(PKT_SIZE, mbuf_get_left(mb));
+		ASSERT_EQ(i * 4, ntohl(mbuf_read_u32(mb)));
+	}
+
+	/* released buffers replace the next kept ones, nothing is allocated */
+	for (i=0; i<f.n_keep; i++)
+		f.keepv[i] = mem_deref(f.keepv[i]);
+
+	keepc  = f.n_keep;
+	allocs = st->allocs;
+	f.n_keep = 0;
+
+	err = send_burst(&f, n, n / 2);
+	TEST_ERR(err);
+
+	err = receive(&f, n / 2);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(f.n_keep > 0 && f.n_keep < keepc - 8);
+	ASSERT_EQ(allocs, st->allocs);
+	ASSERT_TRUE(st->reuses >= f.n_keep - 8);
+
+	/* a smaller batch still delivers everything */
+	err = rtprx_set_batch(f.rx, 0);
+	TEST_ERR(err);
+	ASSERT_EQ(1, rtprx_batch(f.rx));
+
+	err = send_burst(&f, n + n / 2, 10);
+	TEST_ERR(err);
+
+	err = receive(&f, 10);
+	TEST_ERR(err);
+
+	ASSERT_EQ(n + n / 2 + 10, f.n_recv);
+
+ out:
+	fixture_close(&f);
+
+	return err;
+}
+
+
+static int perf_rtprx(uint32_t batch)
+{
+	struct fixture f;
+	const uint32_t burst = 256;
+	const uint32_t rounds = 400;
+	uint64_t usec = 0;
+	uint32_t r;
+	int err;
+
+	err = fixture_init(&f, batch);
+	if (err)
+		goto out;
+
+	/* keep nothing, so that the pool is reused */
+	f.n_keep = N_KEEP;
+
+	for (r=0; r<rounds; r++) {
+
+		uint64_t t0;
+
+		err = send_burst(&f, r * burst, burst);
+		if (err)
+			goto out;
+
+		t0 = tmr_jiffies_usec();
+
+		err = receive(&f, burst);
+		if (err)
+			goto out;
+
+		usec += tmr_jiffies_usec() - t0;
+	}
+
+	re_printf("  batch %-4u %10.0f packets/s", batch,
+		  usec ? 1e6 * rounds * burst / usec : 0.0);
+
+	if (f.rx) {
+		const struct rtprx_stats *st = rtprx_stats(f.rx);
+
+		re_printf("  (%.1f per wakeup, %llu allocs)",
+			  1.0 * st->packets / st->wakeups, st->allocs);
+	}
+
+	re_printf("\n");
+
+	f.n_keep = 0;
+
+ out:
+	fixture_close(&f);
+
+	return err;
+}
+
+
+int test_perf_rtprx(void)
+{
+	static const uint32_t batchv[] = {0, 1, 8, 32, 64};
+	size_t i;
+	int err = 0;
+
+	re_printf("rtprx: receive %u byte packets, batch 0 is plain udp\n",
+		  PKT_SIZE);
+
+	for (i=0; i<ARRAY_SIZE(batchv); i++) {
+
+		err = perf_rtprx(batchv[i]);
+		if (err == ENOSYS) {
+			err = 0;
+			break;
+		}
+		if (err)
+			break;
+	}
+
+	return err;
+}
@@ -0,0 +1,271 @@
+/**
+ * @file test/rtptx.c  Baresip selftest -- batched RTP transmit
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "rtptx"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	PKT_SIZE  = 1200,      /* a video packet         */
+	BURST     = 64,        /* packets per frame      */
+	BIG_SIZE  = 4000,      /* larger than queue slot */
+	SOCKBUF   = 4 << 20,
+	TIMEOUT   = 5000,      /* [ms] */
+};
+
+struct fixture {
+	struct udp_sock *us_rx;
+	struct udp_sock *us_tx;
+	struct rtptx *tx;
+	struct sa raddr;
+	struct tmr tmr;
+	struct mbuf *mb;
+	uint32_t n_recv;
+	uint32_t n_want;
+	int err;
+};
+
+
+static void timeout_handler(void *arg)
+{
+	struct fixture *f = arg;
+
+	f->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static void recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct fixture *f = arg;
+	(void)src;
+
+	/* packets must arrive in order */
+	if (ntohl(mbuf_read_u32(mb)) != f->n_recv) {
+		f->err = EPROTO;
+		re_cancel();
+		return;
+	}
+
+	if (++f->n_recv >= f->n_want)
+		re_cancel();
+}
+
+
+static int fixture_init(struct fixture *f, uint32_t batch)
+{
+	struct sa laddr;
+	int err;
+
+	memset(f, 0, sizeof(*f));
+
+	sa_set_str(&laddr, "127.0.0.1", 0);
+
+	err  = udp_listen(&f->us_rx, &laddr, recv_handler, f);
+	err |= udp_listen(&f->us_tx, &laddr, NULL, NULL);
+	if (err)
+		return err;
+
+	err = udp_local_get(f->us_rx, &f->raddr);
+	if (err)
+		return err;
+
+	udp_sockbuf_set(f->us_rx, SOCKBUF);
+	udp_sockbuf_set(f->us_tx, SOCKBUF);
+
+	f->mb = mbuf_alloc(BIG_SIZE);
+	if (!f->mb)
+		return ENOMEM;
+
+	if (batch)
+		err = rtptx_alloc(&f->tx, f->us_tx, AF_INET, batch);
+
+	return err;
+}
+
+
+static void fixture_close(struct fixture *f)
+{
+	tmr_cancel(&f->tmr);
+
+	mem_deref(f->tx);
+	mem_deref(f->mb);
+	mem_deref(f->us_tx);
+	mem_deref(f->us_rx);
+}
+
+
+static int send_one(struct fixture *f, uint32_t seq, size_t size)
+{
+	int err;
+
+	f->mb->pos = 0;
+	f->mb->end = 0;
+
+	err  = mbuf_write_u32(f->mb, htonl(seq));
+	err |= mbuf_fill(f->mb, 0xd5, size - 4);
+	if (err)
+		return err;
+
+	f->mb->pos = 0;
+
+	return udp_send(f->us_tx, &f->raddr, f->mb);
+}
+
+
+static int receive(struct fixture *f, uint32_t n)
+{
+	f->n_want += n;
+
+	tmr_start(&f->tmr, TIMEOUT, timeout_handler, f);
+
+	(void)re_main(NULL);
+
+	tmr_cancel(&f->tmr);
+
+	return f->err;
+}
+
+
+int test_rtptx(void)
+{
+	struct fixture f;
+	struct rtptx_stats st;
+	const uint32_t n = 100;
+	uint32_t i;
+	int err;
+
+	err = fixture_init(&f, 16);
+	if (err == ENOSYS) {
+		/* batched transmit is not supported on this platform */
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	/* uncorked packets are sent as before */
+	err = send_one(&f, 0, PKT_SIZE);
+	TEST_ERR(err);
+
+	rtptx_cork(f.tx);
+	rtptx_cork(f.tx);
+
+	for (i=1; i<=10; i++) {
+		err = send_one(&f, i, PKT_SIZE);
+		TEST_ERR(err);
+	}
+
+	/* nothing is sent until the last cork is removed */
+	ASSERT_EQ(0, rtptx_uncork(f.tx));
+	err = rtptx_stats(f.tx, &st);
+	TEST_ERR(err);
+	ASSERT_EQ(10, st.packets);
+	ASSERT_EQ(1, st.direct);
+	ASSERT_EQ(0, st.syscalls);
+
+	/* a large packet is sent directly, after the queue */
+	for (; i<n; i++) {
+		err = send_one(&f, i, i == n/2 ? BIG_SIZE : PKT_SIZE);
+		TEST_ERR(err);
+	}
+
+	ASSERT_EQ(0, rtptx_uncork(f.tx));
+
+	err = receive(&f, n);
+	TEST_ERR(err);
+
+	err = rtptx_stats(f.tx, &st);
+	TEST_ERR(err);
+	ASSERT_EQ(n - 2, st.packets);
+	ASSERT_EQ(2, st.direct);
+	ASSERT_EQ(0, st.errors);
+	ASSERT_EQ(16, st.max_batch);
+	ASSERT_TRUE(st.syscalls <= (n - 2) / 16 + 2);
+
+ out:
+	fixture_close(&f);
+
+	return err;
+}
+
+
+static int perf_rtptx(uint32_t batch)
+{
+	struct fixture f;
+	struct rtptx_stats st;
+	const uint32_t rounds = 2000;
+	uint64_t usec = 0, syscalls;
+	uint32_t r, i;
+	int err;
+
+	err = fixture_init(&f, batch);
+	if (err)
+		goto out;
+
+	for (r=0; r<rounds; r++) {
+
+		uint64_t t0 = tmr_jiffies_usec();
+
+		rtptx_cork(f.tx);
+
+		for (i=0; i<BURST; i++) {
+			err = send_one(&f, r * BURST + i, PKT_SIZE);
+			if (err)
+				goto out;
+		}
+
+		(void)rtptx_uncork(f.tx);
+
+		usec += tmr_jiffies_usec() - t0;
+
+		/* drain, so that the receiver does not drop */
+		err = receive(&f, BURST);
+		if (err)
+			goto out;
+	}
+
+	syscalls = (uint64_t)rounds * BURST;
+	if (f.tx && 0 == rtptx_stats(f.tx, &st))
+		syscalls = st.syscalls + st.direct;
+
+	re_printf("  batch %-4u %10.0f packets/s %8llu syscalls\n", batch,
+		  usec ? 1e6 * rounds * BURST / usec : 0.0, syscalls);
+
+ out:
+	fixture_close(&f);
+
+	return err;
+}
+
+
+int test_perf_rtptx(void)
+{
+	static const uint32_t batchv[] = {0, 1, 8, 32, 64};
+	size_t i;
+	int err = 0;
+
+	re_printf("rtptx: send bursts of %u packets of %u bytes,"
+		  " batch 0 is plain udp\n", BURST, PKT_SIZE);
+
+	for (i=0; i<ARRAY_SIZE(batchv); i++) {
+
+		err = perf_rtptx(batchv[i]);
+		if (err == ENOSYS) {
+			err = 0;
+			break;
+		}
+		if (err)
+			break;
+	}
+
+	return err;
+}
@@ -12,13 +12,21 @@ TEST_SRCS	+= account.c
 TEST_SRCS	+= aulevel.c
 TEST_SRCS	+= call.c
 TEST_SRCS	+= cmd.c
+TEST_SRCS	+= confmix.c
 TEST_SRCS	+= contact.c
+TEST_SRCS	+= dsp.c
 TEST_SRCS	+= event.c
 TEST_SRCS	+= h264.c
+TEST_SRCS	+= lathist.c
+TEST_SRCS	+= log.c
+TEST_SRCS	+= mclock.c
 TEST_SRCS	+= message.c
 TEST_SRCS	+= net.c
 TEST_SRCS	+= play.c
+TEST_SRCS	+= rtprx.c
+TEST_SRCS	+= rtptx.c
 TEST_SRCS	+= ua.c
+TEST_SRCS	+= vidcvt.c
 TEST_SRCS	+= video.c
 
 
@@ -46,6 +54,7 @@ TEST_SRCS	+= mock/mock_mnat.c
 TEST_SRCS	+= mock/mock_menc.c
 TEST_SRCS	+= mock/mock_vidsrc.c
 TEST_SRCS	+= mock/mock_vidcodec.c
+TEST_SRCS	+= mock/mock_vidfilt.c
 TEST_SRCS	+= mock/mock_vidisp.c
 
 TEST_SRCS	+= test.c
@@ -207,6 +207,18 @@ int mock_vidisp_register(struct vidisp **vidispp,
 			 mock_vidisp_h *disph, void *arg);
 
 
+/*
+ * Mock Video-filter
+ */
+
+struct vidfilt;
+struct vidpool;
+
+const struct vidfilt *mock_vidfilt_register(struct list *vidfiltl,
+					    struct vidpool *pool);
+void mock_vidfilt_unregister(void);
+
+
 /* test cases */
 
 int test_account(void);
@@ -230,20 +242,54 @@ int test_call_rtp_timeout(void);
 int test_call_tcp(void);
 int test_call_transfer(void);
 int test_call_video(void);
+int test_call_video_cc(void);
+int test_call_video_nack(void);
+int test_call_video_relay(void);
 int test_call_webrtc(void);
 int test_cmd(void);
 int test_cmd_long(void);
+int test_confmix(void);
 int test_contact(void);
+int test_dsp(void);
 int test_event(void);
+int test_event_bus(void);
 int test_h264(void);
+int test_lathist(void);
+int test_log(void);
+int test_mclock(void);
 int test_message(void);
 int test_network(void);
 int test_play(void);
+int test_play_file_cache(void);
+int test_rtprx(void);
+int test_rtptx(void);
 int test_ua_alloc(void);
 int test_ua_options(void);
 int test_ua_register(void);
 int test_ua_register_auth(void);
 int test_ua_register_auth_dns(void);
 int test_ua_register_dns(void);
+int test_ua_register_paced(void);
+int test_uag_find(void);
 int test_uag_find_param(void);
+int test_vidcvt(void);
 int test_video(void);
+int test_video_cc(void);
+int test_video_decq(void);
+int test_video_decq_worker(void);
+int test_video_pool(void);
+int test_video_pool_filter(void);
+int test_video_rtx(void);
+int test_video_simulcast(void);
+
+
+/* performance tests */
+
+int test_perf_confmix(void);
+int test_perf_dsp(void);
+int test_perf_h264(void);
+int test_perf_rtprx(void);
+int test_perf_rtptx(void);
+int test_perf_ua_register(void);
+int test_perf_uag_find(void);
+int test_perf_vidcvt(void);
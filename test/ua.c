@@ -174,6 +174,143 @@ int test_ua_register(void)
 }
 
 
+struct regn {
+	struct ua **uav;
+	unsigned n_uas;
+	unsigned n_ok;
+	int err;
+};
+
+
+static void regn_event_handler(struct ua *ua, enum ua_event ev,
+			       struct call *call, const char *prm, void *arg)
+{
+	struct regn *r = arg;
+	(void)ua;
+	(void)call;
+	(void)prm;
+
+	if (ev == UA_EVENT_REGISTER_OK) {
+		if (++r->n_ok >= r->n_uas)
+			re_cancel();
+	}
+	else if (ev == UA_EVENT_REGISTER_FAIL) {
+		r->err = EAUTH;
+		re_cancel();
+	}
+}
+
+
+/*
+ * Register N accounts at once against the mock SIP server, paced by the
+ * register scheduler. Returns the time until all are registered.
+ */
+static int reg_n(unsigned n_uas, uint32_t rate, uint64_t *msp,
+		 struct regsched_stats *stats)
+{
+	struct sip_server *srv = NULL;
+	struct regn r;
+	struct sa laddr;
+	uint64_t t0;
+	unsigned i;
+	int err;
+
+	memset(&r, 0, sizeof(r));
+
+	err = ua_init("test", true, false, false);
+	if (err)
+		return err;
+
+	err = regsched_set_rate(uag_regsched(), rate, 10);
+	TEST_ERR(err);
+
+	err = sip_server_alloc(&srv, sip_server_exit_handler, NULL);
+	TEST_ERR(err);
+
+	err = sip_transp_laddr(srv->sip, &laddr, SIP_TRANSP_UDP, NULL);
+	TEST_ERR(err);
+
+	r.uav = mem_zalloc(n_uas * sizeof(*r.uav), NULL);
+	if (!r.uav) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<n_uas; i++) {
+		char aor[64];
+
+		re_snprintf(aor, sizeof(aor), "<sip:user%u@%J>", i, &laddr);
+
+		err = ua_alloc(&r.uav[i], aor);
+		TEST_ERR(err);
+	}
+
+	r.n_uas = n_uas;
+
+	err = uag_event_register(regn_event_handler, &r);
+	TEST_ERR(err);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<n_uas; i++) {
+		err = ua_register(r.uav[i]);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(10000 + 1000 * n_uas / (rate ? rate : 1000));
+	TEST_ERR(err);
+	TEST_ERR(r.err);
+
+	*msp = tmr_jiffies() - t0;
+
+	ASSERT_EQ(n_uas, r.n_ok);
+	ASSERT_EQ(n_uas, srv->n_register_req);
+
+	err = regsched_stats(uag_regsched(), stats);
+	TEST_ERR(err);
+
+ out:
+	uag_event_unregister(regn_event_handler);
+
+	if (r.uav) {
+		for (i=0; i<n_uas; i++)
+			mem_deref(r.uav[i]);
+	}
+	mem_deref(r.uav);
+
+	ua_stop_all(true);
+	ua_close();
+	mem_deref(srv);
+
+	return err;
+}
+
+
+int test_ua_register_paced(void)
+{
+	struct regsched_stats st;
+	const unsigned n = 40;
+	const uint32_t rate = 200;
+	uint64_t ms = 0;
+	int err;
+
+	err = reg_n(n, rate, &ms, &st);
+	TEST_ERR(err);
+
+	/* a burst of rate/10, then one REGISTER every 5 ms */
+	ASSERT_TRUE(ms >= 1000 * (n - rate/10) / rate - 10);
+
+	ASSERT_EQ(n, st.started);
+	ASSERT_EQ(n - rate/10, st.queued);
+	ASSERT_EQ(n, st.done);
+	ASSERT_EQ(0, st.depth);
+	ASSERT_EQ(n - rate/10, st.max_depth);
+
+ out:
+	return err;
+}
+
+
 int test_ua_alloc(void)
 {
 	struct ua *ua;
@@ -239,6 +376,168 @@ int test_uag_find_param(void)
 }
 
 
+int test_uag_find(void)
+{
+	struct ua *ua1 = NULL, *ua2 = NULL;
+	struct pl pl;
+	int err = 0;
+
+	err  = ua_alloc(&ua1, "<sip:alice@test.invalid>;regint=0");
+	err |= ua_alloc(&ua2, "<sip:bob@test.invalid>;regint=0");
+	if (err)
+		goto out;
+
+	/* by contact user */
+	pl_set_str(&pl, ua_local_cuser(ua2));
+	ASSERT_TRUE(ua2 == uag_find(&pl));
+
+	/* by AOR user, case-insensitive */
+	pl_set_str(&pl, "ALICE");
+	ASSERT_TRUE(ua1 == uag_find(&pl));
+
+	pl_set_str(&pl, "carol");
+	ASSERT_TRUE(NULL == uag_find(&pl));
+
+	/* catchall */
+	ua_set_catchall(ua2, true);
+	ASSERT_TRUE(ua2 == uag_find(&pl));
+	ua_set_catchall(ua2, false);
+	ASSERT_TRUE(NULL == uag_find(&pl));
+
+	ASSERT_TRUE(ua2 == uag_find_aor("sip:bob@test.invalid"));
+
+	/* removed from the index */
+	mem_deref(ua1);
+	ua1 = NULL;
+
+	pl_set_str(&pl, "alice");
+	ASSERT_TRUE(NULL == uag_find(&pl));
+	ASSERT_TRUE(NULL == uag_find_aor("sip:alice@test.invalid"));
+
+ out:
+	mem_deref(ua2);
+	mem_deref(ua1);
+
+	return err;
+}
+
+
+static int perf_uag_find(unsigned n_uas)
+{
+	struct ua **uav;
+	struct ua *ua;
+	struct pl cuser, user;
+	uint64_t t0, t1, t2;
+	const unsigned n = 200000;
+	unsigned i;
+	int err = 0;
+
+	uav = mem_zalloc(n_uas * sizeof(*uav), NULL);
+	if (!uav)
+		return ENOMEM;
+
+	for (i=0; i<n_uas; i++) {
+		char aor[64];
+
+		re_snprintf(aor, sizeof(aor),
+			    "<sip:user%u@test.invalid>;regint=0", i);
+
+		err = ua_alloc(&uav[i], aor);
+		if (err)
+			goto out;
+	}
+
+	/* the last UA is the worst case for a linear search */
+	ua = uav[n_uas - 1];
+
+	pl_set_str(&cuser, ua_local_cuser(ua));
+	pl_set_str(&user, ua_aor(ua) + 4);
+	user.l = strcspn(user.p, "@");
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<n; i++) {
+		ASSERT_TRUE(ua == uag_find(&cuser));
+	}
+
+	t1 = tmr_jiffies();
+
+	for (i=0; i<n; i++) {
+		ASSERT_TRUE(ua == uag_find(&user));
+	}
+
+	t2 = tmr_jiffies();
+
+	re_printf("uag_find: %5u UAs: cuser %.1f ns, aor-user %.1f ns\n",
+		  n_uas,
+		  1000000.0 * (double)(t1 - t0) / n,
+		  1000000.0 * (double)(t2 - t1) / n);
+
+ out:
+	for (i=0; i<n_uas; i++)
+		mem_deref(uav[i]);
+
+	mem_deref(uav);
+
+	return err;
+}
+
+
+/*
+ * Incoming INVITE dispatch: lookup of the target UA from
+ * the Request-URI user with 10, 1k and 10k UAs.
+ */
+int test_perf_uag_find(void)
+{
+	static const unsigned n_uasv[] = {10, 1000, 10000};
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(n_uasv); i++) {
+
+		err = perf_uag_find(n_uasv[i]);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+
+/*
+ * Registration storm: time until N accounts which start to register at
+ * once are all registered, unpaced and at a limited rate.
+ */
+int test_perf_ua_register(void)
+{
+	static const unsigned n_uasv[] = {100, 1000};
+	static const uint32_t ratev[] = {0, 500};
+	size_t i, j;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(n_uasv); i++) {
+		for (j=0; j<ARRAY_SIZE(ratev); j++) {
+
+			struct regsched_stats st;
+			uint64_t ms;
+
+			err = reg_n(n_uasv[i], ratev[j], &ms, &st);
+			if (err)
+				return err;
+
+			re_printf("ua_register: %5u UAs, rate %3u/s:"
+				  " %5llu ms, max depth %u,"
+				  " answer avg %llu max %llu ms\n",
+				  n_uasv[i], ratev[j], ms, st.max_depth,
+				  st.done ? st.done_usec / st.done / 1000 : 0,
+				  st.done_max / 1000);
+		}
+	}
+
+	return err;
+}
+
+
 static const char *_sip_transp_srvid(enum sip_transp tp)
 {
 	switch (tp) {
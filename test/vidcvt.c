@@ -0,0 +1,409 @@
+/**
+ * @file test/vidcvt.c  Baresip selftest -- video pixel format conversion
+ *
+ * Copyright (C) 2021 Dalei Liu
+ */
+
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "vidcvt"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	MAX_W  = 130,       /* widest row, the kernels have scalar tails */
+	PERF_W = 1280,
+	PERF_H = 720,
+	PERF_ROUNDS = 50,
+};
+
+struct cvt_bufs {
+	uint8_t src[2][4 * MAX_W];
+	uint8_t chroma[MAX_W];
+	uint8_t out[4][MAX_W];
+	uint8_t ref[4][MAX_W];
+};
+
+struct row_conv {
+	const char *name;
+	size_t offset;        /* of the row handler in the kernel set */
+	enum vidfmt fmt;
+};
+
+static const struct row_conv convv[] = {
+	{"yuyv", offsetof(struct vidcvt_kernel, yuyv422), VID_FMT_YUYV422},
+	{"uyvy", offsetof(struct vidcvt_kernel, uyvy422), VID_FMT_UYVY422},
+	{"nv12", offsetof(struct vidcvt_kernel, nv12),    VID_FMT_NV12},
+	{"nv21", offsetof(struct vidcvt_kernel, nv21),    VID_FMT_NV21},
+	{"rgb32", offsetof(struct vidcvt_kernel, rgb32),  VID_FMT_RGB32},
+};
+
+
+static vidcvt_row_h *row_handler(const struct vidcvt_kernel *k,
+				 const struct row_conv *conv)
+{
+	vidcvt_row_h *h;
+
+	memcpy(&h, (const uint8_t *)k + conv->offset, sizeof(h));
+
+	return h;
+}
+
+
+static void fill_random(uint8_t *p, size_t n)
+{
+	while (n--)
+		*p++ = (uint8_t)rand_u16();
+}
+
+
+static void fill_frame(struct vidframe *f)
+{
+	const struct vidsz *sz = &f->size;
+
+	switch (f->fmt) {
+
+	case VID_FMT_YUV420P:
+		fill_random(f->data[0], (size_t)f->linesize[0] * sz->h);
+		fill_random(f->data[1], (size_t)f->linesize[1] * sz->h / 2);
+		fill_random(f->data[2], (size_t)f->linesize[2] * sz->h / 2);
+		break;
+
+	case VID_FMT_NV12:
+	case VID_FMT_NV21:
+		fill_random(f->data[0], (size_t)f->linesize[0] * sz->h);
+		fill_random(f->data[1], (size_t)f->linesize[1] * sz->h / 2);
+		break;
+
+	default:
+		fill_random(f->data[0], (size_t)f->linesize[0] * sz->h);
+		break;
+	}
+}
+
+
+static int frame_cmp(const struct vidframe *a, const struct vidframe *b)
+{
+	unsigned y, i;
+	int err = 0;
+
+	ASSERT_EQ(a->fmt, b->fmt);
+	ASSERT_TRUE(vidsz_cmp(&a->size, &b->size));
+
+	for (i=0; i<3; i++) {
+
+		const unsigned w = i ? a->size.w / 2 : a->size.w;
+		const unsigned h = i ? a->size.h / 2 : a->size.h;
+
+		for (y=0; y<h; y++) {
+			TEST_MEMCMP(a->data[i] + y * a->linesize[i], w,
+				    b->data[i] + y * b->linesize[i], w);
+		}
+	}
+
+ out:
+	return err;
+}
+
+
+static int check_kernel(const struct vidcvt_kernel *k,
+			const struct vidcvt_kernel *ref, struct cvt_bufs *b)
+{
+	static const unsigned weightv[] = {0, 1, 77, 128, 255};
+	unsigned w, i, j;
+	int err = 0;
+
+	for (w=2; w<=MAX_W; w+=2) {
+
+		for (i=0; i<ARRAY_SIZE(convv); i++) {
+
+			vidcvt_row_h *h = row_handler(k, &convv[i]);
+			vidcvt_row_h *h_ref = row_handler(ref, &convv[i]);
+
+			memset(b->out, 0, sizeof(b->out));
+			memset(b->ref, 0, sizeof(b->ref));
+
+			h(b->out[0], b->out[1], b->out[2], b->out[3],
+			  b->src[0], b->src[1], b->chroma, w);
+			h_ref(b->ref[0], b->ref[1], b->ref[2], b->ref[3],
+			      b->src[0], b->src[1], b->chroma, w);
+
+			TEST_MEMCMP(b->ref, sizeof(b->ref),
+				    b->out, sizeof(b->out));
+		}
+
+		for (j=0; j<ARRAY_SIZE(weightv); j++) {
+
+			k->blend(b->out[0], b->src[0], b->src[1], weightv[j],
+				 w);
+			ref->blend(b->ref[0], b->src[0], b->src[1],
+				   weightv[j], w);
+
+			TEST_MEMCMP(b->ref[0], w, b->out[0], w);
+		}
+	}
+
+ out:
+	if (err)
+		warning("test: vidcvt kernel %s differs from %s (w=%u)\n",
+			k->name, ref->name, w);
+
+	return err;
+}
+
+
+/* a threaded conversion gives the same frame as a single thread */
+static int check_threads(enum vidfmt fmt, const struct vidsz *src_sz,
+			 const struct vidsz *dst_sz)
+{
+	struct vidcvt *cvt1 = NULL, *cvt3 = NULL;
+	struct vidframe *src = NULL, *dst1 = NULL, *dst3 = NULL;
+	int err;
+
+	err  = vidcvt_alloc(&cvt1, 1);
+	err |= vidcvt_alloc(&cvt3, 3);
+	err |= vidframe_alloc(&src, fmt, src_sz);
+	err |= vidframe_alloc(&dst1, VID_FMT_YUV420P, dst_sz);
+	err |= vidframe_alloc(&dst3, VID_FMT_YUV420P, dst_sz);
+	TEST_ERR(err);
+
+	fill_frame(src);
+
+	err  = vidcvt_convert(cvt1, dst1, src);
+	err |= vidcvt_convert(cvt3, dst3, src);
+	TEST_ERR(err);
+
+	err = frame_cmp(dst1, dst3);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(dst3);
+	mem_deref(dst1);
+	mem_deref(src);
+	mem_deref(cvt3);
+	mem_deref(cvt1);
+
+	return err;
+}
+
+
+int test_vidcvt(void)
+{
+	const struct vidsz vga = {640, 480}, nhd = {640, 360};
+	const struct vidsz sz = {64, 48}, half = {32, 24}, odd = {63, 48};
+	const struct vidcvt_kernel *k, *ref = NULL;
+	struct vidcvt *cvt = NULL;
+	struct vidframe *src = NULL, *dst = NULL, *dst_odd = NULL;
+	struct vidcvt_stats st;
+	struct cvt_bufs *b;
+	unsigned i;
+	int err = 0;
+
+	b = mem_zalloc(sizeof(*b), NULL);
+	if (!b)
+		return ENOMEM;
+
+	fill_random((uint8_t *)b->src, sizeof(b->src));
+	fill_random(b->chroma, sizeof(b->chroma));
+
+	/* the scalar kernel is the last one */
+	for (i=0; (k = vidcvt_kernel_get(i)); i++)
+		ref = k;
+
+	ASSERT_TRUE(ref != NULL);
+	ASSERT_TRUE(vidcvt_kernel() == vidcvt_kernel_get(0));
+
+	for (i=0; (k = vidcvt_kernel_get(i)); i++) {
+
+		err = check_kernel(k, ref, b);
+		TEST_ERR(err);
+	}
+
+	ASSERT_TRUE(vidcvt_supported(VID_FMT_YUV420P, VID_FMT_NV12));
+	ASSERT_TRUE(!vidcvt_supported(VID_FMT_NV12, VID_FMT_YUV420P));
+
+	/* known values, BT.601 red */
+	err  = vidcvt_alloc(&cvt, 2);
+	err |= vidframe_alloc(&src, VID_FMT_RGB32, &sz);
+	err |= vidframe_alloc(&dst, VID_FMT_YUV420P, &half);
+	TEST_ERR(err);
+
+	vidframe_fill(src, 255, 0, 0);
+
+	err = vidcvt_convert(cvt, dst, src);
+	TEST_ERR(err);
+
+	ASSERT_EQ(82, dst->data[0][0]);
+	ASSERT_EQ(82, dst->data[0][dst->linesize[0] * 23 + 31]);
+	ASSERT_EQ(90, dst->data[1][0]);
+	ASSERT_EQ(240, dst->data[2][0]);
+
+	/* odd sizes are left to vidconv() */
+	err = vidframe_alloc(&dst_odd, VID_FMT_YUV420P, &odd);
+	TEST_ERR(err);
+
+	err = vidcvt_convert(cvt, dst_odd, src);
+	TEST_ERR(err);
+
+	err = vidcvt_stats(cvt, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(2, st.threads);
+	ASSERT_EQ(1, st.frames);
+	ASSERT_EQ(1, st.scaled);
+	ASSERT_EQ(1, st.fallback);
+
+	/* every format, with and without scaling */
+	for (i=0; i<ARRAY_SIZE(convv); i++) {
+
+		err  = check_threads(convv[i].fmt, &vga, &vga);
+		err |= check_threads(convv[i].fmt, &vga, &nhd);
+		TEST_ERR(err);
+	}
+
+	err = check_threads(VID_FMT_YUV420P, &vga, &nhd);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(dst_odd);
+	mem_deref(dst);
+	mem_deref(src);
+	mem_deref(cvt);
+	mem_deref(b);
+
+	return err;
+}
+
+
+static double mpix_per_sec(uint64_t n, uint64_t usec)
+{
+	return usec ? (double)n / (double)usec : 0;
+}
+
+
+/* a whole frame through one row handler, without slicing */
+static void perf_rows(vidcvt_row_h *h, struct vidframe *dst,
+		      const struct vidframe *src, bool semi)
+{
+	unsigned y;
+
+	for (y=0; y<src->size.h; y+=2) {
+
+		const uint8_t *s0 = src->data[0] + y * src->linesize[0];
+		uint8_t *d0 = dst->data[0] + y * dst->linesize[0];
+
+		h(d0, d0 + dst->linesize[0],
+		  dst->data[1] + y/2 * dst->linesize[1],
+		  dst->data[2] + y/2 * dst->linesize[2],
+		  s0, s0 + src->linesize[0],
+		  semi ? src->data[1] + y/2 * src->linesize[1] : NULL,
+		  src->size.w);
+	}
+}
+
+
+static int perf_convert(struct vidcvt *cvt, struct vidframe *dst,
+			const struct vidframe *src, double *mpix)
+{
+	const uint64_t n = (uint64_t)PERF_ROUNDS * src->size.w * src->size.h;
+	uint64_t t0;
+	unsigned r;
+	int err = 0;
+
+	t0 = tmr_jiffies_usec();
+	for (r=0; r<PERF_ROUNDS; r++)
+		err |= vidcvt_convert(cvt, dst, src);
+
+	*mpix = mpix_per_sec(n, tmr_jiffies_usec() - t0);
+
+	return err;
+}
+
+
+int test_perf_vidcvt(void)
+{
+	const struct vidsz sz = {PERF_W, PERF_H};
+	const struct vidsz half = {PERF_W / 2, PERF_H / 2};
+	const uint64_t n = (uint64_t)PERF_ROUNDS * PERF_W * PERF_H;
+	const uint32_t threadv[] = {1, 2, 4};
+	struct vidframe *srcv[ARRAY_SIZE(convv)] = {NULL};
+	struct vidframe *dst = NULL, *dst_half = NULL;
+	struct vidcvt *cvt = NULL;
+	const struct vidcvt_kernel *k;
+	size_t i, j;
+	int err = 0;
+
+	err  = vidframe_alloc(&dst, VID_FMT_YUV420P, &sz);
+	err |= vidframe_alloc(&dst_half, VID_FMT_YUV420P, &half);
+	for (i=0; i<ARRAY_SIZE(convv); i++)
+		err |= vidframe_alloc(&srcv[i], convv[i].fmt, &sz);
+	TEST_ERR(err);
+
+	for (i=0; i<ARRAY_SIZE(convv); i++)
+		fill_frame(srcv[i]);
+
+	re_printf("vidcvt kernels, %u x %u [Mpixels/s]:\n"
+		  "  %-6s", PERF_W, PERF_H, "kernel");
+	for (i=0; i<ARRAY_SIZE(convv); i++)
+		re_printf(" %8s", convv[i].name);
+	re_printf("\n");
+
+	for (i=0; (k = vidcvt_kernel_get(i)); i++) {
+
+		re_printf("  %-6s", k->name);
+
+		for (j=0; j<ARRAY_SIZE(convv); j++) {
+
+			vidcvt_row_h *h = row_handler(k, &convv[j]);
+			const bool semi = convv[j].fmt == VID_FMT_NV12 ||
+				convv[j].fmt == VID_FMT_NV21;
+			uint64_t t0 = tmr_jiffies_usec();
+			unsigned r;
+
+			for (r=0; r<PERF_ROUNDS; r++)
+				perf_rows(h, dst, srcv[j], semi);
+
+			re_printf(" %8.0f", mpix_per_sec(n, tmr_jiffies_usec()
+							 - t0));
+		}
+
+		re_printf("\n");
+	}
+
+	re_printf("vidcvt frames, %s kernel [Mpixels/s]:\n"
+		  "  %-7s %8s %8s %8s\n", vidcvt_kernel()->name,
+		  "threads", "yuyv", "yuyv/2", "i420/2");
+
+	for (i=0; i<ARRAY_SIZE(threadv); i++) {
+
+		double mpix[3];
+
+		err = vidcvt_alloc(&cvt, threadv[i]);
+		TEST_ERR(err);
+
+		err  = perf_convert(cvt, dst, srcv[0], &mpix[0]);
+		err |= perf_convert(cvt, dst_half, srcv[0], &mpix[1]);
+		err |= perf_convert(cvt, dst_half, dst, &mpix[2]);
+		TEST_ERR(err);
+
+		re_printf("  %-7u %8.0f %8.0f %8.0f\n", threadv[i],
+			  mpix[0], mpix[1], mpix[2]);
+
+		cvt = mem_deref(cvt);
+	}
+
+ out:
+	mem_deref(cvt);
+	for (i=0; i<ARRAY_SIZE(convv); i++)
+		mem_deref(srcv[i]);
+	mem_deref(dst_half);
+	mem_deref(dst);
+
+	return err;
+}
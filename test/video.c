@@ -4,6 +4,8 @@
  * Copyright (C) 2010 - 2017 Creytiv.com
  */
 
+#include <string.h>
+#include <pthread.h>
 #include <re.h>
 #include <baresip.h>
 #include "test.h"
@@ -31,3 +33,947 @@ int test_video(void)
  out:
 	return err;
 }
+
+
+enum {
+	RTX_SIZE = 64,
+	RTX_PKTS = 1000,
+	RTX_SEQ0 = 65500,
+	RTX_HEADROOM = 16,
+	RTX_TAILROOM = 16,
+};
+
+struct rtx_test {
+	bool rxv[RTX_PKTS];
+	unsigned n_resent;
+	unsigned n_bad;
+};
+
+
+static size_t rtx_len(unsigned i)
+{
+	return 10 + i % 100;
+}
+
+
+static int rtx_send_handler(uint16_t seq, bool marker, uint8_t pt,
+			    uint32_t ts, struct mbuf *mb, void *arg)
+{
+	struct rtx_test *rt = arg;
+	const uint16_t i = seq - (uint16_t)RTX_SEQ0;
+	const uint8_t *p = mbuf_buf(mb);
+	size_t j;
+
+	if (i >= RTX_PKTS || rt->rxv[i] || mb->pos < RTP_HEADER_SIZE ||
+	    pt != 96 || ts != i * 90u || marker != (i % 10 == 9) ||
+	    mbuf_get_left(mb) != rtx_len(i)) {
+		++rt->n_bad;
+		return 0;
+	}
+
+	for (j=0; j<rtx_len(i); j++) {
+		if (p[j] != (uint8_t)(i + j))
+			++rt->n_bad;
+	}
+
+	rt->rxv[i] = true;
+	++rt->n_resent;
+
+	return 0;
+}
+
+
+/* NACK the lost packets of a window, like a receiver */
+static uint32_t rtx_nack_window(struct rtxbuf *buf, struct rtx_test *rt,
+				unsigned first, unsigned last)
+{
+	uint32_t misses = 0;
+	unsigned i = first;
+
+	while (i <= last) {
+
+		uint16_t blp = 0;
+		unsigned pid, k;
+
+		if (rt->rxv[i]) {
+			++i;
+			continue;
+		}
+
+		pid = i++;
+
+		for (k=1; k<=16 && pid + k <= last; k++) {
+			if (!rt->rxv[pid + k])
+				blp |= 1 << (k - 1);
+		}
+
+		misses += rtxbuf_nack(buf, (uint16_t)(RTX_SEQ0 + pid), blp,
+				      rtx_send_handler, rt);
+		i = pid + 17;
+	}
+
+	return misses;
+}
+
+
+int test_video_rtx(void)
+{
+	struct rtxbuf *buf = NULL;
+	struct rtxbuf_stats st;
+	struct rtx_test rt;
+	uint8_t pld[128];
+	uint32_t x = 1, misses = 0;
+	unsigned i, j, n_lost = 0;
+	int err;
+
+	memset(&rt, 0, sizeof(rt));
+
+	err = rtxbuf_alloc(&buf, RTX_SIZE, 10000, RTX_HEADROOM,
+			   RTX_TAILROOM);
+	TEST_ERR(err);
+
+	for (i=0; i<RTX_PKTS; i++) {
+
+		for (j=0; j<rtx_len(i); j++)
+			pld[j] = (uint8_t)(i + j);
+
+		err = rtxbuf_stage(buf, i % 10 == 9, 96, i * 90, pld,
+				   rtx_len(i));
+		TEST_ERR(err);
+
+		rtxbuf_commit(buf, (uint16_t)(RTX_SEQ0 + i));
+
+		/* about 5% loss, with a burst now and then */
+		x = x * 1103515245 + 12345;
+		if ((x >> 16) % 20 == 0 || i % 97 < 3)
+			++n_lost;
+		else
+			rt.rxv[i] = true;
+
+		if (i % 32 == 31)
+			misses += rtx_nack_window(buf, &rt, i - 31, i);
+	}
+
+	misses += rtx_nack_window(buf, &rt, RTX_PKTS / 32 * 32, RTX_PKTS - 1);
+
+	/* every loss was resent from the history */
+	ASSERT_EQ(0, rt.n_bad);
+	ASSERT_EQ(0, misses);
+	ASSERT_EQ(n_lost, rt.n_resent);
+
+	/* old packets are gone, a picture update is needed */
+	ASSERT_EQ(1, rtxbuf_nack(buf, RTX_SEQ0, 0, rtx_send_handler, &rt));
+
+	err = rtxbuf_stats(buf, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(RTX_SIZE, st.size);
+	ASSERT_TRUE(RTX_PKTS == st.stored);
+	ASSERT_TRUE(rt.n_resent == st.hits);
+	ASSERT_TRUE(1 == st.misses);
+	ASSERT_TRUE(st.mem <= (RTX_SIZE + 2) *
+		    (RTX_HEADROOM + rtx_len(99) + RTX_TAILROOM));
+
+ out:
+	mem_deref(buf);
+
+	return err;
+}
+
+
+enum {
+	CC_MIN      = 50000,
+	CC_MAX      = 2500000,
+	CC_PKTSZ    = 1200,
+	CC_TICK     = 4000,       /* pacer interval [us]       */
+	CC_DELAY    = 20000,      /* one-way link delay [us]   */
+	CC_QUEUE    = 400000,     /* tail drop above [us]      */
+	CC_SSRC     = 0x1234,
+};
+
+/* netem-like bottleneck: fixed rate, delay, a bounded FIFO and loss */
+struct cc_link {
+	uint32_t capacity;        /* [bit/s]                   */
+	uint32_t loss;            /* random loss in 1/1000     */
+	uint64_t busy;            /* link is busy until [us]   */
+	uint64_t remb_at;         /* REMB delivered at [us]    */
+	uint32_t remb;            /* REMB in flight [bit/s]    */
+	uint32_t sent;            /* packets in the RR period  */
+	uint32_t lost;            /* lost in the RR period     */
+	uint64_t qdelay;          /* sum of queueing delays    */
+	uint32_t npkt;            /* packets delivered         */
+	uint32_t x;               /* random generator state    */
+};
+
+
+/* the arrival time of a packet, 0 if it was dropped */
+static uint64_t cc_link_send(struct cc_link *l, uint64_t now, size_t size)
+{
+	const uint64_t start = max(now, l->busy);
+
+	++l->sent;
+
+	l->x = l->x * 1103515245 + 12345;
+	if (start - now > CC_QUEUE || (l->x >> 16) % 1000 < l->loss) {
+		++l->lost;
+		return 0;
+	}
+
+	l->busy = start + (uint64_t)size * 8 * 1000000 / l->capacity;
+	l->qdelay += start - now;
+	++l->npkt;
+
+	return l->busy + CC_DELAY;
+}
+
+
+/* run the link for a while, returns the mean target of the last half */
+static uint32_t cc_run(struct bwe_tx *tx, struct bwe_rx *rx,
+		       struct cc_link *l, uint64_t *now, unsigned secs)
+{
+	const uint64_t end = *now + secs * 1000000ULL;
+	uint64_t budget = 0, sum = 0, n = 0, rr = *now + 1000000;
+	const uint32_t ssrc = CC_SSRC;
+	struct mbuf *mb;
+	int err = 0;
+
+	mb = mbuf_alloc(64);
+	if (!mb)
+		return 0;
+
+	l->qdelay = 0;
+	l->npkt = 0;
+
+	for (; *now < end; *now += CC_TICK) {
+
+		uint64_t arrival;
+		uint32_t bps;
+
+		/* REMB and RTCP RR come back from the receiver */
+		if (l->remb && *now >= l->remb_at) {
+
+			mbuf_rewind(mb);
+			err |= bwe_remb_encode(mb, l->remb, &ssrc, 1);
+			mbuf_set_pos(mb, 0);
+			err |= bwe_remb_decode(&bps, mb);
+
+			bwe_tx_remb(tx, bps);
+			l->remb = 0;
+		}
+
+		if (*now >= rr) {
+			bwe_tx_loss(tx, *now, l->sent ?
+				    l->lost * 256 / l->sent : 0);
+			l->sent = l->lost = 0;
+			rr += 1000000;
+		}
+
+		/* paced sender */
+		budget += (uint64_t)bwe_tx_target(tx) * CC_TICK / 8000000;
+
+		while (budget >= CC_PKTSZ) {
+
+			budget -= CC_PKTSZ;
+
+			arrival = cc_link_send(l, *now, CC_PKTSZ);
+			if (!arrival)
+				continue;
+
+			bwe_rx_packet(rx, arrival, bwe_abs_send_time(*now),
+				      CC_PKTSZ);
+
+			if (bwe_rx_feedback(rx, arrival, &bps)) {
+				l->remb    = bps;
+				l->remb_at = arrival + CC_DELAY;
+			}
+		}
+
+		if (*now >= end - secs * 500000ULL) {
+			sum += bwe_tx_target(tx);
+			++n;
+		}
+	}
+
+	mem_deref(mb);
+
+	return err ? 0 : (uint32_t)(sum / n);
+}
+
+
+int test_video_cc(void)
+{
+	struct bwe_tx *tx = NULL;
+	struct bwe_rx *rx = NULL;
+	struct cc_link link;
+	uint64_t now = 1000000;
+	uint32_t bps;
+	int err;
+
+	memset(&link, 0, sizeof(link));
+	link.x = 1;
+
+	err  = bwe_tx_alloc(&tx, CC_MAX, CC_MIN, CC_MAX);
+	err |= bwe_rx_alloc(&rx, CC_MAX, CC_MIN, 20000000);
+	TEST_ERR(err);
+
+	/* starting above the bottleneck, the delay brings it down */
+	link.capacity = 1000000;
+	bps = cc_run(tx, rx, &link, &now, 30);
+	ASSERT_TRUE(bps > 600000 && bps < 1100000);
+	ASSERT_TRUE(link.qdelay / link.npkt < 100000);
+
+	/* the capacity drops */
+	link.capacity = 400000;
+	bps = cc_run(tx, rx, &link, &now, 20);
+	ASSERT_TRUE(bps > 200000 && bps < 450000);
+	ASSERT_TRUE(link.qdelay / link.npkt < 100000);
+
+	/* and comes back */
+	link.capacity = 2000000;
+	bps = cc_run(tx, rx, &link, &now, 30);
+	ASSERT_TRUE(bps > 1200000 && bps <= CC_MAX);
+
+	/* heavy random loss on a fast link */
+	bps = bwe_tx_target(tx);
+	link.capacity = 10000000;
+	link.loss = 150;
+	(void)cc_run(tx, rx, &link, &now, 10);
+	ASSERT_TRUE(bwe_tx_target(tx) < bps * 2 / 3);
+
+ out:
+	mem_deref(rx);
+	mem_deref(tx);
+
+	return err;
+}
+
+
+enum {
+	DECQ_SIZE = 4,
+	DECQ_PKTS = 8,
+};
+
+
+static bool decq_keyframe(const struct mbuf *mb)
+{
+	return mbuf_get_left(mb) && mbuf_buf(mb)[0] == 'K';
+}
+
+
+/* put the packets of one frame, the first byte tells if it is a key */
+static int decq_put_frame(struct viddecq *q, uint16_t *seq, uint32_t ts,
+			  unsigned pktc, bool key, bool marker, bool *queued)
+{
+	struct rtp_header hdr;
+	struct mbuf *mb;
+	unsigned i;
+	int err = 0;
+
+	mb = mbuf_alloc(64);
+	if (!mb)
+		return ENOMEM;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ts = ts;
+
+	for (i=0; i<pktc && !err; i++) {
+
+		mbuf_rewind(mb);
+		(void)mbuf_write_u8(mb, i == 0 && key ? 'K' : 'P');
+		(void)mbuf_write_u32(mb, ts + i);
+		mb->pos = 0;
+
+		hdr.seq = (*seq)++;
+		hdr.m   = marker && i == pktc - 1;
+
+		err = viddecq_put(q, &hdr, mb, 0, queued);
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int decq_check_frame(struct viddecq *q, uint32_t ts, unsigned pktc,
+			    bool complete)
+{
+	struct viddecq_frame *f;
+	unsigned i;
+	int err = 0;
+
+	f = viddecq_get(q);
+	ASSERT_TRUE(f != NULL);
+	ASSERT_EQ(ts, f->ts);
+	ASSERT_EQ(pktc, f->pktc);
+	ASSERT_EQ(complete, f->complete);
+
+	for (i=0; i<pktc; i++) {
+
+		struct mbuf *mb = f->pktv[i].mb;
+		uint32_t val;
+
+		ASSERT_EQ(5, mbuf_get_left(mb));
+
+		mb->pos = 1;
+		val = mbuf_read_u32(mb);
+		ASSERT_EQ(ts + i, val);
+		ASSERT_EQ(i == pktc - 1 && complete, f->pktv[i].marker);
+	}
+
+	viddecq_release(q);
+
+ out:
+	return err;
+}
+
+
+int test_video_decq(void)
+{
+	struct viddecq *q = NULL;
+	struct viddecq_stats st;
+	uint16_t seq = 65530;
+	bool queued;
+	unsigned i;
+	int err;
+
+	err = viddecq_alloc(&q, DECQ_SIZE - 1, DECQ_PKTS, decq_keyframe);
+	TEST_ERR(err);
+
+	/* frames are queued when the marker bit is received */
+	for (i=0; i<3; i++) {
+		err = decq_put_frame(q, &seq, i * 3000, 3, i == 0, true,
+				     &queued);
+		TEST_ERR(err);
+		ASSERT_TRUE(queued);
+	}
+
+	for (i=0; i<3; i++) {
+		err = decq_check_frame(q, i * 3000, 3, true);
+		TEST_ERR(err);
+	}
+
+	ASSERT_TRUE(viddecq_get(q) == NULL);
+
+	/* the marker bit is lost, the next frame ends the previous one */
+	err = decq_put_frame(q, &seq, 9000, 2, false, false, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(!queued);
+	ASSERT_TRUE(viddecq_get(q) == NULL);
+
+	err = decq_put_frame(q, &seq, 12000, 1, false, true, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(queued);
+
+	err = decq_check_frame(q, 9000, 2, false);
+	TEST_ERR(err);
+	err = decq_check_frame(q, 12000, 1, true);
+	TEST_ERR(err);
+
+	/* the decoder is behind, the queue runs full */
+	for (i=0; i<DECQ_SIZE; i++) {
+		err = decq_put_frame(q, &seq, 15000 + i * 3000, 2, false,
+				     true, &queued);
+		TEST_ERR(err);
+	}
+
+	err = decq_put_frame(q, &seq, 30000, 2, false, true, &queued);
+	ASSERT_EQ(ENOSPC, err);
+	ASSERT_TRUE(!queued);
+
+	/* stale frames are skipped, delta frames dropped until a key */
+	ASSERT_TRUE(viddecq_get(q) == NULL);
+
+	err = decq_put_frame(q, &seq, 33000, 2, false, true, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(!queued);
+
+	err = decq_put_frame(q, &seq, 36000, 4, true, true, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(queued);
+
+	err = decq_check_frame(q, 36000, 4, true);
+	TEST_ERR(err);
+
+	/* a frame above the packet limit is dropped */
+	err = decq_put_frame(q, &seq, 39000, DECQ_PKTS + 1, true, true,
+			     &queued);
+	ASSERT_EQ(EOVERFLOW, err);
+	ASSERT_TRUE(viddecq_get(q) == NULL);
+
+	err = decq_put_frame(q, &seq, 42000, 1, true, true, &queued);
+	TEST_ERR(err);
+
+	err = decq_check_frame(q, 42000, 1, true);
+	TEST_ERR(err);
+
+	err = viddecq_stats(q, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(DECQ_SIZE, st.size);
+	ASSERT_EQ(11, st.frames);
+	ASSERT_EQ(7, st.decoded);
+	ASSERT_EQ(DECQ_SIZE, st.flushed);
+	ASSERT_EQ(1, st.overflows);
+	ASSERT_EQ(1, st.skipped);
+	ASSERT_EQ(1, st.oversize);
+	ASSERT_EQ(7, st.wait.count);
+
+ out:
+	mem_deref(q);
+
+	return err;
+}
+
+
+struct decq_worker {
+	struct viddecq *q;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t tsv[DECQ_SIZE * 2];
+	unsigned n;
+	bool hold;
+	bool held;
+	bool stop;
+};
+
+
+/* the decoder thread, it stays busy with a frame while hold is set */
+static void *decq_worker_thread(void *arg)
+{
+	struct decq_worker *w = arg;
+	struct viddecq_frame *f;
+
+	pthread_mutex_lock(&w->mutex);
+
+	while (!w->stop) {
+
+		f = viddecq_get(w->q);
+		if (!f) {
+			pthread_cond_wait(&w->cond, &w->mutex);
+			continue;
+		}
+
+		if (w->n < ARRAY_SIZE(w->tsv))
+			w->tsv[w->n] = f->ts;
+		++w->n;
+
+		w->held = true;
+		pthread_cond_broadcast(&w->cond);
+
+		while (w->hold && !w->stop)
+			pthread_cond_wait(&w->cond, &w->mutex);
+
+		w->held = false;
+		viddecq_release(w->q);
+		pthread_cond_broadcast(&w->cond);
+	}
+
+	pthread_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+
+static void decq_worker_signal(struct decq_worker *w, bool hold)
+{
+	pthread_mutex_lock(&w->mutex);
+	w->hold = hold;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+
+/* wait until the decoder has taken n frames and is busy if held */
+static int decq_worker_wait(struct decq_worker *w, unsigned n)
+{
+	struct timespec ts;
+	int err = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 5;
+
+	pthread_mutex_lock(&w->mutex);
+	while (!err && (w->n < n || w->held != w->hold))
+		err = pthread_cond_timedwait(&w->cond, &w->mutex, &ts);
+	pthread_mutex_unlock(&w->mutex);
+
+	return err;
+}
+
+
+int test_video_decq_worker(void)
+{
+	struct decq_worker w;
+	struct viddecq_stats st;
+	pthread_t tid;
+	bool started = false, queued;
+	uint16_t seq = 100;
+	unsigned i;
+	int err;
+
+	memset(&w, 0, sizeof(w));
+	pthread_mutex_init(&w.mutex, NULL);
+	pthread_cond_init(&w.cond, NULL);
+	w.hold = true;
+
+	err = viddecq_alloc(&w.q, DECQ_SIZE, DECQ_PKTS, decq_keyframe);
+	TEST_ERR(err);
+
+	err = pthread_create(&tid, NULL, decq_worker_thread, &w);
+	TEST_ERR(err);
+	started = true;
+
+	/* the decoder is busy with the first frame */
+	err = decq_put_frame(w.q, &seq, 0, 2, true, true, &queued);
+	TEST_ERR(err);
+	decq_worker_signal(&w, true);
+
+	err = decq_worker_wait(&w, 1);
+	TEST_ERR(err);
+
+	/* the queue runs full behind it */
+	for (i=1; i<DECQ_SIZE; i++) {
+		err = decq_put_frame(w.q, &seq, i * 3000, 2, false, true,
+				     &queued);
+		TEST_ERR(err);
+		ASSERT_TRUE(queued);
+		decq_worker_signal(&w, true);
+	}
+
+	err = decq_put_frame(w.q, &seq, i * 3000, 2, false, true, &queued);
+	ASSERT_EQ(ENOSPC, err);
+	ASSERT_TRUE(!queued);
+
+	/* the keyframe takes a stale slot, the decoder is still busy */
+	err = decq_put_frame(w.q, &seq, 15000, 2, false, true, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(!queued);
+
+	err = decq_put_frame(w.q, &seq, 18000, 3, true, true, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(queued);
+	decq_worker_signal(&w, true);
+
+	err = decq_put_frame(w.q, &seq, 21000, 2, false, true, &queued);
+	TEST_ERR(err);
+	ASSERT_TRUE(queued);
+
+	/* the decoder skips the stale frames and goes on with the key */
+	decq_worker_signal(&w, false);
+
+	err = decq_worker_wait(&w, 3);
+	TEST_ERR(err);
+
+	ASSERT_EQ(3, w.n);
+	ASSERT_EQ(0, w.tsv[0]);
+	ASSERT_EQ(18000, w.tsv[1]);
+	ASSERT_EQ(21000, w.tsv[2]);
+
+	err = viddecq_stats(w.q, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(6, st.frames);
+	ASSERT_EQ(3, st.decoded);
+	ASSERT_EQ(1, st.overflows);
+	ASSERT_EQ(1, st.skipped);
+
+ out:
+	if (started) {
+		pthread_mutex_lock(&w.mutex);
+		w.stop = true;
+		pthread_cond_broadcast(&w.cond);
+		pthread_mutex_unlock(&w.mutex);
+
+		pthread_join(tid, NULL);
+	}
+
+	mem_deref(w.q);
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.mutex);
+
+	return err;
+}
+
+
+int test_video_pool(void)
+{
+	struct vidpool *pool = NULL;
+	struct vidframe *f1 = NULL, *f2 = NULL, *f3 = NULL;
+	struct vidpool_stats st;
+	struct vidsz vga = {640, 480}, qvga = {320, 240};
+	struct vidframe *prev;
+	int err;
+
+	err = vidpool_alloc(&pool, 2);
+	TEST_ERR(err);
+
+	err = vidpool_get(pool, &f1, VID_FMT_YUV420P, &vga);
+	TEST_ERR(err);
+	ASSERT_EQ(VID_FMT_YUV420P, f1->fmt);
+	ASSERT_TRUE(vidsz_cmp(&vga, &f1->size));
+
+	/* a released frame is reused */
+	prev = f1;
+	f1 = mem_deref(f1);
+
+	err = vidpool_get(pool, &f1, VID_FMT_YUV420P, &vga);
+	TEST_ERR(err);
+	ASSERT_TRUE(f1 == prev);
+
+	/* a frame in use is not handed out again */
+	err = vidpool_get(pool, &f2, VID_FMT_YUV420P, &vga);
+	TEST_ERR(err);
+	ASSERT_TRUE(f2 != f1);
+
+	/* the pool is full, the frame is allocated outside of it */
+	err = vidpool_get(pool, &f3, VID_FMT_YUV420P, &vga);
+	TEST_ERR(err);
+	ASSERT_TRUE(f3 != f1 && f3 != f2);
+	f3 = mem_deref(f3);
+
+	/* the resolution changes, a free frame of the old size is replaced */
+	f2 = mem_deref(f2);
+
+	err = vidpool_get(pool, &f2, VID_FMT_NV12, &qvga);
+	TEST_ERR(err);
+	ASSERT_EQ(VID_FMT_NV12, f2->fmt);
+	ASSERT_TRUE(vidsz_cmp(&qvga, &f2->size));
+
+	err = vidpool_stats(pool, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(2, st.max);
+	ASSERT_EQ(3, st.allocs);
+	ASSERT_EQ(1, st.reuses);
+	ASSERT_EQ(1, st.unpooled);
+	ASSERT_EQ(1, st.reconfigs);
+
+	/* frames in use stay valid after the pool is gone */
+	pool = mem_deref(pool);
+	ASSERT_TRUE(vidsz_cmp(&vga, &f1->size));
+
+	/* without a pool a frame is allocated */
+	err = vidpool_get(NULL, &f3, VID_FMT_YUV420P, &qvga);
+	TEST_ERR(err);
+	ASSERT_TRUE(vidsz_cmp(&qvga, &f3->size));
+
+ out:
+	mem_deref(f3);
+	mem_deref(f2);
+	mem_deref(f1);
+	mem_deref(pool);
+
+	return err;
+}
+
+
+/*
+ * A converted frame from the pool goes through a scaling filter, which
+ * points the frame at a frame of its own from the same pool. The frame
+ * gets its own buffer back on the next frame.
+ */
+int test_video_pool_filter(void)
+{
+	struct vidfilt_prm prm = {160, 120, VID_FMT_YUV420P, 30};
+	struct list vidfiltl = LIST_INIT, filtl = LIST_INIT;
+	const struct vidsz vga = {640, 480};
+	const struct vidfilt *vf;
+	struct vidpool *pool = NULL;
+	struct vidframe *frame = NULL, *own = NULL;
+	struct vidpool_stats st;
+	struct vidfilt_enc_st *fst;
+	uint8_t *own_data = NULL;
+	void *ctx = NULL;
+	uint64_t ts = 0;
+	int i, err;
+
+	err = vidpool_alloc(&pool, 2);
+	TEST_ERR(err);
+
+	vf = mock_vidfilt_register(&vidfiltl, pool);
+
+	err = vidfilt_enc_append(&filtl, &ctx, vf, &prm, NULL);
+	TEST_ERR(err);
+
+	fst = list_ledata(list_head(&filtl));
+
+	for (i=0; i<3; i++) {
+
+		err = vidpool_get(pool, &frame, VID_FMT_YUV420P, &vga);
+		TEST_ERR(err);
+
+		ASSERT_EQ(VID_FMT_YUV420P, frame->fmt);
+		ASSERT_TRUE(vidsz_cmp(&vga, &frame->size));
+
+		if (own) {
+			ASSERT_TRUE(frame == own);
+			ASSERT_TRUE(frame->data[0] == own_data);
+		}
+
+		own      = frame;
+		own_data = frame->data[0];
+
+		vidframe_fill_color(frame, 0x80, 0x40, 0x20);
+
+		err = fst->vf->ench(fst, frame, &ts);
+		TEST_ERR(err);
+
+		ASSERT_EQ(160, frame->size.w);
+		ASSERT_EQ(120, frame->size.h);
+		ASSERT_TRUE(frame->data[0] != own_data);
+
+		frame = mem_deref(frame);
+	}
+
+	err = vidpool_stats(pool, &st);
+	TEST_ERR(err);
+
+	ASSERT_EQ(2, st.allocs);
+	ASSERT_EQ(4, st.reuses);
+	ASSERT_EQ(0, st.unpooled);
+	ASSERT_EQ(0, st.reconfigs);
+
+ out:
+	mem_deref(frame);
+	list_flush(&filtl);
+	mock_vidfilt_unregister();
+	mem_deref(pool);
+
+	return err;
+}
+
+
+static int simulcast_check_encode(const struct simulcast *sc,
+				  const char *expect)
+{
+	char *str = NULL;
+	int err;
+
+	err = re_sdprintf(&str, "%H", simulcast_encode, sc);
+	TEST_ERR(err);
+
+	ASSERT_STREQ(expect, str);
+
+ out:
+	mem_deref(str);
+
+	return err;
+}
+
+
+int test_video_simulcast(void)
+{
+	struct simulcast sc;
+	struct vidsz sz;
+	struct vidsz hd = {1280, 720}, odd = {642, 362}, tiny = {40, 30};
+	int err;
+
+	err = simulcast_init(&sc, SIMULCAST_MAX + 1, 2100000);
+	ASSERT_EQ(EINVAL, err);
+
+	err = simulcast_init(&sc, 3, 2100000);
+	TEST_ERR(err);
+
+	ASSERT_EQ(3, sc.n);
+	ASSERT_STREQ("f", sc.layerv[0].rid);
+	ASSERT_STREQ("q", sc.layerv[2].rid);
+
+	/* the bitrate follows the number of pixels */
+	ASSERT_EQ(1600000, sc.layerv[0].max_bitrate);
+	ASSERT_EQ(400000, sc.layerv[1].max_bitrate);
+	ASSERT_EQ(100000, sc.layerv[2].max_bitrate);
+	ASSERT_EQ(400000, sc.layerv[0].min_bitrate);
+
+	/* each layer halves the size, rounded down to even */
+	err = simulcast_size(&sz, &hd, &sc.layerv[0]);
+	TEST_ERR(err);
+	ASSERT_TRUE(vidsz_cmp(&hd, &sz));
+
+	err = simulcast_size(&sz, &hd, &sc.layerv[2]);
+	TEST_ERR(err);
+	ASSERT_EQ(320, sz.w);
+	ASSERT_EQ(180, sz.h);
+
+	err = simulcast_size(&sz, &odd, &sc.layerv[1]);
+	TEST_ERR(err);
+	ASSERT_EQ(320, sz.w);
+	ASSERT_EQ(180, sz.h);
+
+	err = simulcast_size(&sz, &tiny, &sc.layerv[2]);
+	ASSERT_EQ(ERANGE, err);
+
+	/* all layers get their most bitrate */
+	ASSERT_EQ(3, simulcast_allocate(&sc, 2100000));
+	ASSERT_EQ(1600000, sc.layerv[0].bitrate);
+	ASSERT_EQ(400000, sc.layerv[1].bitrate);
+	ASSERT_EQ(100000, sc.layerv[2].bitrate);
+
+	/* the full size is paused first */
+	ASSERT_EQ(2, simulcast_allocate(&sc, 600000));
+	ASSERT_TRUE(!sc.layerv[0].active);
+	ASSERT_EQ(0, sc.layerv[0].bitrate);
+	ASSERT_EQ(400000, sc.layerv[1].bitrate);
+
+	/* the smallest layer is always sent */
+	ASSERT_EQ(1, simulcast_allocate(&sc, 50000));
+	ASSERT_TRUE(sc.layerv[2].active);
+	ASSERT_EQ(50000, sc.layerv[2].bitrate);
+
+	sc.layerv[2].enabled = false;
+	ASSERT_EQ(1, simulcast_allocate(&sc, 50000));
+	ASSERT_TRUE(sc.layerv[1].active);
+	ASSERT_TRUE(!sc.layerv[2].active);
+
+	/* the answer takes a part of the layers */
+	err = simulcast_init(&sc, 3, 2100000);
+	TEST_ERR(err);
+
+	err = simulcast_decode(&sc, "recv f;h");
+	TEST_ERR(err);
+	ASSERT_TRUE(sc.layerv[0].enabled);
+	ASSERT_TRUE(sc.layerv[1].enabled);
+	ASSERT_TRUE(!sc.layerv[2].enabled);
+
+	err = simulcast_check_encode(&sc, "send f;h");
+	TEST_ERR(err);
+
+	/* the bitrate is shared among the layers taken */
+	ASSERT_EQ(1680000, sc.layerv[0].max_bitrate);
+	ASSERT_EQ(420000, sc.layerv[1].max_bitrate);
+	ASSERT_EQ(0, sc.layerv[2].max_bitrate);
+
+	/* paused streams are not sent */
+	err = simulcast_decode(&sc, "send a recv ~f;q");
+	TEST_ERR(err);
+	ASSERT_TRUE(!sc.layerv[0].enabled);
+	ASSERT_TRUE(sc.layerv[2].enabled);
+
+	/* the layers take the stream IDs of an offer, the first alternative */
+	err = simulcast_decode(&sc, "recv hi;lo,x");
+	TEST_ERR(err);
+	ASSERT_STREQ("hi", sc.layerv[0].rid);
+	ASSERT_STREQ("lo", sc.layerv[1].rid);
+	ASSERT_TRUE(!sc.layerv[2].enabled);
+
+	err = simulcast_check_encode(&sc, "send hi;lo");
+	TEST_ERR(err);
+
+	ASSERT_EQ(ENOENT, simulcast_decode(&sc, "send f;h"));
+	ASSERT_EQ(ENOENT, simulcast_decode(&sc, "recv ~f"));
+
+	/* a peer without simulcast gets the full size with all bitrate */
+	simulcast_single(&sc);
+	ASSERT_TRUE(sc.layerv[0].enabled);
+	ASSERT_TRUE(!sc.layerv[1].enabled);
+	ASSERT_EQ(2100000, sc.layerv[0].max_bitrate);
+
+	ASSERT_EQ(1, simulcast_allocate(&sc, 2100000));
+	ASSERT_EQ(2100000, sc.layerv[0].bitrate);
+
+	err = simulcast_check_encode(&sc, "send hi");
+	TEST_ERR(err);
+
+ out:
+	return err;
+}